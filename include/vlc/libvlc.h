@@ -287,6 +287,19 @@ LIBVLC_API const char * libvlc_get_changeset(void);
  */
 LIBVLC_API void libvlc_free( void *ptr );
 
+/**
+ * Exports the run-time metrics of a LibVLC instance.
+ *
+ * The metrics (demux, decode and mux latencies, decoder queues, video output
+ * drops, HTTP clients...) are returned in the Prometheus text exposition
+ * format.
+ *
+ * \param p_instance the instance
+ * \return a string (must be freed with libvlc_free()), or NULL on error
+ * \version LibVLC 4.0.0 or later
+ */
+LIBVLC_API char *libvlc_metrics_export( libvlc_instance_t *p_instance );
+
 /** \defgroup libvlc_event LibVLC asynchronous events
  * LibVLC emits asynchronous events.
  *
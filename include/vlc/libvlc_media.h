@@ -303,6 +303,11 @@ typedef enum libvlc_media_parse_flag_t
      * when the input is asking for credentials.
      */
     libvlc_media_do_interact    = 0x08,
+    /**
+     * Parse this media before the ones requested without this flag, e.g. for
+     * the media currently visible to the user.
+     */
+    libvlc_media_parse_priority = 0x10,
 } libvlc_media_parse_flag_t;
 
 /**
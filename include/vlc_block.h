@@ -184,7 +184,7 @@ static inline void block_Release(block_t *block)
     block->pf_release(block);
 }
 
-static inline void block_CopyProperties( block_t *dst, block_t *src )
+static inline void block_CopyProperties( block_t *dst, const block_t *src )
 {
     dst->i_flags   = src->i_flags;
     dst->i_nb_samples = src->i_nb_samples;
@@ -196,22 +196,44 @@ static inline void block_CopyProperties( block_t *dst, block_t *src )
 /**
  * Duplicates a block.
  *
- * Creates a writeable duplicate of a block.
+ * Creates a duplicate of a block. If the block payload is shared (see
+ * block_shared_Alloc()), only the block header is duplicated, and the payload
+ * remains shared between both blocks. Otherwise, the payload is copied and the
+ * duplicate is writeable.
  *
  * @return the duplicate on success, NULL on error.
  */
-VLC_USED
-static inline block_t *block_Duplicate( block_t *p_block )
-{
-    block_t *p_dup = block_Alloc( p_block->i_buffer );
-    if( p_dup == NULL )
-        return NULL;
+VLC_API block_t *block_Duplicate(const block_t *) VLC_USED;
 
-    block_CopyProperties( p_dup, p_block );
-    memcpy( p_dup->p_buffer, p_block->p_buffer, p_block->i_buffer );
+/**
+ * Shares a block payload.
+ *
+ * Wraps a block so that block_Duplicate() creates new references to its
+ * payload instead of copying it. The payload is released with the last
+ * reference.
+ *
+ * The payload of a shared block must be treated as read-only, unless it was
+ * made writeable with block_MakeWritable(). block_Realloc() and
+ * block_TryRealloc() take care of that by themselves.
+ *
+ * @param block block to share (if already shared, it is returned as is)
+ * @return the shared block, or NULL on memory error (the block is then left
+ * untouched).
+ */
+VLC_API block_t *block_shared_Alloc(block_t *block) VLC_USED;
 
-    return p_dup;
-}
+/**
+ * Makes a block writeable.
+ *
+ * If the block payload is shared with other blocks, it is copied into a new
+ * private block and the given block is released. Otherwise, the block is
+ * returned as is.
+ *
+ * @note On error, the block is discarded.
+ *
+ * @return the writeable block, or NULL on memory error.
+ */
+VLC_API block_t *block_MakeWritable(block_t *block) VLC_USED;
 
 /**
  * Wraps heap in a block.
@@ -460,6 +482,31 @@ VLC_API void block_FifoPut(block_fifo_t *fifo, block_t *block);
  */
 VLC_API block_t *block_FifoGet(block_fifo_t *) VLC_USED;
 
+/**
+ * Dequeue a batch of blocks from the FIFO.
+ *
+ * Without deadline, this waits until there is at least one block in the
+ * queue. With a deadline, this waits until the queue holds at least
+ * max_depth blocks or max_size bytes, or until the deadline; the consumer is
+ * not woken up for every queued block in the mean time. Then, up to
+ * max_depth blocks and max_size bytes are dequeued at once, and at least one
+ * block if the FIFO is not empty.
+ *
+ * This function is (always) cancellation point.
+ *
+ * @warning Only one thread at a time may wait for a batch with a deadline on
+ * a given FIFO.
+ *
+ * @param max_depth maximum number of blocks (zero if unlimited)
+ * @param max_size maximum number of bytes (zero if unlimited)
+ * @param deadline time limit to wait for the batch, or VLC_TICK_INVALID
+ * @return a linked-list of blocks, or NULL if the deadline was reached
+ * with an empty FIFO
+ */
+VLC_API block_t *block_FifoGetBatch(block_fifo_t *, size_t max_depth,
+                                    size_t max_size, vlc_tick_t deadline)
+VLC_USED;
+
 /**
  * Peeks the first block in the FIFO.
  *
@@ -576,6 +623,24 @@ VLC_API block_t *vlc_fifo_DequeueUnlocked(vlc_fifo_t *) VLC_USED;
  */
 VLC_API block_t *vlc_fifo_DequeueAllUnlocked(vlc_fifo_t *) VLC_USED;
 
+/**
+ * Dequeues a batch of blocks from a locked FIFO.
+ *
+ * Dequeues up to max_depth blocks and up to max_size bytes at once. The first
+ * block is dequeued in any case, even if it is larger than max_size.
+ *
+ * @note This function is not a cancellation point.
+ *
+ * @warning The FIFO must be locked by the calling thread using
+ * vlc_fifo_Lock(). Otherwise behaviour is undefined.
+ *
+ * @param max_depth maximum number of blocks (zero if unlimited)
+ * @param max_size maximum number of bytes (zero if unlimited)
+ * @return a linked-list of blocks (NULL if the FIFO is empty)
+ */
+VLC_API block_t *vlc_fifo_DequeueBatchUnlocked(vlc_fifo_t *, size_t max_depth,
+                                               size_t max_size) VLC_USED;
+
 /**
  * Counts blocks in a FIFO.
  *
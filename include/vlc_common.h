@@ -198,6 +198,25 @@
 # define VLC_WEAK
 #endif
 
+#ifdef __has_attribute
+# if __has_attribute(__target__)
+#  define VLC_TARGET(x) __attribute__ ((__target__ (x)))
+# endif
+#endif
+#ifndef VLC_TARGET
+/**
+ * Target instruction set function annotation
+ *
+ * Use this macro to compile a function for the given instruction set
+ * extensions (e.g. "avx2"), whatever the compiler flags. The function must
+ * only be called once the CPU was found to support them (see vlc_CPU()).
+ *
+ * Code using this macro shall only be built if the compiler supports the
+ * target function attribute, as checked by the configure script.
+ */
+# define VLC_TARGET(x)
+#endif
+
 /* Branch prediction */
 #if defined (__GNUC__) || defined (__clang__)
 # define likely(p)     __builtin_expect(!!(p), 1)
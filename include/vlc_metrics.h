@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * vlc_metrics.h: run-time metrics
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_METRICS_H
+# define VLC_METRICS_H 1
+
+/**
+ * @defgroup metrics Metrics
+ * @ingroup os
+ * @{
+ * @file
+ * Run-time metrics
+ *
+ * Metrics are counters, gauges and latency histograms shared by all the
+ * objects of a LibVLC instance. They are meant to be updated from real-time
+ * code paths: updates are lock-free, and all functions accept a NULL metric
+ * (as returned on registration failure) as a no-op.
+ *
+ * The whole set of metrics can be exported in the Prometheus text exposition
+ * format with vlc_metrics_Export().
+ */
+
+typedef struct vlc_metric vlc_metric_t;
+
+enum vlc_metric_type
+{
+    VLC_METRIC_COUNTER, /**< Monotonic count of events */
+    VLC_METRIC_GAUGE, /**< Value that can go up and down */
+    VLC_METRIC_HISTOGRAM, /**< Distribution of durations */
+};
+
+/**
+ * Registers a metric.
+ *
+ * If a metric of the same name was already registered, it is returned
+ * instead, so that several objects can contribute to the same metric.
+ * Metrics remain registered until the LibVLC instance is destroyed.
+ *
+ * The name can end with a set of Prometheus labels, e.g.
+ * <tt>vlc_decoder_decode_seconds{type="video"}</tt>. Metrics that only
+ * differ by their labels must have the same type.
+ *
+ * @param obj any object of the LibVLC instance
+ * @param type metric type
+ * @param name metric name, as exported
+ * @param help description of the metric
+ * @return the metric, or NULL on error
+ */
+VLC_API vlc_metric_t *vlc_metric_Register(vlc_object_t *obj,
+                                          enum vlc_metric_type type,
+                                          const char *name, const char *help);
+#define vlc_metric_Register(o, t, n, h) \
+    vlc_metric_Register(VLC_OBJECT(o), t, n, h)
+
+/**
+ * Adds to a counter or a gauge.
+ *
+ * @param delta value to add (must be positive for a counter)
+ */
+VLC_API void vlc_metric_Add(vlc_metric_t *, int64_t delta);
+
+/**
+ * Sets the value of a gauge.
+ */
+VLC_API void vlc_metric_Set(vlc_metric_t *, int64_t value);
+
+/**
+ * Records a duration in a histogram.
+ */
+VLC_API void vlc_metric_Observe(vlc_metric_t *, vlc_tick_t duration);
+
+/**
+ * Exports all the metrics of a LibVLC instance.
+ *
+ * @return a heap-allocated string in the Prometheus text exposition format,
+ * or NULL on error
+ */
+VLC_API char *vlc_metrics_Export(vlc_object_t *) VLC_USED;
+#define vlc_metrics_Export(o) vlc_metrics_Export(VLC_OBJECT(o))
+
+/** @} */
+
+#endif
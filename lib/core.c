@@ -30,6 +30,7 @@
 #include <vlc/vlc.h>
 
 #include <vlc_interface.h>
+#include <vlc_metrics.h>
 #include <vlc_vlm.h>
 
 #include <stdarg.h>
@@ -161,6 +162,11 @@ void libvlc_free( void *ptr )
     free( ptr );
 }
 
+char *libvlc_metrics_export( libvlc_instance_t *p_instance )
+{
+    return vlc_metrics_Export( p_instance->p_libvlc_int );
+}
+
 static libvlc_module_description_t *module_description_list_get(
                 libvlc_instance_t *p_instance, const char *capability )
 {
@@ -0,0 +1,648 @@
+/*****************************************************************************
+ * uring.c: Linux io_uring file input
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * This access reads regular files with asynchronous reads queued to an
+ * io_uring, so that several large reads are in flight while the demuxer
+ * processes the data of the previous ones. The read buffers are handed over
+ * to the stream layer as blocks, without copying.
+ *
+ * The read-ahead window starts with a single read, so that probing and
+ * preparsing do not read more than needed, then doubles with each block
+ * consumed sequentially up to the configured depth. Seeking resets it.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <linux/io_uring.h>
+#include <linux/magic.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_access.h>
+#include <vlc_block.h>
+#include <vlc_fs.h>
+
+/* Alignment of the buffers, offsets and sizes of the reads, as required for
+ * direct I/O by all common devices and file systems */
+#define URING_ALIGN 4096
+
+/* User data of the cancellation requests, not a read index */
+#define URING_CANCEL UINT64_MAX
+
+struct uring_read
+{
+    uint8_t *buf;
+    uint64_t offset; /**< File offset of the read */
+    int32_t res; /**< Completion result, bytes read or negative errno */
+    bool done;
+};
+
+typedef struct
+{
+    int fd;
+    int ring_fd;
+
+    /* Submission queue */
+    void *sq_ring;
+    size_t sq_ring_size;
+    atomic_uint *sq_tail;
+    const unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sq_entries;
+    unsigned to_submit; /**< Queued entries not yet consumed by the kernel */
+
+    /* Completion queue */
+    void *cq_ring;
+    size_t cq_ring_size;
+    atomic_uint *cq_head;
+    atomic_uint *cq_tail;
+    const unsigned *cq_mask;
+    const struct io_uring_cqe *cqes;
+
+    /* Reads, in file order, from the oldest one */
+    struct uring_read *reads;
+    unsigned depth; /**< Maximum number of reads in flight */
+    unsigned window; /**< Current read-ahead window */
+    unsigned first;
+    unsigned count;
+
+    size_t block_size;
+    uint64_t submit_offset; /**< Offset of the next read to queue */
+    uint64_t offset; /**< Stream position */
+    uint64_t size;
+    bool broken; /**< Reads may still be in flight with unknown state */
+} access_sys_t;
+
+static int uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+static bool IsRemote(int fd)
+{
+    struct statfs stf;
+
+    if (fstatfs(fd, &stf))
+        return false;
+
+    switch ((unsigned long)stf.f_type)
+    {
+        case AFS_SUPER_MAGIC:
+        case CODA_SUPER_MAGIC:
+        case NCP_SUPER_MAGIC:
+        case NFS_SUPER_MAGIC:
+        case SMB_SUPER_MAGIC:
+        case 0xFF534D42 /*CIFS_MAGIC_NUMBER*/:
+            return true;
+    }
+    return false;
+}
+
+static int RingSetup(access_sys_t *sys)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof (params));
+    sys->ring_fd = uring_setup(sys->depth, &params);
+    if (sys->ring_fd == -1)
+        return -1;
+
+    /* IORING_OP_READ came along with this feature (Linux 5.6) */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+        goto error;
+
+    sys->sq_ring_size = params.sq_off.array
+                      + params.sq_entries * sizeof (unsigned);
+    sys->cq_ring_size = params.cq_off.cqes
+                      + params.cq_entries * sizeof (struct io_uring_cqe);
+    sys->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+
+    sys->sq_ring = mmap(NULL, sys->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, sys->ring_fd,
+                        IORING_OFF_SQ_RING);
+    if (sys->sq_ring == MAP_FAILED)
+        goto error;
+
+    sys->cq_ring = mmap(NULL, sys->cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, sys->ring_fd,
+                        IORING_OFF_CQ_RING);
+    if (sys->cq_ring == MAP_FAILED)
+        goto error_sq;
+
+    sys->sqes = mmap(NULL, sys->sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, sys->ring_fd,
+                     IORING_OFF_SQES);
+    if (sys->sqes == MAP_FAILED)
+        goto error_cq;
+
+    uint8_t *sq = sys->sq_ring, *cq = sys->cq_ring;
+
+    sys->sq_tail = (atomic_uint *)(sq + params.sq_off.tail);
+    sys->sq_mask = (const unsigned *)(sq + params.sq_off.ring_mask);
+    sys->sq_array = (unsigned *)(sq + params.sq_off.array);
+    sys->cq_head = (atomic_uint *)(cq + params.cq_off.head);
+    sys->cq_tail = (atomic_uint *)(cq + params.cq_off.tail);
+    sys->cq_mask = (const unsigned *)(cq + params.cq_off.ring_mask);
+    sys->cqes = (const struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    sys->sq_entries = params.sq_entries;
+    sys->to_submit = 0;
+    return 0;
+
+error_cq:
+    munmap(sys->cq_ring, sys->cq_ring_size);
+error_sq:
+    munmap(sys->sq_ring, sys->sq_ring_size);
+error:
+    vlc_close(sys->ring_fd);
+    return -1;
+}
+
+static void RingDestroy(access_sys_t *sys)
+{
+    munmap(sys->sqes, sys->sqes_size);
+    munmap(sys->cq_ring, sys->cq_ring_size);
+    munmap(sys->sq_ring, sys->sq_ring_size);
+    vlc_close(sys->ring_fd);
+}
+
+/**
+ * Queues reads until the read-ahead window is full.
+ * Returns -1 if no read could be queued for lack of memory.
+ */
+static int Queue(access_sys_t *sys)
+{
+    unsigned tail = atomic_load_explicit(sys->sq_tail, memory_order_relaxed);
+
+    while (sys->count < sys->window && sys->submit_offset < sys->size)
+    {
+        unsigned idx = (sys->first + sys->count) % sys->depth;
+        struct uring_read *rd = &sys->reads[idx];
+
+        rd->buf = aligned_alloc(URING_ALIGN, sys->block_size);
+        if (unlikely(rd->buf == NULL))
+            break;
+        rd->offset = sys->submit_offset;
+        rd->done = false;
+
+        struct io_uring_sqe *sqe = &sys->sqes[tail & *sys->sq_mask];
+
+        memset(sqe, 0, sizeof (*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = sys->fd;
+        sqe->addr = (uintptr_t)rd->buf;
+        sqe->len = sys->block_size;
+        sqe->off = rd->offset;
+        sqe->user_data = idx;
+        sys->sq_array[tail & *sys->sq_mask] = tail & *sys->sq_mask;
+        tail++;
+
+        sys->submit_offset += sys->block_size;
+        sys->count++;
+        sys->to_submit++;
+    }
+
+    atomic_store_explicit(sys->sq_tail, tail, memory_order_release);
+    return (sys->count == 0 && sys->submit_offset < sys->size) ? -1 : 0;
+}
+
+static void Reap(access_sys_t *sys)
+{
+    unsigned head = atomic_load_explicit(sys->cq_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(sys->cq_tail, memory_order_acquire);
+
+    while (head != tail)
+    {
+        const struct io_uring_cqe *cqe = &sys->cqes[head & *sys->cq_mask];
+
+        if (cqe->user_data != URING_CANCEL)
+        {
+            struct uring_read *rd = &sys->reads[cqe->user_data];
+
+            rd->res = cqe->res;
+            rd->done = true;
+        }
+        head++;
+    }
+
+    atomic_store_explicit(sys->cq_head, head, memory_order_release);
+}
+
+/**
+ * Submits the queued reads and waits for the oldest read to complete.
+ */
+static int Wait(access_sys_t *sys)
+{
+    const struct uring_read *rd = &sys->reads[sys->first];
+
+    while (!rd->done || sys->to_submit > 0)
+    {
+        unsigned wait = !rd->done;
+        int val = uring_enter(sys->ring_fd, sys->to_submit, wait,
+                              wait ? IORING_ENTER_GETEVENTS : 0);
+        if (val < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        assert((unsigned)val <= sys->to_submit);
+        sys->to_submit -= val;
+        Reap(sys);
+    }
+    return 0;
+}
+
+/**
+ * Submits the queued entries without waiting.
+ */
+static int Submit(access_sys_t *sys)
+{
+    while (sys->to_submit > 0)
+    {
+        int val = uring_enter(sys->ring_fd, sys->to_submit, 0, 0);
+        if (val < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        assert((unsigned)val <= sys->to_submit);
+        sys->to_submit -= val;
+    }
+    return 0;
+}
+
+/**
+ * Requests the cancellation of the reads in flight, and waits until all of
+ * them completed, one way or another.
+ */
+static int Cancel(access_sys_t *sys)
+{
+    if (Submit(sys))
+        return -1;
+
+    unsigned tail = atomic_load_explicit(sys->sq_tail, memory_order_relaxed);
+
+    assert(sys->count <= sys->sq_entries);
+    for (unsigned i = 0; i < sys->count; i++)
+    {
+        unsigned idx = (sys->first + i) % sys->depth;
+
+        if (sys->reads[idx].done)
+            continue;
+
+        struct io_uring_sqe *sqe = &sys->sqes[tail & *sys->sq_mask];
+
+        memset(sqe, 0, sizeof (*sqe));
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = idx;
+        sqe->user_data = URING_CANCEL;
+        sys->sq_array[tail & *sys->sq_mask] = tail & *sys->sq_mask;
+        tail++;
+        sys->to_submit++;
+    }
+
+    atomic_store_explicit(sys->sq_tail, tail, memory_order_release);
+
+    /* Reads that are already running cannot be cancelled, and complete
+     * normally */
+    for (unsigned i = 0; i < sys->count;)
+    {
+        if (sys->reads[(sys->first + i) % sys->depth].done)
+        {
+            i++;
+            continue;
+        }
+
+        int val = uring_enter(sys->ring_fd, sys->to_submit, 1,
+                              IORING_ENTER_GETEVENTS);
+        if (val < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        assert((unsigned)val <= sys->to_submit);
+        sys->to_submit -= val;
+        Reap(sys);
+    }
+    return 0;
+}
+
+/**
+ * Cancels the read-ahead and restarts reading from the given offset.
+ */
+static void Restart(access_sys_t *sys, uint64_t offset)
+{
+    /* Buffers cannot be released while the kernel may still write to them.
+     * If the ring failed, they are leaked and no further reads are made. */
+    if (!sys->broken && Cancel(sys))
+        sys->broken = true;
+
+    while (sys->count > 0)
+    {
+        if (!sys->broken)
+            free(sys->reads[sys->first].buf);
+        sys->first = (sys->first + 1) % sys->depth;
+        sys->count--;
+    }
+
+    sys->first = 0;
+    sys->window = 1;
+    sys->offset = offset;
+    sys->submit_offset = offset & ~(uint64_t)(URING_ALIGN - 1);
+}
+
+static block_t *Block(stream_t *access, bool *restrict eof)
+{
+    access_sys_t *sys = access->p_sys;
+
+    if (sys->broken)
+    {
+        *eof = true;
+        return NULL;
+    }
+
+    if (Queue(sys))
+        return NULL;
+    if (sys->count == 0)
+    {
+        /* The file may have grown since it was opened */
+        struct stat st;
+
+        if (fstat(sys->fd, &st) == 0 && (uint64_t)st.st_size > sys->size)
+        {
+            sys->size = st.st_size;
+            return NULL;
+        }
+        *eof = true;
+        return NULL;
+    }
+
+    struct uring_read *rd = &sys->reads[sys->first];
+
+    if (Wait(sys))
+    {
+        msg_Err(access, "read error: %s", vlc_strerror_c(errno));
+        Restart(sys, sys->offset);
+        *eof = true;
+        return NULL;
+    }
+
+    sys->first = (sys->first + 1) % sys->depth;
+    sys->count--;
+
+    if (rd->res < 0)
+    {
+        free(rd->buf);
+        if (rd->res != -EINTR && rd->res != -EAGAIN)
+        {
+            msg_Err(access, "read error: %s", vlc_strerror_c(-rd->res));
+            *eof = true;
+        }
+        Restart(sys, sys->offset);
+        return NULL;
+    }
+
+    /* The first read after a seek starts at an aligned offset */
+    size_t skip = sys->offset - rd->offset;
+    if ((size_t)rd->res <= skip)
+    {   /* The file was truncated */
+        free(rd->buf);
+        Restart(sys, sys->offset);
+        sys->size = sys->offset;
+        *eof = true;
+        return NULL;
+    }
+
+    block_t *block = block_heap_Alloc(rd->buf, sys->block_size);
+    if (unlikely(block == NULL))
+    {
+        Restart(sys, sys->offset);
+        return NULL;
+    }
+
+    block->p_buffer += skip;
+    block->i_buffer = rd->res - skip;
+    sys->offset = rd->offset + rd->res;
+
+    if ((size_t)rd->res < sys->block_size && sys->offset < sys->size)
+        /* Short read: the following reads are not contiguous anymore */
+        Restart(sys, sys->offset);
+    else if (sys->window < sys->depth)
+        sys->window *= 2;
+    if (sys->window > sys->depth)
+        sys->window = sys->depth;
+
+    return block;
+}
+
+static int Seek(stream_t *access, uint64_t offset)
+{
+    access_sys_t *sys = access->p_sys;
+
+    if (offset != sys->offset)
+        Restart(sys, offset);
+    return VLC_SUCCESS;
+}
+
+static int Control(stream_t *access, int query, va_list args)
+{
+    access_sys_t *sys = access->p_sys;
+
+    switch (query)
+    {
+        case STREAM_CAN_SEEK:
+        case STREAM_CAN_FASTSEEK:
+        case STREAM_CAN_PAUSE:
+        case STREAM_CAN_CONTROL_PACE:
+            *va_arg(args, bool *) = true;
+            break;
+
+        case STREAM_GET_SIZE:
+        {
+            struct stat st;
+
+            if (fstat(sys->fd, &st))
+                return VLC_EGENERIC;
+            sys->size = st.st_size;
+            *va_arg(args, uint64_t *) = sys->size;
+            break;
+        }
+
+        case STREAM_GET_PTS_DELAY:
+        {
+            int64_t *delay = va_arg(args, int64_t *);
+
+            if (IsRemote(sys->fd))
+                *delay = var_InheritInteger(access, "network-caching");
+            else
+                *delay = var_InheritInteger(access, "file-caching");
+            *delay *= 1000;
+            break;
+        }
+
+        case STREAM_SET_PAUSE_STATE:
+            break;
+
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+static int Open(vlc_object_t *obj)
+{
+    stream_t *access = (stream_t *)obj;
+
+    if (access->psz_filepath == NULL)
+        return VLC_EGENERIC;
+
+    access_sys_t *sys = vlc_obj_malloc(obj, sizeof (*sys));
+    if (unlikely(sys == NULL))
+        return VLC_ENOMEM;
+
+    sys->depth = var_InheritInteger(obj, "uring-depth");
+    sys->block_size = var_InheritInteger(obj, "uring-block-size") << 10;
+    sys->block_size = (sys->block_size + URING_ALIGN - 1)
+                    & ~(size_t)(URING_ALIGN - 1);
+
+    int flags = O_RDONLY | O_NONBLOCK;
+
+    if (var_InheritBool(obj, "uring-direct"))
+        flags |= O_DIRECT;
+
+    sys->fd = vlc_open(access->psz_filepath, flags);
+    if (sys->fd == -1 && (flags & O_DIRECT) && errno == EINVAL)
+    {
+        msg_Warn(access, "direct I/O not supported");
+        sys->fd = vlc_open(access->psz_filepath, flags & ~O_DIRECT);
+    }
+    if (sys->fd == -1)
+    {
+        msg_Err(access, "cannot open file %s (%s)", access->psz_filepath,
+                vlc_strerror_c(errno));
+        return VLC_EGENERIC;
+    }
+
+    /* Other file types are left to the file module */
+    struct stat st;
+    if (fstat(sys->fd, &st) || !S_ISREG(st.st_mode))
+        goto error;
+
+    fcntl(sys->fd, F_SETFL, fcntl(sys->fd, F_GETFL) & ~O_NONBLOCK);
+
+    sys->reads = vlc_obj_malloc(obj, sys->depth * sizeof (*sys->reads));
+    if (unlikely(sys->reads == NULL))
+        goto error;
+
+    if (RingSetup(sys))
+    {
+        msg_Dbg(access, "io_uring not available: %s", vlc_strerror_c(errno));
+        goto error;
+    }
+
+    sys->first = 0;
+    sys->count = 0;
+    sys->window = 1;
+    sys->offset = 0;
+    sys->submit_offset = 0;
+    sys->size = st.st_size;
+    sys->broken = false;
+
+    /* The kernel read-ahead is redundant with ours */
+    posix_fadvise(sys->fd, 0, 0, POSIX_FADV_RANDOM);
+
+    access->pf_read = NULL;
+    access->pf_block = Block;
+    access->pf_seek = Seek;
+    access->pf_control = Control;
+    access->p_sys = sys;
+    return VLC_SUCCESS;
+
+error:
+    vlc_close(sys->fd);
+    return VLC_EGENERIC;
+}
+
+static void Close(vlc_object_t *obj)
+{
+    stream_t *access = (stream_t *)obj;
+    access_sys_t *sys = access->p_sys;
+
+    Restart(sys, 0);
+    RingDestroy(sys);
+    vlc_close(sys->fd);
+}
+
+#define DEPTH_TEXT N_("Read-ahead depth")
+#define DEPTH_LONGTEXT N_( \
+    "Maximum number of reads in flight.")
+#define BLOCK_SIZE_TEXT N_("Read size (KiB)")
+#define BLOCK_SIZE_LONGTEXT N_( \
+    "Size of each read. It is rounded up to a multiple of 4 KiB.")
+#define DIRECT_TEXT N_("Direct I/O")
+#define DIRECT_LONGTEXT N_( \
+    "Bypass the page cache of the operating system. This avoids evicting " \
+    "useful data from the cache when reading huge media libraries once.")
+
+vlc_module_begin()
+    set_shortname(N_("io_uring"))
+    set_description(N_("Linux io_uring file input"))
+    set_category(CAT_INPUT)
+    set_subcategory(SUBCAT_INPUT_ACCESS)
+    set_capability("access", 60)
+    add_shortcut("file")
+    set_callbacks(Open, Close)
+
+    add_integer("uring-depth", 8, DEPTH_TEXT, DEPTH_LONGTEXT, true)
+        change_integer_range(1, 64)
+    add_integer("uring-block-size", 256, BLOCK_SIZE_TEXT,
+                BLOCK_SIZE_LONGTEXT, true)
+        change_integer_range(4, 16384)
+    add_bool("uring-direct", false, DIRECT_TEXT, DIRECT_LONGTEXT, true)
+vlc_module_end()
@@ -440,7 +440,10 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
             memcpy( p_buffer->p_buffer, &hdr, sizeof( hdr ) );
         }
 
-        /* send data */
+        /* send data, the stream keeps a reference to the payload */
+        block_t *p_shared = block_shared_Alloc( p_buffer );
+        if( p_shared != NULL )
+            p_buffer = p_shared;
         i_err = httpd_StreamSend( p_sys->p_httpd_stream, p_buffer );
 
         block_Release( p_buffer );
@@ -46,11 +46,19 @@
 #elif defined (HAVE_SYS_SOCKET_H)
 #   include <sys/socket.h>
 #endif
+#ifdef HAVE_SENDMMSG
+#   include <netinet/udp.h>
+#endif
 
 #include <vlc_network.h>
 
 #define MAX_EMPTY_BLOCKS 200
 
+/* Maximum number of datagrams handed to the kernel at once */
+#define MAX_BATCH_BLOCKS 64
+/* Maximum payload of a segmented (GSO) send */
+#define MAX_GSO_PAYLOAD 65000
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -71,6 +79,11 @@ static void Close( vlc_object_t * );
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
 
+#define GSO_TEXT N_("Segmentation offload")
+#define GSO_LONGTEXT N_("Hand each group of equally sized packets to the " \
+                        "kernel as a single segmented datagram (UDP GSO) " \
+                        "when the system supports it." )
+
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
     set_shortname( "UDP" )
@@ -79,6 +92,7 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_bool( SOUT_CFG_PREFIX "gso", false, GSO_TEXT, GSO_LONGTEXT, true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -92,6 +106,7 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "gso",
     NULL
 };
 
@@ -118,6 +133,14 @@ typedef struct
     block_fifo_t *p_fifo;
     block_t      *p_buffer;
 
+    /* Packets dequeued but not handled yet, owned by the writer thread */
+    block_t      *p_pending;
+
+    /* Packets of the current group, owned by the writer thread */
+    block_t      *pp_batch[MAX_BATCH_BLOCKS];
+    unsigned      i_batch;
+    bool          b_gso;
+
     vlc_thread_t  thread;
 } sout_access_out_sys_t;
 
@@ -209,6 +232,9 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_mtu_warning = false;
     p_sys->p_fifo = block_FifoNew();
     p_sys->p_buffer = NULL;
+    p_sys->p_pending = NULL;
+    p_sys->i_batch = 0;
+    p_sys->b_gso = var_GetBool( p_access, SOUT_CFG_PREFIX "gso" );
 
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -237,8 +263,11 @@ static void Close( vlc_object_t * p_this )
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
     block_FifoRelease( p_sys->p_fifo );
+    block_ChainRelease( p_sys->p_pending );
 
     if( p_sys->p_buffer ) block_Release( p_sys->p_buffer );
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+        block_Release( p_sys->pp_batch[i] );
 
     net_Close( p_sys->i_handle );
     free( p_sys );
@@ -266,6 +295,7 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
 static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
+    block_t *p_packets = NULL, **pp_last = &p_packets;
     int i_len = 0;
 
     while( p_buffer )
@@ -291,7 +321,7 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
                          now - p_sys->p_buffer->i_dts
                           - p_sys->i_caching );
             }
-            block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
+            block_ChainLastAppend( &pp_last, p_sys->p_buffer );
             p_sys->p_buffer = NULL;
         }
 
@@ -333,7 +363,7 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
                              vlc_tick_now() - p_sys->p_buffer->i_dts
                               - p_sys->i_caching );
                 }
-                block_FifoPut( p_sys->p_fifo, p_sys->p_buffer );
+                block_ChainLastAppend( &pp_last, p_sys->p_buffer );
                 p_sys->p_buffer = NULL;
             }
         }
@@ -343,26 +373,204 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
         p_buffer = p_next;
     }
 
+    /* Hand all complete packets over to the writer thread at once */
+    if( p_packets != NULL )
+        block_FifoPut( p_sys->p_fifo, p_packets );
+
     return i_len;
 }
 
+#if defined(HAVE_SENDMMSG) && defined(UDP_SEGMENT)
+/*****************************************************************************
+ * SendSegmented: send a run of packets as one GSO datagram
+ *****************************************************************************
+ * All packets but the last must have the same size. Returns the number of
+ * packets sent, 0 if the run cannot or could not be segmented.
+ *****************************************************************************/
+static unsigned SendSegmented( sout_access_out_t *p_access,
+                               block_t **pp_blocks, unsigned i_count )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const size_t i_segment = pp_blocks[0]->i_buffer;
+    struct iovec iov[MAX_BATCH_BLOCKS];
+    size_t i_total = 0;
+    unsigned i;
+
+    for( i = 0; i < i_count; i++ )
+    {
+        if( pp_blocks[i]->i_buffer > i_segment ||
+            i_total + pp_blocks[i]->i_buffer > MAX_GSO_PAYLOAD )
+            break;
+        iov[i].iov_base = pp_blocks[i]->p_buffer;
+        iov[i].iov_len = pp_blocks[i]->i_buffer;
+        i_total += pp_blocks[i]->i_buffer;
+        if( pp_blocks[i]->i_buffer < i_segment )
+        {
+            i++; /* a shorter segment can only be the last one */
+            break;
+        }
+    }
+    if( i < 2 )
+        return 0;
+
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = i,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    *(uint16_t *)CMSG_DATA(cmsg) = i_segment;
+
+    if( sendmsg( p_sys->i_handle, &msg, 0 ) == -1 )
+    {
+        if( errno == EINVAL || errno == EIO || errno == ENOPROTOOPT )
+        {
+            msg_Warn( p_access, "segmentation offload unavailable: %s",
+                      vlc_strerror_c(errno) );
+            p_sys->b_gso = false;
+            return 0;
+        }
+        msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+    }
+    return i;
+}
+#endif
+
+/*****************************************************************************
+ * SendBatch: send all pending packets with as few system calls as possible
+ *****************************************************************************/
+static void SendBatch( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    block_t **pp_blocks = p_sys->pp_batch;
+    unsigned i_count = p_sys->i_batch;
+    unsigned i_sent = 0;
+
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[MAX_BATCH_BLOCKS];
+    struct iovec iov[MAX_BATCH_BLOCKS];
+
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        iov[i].iov_base = pp_blocks[i]->p_buffer;
+        iov[i].iov_len = pp_blocks[i]->i_buffer;
+        memset( &msgs[i], 0, sizeof(msgs[i]) );
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while( i_sent < i_count )
+    {
+# ifdef UDP_SEGMENT
+        if( p_sys->b_gso )
+        {
+            unsigned i_segmented = SendSegmented( p_access, &pp_blocks[i_sent],
+                                                  i_count - i_sent );
+            if( i_segmented > 0 )
+            {
+                i_sent += i_segmented;
+                continue;
+            }
+        }
+# endif
+        int i_ret = sendmmsg( p_sys->i_handle, &msgs[i_sent],
+                              i_count - i_sent, 0 );
+        if( i_ret <= 0 )
+        {
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+            i_ret = 1; /* skip the failing packet */
+        }
+        i_sent += i_ret;
+    }
+#else
+    for( ; i_sent < i_count; i_sent++ )
+    {
+        if ( send( p_sys->i_handle, pp_blocks[i_sent]->p_buffer,
+                   pp_blocks[i_sent]->i_buffer, 0 ) == -1 )
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+    }
+#endif
+
+    for( unsigned i = 0; i < i_count; i++ )
+        block_Release( pp_blocks[i] );
+    p_sys->i_batch = 0;
+}
+
+/*****************************************************************************
+ * SendGroup: send the current group of packets at its date
+ *****************************************************************************/
+static void SendGroup( sout_access_out_t *p_access, vlc_tick_t i_date )
+{
+    vlc_tick_wait( i_date );
+    SendBatch( p_access );
+
+#if 1
+    vlc_tick_t i_sent = vlc_tick_now();
+    if ( i_sent > i_date + 20000 )
+    {
+        msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
+                 i_sent - i_date );
+    }
+#endif
+}
+
 /*****************************************************************************
  * ThreadWrite: Write a packet on the network at the good time.
+ *****************************************************************************
+ * Each group leaves at the date of its first packet, so that groups are
+ * spread over time like the packets themselves rather than being held until
+ * the date of their last packet. A group is closed when it is complete, when
+ * its date is reached, or by a clock reference which then starts a new group
+ * so as to be sent exactly on time.
  *****************************************************************************/
 static void* ThreadWrite( void *data )
 {
     sout_access_out_t *p_access = data;
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     vlc_tick_t i_date_last = -1;
-    const unsigned i_group = var_GetInteger( p_access,
-                                             SOUT_CFG_PREFIX "group" );
-    int i_to_send = i_group;
+    vlc_tick_t i_group_date = VLC_TICK_INVALID;
+    const unsigned i_group = VLC_CLIP( var_GetInteger( p_access,
+                                           SOUT_CFG_PREFIX "group" ),
+                                       1, MAX_BATCH_BLOCKS );
     unsigned i_dropped_packets = 0;
 
     for (;;)
     {
-        block_t *p_pk = block_FifoGet( p_sys->p_fifo );
-        vlc_tick_t    i_date, i_sent;
+        if( p_sys->p_pending == NULL )
+        {
+            if( p_sys->i_batch == 0 )
+                p_sys->p_pending = block_FifoGetBatch( p_sys->p_fifo,
+                                                       i_group, 0,
+                                                       VLC_TICK_INVALID );
+            else
+            {
+                /* Wait for the rest of the group until its date, without
+                 * being woken up for every packet */
+                p_sys->p_pending = block_FifoGetBatch( p_sys->p_fifo,
+                                                       i_group - p_sys->i_batch,
+                                                       0, i_group_date );
+                if( p_sys->p_pending == NULL )
+                {
+                    SendGroup( p_access, i_group_date );
+                    continue;
+                }
+            }
+        }
+
+        block_t *p_pk = p_sys->p_pending;
+        vlc_tick_t i_date;
+
+        p_sys->p_pending = p_pk->p_next;
+        p_pk->p_next = NULL;
 
         i_date = p_sys->i_caching + p_pk->i_dts;
         if( i_date_last > 0 )
@@ -387,35 +595,22 @@ static void* ThreadWrite( void *data )
             }
         }
 
-        block_cleanup_push( p_pk );
-        i_to_send--;
-        if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
-        {
-            vlc_tick_wait( i_date );
-            i_to_send = i_group;
-        }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
-        vlc_cleanup_pop();
-
         if( i_dropped_packets )
         {
             msg_Dbg( p_access, "dropped %i packets", i_dropped_packets );
             i_dropped_packets = 0;
         }
+        i_date_last = i_date;
 
-#if 1
-        i_sent = vlc_tick_now();
-        if ( i_sent > i_date + 20000 )
-        {
-            msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
-                     i_sent - i_date );
-        }
-#endif
+        if( (p_pk->i_flags & BLOCK_FLAG_CLOCK) && p_sys->i_batch > 0 )
+            SendGroup( p_access, i_group_date );
 
-        block_Release( p_pk );
+        if( p_sys->i_batch == 0 )
+            i_group_date = i_date;
+        p_sys->pp_batch[p_sys->i_batch++] = p_pk;
 
-        i_date_last = i_date;
+        if( p_sys->i_batch >= i_group )
+            SendGroup( p_access, i_group_date );
     }
     return NULL;
 }
@@ -0,0 +1,1004 @@
+/*****************************************************************************
+ * format_simd.h: PCM sample format conversion kernels
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_FORMAT_SIMD_H
+#define VLC_FORMAT_SIMD_H 1
+
+/* Conversions between the S16N, S32N, FL32 and FL64 sample formats.
+ *
+ * Each kernel converts count samples from src to dst. The destination may
+ * be the source itself if its samples are not larger, as the vectors are
+ * loaded before being stored, from the start of the buffers.
+ *
+ * The vectorized kernels give exactly the results of the C ones for all
+ * the non-NaN input values, out-of-range ones included: floating point
+ * values are rounded to nearest even towards S16N (Walken's trick) and to
+ * nearest, halfway away from zero, towards S32N and from FL64, then
+ * clipped. The samples the vectors can not cover are converted by the C
+ * kernels. */
+
+#include <math.h>
+#include <vlc_cpu.h>
+
+#if defined(HAVE_SSE2_INTRINSICS) && defined(HAVE_ATTRIBUTE_TARGET) \
+ && (defined(__i386__) || defined(__x86_64__))
+# include <immintrin.h>
+# define FORMAT_HAVE_X86
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define FORMAT_HAVE_NEON
+#endif
+
+typedef void (*format_convert_t)(void *dst, const void *src, size_t count);
+
+/*** C ***/
+static void S16toFl32_C(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    float *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+    {   /* This is Walken's trick based on IEEE float format. On my PIII
+         * this takes 16 seconds to perform one billion conversions, instead
+         * of 19 seconds for a division. */
+        union { float f; int32_t i; } u;
+        u.i = s[i] + 0x43c00000;
+        d[i] = u.f - 384.f;
+    }
+}
+
+static void S16toS32_C(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    int32_t *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = (uint32_t)s[i] << 16;
+}
+
+static void S16toFl64_C(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    double *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = (double)s[i] / 32768.;
+}
+
+static void Fl32toS16_C(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int16_t *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+    {   /* This is Walken's trick based on IEEE float format. */
+        union { float f; int32_t i; } u;
+        u.f = s[i] + 384.f;
+        if (u.i > 0x43c07fff)
+            d[i] = 32767;
+        else if (u.i < 0x43bf8000)
+            d[i] = -32768;
+        else
+            d[i] = u.i - 0x43c00000;
+    }
+}
+
+static void Fl32toS32_C(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int32_t *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float v = s[i] * 2147483648.f;
+        if (v >= 2147483647.f)
+            d[i] = 2147483647;
+        else
+        if (v <= -2147483648.f)
+            d[i] = -2147483648;
+        else
+            d[i] = lroundf(v);
+    }
+}
+
+static void Fl32toFl64_C(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    double *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = s[i];
+}
+
+static void S32toS16_C(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    int16_t *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = s[i] >> 16;
+}
+
+static void S32toFl32_C(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    float *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = (float)s[i] / 2147483648.f;
+}
+
+static void S32toFl64_C(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    double *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = (double)s[i] / 2147483648.;
+}
+
+static void Fl64toS16_C(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int16_t *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const double v = s[i] * 32768.;
+        if (v >= 32767.)
+            d[i] = 32767;
+        else if (v < -32768.)
+            d[i] = -32768;
+        else
+            d[i] = lround(v);
+    }
+}
+
+/* Unlike the former converter, which rounded the scaled sample to a float
+ * first, this computes in double precision, as the vector kernels do. The
+ * output thus differs by up to 128 for samples of large magnitude, where the
+ * float mantissa is too short for 32-bit integers. */
+static void Fl64toS32_C(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int32_t *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const double v = s[i] * 2147483648.;
+        if (v >= 2147483647.)
+            d[i] = 2147483647;
+        else
+        if (v <= -2147483648.)
+            d[i] = -2147483648;
+        else
+            d[i] = lround(v);
+    }
+}
+
+static void Fl64toFl32_C(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    float *d = dst;
+
+    for (size_t i = 0; i < count; i++)
+        d[i] = s[i];
+}
+
+#ifdef FORMAT_HAVE_X86
+/*** SSE2 ***/
+#define FORMAT_SIMD_TARGET VLC_TARGET("sse2")
+
+/* Rounds to nearest, halfway away from zero, values within the int32 range */
+FORMAT_SIMD_TARGET
+static inline __m128i RoundPD_SSE2(__m128d v)
+{
+    __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(v));
+    __m128d d = _mm_sub_pd(v, t);
+    const __m128d one = _mm_set1_pd(1.);
+
+    t = _mm_add_pd(t, _mm_and_pd(_mm_cmpge_pd(d, _mm_set1_pd(.5)), one));
+    t = _mm_sub_pd(t, _mm_and_pd(_mm_cmple_pd(d, _mm_set1_pd(-.5)), one));
+    return _mm_cvttpd_epi32(t);
+}
+
+FORMAT_SIMD_TARGET
+static void S16toFl32_SSE2(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    float *d = dst;
+    const __m128 scale = _mm_set1_ps(1.f / 32768.f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+        _mm_storeu_ps(&d[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(&d[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    S16toFl32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S16toS32_SSE2(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    int32_t *d = dst;
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+
+        _mm_storeu_si128((__m128i *)&d[i], _mm_unpacklo_epi16(zero, x));
+        _mm_storeu_si128((__m128i *)&d[i + 4], _mm_unpackhi_epi16(zero, x));
+    }
+    S16toS32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S16toFl64_SSE2(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    double *d = dst;
+    const __m128d scale = _mm_set1_pd(1. / 32768.);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+        _mm_storeu_pd(&d[i], _mm_mul_pd(_mm_cvtepi32_pd(lo), scale));
+        _mm_storeu_pd(&d[i + 2], _mm_mul_pd(
+                      _mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), scale));
+        _mm_storeu_pd(&d[i + 4], _mm_mul_pd(_mm_cvtepi32_pd(hi), scale));
+        _mm_storeu_pd(&d[i + 6], _mm_mul_pd(
+                      _mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), scale));
+    }
+    S16toFl64_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl32toS16_SSE2(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int16_t *d = dst;
+    const __m128 scale = _mm_set1_ps(32768.f);
+    const __m128 max = _mm_set1_ps(32767.f), min = _mm_set1_ps(-32768.f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 lo = _mm_mul_ps(_mm_loadu_ps(&s[i]), scale);
+        __m128 hi = _mm_mul_ps(_mm_loadu_ps(&s[i + 4]), scale);
+
+        lo = _mm_max_ps(_mm_min_ps(lo, max), min);
+        hi = _mm_max_ps(_mm_min_ps(hi, max), min);
+        _mm_storeu_si128((__m128i *)&d[i],
+                         _mm_packs_epi32(_mm_cvtps_epi32(lo),
+                                         _mm_cvtps_epi32(hi)));
+    }
+    Fl32toS16_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl32toS32_SSE2(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int32_t *d = dst;
+    const __m128 scale = _mm_set1_ps(2147483648.f);
+    const __m128 min = _mm_set1_ps(-2147483648.f);
+    const __m128 half = _mm_set1_ps(.5f), mhalf = _mm_set1_ps(-.5f);
+    const __m128i max = _mm_set1_epi32(INT32_MAX);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 v = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&s[i]), scale), min);
+        /* 2^31 and above do not fit: cvttps gives INT32_MIN */
+        __m128i over = _mm_castps_si128(_mm_cmpge_ps(v, scale));
+        __m128i t = _mm_cvttps_epi32(v);
+        __m128 f = _mm_sub_ps(v, _mm_cvtepi32_ps(t));
+
+        t = _mm_sub_epi32(t, _mm_castps_si128(_mm_cmpge_ps(f, half)));
+        t = _mm_add_epi32(t, _mm_castps_si128(_mm_cmple_ps(f, mhalf)));
+        t = _mm_or_si128(_mm_andnot_si128(over, t), _mm_and_si128(over, max));
+        _mm_storeu_si128((__m128i *)&d[i], t);
+    }
+    Fl32toS32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl32toFl64_SSE2(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    double *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&s[i]);
+
+        _mm_storeu_pd(&d[i], _mm_cvtps_pd(x));
+        _mm_storeu_pd(&d[i + 2], _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+    Fl32toFl64_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S32toS16_SSE2(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    int16_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)&s[i]);
+        __m128i hi = _mm_loadu_si128((const __m128i *)&s[i + 4]);
+
+        _mm_storeu_si128((__m128i *)&d[i],
+                         _mm_packs_epi32(_mm_srai_epi32(lo, 16),
+                                         _mm_srai_epi32(hi, 16)));
+    }
+    S32toS16_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S32toFl32_SSE2(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    float *d = dst;
+    const __m128 scale = _mm_set1_ps(1.f / 2147483648.f);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+
+        _mm_storeu_ps(&d[i], _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    S32toFl32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S32toFl64_SSE2(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    double *d = dst;
+    const __m128d scale = _mm_set1_pd(1. / 2147483648.);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+
+        _mm_storeu_pd(&d[i], _mm_mul_pd(_mm_cvtepi32_pd(x), scale));
+        _mm_storeu_pd(&d[i + 2], _mm_mul_pd(
+                      _mm_cvtepi32_pd(_mm_srli_si128(x, 8)), scale));
+    }
+    S32toFl64_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl64toS16_SSE2(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int16_t *d = dst;
+    const __m128d scale = _mm_set1_pd(32768.);
+    const __m128d max = _mm_set1_pd(32767.), min = _mm_set1_pd(-32768.);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i r[4];
+
+        for (int j = 0; j < 4; j++)
+        {
+            __m128d v = _mm_mul_pd(_mm_loadu_pd(&s[i + 2 * j]), scale);
+            r[j] = RoundPD_SSE2(_mm_max_pd(_mm_min_pd(v, max), min));
+        }
+        __m128i lo = _mm_unpacklo_epi64(r[0], r[1]);
+        __m128i hi = _mm_unpacklo_epi64(r[2], r[3]);
+        _mm_storeu_si128((__m128i *)&d[i], _mm_packs_epi32(lo, hi));
+    }
+    Fl64toS16_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl64toS32_SSE2(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int32_t *d = dst;
+    const __m128d scale = _mm_set1_pd(2147483648.);
+    const __m128d max = _mm_set1_pd(2147483647.);
+    const __m128d min = _mm_set1_pd(-2147483648.);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128d a = _mm_mul_pd(_mm_loadu_pd(&s[i]), scale);
+        __m128d b = _mm_mul_pd(_mm_loadu_pd(&s[i + 2]), scale);
+        __m128i lo = RoundPD_SSE2(_mm_max_pd(_mm_min_pd(a, max), min));
+        __m128i hi = RoundPD_SSE2(_mm_max_pd(_mm_min_pd(b, max), min));
+
+        _mm_storeu_si128((__m128i *)&d[i], _mm_unpacklo_epi64(lo, hi));
+    }
+    Fl64toS32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl64toFl32_SSE2(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    float *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(&s[i]));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(&s[i + 2]));
+
+        _mm_storeu_ps(&d[i], _mm_movelh_ps(lo, hi));
+    }
+    Fl64toFl32_C(&d[i], &s[i], count - i);
+}
+#undef FORMAT_SIMD_TARGET
+
+/*** AVX2 ***/
+#define FORMAT_SIMD_TARGET VLC_TARGET("avx2")
+
+FORMAT_SIMD_TARGET
+static inline __m128i RoundPD_AVX2(__m256d v)
+{
+    __m256d t = _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256d d = _mm256_sub_pd(v, t);
+    const __m256d one = _mm256_set1_pd(1.);
+
+    t = _mm256_add_pd(t, _mm256_and_pd(_mm256_cmp_pd(d, _mm256_set1_pd(.5),
+                                                     _CMP_GE_OQ), one));
+    t = _mm256_sub_pd(t, _mm256_and_pd(_mm256_cmp_pd(d, _mm256_set1_pd(-.5),
+                                                     _CMP_LE_OQ), one));
+    return _mm256_cvttpd_epi32(t);
+}
+
+FORMAT_SIMD_TARGET
+static void S16toFl32_AVX2(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    float *d = dst;
+    const __m256 scale = _mm256_set1_ps(1.f / 32768.f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)&s[i]));
+
+        _mm256_storeu_ps(&d[i], _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+    }
+    S16toFl32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S16toS32_AVX2(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    int32_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)&s[i]));
+
+        _mm256_storeu_si256((__m256i *)&d[i], _mm256_slli_epi32(x, 16));
+    }
+    S16toS32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S16toFl64_AVX2(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    double *d = dst;
+    const __m256d scale = _mm256_set1_pd(1. / 32768.);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_cvtepi16_epi32(
+                        _mm_loadl_epi64((const __m128i *)&s[i]));
+
+        _mm256_storeu_pd(&d[i], _mm256_mul_pd(_mm256_cvtepi32_pd(x), scale));
+    }
+    S16toFl64_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl32toS16_AVX2(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int16_t *d = dst;
+    const __m256 scale = _mm256_set1_ps(32768.f);
+    const __m256 max = _mm256_set1_ps(32767.f);
+    const __m256 min = _mm256_set1_ps(-32768.f);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256 lo = _mm256_mul_ps(_mm256_loadu_ps(&s[i]), scale);
+        __m256 hi = _mm256_mul_ps(_mm256_loadu_ps(&s[i + 8]), scale);
+
+        lo = _mm256_max_ps(_mm256_min_ps(lo, max), min);
+        hi = _mm256_max_ps(_mm256_min_ps(hi, max), min);
+
+        /* packs works within each 128 bits half */
+        __m256i x = _mm256_packs_epi32(_mm256_cvtps_epi32(lo),
+                                       _mm256_cvtps_epi32(hi));
+        _mm256_storeu_si256((__m256i *)&d[i],
+                            _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3,1,2,0)));
+    }
+    Fl32toS16_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl32toS32_AVX2(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int32_t *d = dst;
+    const __m256 scale = _mm256_set1_ps(2147483648.f);
+    const __m256 min = _mm256_set1_ps(-2147483648.f);
+    const __m256 half = _mm256_set1_ps(.5f), mhalf = _mm256_set1_ps(-.5f);
+    const __m256i max = _mm256_set1_epi32(INT32_MAX);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 v = _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&s[i]), scale),
+                                 min);
+        /* 2^31 and above do not fit: cvttps gives INT32_MIN */
+        __m256i over = _mm256_castps_si256(_mm256_cmp_ps(v, scale,
+                                                         _CMP_GE_OQ));
+        __m256i t = _mm256_cvttps_epi32(v);
+        __m256 f = _mm256_sub_ps(v, _mm256_cvtepi32_ps(t));
+
+        t = _mm256_sub_epi32(t, _mm256_castps_si256(
+                                _mm256_cmp_ps(f, half, _CMP_GE_OQ)));
+        t = _mm256_add_epi32(t, _mm256_castps_si256(
+                                _mm256_cmp_ps(f, mhalf, _CMP_LE_OQ)));
+        _mm256_storeu_si256((__m256i *)&d[i],
+                            _mm256_blendv_epi8(t, max, over));
+    }
+    Fl32toS32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl32toFl64_AVX2(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    double *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_pd(&d[i], _mm256_cvtps_pd(_mm_loadu_ps(&s[i])));
+    Fl32toFl64_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S32toS16_AVX2(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    int16_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)&s[i]);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)&s[i + 8]);
+        __m256i x = _mm256_packs_epi32(_mm256_srai_epi32(lo, 16),
+                                       _mm256_srai_epi32(hi, 16));
+
+        _mm256_storeu_si256((__m256i *)&d[i],
+                            _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3,1,2,0)));
+    }
+    S32toS16_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S32toFl32_AVX2(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    float *d = dst;
+    const __m256 scale = _mm256_set1_ps(1.f / 2147483648.f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)&s[i]);
+
+        _mm256_storeu_ps(&d[i], _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+    }
+    S32toFl32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void S32toFl64_AVX2(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    double *d = dst;
+    const __m256d scale = _mm256_set1_pd(1. / 2147483648.);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&s[i]);
+
+        _mm256_storeu_pd(&d[i], _mm256_mul_pd(_mm256_cvtepi32_pd(x), scale));
+    }
+    S32toFl64_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl64toS16_AVX2(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int16_t *d = dst;
+    const __m256d scale = _mm256_set1_pd(32768.);
+    const __m256d max = _mm256_set1_pd(32767.);
+    const __m256d min = _mm256_set1_pd(-32768.);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256d a = _mm256_mul_pd(_mm256_loadu_pd(&s[i]), scale);
+        __m256d b = _mm256_mul_pd(_mm256_loadu_pd(&s[i + 4]), scale);
+        __m128i lo = RoundPD_AVX2(_mm256_max_pd(_mm256_min_pd(a, max), min));
+        __m128i hi = RoundPD_AVX2(_mm256_max_pd(_mm256_min_pd(b, max), min));
+
+        _mm_storeu_si128((__m128i *)&d[i], _mm_packs_epi32(lo, hi));
+    }
+    Fl64toS16_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl64toS32_AVX2(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int32_t *d = dst;
+    const __m256d scale = _mm256_set1_pd(2147483648.);
+    const __m256d max = _mm256_set1_pd(2147483647.);
+    const __m256d min = _mm256_set1_pd(-2147483648.);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(&s[i]), scale);
+
+        _mm_storeu_si128((__m128i *)&d[i],
+                         RoundPD_AVX2(_mm256_max_pd(_mm256_min_pd(v, max),
+                                                    min)));
+    }
+    Fl64toS32_C(&d[i], &s[i], count - i);
+}
+
+FORMAT_SIMD_TARGET
+static void Fl64toFl32_AVX2(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    float *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(&d[i], _mm256_cvtpd_ps(_mm256_loadu_pd(&s[i])));
+    Fl64toFl32_C(&d[i], &s[i], count - i);
+}
+#undef FORMAT_SIMD_TARGET
+#endif /* FORMAT_HAVE_X86 */
+
+#ifdef FORMAT_HAVE_NEON
+/*** NEON ***/
+/* The vcvta (halfway away from zero) and vcvtn (nearest even) conversions
+ * saturate, and so do the narrowing moves: only the scaling remains. */
+static void S16toFl32_NEON(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    float *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(&s[i]);
+
+        vst1q_f32(&d[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(
+                                     vget_low_s16(x))), 1.f / 32768.f));
+        vst1q_f32(&d[i + 4], vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(x)),
+                                         1.f / 32768.f));
+    }
+    S16toFl32_C(&d[i], &s[i], count - i);
+}
+
+static void S16toS32_NEON(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    int32_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(&s[i]);
+
+        vst1q_s32(&d[i], vshll_n_s16(vget_low_s16(x), 16));
+        vst1q_s32(&d[i + 4], vshll_high_n_s16(x, 16));
+    }
+    S16toS32_C(&d[i], &s[i], count - i);
+}
+
+static void S16toFl64_NEON(void *dst, const void *src, size_t count)
+{
+    const int16_t *s = src;
+    double *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        int32x4_t x = vmovl_s16(vld1_s16(&s[i]));
+
+        vst1q_f64(&d[i], vmulq_n_f64(vcvtq_f64_s64(vmovl_s32(
+                                     vget_low_s32(x))), 1. / 32768.));
+        vst1q_f64(&d[i + 2], vmulq_n_f64(vcvtq_f64_s64(vmovl_high_s32(x)),
+                                         1. / 32768.));
+    }
+    S16toFl64_C(&d[i], &s[i], count - i);
+}
+
+static void Fl32toS16_NEON(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int16_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        int32x4_t lo = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(&s[i]), 32768.f));
+        int32x4_t hi = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(&s[i + 4]),
+                                                  32768.f));
+
+        vst1q_s16(&d[i], vqmovn_high_s32(vqmovn_s32(lo), hi));
+    }
+    Fl32toS16_C(&d[i], &s[i], count - i);
+}
+
+static void Fl32toS32_NEON(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    int32_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        vst1q_s32(&d[i], vcvtaq_s32_f32(vmulq_n_f32(vld1q_f32(&s[i]),
+                                                    2147483648.f)));
+    Fl32toS32_C(&d[i], &s[i], count - i);
+}
+
+static void Fl32toFl64_NEON(void *dst, const void *src, size_t count)
+{
+    const float *s = src;
+    double *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t x = vld1q_f32(&s[i]);
+
+        vst1q_f64(&d[i], vcvt_f64_f32(vget_low_f32(x)));
+        vst1q_f64(&d[i + 2], vcvt_high_f64_f32(x));
+    }
+    Fl32toFl64_C(&d[i], &s[i], count - i);
+}
+
+static void S32toS16_NEON(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    int16_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        int32x4_t lo = vld1q_s32(&s[i]);
+        int32x4_t hi = vld1q_s32(&s[i + 4]);
+
+        vst1q_s16(&d[i], vshrn_high_n_s32(vshrn_n_s32(lo, 16), hi, 16));
+    }
+    S32toS16_C(&d[i], &s[i], count - i);
+}
+
+static void S32toFl32_NEON(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    float *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(&d[i], vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(&s[i])),
+                                     1.f / 2147483648.f));
+    S32toFl32_C(&d[i], &s[i], count - i);
+}
+
+static void S32toFl64_NEON(void *dst, const void *src, size_t count)
+{
+    const int32_t *s = src;
+    double *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        int32x4_t x = vld1q_s32(&s[i]);
+
+        vst1q_f64(&d[i], vmulq_n_f64(vcvtq_f64_s64(vmovl_s32(
+                                     vget_low_s32(x))), 1. / 2147483648.));
+        vst1q_f64(&d[i + 2], vmulq_n_f64(vcvtq_f64_s64(vmovl_high_s32(x)),
+                                         1. / 2147483648.));
+    }
+    S32toFl64_C(&d[i], &s[i], count - i);
+}
+
+static void Fl64toS16_NEON(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int16_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        int64x2_t lo = vcvtaq_s64_f64(vmulq_n_f64(vld1q_f64(&s[i]), 32768.));
+        int64x2_t hi = vcvtaq_s64_f64(vmulq_n_f64(vld1q_f64(&s[i + 2]),
+                                                  32768.));
+
+        vst1_s16(&d[i], vqmovn_s32(vqmovn_high_s64(vqmovn_s64(lo), hi)));
+    }
+    Fl64toS16_C(&d[i], &s[i], count - i);
+}
+
+static void Fl64toS32_NEON(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    int32_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        int64x2_t lo = vcvtaq_s64_f64(vmulq_n_f64(vld1q_f64(&s[i]),
+                                                  2147483648.));
+        int64x2_t hi = vcvtaq_s64_f64(vmulq_n_f64(vld1q_f64(&s[i + 2]),
+                                                  2147483648.));
+
+        vst1q_s32(&d[i], vqmovn_high_s64(vqmovn_s64(lo), hi));
+    }
+    Fl64toS32_C(&d[i], &s[i], count - i);
+}
+
+static void Fl64toFl32_NEON(void *dst, const void *src, size_t count)
+{
+    const double *s = src;
+    float *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        float64x2_t lo = vld1q_f64(&s[i]);
+        float64x2_t hi = vld1q_f64(&s[i + 2]);
+
+        vst1q_f32(&d[i], vcvt_high_f32_f64(vcvt_f32_f64(lo), hi));
+    }
+    Fl64toFl32_C(&d[i], &s[i], count - i);
+}
+#endif /* FORMAT_HAVE_NEON */
+
+enum format_simd
+{
+    FORMAT_SIMD_C,
+    FORMAT_SIMD_SSE2,
+    FORMAT_SIMD_AVX2,
+    FORMAT_SIMD_NEON,
+    FORMAT_SIMD_COUNT,
+    FORMAT_SIMD_AUTO = FORMAT_SIMD_COUNT
+};
+
+#define FORMAT_CONVERSION(src, dst, name) \
+    { VLC_CODEC_##src, VLC_CODEC_##dst, { [FORMAT_SIMD_C] = name##_C, \
+      FORMAT_X86(name) FORMAT_NEON(name) } }
+#ifdef FORMAT_HAVE_X86
+# define FORMAT_X86(name) \
+    [FORMAT_SIMD_SSE2] = name##_SSE2, [FORMAT_SIMD_AVX2] = name##_AVX2,
+#else
+# define FORMAT_X86(name)
+#endif
+#ifdef FORMAT_HAVE_NEON
+# define FORMAT_NEON(name) [FORMAT_SIMD_NEON] = name##_NEON,
+#else
+# define FORMAT_NEON(name)
+#endif
+
+static const struct
+{
+    vlc_fourcc_t src;
+    vlc_fourcc_t dst;
+    format_convert_t convert[FORMAT_SIMD_COUNT];
+} format_conversions[] = {
+    FORMAT_CONVERSION(S16N, FL32, S16toFl32),
+    FORMAT_CONVERSION(S16N, S32N, S16toS32),
+    FORMAT_CONVERSION(S16N, FL64, S16toFl64),
+    FORMAT_CONVERSION(FL32, S16N, Fl32toS16),
+    FORMAT_CONVERSION(FL32, S32N, Fl32toS32),
+    FORMAT_CONVERSION(FL32, FL64, Fl32toFl64),
+    FORMAT_CONVERSION(S32N, S16N, S32toS16),
+    FORMAT_CONVERSION(S32N, FL32, S32toFl32),
+    FORMAT_CONVERSION(S32N, FL64, S32toFl64),
+    FORMAT_CONVERSION(FL64, S16N, Fl64toS16),
+    FORMAT_CONVERSION(FL64, S32N, Fl64toS32),
+    FORMAT_CONVERSION(FL64, FL32, Fl64toFl32),
+};
+
+#undef FORMAT_NEON
+#undef FORMAT_X86
+#undef FORMAT_CONVERSION
+
+/**
+ * Finds a conversion kernel.
+ *
+ * \param simd instruction set, or FORMAT_SIMD_AUTO for the best one the CPU
+ * supports
+ * \return the kernel, or NULL if the conversion or the instruction set is
+ * not supported
+ */
+static inline format_convert_t format_FindConversion(vlc_fourcc_t src,
+                                                     vlc_fourcc_t dst,
+                                                     enum format_simd simd)
+{
+    if (simd == FORMAT_SIMD_AUTO)
+    {
+        simd = FORMAT_SIMD_C;
+#ifdef FORMAT_HAVE_X86
+        if (vlc_CPU_AVX2())
+            simd = FORMAT_SIMD_AVX2;
+        else if (vlc_CPU_SSE2())
+            simd = FORMAT_SIMD_SSE2;
+#endif
+#ifdef FORMAT_HAVE_NEON
+        simd = FORMAT_SIMD_NEON;
+#endif
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(format_conversions); i++)
+        if (format_conversions[i].src == src
+         && format_conversions[i].dst == dst)
+            return format_conversions[i].convert[simd];
+    return NULL;
+}
+
+#endif
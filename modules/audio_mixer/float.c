@@ -35,6 +35,8 @@
 #include <vlc_aout.h>
 #include <vlc_aout_volume.h>
 
+#include "float_simd.h"
+
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
@@ -54,47 +56,69 @@ vlc_module_end ()
 /**
  * Mixes a new output buffer
  */
-static void FilterFL32( audio_volume_t *p_volume, block_t *p_buffer,
-                        float f_multiplier )
-{
-    if( f_multiplier == 1.f )
-        return; /* nothing to do */
-
-    float *p = (float *)p_buffer->p_buffer;
-    for( size_t i = p_buffer->i_buffer / sizeof(*p); i > 0; i-- )
-        *(p++) *= f_multiplier;
-
-    (void) p_volume;
+#define FILTER(name, type) \
+static void Filter##name( audio_volume_t *p_volume, block_t *p_buffer, \
+                          float f_multiplier ) \
+{ \
+    if( f_multiplier == 1.f ) \
+        return; /* nothing to do */ \
+\
+    Amplify##name( p_buffer->p_buffer, p_buffer->i_buffer / sizeof(type), \
+                   f_multiplier ); \
+    (void) p_volume; \
 }
 
-static void FilterFL64( audio_volume_t *p_volume, block_t *p_buffer,
-                        float f_multiplier )
-{
-    double *p = (double *)p_buffer->p_buffer;
-    double mult = f_multiplier;
-    if( mult == 1. )
-        return; /* nothing to do */
-
-    for( size_t i = p_buffer->i_buffer / sizeof(*p); i > 0; i-- )
-        *(p++) *= mult;
+FILTER(Fl32_C, float)
+FILTER(Fl64_C, double)
+#ifdef VOLUME_HAVE_X86
+FILTER(Fl32_SSE2, float)
+FILTER(Fl64_SSE2, double)
+FILTER(Fl32_AVX2, float)
+FILTER(Fl64_AVX2, double)
+#endif
+#ifdef VOLUME_HAVE_NEON
+FILTER(Fl32_NEON, float)
+FILTER(Fl64_NEON, double)
+#endif
+#undef FILTER
 
-    (void) p_volume;
-}
+typedef void (*volume_filter_t)(audio_volume_t *, block_t *, float);
 
 /**
  * Initializes the mixer
  */
 static int Create( vlc_object_t *p_this )
 {
+    static const volume_filter_t fl32[VOLUME_SIMD_COUNT] = {
+        [VOLUME_SIMD_C] = FilterFl32_C,
+#ifdef VOLUME_HAVE_X86
+        [VOLUME_SIMD_SSE2] = FilterFl32_SSE2,
+        [VOLUME_SIMD_AVX2] = FilterFl32_AVX2,
+#endif
+#ifdef VOLUME_HAVE_NEON
+        [VOLUME_SIMD_NEON] = FilterFl32_NEON,
+#endif
+    };
+    static const volume_filter_t fl64[VOLUME_SIMD_COUNT] = {
+        [VOLUME_SIMD_C] = FilterFl64_C,
+#ifdef VOLUME_HAVE_X86
+        [VOLUME_SIMD_SSE2] = FilterFl64_SSE2,
+        [VOLUME_SIMD_AVX2] = FilterFl64_AVX2,
+#endif
+#ifdef VOLUME_HAVE_NEON
+        [VOLUME_SIMD_NEON] = FilterFl64_NEON,
+#endif
+    };
     audio_volume_t *p_volume = (audio_volume_t *)p_this;
+    enum volume_simd simd = volume_GetSimd();
 
     switch (p_volume->format)
     {
         case VLC_CODEC_FL32:
-            p_volume->amplify = FilterFL32;
+            p_volume->amplify = fl32[simd];
             break;
         case VLC_CODEC_FL64:
-            p_volume->amplify = FilterFL64;
+            p_volume->amplify = fl64[simd];
             break;
         default:
             return -1;
@@ -0,0 +1,227 @@
+/*****************************************************************************
+ * float_simd.h: floating point volume kernels
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_FLOAT_SIMD_H
+#define VLC_FLOAT_SIMD_H 1
+
+/* Multiplies count FL32 or FL64 samples in place. Floating point samples
+ * are not clipped: the audio output does it, if needed, once mixed. */
+
+#include <vlc_cpu.h>
+
+#if defined(HAVE_SSE2_INTRINSICS) && defined(HAVE_ATTRIBUTE_TARGET) \
+ && (defined(__i386__) || defined(__x86_64__))
+# include <immintrin.h>
+# define VOLUME_HAVE_X86
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define VOLUME_HAVE_NEON
+#endif
+
+typedef void (*volume_amplify_t)(void *buf, size_t count, float mult);
+
+/*** C ***/
+static void AmplifyFl32_C(void *buf, size_t count, float mult)
+{
+    float *p = buf;
+
+    for (size_t i = 0; i < count; i++)
+        p[i] *= mult;
+}
+
+static void AmplifyFl64_C(void *buf, size_t count, float mult)
+{
+    double *p = buf;
+    const double m = mult;
+
+    for (size_t i = 0; i < count; i++)
+        p[i] *= m;
+}
+
+#ifdef VOLUME_HAVE_X86
+/*** SSE2 ***/
+VLC_TARGET("sse2")
+static void AmplifyFl32_SSE2(void *buf, size_t count, float mult)
+{
+    float *p = buf;
+    const __m128 m = _mm_set1_ps(mult);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_ps(&p[i], _mm_mul_ps(_mm_loadu_ps(&p[i]), m));
+        _mm_storeu_ps(&p[i + 4], _mm_mul_ps(_mm_loadu_ps(&p[i + 4]), m));
+    }
+    AmplifyFl32_C(&p[i], count - i, mult);
+}
+
+VLC_TARGET("sse2")
+static void AmplifyFl64_SSE2(void *buf, size_t count, float mult)
+{
+    double *p = buf;
+    const __m128d m = _mm_set1_pd(mult);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_pd(&p[i], _mm_mul_pd(_mm_loadu_pd(&p[i]), m));
+        _mm_storeu_pd(&p[i + 2], _mm_mul_pd(_mm_loadu_pd(&p[i + 2]), m));
+    }
+    AmplifyFl64_C(&p[i], count - i, mult);
+}
+
+/*** AVX2 ***/
+VLC_TARGET("avx2")
+static void AmplifyFl32_AVX2(void *buf, size_t count, float mult)
+{
+    float *p = buf;
+    const __m256 m = _mm256_set1_ps(mult);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_ps(&p[i], _mm256_mul_ps(_mm256_loadu_ps(&p[i]), m));
+        _mm256_storeu_ps(&p[i + 8],
+                         _mm256_mul_ps(_mm256_loadu_ps(&p[i + 8]), m));
+    }
+    AmplifyFl32_C(&p[i], count - i, mult);
+}
+
+VLC_TARGET("avx2")
+static void AmplifyFl64_AVX2(void *buf, size_t count, float mult)
+{
+    double *p = buf;
+    const __m256d m = _mm256_set1_pd(mult);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_pd(&p[i], _mm256_mul_pd(_mm256_loadu_pd(&p[i]), m));
+        _mm256_storeu_pd(&p[i + 4],
+                         _mm256_mul_pd(_mm256_loadu_pd(&p[i + 4]), m));
+    }
+    AmplifyFl64_C(&p[i], count - i, mult);
+}
+#endif /* VOLUME_HAVE_X86 */
+
+#ifdef VOLUME_HAVE_NEON
+/*** NEON ***/
+static void AmplifyFl32_NEON(void *buf, size_t count, float mult)
+{
+    float *p = buf;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        vst1q_f32(&p[i], vmulq_n_f32(vld1q_f32(&p[i]), mult));
+        vst1q_f32(&p[i + 4], vmulq_n_f32(vld1q_f32(&p[i + 4]), mult));
+    }
+    AmplifyFl32_C(&p[i], count - i, mult);
+}
+
+static void AmplifyFl64_NEON(void *buf, size_t count, float mult)
+{
+    double *p = buf;
+    const double m = mult;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_f64(&p[i], vmulq_n_f64(vld1q_f64(&p[i]), m));
+        vst1q_f64(&p[i + 2], vmulq_n_f64(vld1q_f64(&p[i + 2]), m));
+    }
+    AmplifyFl64_C(&p[i], count - i, mult);
+}
+#endif /* VOLUME_HAVE_NEON */
+
+enum volume_simd
+{
+    VOLUME_SIMD_C,
+    VOLUME_SIMD_SSE2,
+    VOLUME_SIMD_AVX2,
+    VOLUME_SIMD_NEON,
+    VOLUME_SIMD_COUNT,
+    VOLUME_SIMD_AUTO = VOLUME_SIMD_COUNT
+};
+
+/**
+ * Returns the best instruction set the CPU supports for the volume kernels.
+ */
+static inline enum volume_simd volume_GetSimd(void)
+{
+#ifdef VOLUME_HAVE_X86
+    if (vlc_CPU_AVX2())
+        return VOLUME_SIMD_AVX2;
+    if (vlc_CPU_SSE2())
+        return VOLUME_SIMD_SSE2;
+#endif
+#ifdef VOLUME_HAVE_NEON
+    return VOLUME_SIMD_NEON;
+#endif
+    return VOLUME_SIMD_C;
+}
+
+/**
+ * Finds a volume kernel.
+ *
+ * \param simd instruction set, or VOLUME_SIMD_AUTO for the best one the CPU
+ * supports
+ * \return the kernel, or NULL if the format or the instruction set is not
+ * supported
+ */
+static inline volume_amplify_t volume_FindAmplify(vlc_fourcc_t format,
+                                                  enum volume_simd simd)
+{
+    static const volume_amplify_t fl32[VOLUME_SIMD_COUNT] = {
+        [VOLUME_SIMD_C] = AmplifyFl32_C,
+#ifdef VOLUME_HAVE_X86
+        [VOLUME_SIMD_SSE2] = AmplifyFl32_SSE2,
+        [VOLUME_SIMD_AVX2] = AmplifyFl32_AVX2,
+#endif
+#ifdef VOLUME_HAVE_NEON
+        [VOLUME_SIMD_NEON] = AmplifyFl32_NEON,
+#endif
+    };
+    static const volume_amplify_t fl64[VOLUME_SIMD_COUNT] = {
+        [VOLUME_SIMD_C] = AmplifyFl64_C,
+#ifdef VOLUME_HAVE_X86
+        [VOLUME_SIMD_SSE2] = AmplifyFl64_SSE2,
+        [VOLUME_SIMD_AVX2] = AmplifyFl64_AVX2,
+#endif
+#ifdef VOLUME_HAVE_NEON
+        [VOLUME_SIMD_NEON] = AmplifyFl64_NEON,
+#endif
+    };
+
+    if (simd == VOLUME_SIMD_AUTO)
+        simd = volume_GetSimd();
+
+    switch (format)
+    {
+        case VLC_CODEC_FL32:
+            return fl32[simd];
+        case VLC_CODEC_FL64:
+            return fl64[simd];
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*****************************************************************************
+ * metrics.c: run-time metrics HTTP exporter
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_interface.h>
+#include <vlc_httpd.h>
+#include <vlc_metrics.h>
+
+struct intf_sys_t
+{
+    httpd_host_t *host;
+    httpd_file_t *file;
+};
+
+static int Fill(httpd_file_sys_t *data, httpd_file_t *file,
+                uint8_t *request, uint8_t **pp_data, int *pi_data)
+{
+    intf_thread_t *intf = (intf_thread_t *)data;
+    char *text = vlc_metrics_Export(intf);
+
+    VLC_UNUSED(file); VLC_UNUSED(request);
+
+    *pp_data = (uint8_t *)text;
+    *pi_data = (text != NULL) ? strlen(text) : 0;
+    return VLC_SUCCESS;
+}
+
+static int Open(vlc_object_t *obj)
+{
+    intf_thread_t *intf = (intf_thread_t *)obj;
+    intf_sys_t *sys = malloc(sizeof (*sys));
+    if (unlikely(sys == NULL))
+        return VLC_ENOMEM;
+
+    sys->host = vlc_http_HostNew(obj);
+    if (sys->host == NULL)
+        goto error;
+
+    char *url = var_InheritString(obj, "metrics-url");
+    sys->file = httpd_FileNew(sys->host, url ? url : "/metrics",
+                              "text/plain; version=0.0.4", NULL, NULL, Fill,
+                              (httpd_file_sys_t *)intf);
+    free(url);
+    if (sys->file == NULL)
+    {
+        httpd_HostDelete(sys->host);
+        goto error;
+    }
+
+    intf->p_sys = sys;
+    return VLC_SUCCESS;
+error:
+    free(sys);
+    return VLC_EGENERIC;
+}
+
+static void Close(vlc_object_t *obj)
+{
+    intf_thread_t *intf = (intf_thread_t *)obj;
+    intf_sys_t *sys = intf->p_sys;
+
+    httpd_FileDelete(sys->file);
+    httpd_HostDelete(sys->host);
+    free(sys);
+}
+
+#define URL_TEXT N_("Metrics URL")
+#define URL_LONGTEXT N_( \
+    "Path of the metrics on the HTTP server (see --http-host and --http-port).")
+
+vlc_module_begin()
+    set_shortname(N_("Metrics"))
+    set_description(N_("Metrics HTTP exporter"))
+    set_category(CAT_INTERFACE)
+    set_subcategory(SUBCAT_INTERFACE_CONTROL)
+    set_capability("interface", 0)
+    set_callbacks(Open, Close)
+    add_string("metrics-url", "/metrics", URL_TEXT, URL_LONGTEXT, true)
+vlc_module_end()
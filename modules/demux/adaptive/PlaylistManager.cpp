@@ -121,6 +121,9 @@ bool PlaylistManager::setupPeriod()
             if(!tracker)
                 continue;
 
+            tracker->registerListener(conManager);
+            tracker->setPrefetchDepth(var_InheritInteger(p_demux, "adaptive-prefetch"));
+
             AbstractStream *st = streamFactory->create(p_demux, set->getStreamFormat(),
                                                        tracker, conManager);
             if(!st)
@@ -87,6 +87,8 @@ SegmentTracker::SegmentTracker(AbstractAdaptationLogic *logic_, BaseAdaptationSe
     setAdaptationLogic(logic_);
     adaptationSet = adaptSet;
     format = StreamFormat::UNSUPPORTED;
+    prefetchDepth = 0;
+    prefetchRepresentation = NULL;
 }
 
 SegmentTracker::~SegmentTracker()
@@ -127,6 +129,7 @@ bool SegmentTracker::segmentsListReady() const
 
 void SegmentTracker::reset()
 {
+    clearPrefetchedChunks();
     notify(SegmentTrackerEvent(curRepresentation, NULL));
     curRepresentation = NULL;
     init_sent = false;
@@ -166,6 +169,7 @@ SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
     if(rep != curRepresentation)
     {
         notify(SegmentTrackerEvent(curRepresentation, rep));
+        clearPrefetchedChunks();
         prevRep = curRepresentation;
         curRepresentation = rep;
         init_sent = false;
@@ -246,7 +250,9 @@ SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
         initializing = false;
     }
 
-    SegmentChunk *chunk = segment->toChunk(next, rep, connManager);
+    SegmentChunk *chunk = getPrefetchedChunk(rep, next);
+    if(!chunk)
+        chunk = segment->toChunk(next, rep, connManager);
 
     /* Notify new segment length for stats / logic */
     if(chunk)
@@ -273,11 +279,75 @@ SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
     {
         curNumber = next;
         next++;
+        prefetchChunks(rep, connManager);
     }
 
     return chunk;
 }
 
+void SegmentTracker::setPrefetchDepth(unsigned depth)
+{
+    prefetchDepth = depth;
+}
+
+SegmentChunk * SegmentTracker::getPrefetchedChunk(BaseRepresentation *rep, uint64_t number)
+{
+    if(rep != prefetchRepresentation)
+        clearPrefetchedChunks();
+
+    while(!prefetched.empty() && prefetched.front().first < number)
+    {
+        delete prefetched.front().second;
+        prefetched.pop_front();
+    }
+
+    if(!prefetched.empty() && prefetched.front().first == number)
+    {
+        SegmentChunk *chunk = prefetched.front().second;
+        prefetched.pop_front();
+        return chunk;
+    }
+
+    /* Not the sequence we did prefetch (seek, gap...) */
+    clearPrefetchedChunks();
+    return NULL;
+}
+
+void SegmentTracker::prefetchChunks(BaseRepresentation *rep, AbstractConnectionManager *connManager)
+{
+    /* Live segments might not be available yet */
+    if(!prefetchDepth || rep->getPlaylist()->isLive())
+        return;
+
+    uint64_t number = prefetched.empty() ? next : prefetched.back().first + 1;
+    prefetchRepresentation = rep;
+    while(prefetched.size() < prefetchDepth)
+    {
+        bool b_gap;
+        ISegment *segment = rep->getNextSegment(BaseRepresentation::INFOTYPE_MEDIA,
+                                                number, &number, &b_gap);
+        if(!segment)
+            break;
+
+        SegmentChunk *chunk = segment->toChunk(number, rep, connManager);
+        if(!chunk)
+            break;
+
+        prefetched.push_back(std::make_pair(number, chunk));
+        number++;
+    }
+}
+
+void SegmentTracker::clearPrefetchedChunks()
+{
+    while(!prefetched.empty())
+    {
+        delete prefetched.front().second;
+        prefetched.pop_front();
+    }
+    prefetchRepresentation = NULL;
+}
+
 bool SegmentTracker::setPositionByTime(vlc_tick_t time, bool restarted, bool tryonly)
 {
     uint64_t segnumber;
@@ -303,6 +373,7 @@ void SegmentTracker::setPositionByNumber(uint64_t segnumber, bool restarted)
         index_sent = false;
         init_sent = false;
     }
+    clearPrefetchedChunks();
     curNumber = next = segnumber;
 }
 
@@ -127,10 +127,14 @@ namespace adaptive
             void notifyBufferingLevel(vlc_tick_t, vlc_tick_t, vlc_tick_t) const;
             void registerListener(SegmentTrackerListenerInterface *);
             void updateSelected();
+            void setPrefetchDepth(unsigned);
 
         private:
             void setAdaptationLogic(AbstractAdaptationLogic *);
             void notify(const SegmentTrackerEvent &) const;
+            SegmentChunk * getPrefetchedChunk(BaseRepresentation *, uint64_t);
+            void prefetchChunks(BaseRepresentation *, AbstractConnectionManager *);
+            void clearPrefetchedChunks();
             bool first;
             bool initializing;
             bool index_sent;
@@ -142,6 +146,9 @@ namespace adaptive
             BaseAdaptationSet *adaptationSet;
             BaseRepresentation *curRepresentation;
             std::list<SegmentTrackerListenerInterface *> listeners;
+            unsigned prefetchDepth;
+            BaseRepresentation *prefetchRepresentation;
+            std::list<std::pair<uint64_t, SegmentChunk *> > prefetched;
     };
 }
 
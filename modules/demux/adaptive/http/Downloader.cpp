@@ -25,41 +25,48 @@
 
 #include <vlc_threads.h>
 
-#include <atomic>
+#include <algorithm>
 
 using namespace adaptive::http;
 
-Downloader::Downloader()
+Downloader::Downloader(unsigned workers_count)
 {
     vlc_mutex_init(&lock);
     vlc_cond_init(&waitcond);
+    vlc_cond_init(&donecond);
     killed = false;
-    thread_handle_valid = false;
+    max_workers = workers_count ? workers_count : 1;
 }
 
 bool Downloader::start()
 {
-    if(!thread_handle_valid &&
-       vlc_clone(&thread_handle, downloaderThread,
-                 static_cast<void *>(this), VLC_THREAD_PRIORITY_INPUT))
+    if(!workers.empty())
+        return true;
+
+    for(unsigned i=0; i<max_workers; i++)
     {
-        return false;
+        vlc_thread_t thread_handle;
+        if(vlc_clone(&thread_handle, downloaderThread,
+                     static_cast<void *>(this), VLC_THREAD_PRIORITY_INPUT))
+            break;
+        workers.push_back(thread_handle);
     }
-    thread_handle_valid = true;
-    return true;
+    return !workers.empty();
 }
 
 Downloader::~Downloader()
 {
     vlc_mutex_lock( &lock );
     killed = true;
-    vlc_cond_signal(&waitcond);
+    vlc_cond_broadcast(&waitcond);
     vlc_mutex_unlock( &lock );
 
-    if(thread_handle_valid)
-        vlc_join(thread_handle, NULL);
+    std::vector<vlc_thread_t>::iterator it;
+    for(it = workers.begin(); it != workers.end(); ++it)
+        vlc_join(*it, NULL);
     vlc_mutex_destroy(&lock);
     vlc_cond_destroy(&waitcond);
+    vlc_cond_destroy(&donecond);
 }
 void Downloader::schedule(HTTPChunkBufferedSource *source)
 {
@@ -73,11 +80,26 @@ void Downloader::schedule(HTTPChunkBufferedSource *source)
 void Downloader::cancel(HTTPChunkBufferedSource *source)
 {
     vlc_mutex_lock(&lock);
+    /* wait for the worker currently filling it, if any */
+    while(std::find(downloading.begin(), downloading.end(), source) != downloading.end())
+        vlc_cond_wait(&donecond, &lock);
     source->release();
     chunks.remove(source);
     vlc_mutex_unlock(&lock);
 }
 
+void Downloader::updateBufferingLevel(const ID &id, vlc_tick_t level)
+{
+    vlc_mutex_locker locker(&lock);
+    levels[id] = level;
+}
+
+void Downloader::removeBufferingLevel(const ID &id)
+{
+    vlc_mutex_locker locker(&lock);
+    levels.erase(id);
+}
+
 void * Downloader::downloaderThread(void *opaque)
 {
     Downloader *instance = static_cast<Downloader *>(opaque);
@@ -93,27 +115,73 @@ void Downloader::DownloadSource(HTTPChunkBufferedSource *source)
         source->bufferize(HTTPChunkSource::CHUNK_SIZE);
 }
 
+bool Downloader::isDownloading(const ID &id) const
+{
+    std::list<HTTPChunkBufferedSource *>::const_iterator it;
+    for(it = downloading.begin(); it != downloading.end(); ++it)
+    {
+        if((*it)->sourceid == id)
+            return true;
+    }
+    return false;
+}
+
+HTTPChunkBufferedSource * Downloader::getNextSource() const
+{
+    /* Streams without any ongoing download come first, then the
+       one with the lowest buffering level. Queue order breaks ties,
+       so that each stream's segments still complete in order. */
+    HTTPChunkBufferedSource *best = NULL;
+    bool best_busy = true;
+    vlc_tick_t best_level = 0;
+
+    std::list<HTTPChunkBufferedSource *>::const_iterator it;
+    for(it = chunks.begin(); it != chunks.end(); ++it)
+    {
+        HTTPChunkBufferedSource *source = *it;
+        if(std::find(downloading.begin(), downloading.end(), source) != downloading.end())
+            continue;
+
+        const bool busy = isDownloading(source->sourceid);
+        std::map<ID, vlc_tick_t>::const_iterator lit = levels.find(source->sourceid);
+        const vlc_tick_t level = (lit != levels.end()) ? (*lit).second : 0;
+
+        if(best == NULL || (best_busy && !busy) ||
+           (best_busy == busy && level < best_level))
+        {
+            best = source;
+            best_busy = busy;
+            best_level = level;
+        }
+    }
+    return best;
+}
+
 void Downloader::Run()
 {
     vlc_mutex_lock(&lock);
     while(1)
     {
-        while(chunks.empty() && !killed)
+        HTTPChunkBufferedSource *source;
+        while(!killed && (source = getNextSource()) == NULL)
             vlc_cond_wait(&waitcond, &lock);
 
         if(killed)
             break;
 
-        if(!chunks.empty())
+        downloading.push_back(source);
+        vlc_mutex_unlock(&lock);
+
+        DownloadSource(source);
+
+        vlc_mutex_lock(&lock);
+        downloading.remove(source);
+        if(source->isDone())
         {
-            HTTPChunkBufferedSource *source = chunks.front();
-            DownloadSource(source);
-            if(source->isDone())
-            {
-                chunks.pop_front();
-                source->release();
-            }
+            chunks.remove(source);
+            source->release();
         }
+        vlc_cond_broadcast(&donecond);
     }
     vlc_mutex_unlock(&lock);
 }
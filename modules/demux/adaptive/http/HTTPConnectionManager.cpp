@@ -58,12 +58,20 @@ void AbstractConnectionManager::setDownloadRateObserver(IDownloadRateObserver *o
     rateObserver = obs;
 }
 
+static Downloader * createDownloader(vlc_object_t *p_object)
+{
+    int64_t workers = var_InheritInteger(p_object, "adaptive-download-threads");
+    Downloader *downloader = new (std::nothrow) Downloader(workers > 0 ? workers : 1);
+    if(downloader)
+        downloader->start();
+    return downloader;
+}
+
 HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *p_object_, ConnectionFactory *factory_)
     : AbstractConnectionManager( p_object_ )
 {
     vlc_mutex_init(&lock);
-    downloader = new (std::nothrow) Downloader();
-    downloader->start();
+    downloader = createDownloader(p_object);
     factory = factory_;
 }
 
@@ -71,8 +79,7 @@ HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *p_object_, AuthSt
     : AbstractConnectionManager( p_object_ )
 {
     vlc_mutex_init(&lock);
-    downloader = new (std::nothrow) Downloader();
-    downloader->start();
+    downloader = createDownloader(p_object);
     if(var_InheritBool(p_object, "adaptive-use-access"))
         factory = new (std::nothrow) StreamUrlConnectionFactory();
     else
@@ -157,3 +164,24 @@ void HTTPConnectionManager::cancel(AbstractChunkSource *source)
     if(src)
         downloader->cancel(src);
 }
+
+void HTTPConnectionManager::trackerEvent(const SegmentTrackerEvent &event)
+{
+    if(!downloader)
+        return;
+
+    /* Let the downloader serve first the stream closest to underrun */
+    switch(event.type)
+    {
+        case SegmentTrackerEvent::BUFFERING_LEVEL_CHANGE:
+            downloader->updateBufferingLevel(*event.u.buffering_level.id,
+                                             event.u.buffering_level.current);
+            break;
+        case SegmentTrackerEvent::BUFFERING_STATE:
+            if(!event.u.buffering.enabled)
+                downloader->removeBufferingLevel(*event.u.buffering.id);
+            break;
+        default:
+            break;
+    }
+}
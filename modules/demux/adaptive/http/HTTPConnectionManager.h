@@ -26,6 +26,7 @@
 #define HTTPCONNECTIONMANAGER_H_
 
 #include "../logic/IDownloadRateObserver.h"
+#include "../SegmentTracker.hpp"
 
 #include <vlc_common.h>
 
@@ -43,7 +44,8 @@ namespace adaptive
         class Downloader;
         class AbstractChunkSource;
 
-        class AbstractConnectionManager : public IDownloadRateObserver
+        class AbstractConnectionManager : public IDownloadRateObserver,
+                                          public SegmentTrackerListenerInterface
         {
             public:
                 AbstractConnectionManager(vlc_object_t *);
@@ -75,6 +77,7 @@ namespace adaptive
 
                 virtual void start(AbstractChunkSource *) /* impl */;
                 virtual void cancel(AbstractChunkSource *) /* impl */;
+                virtual void trackerEvent(const SegmentTrackerEvent &) /* impl */;
 
             private:
                 void    releaseAllConnections ();
@@ -42,9 +42,12 @@
 #include <vlc_meta.h>
 #include <vlc_codecs.h>
 #include <vlc_charset.h>
+#include <vlc_atomic.h>
+#include <vlc_interrupt.h>
 
 #include "libavi.h"
 #include "../rawdv.h"
+#include "../cachefile.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -57,6 +60,16 @@
     "Recreate a index for the AVI file. Use this if your AVI file is damaged "\
     "or incomplete (not seekable)." )
 
+#define INDEX_BACKGROUND_TEXT N_("Create index in the background")
+#define INDEX_BACKGROUND_LONGTEXT N_( \
+    "Create the missing index of local files while playing, instead of " \
+    "before. Seeking beyond the part already indexed is slower." )
+
+#define INDEX_CACHE_TEXT N_("Cache created index")
+#define INDEX_CACHE_LONGTEXT N_( \
+    "Store the index created for a local file in the user cache directory, " \
+    "and reuse it while the file is unchanged." )
+
 static int  Open ( vlc_object_t * );
 static void Close( vlc_object_t * );
 
@@ -79,6 +92,10 @@ vlc_module_begin ()
     add_integer( "avi-index", 0,
               INDEX_TEXT, INDEX_LONGTEXT, false )
         change_integer_list( pi_index, ppsz_indexes )
+    add_bool( "avi-index-background", true,
+              INDEX_BACKGROUND_TEXT, INDEX_BACKGROUND_LONGTEXT, true )
+    add_bool( "avi-index-cache", false,
+              INDEX_CACHE_TEXT, INDEX_CACHE_LONGTEXT, true )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -168,6 +185,8 @@ typedef struct
 
 } avi_track_t;
 
+typedef struct avi_indexer_t avi_indexer_t;
+
 typedef struct
 {
     vlc_tick_t i_time;
@@ -186,6 +205,12 @@ typedef struct
     uint64_t i_movi_begin;
     uint64_t i_movi_lastchunk_pos;   /* XXX position of last valid chunk */
 
+    /* index created from the movi list */
+    avi_indexer_t *p_indexer;   /* while created in the background */
+    bool  b_index_created;      /* completely */
+    cachefile_t index_cache;
+    bool  b_index_cache;        /* if index_cache is set up */
+
     /* number of streams and information */
     unsigned int i_track;
     avi_track_t  **track;
@@ -214,12 +239,18 @@ static int AVI_StreamBytesSet ( demux_t *,
 vlc_fourcc_t AVI_FourccGetCodec( unsigned int i_cat, vlc_fourcc_t );
 static int   AVI_GetKeyFlag    ( vlc_fourcc_t , uint8_t * );
 
-static int AVI_PacketGetHeader( demux_t *, avi_packet_t *p_pk );
-static int AVI_PacketNext     ( demux_t * );
-static int AVI_PacketSearch   ( demux_t * );
+static int AVI_PacketGetHeader( stream_t *, avi_packet_t *p_pk );
+static int AVI_PacketNext     ( stream_t * );
+static int AVI_PacketSearch   ( demux_t *, stream_t * );
 
 static void AVI_IndexLoad    ( demux_t * );
-static void AVI_IndexCreate  ( demux_t * );
+static int  AVI_IndexCreate  ( demux_t * );
+static int  AVI_IndexerStart ( demux_t * );
+static void AVI_IndexerStop  ( demux_t * );
+static void AVI_IndexerMerge ( demux_t * );
+static int  AVI_IndexCacheLoad( demux_t * );
+static void AVI_IndexCacheSave( demux_t * );
+static void AVI_FixBeOSTracks( demux_t * );
 
 static void AVI_ExtractSubtitle( demux_t *, unsigned int i_stream, avi_chunk_list_t *, avi_chunk_STRING_t * );
 
@@ -252,6 +283,15 @@ static void Close ( vlc_object_t * p_this )
     demux_t *    p_demux = (demux_t *)p_this;
     demux_sys_t *p_sys = p_demux->p_sys  ;
 
+    if( p_sys->p_indexer )
+        AVI_IndexerStop( p_demux );
+    if( p_sys->b_index_cache )
+    {
+        if( p_sys->b_index_created )
+            AVI_IndexCacheSave( p_demux );
+        cachefile_Clean( &p_sys->index_cache );
+    }
+
     for( unsigned int i = 0; i < p_sys->i_track; i++ )
     {
         if( p_sys->track[i] )
@@ -283,6 +323,7 @@ static int Open( vlc_object_t * p_this )
     demux_sys_t     *p_sys;
 
     bool       b_index = false, b_aborted = false;
+    bool       b_index_background;
     int              i_do_index;
 
     avi_chunk_list_t    *p_riff;
@@ -765,12 +806,21 @@ static int Open( vlc_object_t * p_this )
     }
 
     i_do_index = var_InheritInteger( p_demux, "avi-index" );
+    b_index_background = var_InheritBool( p_demux, "avi-index-background" );
     if( i_do_index == 1 ) /* Always fix */
     {
 aviindex:
         if( p_sys->b_fastseekable )
         {
-            AVI_IndexCreate( p_demux );
+            if( var_InheritBool( p_demux, "avi-index-cache" ) &&
+                AVI_IndexCacheLoad( p_demux ) == VLC_SUCCESS )
+                b_index = true;
+            else if( !b_index_background ||
+                     AVI_IndexerStart( p_demux ) != VLC_SUCCESS )
+            {
+                p_sys->b_index_created =
+                    AVI_IndexCreate( p_demux ) == VLC_SUCCESS;
+            }
         }
         else if( p_sys->b_seekable )
         {
@@ -810,7 +860,8 @@ aviindex:
                 b_index = true;
                 goto aviindex;
             }
-            if( i_do_index == 0 )
+            /* creating it in the background does not delay the playback */
+            if( i_do_index == 0 && !b_index_background )
             {
                 const char *psz_msg = _(
                     "Because this file index is broken or missing, "
@@ -845,46 +896,7 @@ aviindex:
         }
     }
 
-    /* fix some BeOS MediaKit generated file */
-    for( unsigned i = 0 ; i < p_sys->i_track; i++ )
-    {
-        avi_track_t         *tk = p_sys->track[i];
-        avi_chunk_list_t    *p_strl;
-        avi_chunk_strf_auds_t    *p_auds;
-
-        if( tk->fmt.i_cat != AUDIO_ES )
-        {
-            continue;
-        }
-        if( tk->idx.i_size < 1 ||
-            tk->i_scale != 1 ||
-            tk->i_samplesize != 0 )
-        {
-            continue;
-        }
-        p_strl = AVI_ChunkFind( p_hdrl, AVIFOURCC_strl, i, true );
-        p_auds = AVI_ChunkFind( p_strl, AVIFOURCC_strf, 0, false );
-
-        if( p_auds &&
-            p_auds->p_wf->wFormatTag != WAVE_FORMAT_PCM &&
-            tk->i_rate == p_auds->p_wf->nSamplesPerSec )
-        {
-            int64_t i_track_length =
-                tk->idx.p_entry[tk->idx.i_size-1].i_length +
-                tk->idx.p_entry[tk->idx.i_size-1].i_lengthtotal;
-            vlc_tick_t i_length = VLC_TICK_FROM_US( p_avih->i_totalframes *
-                                                    p_avih->i_microsecperframe );
-
-            if( i_length == 0 )
-            {
-                msg_Warn( p_demux, "track[%u] cannot be fixed (BeOS MediaKit generated)", i );
-                continue;
-            }
-            tk->i_samplesize = 1;
-            tk->i_rate       = i_track_length  * CLOCK_FREQ / i_length;
-            msg_Warn( p_demux, "track[%u] fixed with rate=%u scale=%u (BeOS MediaKit generated)", i, tk->i_rate, tk->i_scale );
-        }
-    }
+    AVI_FixBeOSTracks( p_demux );
 
     if( p_sys->b_seekable )
     {
@@ -1013,6 +1025,7 @@ static int Demux_Seekable( demux_t *p_demux )
     /* cannot be more than 100 stream (dcXX or wbXX) */
     avi_track_toread_t toread[100];
 
+    AVI_IndexerMerge( p_demux );
 
     /* detect new selected/unselected streams */
     for( i_track = 0; i_track < p_sys->i_track; i_track++ )
@@ -1151,7 +1164,7 @@ static int Demux_Seekable( demux_t *p_demux )
             if( p_sys->b_seekable && p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
             {
                 vlc_stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return( AVI_TrackStopFinishedStreams( p_demux ) ? 0 : 1 );
                 }
@@ -1165,7 +1178,7 @@ static int Demux_Seekable( demux_t *p_demux )
             {
                 avi_packet_t avi_pk;
 
-                if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+                if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
                 {
                     msg_Warn( p_demux,
                              "cannot get packet header, track disabled" );
@@ -1174,7 +1187,7 @@ static int Demux_Seekable( demux_t *p_demux )
                 if( avi_pk.i_stream >= p_sys->i_track ||
                     ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
                 {
-                    if( AVI_PacketNext( p_demux ) )
+                    if( AVI_PacketNext( p_demux->s ) )
                     {
                         msg_Warn( p_demux,
                                   "cannot skip packet, track disabled" );
@@ -1215,7 +1228,7 @@ static int Demux_Seekable( demux_t *p_demux )
                     }
                     else
                     {
-                        if( AVI_PacketNext( p_demux ) )
+                        if( AVI_PacketNext( p_demux->s ) )
                         {
                             msg_Warn( p_demux,
                                       "cannot skip packet, track disabled" );
@@ -1416,7 +1429,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
 
         avi_packet_t    avi_pk;
 
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             return VLC_DEMUXER_EOF;
         }
@@ -1433,18 +1446,18 @@ static int Demux_UnSeekable( demux_t *p_demux )
                 case AVIFOURCC_JUNK:
                 case AVIFOURCC_LIST:
                 case AVIFOURCC_RIFF:
-                    return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                    return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                 case AVIFOURCC_idx1:
                     if( p_sys->b_odml )
                     {
-                        return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                        return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                     }
                     return VLC_DEMUXER_EOF;
                 default:
                     msg_Warn( p_demux,
                               "seems to have lost position @%"PRIu64", resync",
                               vlc_stream_Tell(p_demux->s) );
-                    if( AVI_PacketSearch( p_demux ) )
+                    if( AVI_PacketSearch( p_demux, p_demux->s ) )
                     {
                         msg_Err( p_demux, "resync failed" );
                         return VLC_DEMUXER_EGENERIC;
@@ -1484,7 +1497,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
             }
             else
             {
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return VLC_DEMUXER_EOF;
                 }
@@ -1524,6 +1537,8 @@ static int Seek( demux_t *p_demux, vlc_tick_t i_date, double f_ratio, bool b_acc
     {
         uint64_t i_pos_backup = vlc_stream_Tell( p_demux->s );
 
+        AVI_IndexerMerge( p_demux );
+
         /* Check and lazy load indexes if it was not done (not fastseekable) */
         if ( !p_sys->b_indexloaded && ( p_sys->i_avih_flags & AVIF_HASINDEX ) )
         {
@@ -1889,7 +1904,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
     if( p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
     {
         vlc_stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-        if( AVI_PacketNext( p_demux ) )
+        if( AVI_PacketNext( p_demux->s ) )
         {
             return VLC_EGENERIC;
         }
@@ -1901,7 +1916,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
 
     for( ;; )
     {
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             msg_Warn( p_demux, "cannot get packet header" );
             return VLC_EGENERIC;
@@ -1909,7 +1924,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
         if( avi_pk.i_stream >= p_sys->i_track ||
             ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
         {
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -1943,7 +1958,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
                 return VLC_SUCCESS;
             }
 
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -2240,17 +2255,17 @@ static void AVI_ParseStreamHeader( vlc_fourcc_t i_id,
 /****************************************************************************
  *
  ****************************************************************************/
-static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
+static int AVI_PacketGetHeader( stream_t *s, avi_packet_t *p_pk )
 {
     const uint8_t *p_peek;
 
-    if( vlc_stream_Peek( p_demux->s, &p_peek, 16 ) < 16 )
+    if( vlc_stream_Peek( s, &p_peek, 16 ) < 16 )
     {
         return VLC_EGENERIC;
     }
     p_pk->i_fourcc  = VLC_FOURCC( p_peek[0], p_peek[1], p_peek[2], p_peek[3] );
     p_pk->i_size    = GetDWLE( p_peek + 4 );
-    p_pk->i_pos     = vlc_stream_Tell( p_demux->s );
+    p_pk->i_pos     = vlc_stream_Tell( s );
     if( p_pk->i_fourcc == AVIFOURCC_LIST || p_pk->i_fourcc == AVIFOURCC_RIFF )
     {
         p_pk->i_type = VLC_FOURCC( p_peek[8],  p_peek[9],
@@ -2267,12 +2282,12 @@ static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketNext( demux_t *p_demux )
+static int AVI_PacketNext( stream_t *s )
 {
     avi_packet_t    avi_ck;
     size_t          i_skip = 0;
 
-    if( AVI_PacketGetHeader( p_demux, &avi_ck ) )
+    if( AVI_PacketGetHeader( s, &avi_ck ) )
     {
         return VLC_EGENERIC;
     }
@@ -2297,7 +2312,7 @@ static int AVI_PacketNext( demux_t *p_demux )
     if( i_skip > SSIZE_MAX )
         return VLC_EGENERIC;
 
-    ssize_t i_ret = vlc_stream_Read( p_demux->s, NULL, i_skip );
+    ssize_t i_ret = vlc_stream_Read( s, NULL, i_skip );
     if( i_ret < 0 || (size_t) i_ret != i_skip )
     {
         return VLC_EGENERIC;
@@ -2305,7 +2320,7 @@ static int AVI_PacketNext( demux_t *p_demux )
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketSearch( demux_t *p_demux )
+static int AVI_PacketSearch( demux_t *p_demux, stream_t *s )
 {
     demux_sys_t     *p_sys = p_demux->p_sys;
     avi_packet_t    avi_pk;
@@ -2313,11 +2328,11 @@ static int AVI_PacketSearch( demux_t *p_demux )
 
     for( ;; )
     {
-        if( vlc_stream_Read( p_demux->s, NULL, 1 ) != 1 )
+        if( vlc_stream_Read( s, NULL, 1 ) != 1 )
         {
             return VLC_EGENERIC;
         }
-        AVI_PacketGetHeader( p_demux, &avi_pk );
+        AVI_PacketGetHeader( s, &avi_pk );
         if( avi_pk.i_stream < p_sys->i_track &&
             ( avi_pk.i_cat == AUDIO_ES || avi_pk.i_cat == VIDEO_ES ) )
         {
@@ -2338,6 +2353,8 @@ static int AVI_PacketSearch( demux_t *p_demux )
          * this code is called only on broken files). */
         if( !(++i_count % 1024) )
         {
+            if( vlc_killed() )
+                return VLC_EGENERIC;
             vlc_tick_sleep( VLC_HARD_MIN_SLEEP );
             if( !(i_count % (1024 * 10)) )
                 msg_Warn( p_demux, "trying to resync..." );
@@ -2669,68 +2686,23 @@ static void AVI_IndexLoad( demux_t *p_demux )
     }
 }
 
-static void AVI_IndexCreate( demux_t *p_demux )
+/* Gives an index entry of a track to the index creation, which returns
+ * false to stop */
+typedef bool (*avi_index_add_t)( demux_t *, void *, unsigned i_stream,
+                                 avi_entry_t * );
+
+/* Indexes the chunks of the movi list from the current position of s */
+static int AVI_IndexScan( demux_t *p_demux, stream_t *s, uint64_t i_movi_end,
+                          avi_index_add_t pf_add, void *p_opaque )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
 
-    avi_chunk_list_t *p_riff;
-    avi_chunk_list_t *p_movi;
-
-    unsigned int i_stream;
-    uint32_t i_movi_end;
-
-    vlc_tick_t i_dialog_update;
-    vlc_dialog_id *p_dialog_id = NULL;
-
-    p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
-    p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0, true );
-
-    if( !p_movi )
-    {
-        msg_Err( p_demux, "cannot find p_movi" );
-        return;
-    }
-
-    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
-        avi_index_Init( &p_sys->track[i_stream]->idx );
-
-    i_movi_end = __MIN( (uint32_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
-                        stream_Size( p_demux->s ) );
-
-    vlc_stream_Seek( p_demux->s, p_movi->i_chunk_pos + 12 );
-    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
-
-
-    /* Only show dialog if AVI is > 10MB */
-    i_dialog_update = vlc_tick_now();
-    if( stream_Size( p_demux->s ) > 10000000 )
-    {
-        p_dialog_id =
-            vlc_dialog_display_progress( p_demux, false, 0.0, _("Cancel"),
-                                         _("Broken or missing AVI Index"),
-                                         _("Fixing AVI Index...") );
-    }
-
     for( ;; )
     {
         avi_packet_t pk;
 
-        /* Don't update/check dialog too often */
-        if( p_dialog_id != NULL && vlc_tick_now() - i_dialog_update > 100000 )
-        {
-            if( vlc_dialog_is_cancelled( p_demux, p_dialog_id ) )
-                break;
-
-            double f_current = vlc_stream_Tell( p_demux->s );
-            double f_size    = stream_Size( p_demux->s );
-            double f_pos     = f_current / f_size;
-            vlc_dialog_update_progress( p_demux, p_dialog_id, f_pos );
-
-            i_dialog_update = vlc_tick_now();
-        }
-
-        if( AVI_PacketGetHeader( p_demux, &pk ) )
-            break;
+        if( AVI_PacketGetHeader( s, &pk ) )
+            return VLC_SUCCESS;
 
         if( pk.i_stream < p_sys->i_track &&
             pk.i_cat == p_sys->track[pk.i_stream]->fmt.i_cat )
@@ -2743,7 +2715,8 @@ static void AVI_IndexCreate( demux_t *p_demux )
             index.i_pos     = pk.i_pos;
             index.i_length  = pk.i_size;
             index.i_lengthtotal = pk.i_size;
-            avi_index_Append( &tk->idx, &p_sys->i_movi_lastchunk_pos, &index );
+            if( !pf_add( p_demux, p_opaque, pk.i_stream, &index ) )
+                return VLC_EGENERIC;
         }
         else
         {
@@ -2757,12 +2730,11 @@ static void AVI_IndexCreate( demux_t *p_demux )
                                             AVIFOURCC_RIFF, 1, true );
 
                     msg_Dbg( p_demux, "looking for new RIFF chunk" );
-                    if( !p_sysx || vlc_stream_Seek( p_demux->s,
-                                         p_sysx->i_chunk_pos + 24 ) )
-                        goto print_stat;
+                    if( !p_sysx || vlc_stream_Seek( s, p_sysx->i_chunk_pos + 24 ) )
+                        return VLC_SUCCESS;
                     break;
                 }
-                goto print_stat;
+                return VLC_SUCCESS;
 
             case AVIFOURCC_RIFF:
                     msg_Dbg( p_demux, "new RIFF chunk found" );
@@ -2774,30 +2746,524 @@ static void AVI_IndexCreate( demux_t *p_demux )
 
             default:
                 msg_Warn( p_demux, "need resync, probably broken avi" );
-                if( AVI_PacketSearch( p_demux ) )
+                if( AVI_PacketSearch( p_demux, s ) )
                 {
                     msg_Warn( p_demux, "lost sync, abord index creation" );
-                    goto print_stat;
+                    return VLC_EGENERIC;
                 }
             }
         }
 
         if( ( !p_sys->b_odml && pk.i_pos + pk.i_size >= i_movi_end ) ||
-            AVI_PacketNext( p_demux ) )
+            AVI_PacketNext( s ) )
         {
-            break;
+            return VLC_SUCCESS;
         }
     }
+}
+
+typedef struct
+{
+    vlc_dialog_id *p_dialog_id;
+    vlc_tick_t     i_dialog_update;
+} avi_index_create_t;
+
+static bool AVI_IndexCreateAdd( demux_t *p_demux, void *p_opaque,
+                                unsigned i_stream, avi_entry_t *p_entry )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_index_create_t *p_create = p_opaque;
+
+    /* Don't update/check dialog too often */
+    if( p_create->p_dialog_id != NULL &&
+        vlc_tick_now() - p_create->i_dialog_update > 100000 )
+    {
+        if( vlc_dialog_is_cancelled( p_demux, p_create->p_dialog_id ) )
+            return false;
 
-print_stat:
-    if( p_dialog_id != NULL )
-        vlc_dialog_release( p_demux, p_dialog_id );
+        double f_current = vlc_stream_Tell( p_demux->s );
+        double f_size    = stream_Size( p_demux->s );
+        double f_pos     = f_current / f_size;
+        vlc_dialog_update_progress( p_demux, p_create->p_dialog_id, f_pos );
+
+        p_create->i_dialog_update = vlc_tick_now();
+    }
+
+    avi_index_Append( &p_sys->track[i_stream]->idx,
+                      &p_sys->i_movi_lastchunk_pos, p_entry );
+    return true;
+}
+
+static int AVI_IndexCreate( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    avi_chunk_list_t *p_riff;
+    avi_chunk_list_t *p_movi;
+
+    unsigned int i_stream;
+    uint32_t i_movi_end;
+
+    avi_index_create_t create = { .p_dialog_id = NULL };
+
+    p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
+    p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0, true );
+    if( !p_movi ) /* truncated file */
+        p_movi = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_movi, 0, true );
+
+    if( !p_movi )
+    {
+        msg_Err( p_demux, "cannot find p_movi" );
+        return VLC_EGENERIC;
+    }
+
+    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
+        avi_index_Init( &p_sys->track[i_stream]->idx );
+
+    i_movi_end = __MIN( (uint32_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
+                        stream_Size( p_demux->s ) );
+
+    vlc_stream_Seek( p_demux->s, p_movi->i_chunk_pos + 12 );
+    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
+
+
+    /* Only show dialog if AVI is > 10MB */
+    create.i_dialog_update = vlc_tick_now();
+    if( stream_Size( p_demux->s ) > 10000000 )
+    {
+        create.p_dialog_id =
+            vlc_dialog_display_progress( p_demux, false, 0.0, _("Cancel"),
+                                         _("Broken or missing AVI Index"),
+                                         _("Fixing AVI Index...") );
+    }
+
+    int i_ret = AVI_IndexScan( p_demux, p_demux->s, i_movi_end,
+                               AVI_IndexCreateAdd, &create );
+
+    if( create.p_dialog_id != NULL )
+        vlc_dialog_release( p_demux, create.p_dialog_id );
 
     for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
     {
         msg_Dbg( p_demux, "stream[%d] creating %d index entries",
                 i_stream, p_sys->track[i_stream]->idx.i_size );
     }
+    return i_ret;
+}
+
+/****************************************************************************
+ * Background index creation.
+ ****************************************************************************
+ * The movi list is scanned by a thread, with its own stream. It publishes
+ * the entries it finds by batches, that the demuxer merges into the track
+ * indexes between two demux or seek calls. Beyond the merged entries, the
+ * demuxer keeps indexing the chunks itself, as without index.
+ ****************************************************************************/
+#define AVI_INDEXER_BATCH 1024
+
+struct avi_indexer_t
+{
+    stream_t        *s;         /* only used by the thread */
+    uint64_t         i_movi_end;
+    vlc_thread_t     thread;
+    vlc_interrupt_t *p_interrupt;
+    demux_t         *p_demux;
+
+    avi_index_t     *p_local;   /* entries of the thread, not published */
+    unsigned         i_local;
+
+    vlc_mutex_t      lock;
+    avi_index_t     *p_pending; /* entries published, not merged */
+    bool             b_done;
+    bool             b_complete; /* the whole movi list was indexed */
+    atomic_bool      b_update;   /* p_pending or b_done changed */
+};
+
+static void AVI_IndexerPublish( avi_indexer_t *p_indexer, unsigned i_track )
+{
+    vlc_mutex_lock( &p_indexer->lock );
+    for( unsigned i = 0; i < i_track; i++ )
+    {
+        avi_index_t *p_local = &p_indexer->p_local[i];
+        avi_index_t *p_pending = &p_indexer->p_pending[i];
+
+        if( p_pending->i_size == 0 )
+        {
+            /* Hand over the whole array */
+            avi_index_Clean( p_pending );
+            *p_pending = *p_local;
+            avi_index_Init( p_local );
+        }
+        else
+        {
+            uint64_t i_last_pos = 0;
+            for( uint32_t j = 0; j < p_local->i_size; j++ )
+                avi_index_Append( p_pending, &i_last_pos, &p_local->p_entry[j] );
+            p_local->i_size = 0;
+        }
+    }
+    vlc_mutex_unlock( &p_indexer->lock );
+
+    p_indexer->i_local = 0;
+    atomic_store( &p_indexer->b_update, true );
+}
+
+static bool AVI_IndexerAdd( demux_t *p_demux, void *p_opaque,
+                            unsigned i_stream, avi_entry_t *p_entry )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer = p_opaque;
+    uint64_t i_last_pos = 0;
+
+    avi_index_Append( &p_indexer->p_local[i_stream], &i_last_pos, p_entry );
+    if( ++p_indexer->i_local >= AVI_INDEXER_BATCH )
+        AVI_IndexerPublish( p_indexer, p_sys->i_track );
+
+    return !vlc_killed();
+}
+
+static void *AVI_IndexerThread( void *p_data )
+{
+    avi_indexer_t *p_indexer = p_data;
+    demux_t *p_demux = p_indexer->p_demux;
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    vlc_interrupt_set( p_indexer->p_interrupt );
+
+    int i_ret = AVI_IndexScan( p_demux, p_indexer->s, p_indexer->i_movi_end,
+                               AVI_IndexerAdd, p_indexer );
+    AVI_IndexerPublish( p_indexer, p_sys->i_track );
+
+    vlc_mutex_lock( &p_indexer->lock );
+    p_indexer->b_done = true;
+    p_indexer->b_complete = i_ret == VLC_SUCCESS && !vlc_killed();
+    vlc_mutex_unlock( &p_indexer->lock );
+    atomic_store( &p_indexer->b_update, true );
+
+    return NULL;
+}
+
+static void AVI_IndexerDelete( demux_t *p_demux, avi_indexer_t *p_indexer )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_Clean( &p_indexer->p_local[i] );
+        avi_index_Clean( &p_indexer->p_pending[i] );
+    }
+    free( p_indexer->p_local );
+    free( p_indexer->p_pending );
+    if( p_indexer->p_interrupt )
+        vlc_interrupt_destroy( p_indexer->p_interrupt );
+    if( p_indexer->s )
+        vlc_stream_Delete( p_indexer->s );
+    free( p_indexer );
+}
+
+/* Starts creating the index in the background, from empty track indexes */
+static int AVI_IndexerStart( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    avi_chunk_list_t *p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
+    avi_chunk_list_t *p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0, true );
+    if( !p_movi ) /* truncated file */
+        p_movi = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_movi, 0, true );
+    if( !p_movi || p_demux->psz_url == NULL )
+        return VLC_EGENERIC;
+
+    avi_indexer_t *p_indexer = calloc( 1, sizeof(*p_indexer) );
+    if( unlikely(p_indexer == NULL) )
+        return VLC_ENOMEM;
+
+    p_indexer->p_demux = p_demux;
+    p_indexer->p_local = calloc( p_sys->i_track, sizeof(avi_index_t) );
+    p_indexer->p_pending = calloc( p_sys->i_track, sizeof(avi_index_t) );
+    p_indexer->p_interrupt = vlc_interrupt_create();
+    p_indexer->s = vlc_stream_NewURL( p_demux, p_demux->psz_url );
+    if( p_indexer->p_local == NULL || p_indexer->p_pending == NULL ||
+        p_indexer->p_interrupt == NULL || p_indexer->s == NULL ||
+        vlc_stream_Seek( p_indexer->s, p_movi->i_chunk_pos + 12 ) )
+    {
+        AVI_IndexerDelete( p_demux, p_indexer );
+        return VLC_EGENERIC;
+    }
+    p_indexer->i_movi_end = __MIN( (uint32_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
+                                   stream_Size( p_indexer->s ) );
+    vlc_mutex_init( &p_indexer->lock );
+    atomic_init( &p_indexer->b_update, false );
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_Clean( &p_sys->track[i]->idx );
+        avi_index_Init( &p_sys->track[i]->idx );
+    }
+    p_sys->i_movi_lastchunk_pos = 0;
+
+    if( vlc_clone( &p_indexer->thread, AVI_IndexerThread, p_indexer,
+                   VLC_THREAD_PRIORITY_LOW ) )
+    {
+        vlc_mutex_destroy( &p_indexer->lock );
+        AVI_IndexerDelete( p_demux, p_indexer );
+        return VLC_EGENERIC;
+    }
+
+    msg_Dbg( p_demux, "creating index from LIST-movi in the background" );
+    p_sys->p_indexer = p_indexer;
+    /* the broken index must not be loaded again */
+    p_sys->b_indexloaded = true;
+    return VLC_SUCCESS;
+}
+
+static void AVI_IndexerStop( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer = p_sys->p_indexer;
+
+    vlc_interrupt_kill( p_indexer->p_interrupt );
+    vlc_join( p_indexer->thread, NULL );
+    vlc_mutex_destroy( &p_indexer->lock );
+    AVI_IndexerDelete( p_demux, p_indexer );
+    p_sys->p_indexer = NULL;
+}
+
+/* Merges the entries published by the indexer into the track indexes */
+static void AVI_IndexerMerge( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_indexer_t *p_indexer = p_sys->p_indexer;
+
+    if( p_indexer == NULL ||
+        !atomic_exchange( &p_indexer->b_update, false ) )
+        return;
+
+    avi_index_t pending[p_sys->i_track];
+
+    vlc_mutex_lock( &p_indexer->lock );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        pending[i] = p_indexer->p_pending[i];
+        avi_index_Init( &p_indexer->p_pending[i] );
+    }
+    const bool b_done = p_indexer->b_done;
+    const bool b_complete = p_indexer->b_complete;
+    vlc_mutex_unlock( &p_indexer->lock );
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_t *p_index = &p_sys->track[i]->idx;
+
+        /* Skip the chunks the demuxer already indexed by itself */
+        for( uint32_t j = 0; j < pending[i].i_size; j++ )
+        {
+            if( p_index->i_size == 0 ||
+                pending[i].p_entry[j].i_pos >
+                    p_index->p_entry[p_index->i_size - 1].i_pos )
+                avi_index_Append( p_index, &p_sys->i_movi_lastchunk_pos,
+                                  &pending[i].p_entry[j] );
+        }
+        avi_index_Clean( &pending[i] );
+    }
+
+    if( b_done )
+    {
+        AVI_IndexerStop( p_demux );
+
+        for( unsigned i = 0; i < p_sys->i_track; i++ )
+            msg_Dbg( p_demux, "stream[%u] created %"PRIu32" index entries%s", i,
+                     p_sys->track[i]->idx.i_size, b_complete ? "" : " (partial)" );
+        p_sys->b_index_created = b_complete;
+        /* Open() could not check the audio tracks without their index */
+        if( b_complete )
+            AVI_FixBeOSTracks( p_demux );
+        p_sys->i_length = AVI_MovieGetLength( p_demux );
+    }
+}
+
+/* Fixes the audio rate of BeOS MediaKit generated files, from the index */
+static void AVI_FixBeOSTracks( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_chunk_list_t *p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0, true );
+    avi_chunk_list_t *p_hdrl = AVI_ChunkFind( p_riff, AVIFOURCC_hdrl, 0, true );
+    avi_chunk_avih_t *p_avih = AVI_ChunkFind( p_hdrl, AVIFOURCC_avih, 0, false );
+
+    if( p_avih == NULL )
+        return;
+
+    for( unsigned i = 0 ; i < p_sys->i_track; i++ )
+    {
+        avi_track_t         *tk = p_sys->track[i];
+        avi_chunk_list_t    *p_strl;
+        avi_chunk_strf_auds_t    *p_auds;
+
+        if( tk->fmt.i_cat != AUDIO_ES )
+        {
+            continue;
+        }
+        if( tk->idx.i_size < 1 ||
+            tk->i_scale != 1 ||
+            tk->i_samplesize != 0 )
+        {
+            continue;
+        }
+        p_strl = AVI_ChunkFind( p_hdrl, AVIFOURCC_strl, i, true );
+        p_auds = AVI_ChunkFind( p_strl, AVIFOURCC_strf, 0, false );
+
+        if( p_auds &&
+            p_auds->p_wf->wFormatTag != WAVE_FORMAT_PCM &&
+            tk->i_rate == p_auds->p_wf->nSamplesPerSec )
+        {
+            int64_t i_track_length =
+                tk->idx.p_entry[tk->idx.i_size-1].i_length +
+                tk->idx.p_entry[tk->idx.i_size-1].i_lengthtotal;
+            vlc_tick_t i_length = VLC_TICK_FROM_US( p_avih->i_totalframes *
+                                                    p_avih->i_microsecperframe );
+
+            if( i_length == 0 )
+            {
+                msg_Warn( p_demux, "track[%u] cannot be fixed (BeOS MediaKit generated)", i );
+                continue;
+            }
+            tk->i_samplesize = 1;
+            tk->i_rate       = i_track_length  * CLOCK_FREQ / i_length;
+            msg_Warn( p_demux, "track[%u] fixed with rate=%u scale=%u (BeOS MediaKit generated)", i, tk->i_rate, tk->i_scale );
+        }
+    }
+}
+
+/****************************************************************************
+ * Created index cache.
+ ****************************************************************************
+ * The index created for a local file is kept in a cache file, holding after
+ * the common header the track count, then for each track its entry count
+ * and its entries.
+ ****************************************************************************/
+#define AVI_INDEX_MAGIC   "VLCAVIIX"
+#define AVI_INDEX_VERSION 2
+
+typedef struct
+{
+    uint32_t i_tracks;
+    uint32_t i_reserved;
+} avi_index_header_t;
+
+typedef struct
+{
+    uint32_t i_fourcc; /* of the track es */
+    uint32_t i_entries;
+} avi_index_track_t;
+
+static_assert( sizeof(avi_index_header_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(avi_index_track_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(avi_entry_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+
+/* Loads the index created by a previous playback of the unchanged file */
+static int AVI_IndexCacheLoad( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const avi_index_header_t expected = { .i_tracks = p_sys->i_track };
+    avi_index_header_t header;
+
+    if( !p_sys->b_index_cache )
+    {
+        if( cachefile_Init( &p_sys->index_cache, "aviindex", AVI_INDEX_MAGIC,
+                            AVI_INDEX_VERSION, p_demux->psz_filepath,
+                            NULL, 0 ) )
+            return VLC_EGENERIC;
+        p_sys->b_index_cache = true;
+    }
+
+    block_t *p_block = cachefile_Load( VLC_OBJECT(p_demux),
+                                       &p_sys->index_cache );
+    if( p_block == NULL )
+        return VLC_EGENERIC;
+
+    const uint8_t *p_data = p_block->p_buffer;
+    size_t i_data = p_block->i_buffer;
+
+    if( i_data < sizeof(header) )
+        goto error;
+    memcpy( &header, p_data, sizeof(header) );
+    if( memcmp( &header, &expected, sizeof(header) ) )
+        goto error;
+    p_data += sizeof(header);
+    i_data -= sizeof(header);
+
+    /* Check every track before touching the indexes */
+    const uint8_t *p_track_data = p_data;
+    size_t i_track_data = i_data;
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_track_t track;
+        if( i_track_data < sizeof(track) )
+            goto error;
+        memcpy( &track, p_track_data, sizeof(track) );
+        if( track.i_fourcc != p_sys->track[i]->fmt.i_codec ||
+            track.i_entries > (i_track_data - sizeof(track)) / sizeof(avi_entry_t) )
+            goto error;
+        p_track_data += sizeof(track) + track.i_entries * sizeof(avi_entry_t);
+        i_track_data -= sizeof(track) + track.i_entries * sizeof(avi_entry_t);
+    }
+
+    p_sys->i_movi_lastchunk_pos = 0;
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_t *p_index = &p_sys->track[i]->idx;
+        avi_index_track_t track;
+
+        memcpy( &track, p_data, sizeof(track) );
+        p_data += sizeof(track);
+
+        avi_index_Clean( p_index );
+        avi_index_Init( p_index );
+        for( uint32_t j = 0; j < track.i_entries; j++ )
+        {
+            avi_entry_t entry;
+            memcpy( &entry, p_data, sizeof(entry) );
+            p_data += sizeof(entry);
+            avi_index_Append( p_index, &p_sys->i_movi_lastchunk_pos, &entry );
+        }
+        msg_Dbg( p_demux, "stream[%u] loaded %"PRIu32" cached index entries",
+                 i, p_index->i_size );
+    }
+
+    block_Release( p_block );
+    p_sys->b_indexloaded = true;
+    return VLC_SUCCESS;
+
+error:
+    msg_Dbg( p_demux, "ignoring stale index cache" );
+    block_Release( p_block );
+    return VLC_EGENERIC;
+}
+
+/* Stores the created index */
+static void AVI_IndexCacheSave( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const avi_index_header_t header = { .i_tracks = p_sys->i_track };
+
+    FILE *file = cachefile_Create( VLC_OBJECT(p_demux), &p_sys->index_cache );
+    if( file == NULL )
+        return;
+
+    int i_ret = cachefile_Write( file, &header, sizeof(header) );
+    for( unsigned i = 0; i < p_sys->i_track && i_ret == 0; i++ )
+    {
+        const avi_index_t *p_index = &p_sys->track[i]->idx;
+        const avi_index_track_t track = {
+            .i_fourcc = p_sys->track[i]->fmt.i_codec,
+            .i_entries = p_index->i_size,
+        };
+        i_ret = cachefile_Write( file, &track, sizeof(track) ) ||
+                cachefile_Write( file, p_index->p_entry,
+                                 p_index->i_size * sizeof(avi_entry_t) );
+    }
+
+    cachefile_Commit( VLC_OBJECT(p_demux), &p_sys->index_cache, file,
+                      i_ret == 0 );
 }
 
 /* */
@@ -0,0 +1,220 @@
+/*****************************************************************************
+ * cachefile.c: cache files of local media files
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_configuration.h>
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+
+#include "cachefile.h"
+
+#define CACHEFILE_ENDIAN 0x01020304
+
+static_assert( sizeof(cachefile_header_t) % CACHEFILE_ALIGN == 0,
+               "misaligned" );
+
+static char *cachefile_Path( const char *psz_dir, const char *psz_filepath,
+                             const void *p_key, size_t i_key )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    if( psz_cachedir == NULL )
+        return NULL;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, psz_filepath, strlen( psz_filepath ) );
+    if( i_key > 0 )
+        AddMD5( &md5, p_key, i_key );
+    EndMD5( &md5 );
+    char *psz_hash = psz_md5_hash( &md5 );
+
+    char *psz_path;
+    if( psz_hash == NULL ||
+        asprintf( &psz_path, "%s" DIR_SEP "%s" DIR_SEP "%s",
+                  psz_cachedir, psz_dir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_hash );
+    free( psz_cachedir );
+    return psz_path;
+}
+
+int cachefile_Init( cachefile_t *p_cache, const char *psz_dir,
+                    const char *psz_magic, uint32_t i_version,
+                    const char *psz_filepath, const void *p_key, size_t i_key )
+{
+    struct stat st;
+
+    memset( p_cache, 0, sizeof(*p_cache) );
+    if( psz_filepath == NULL || vlc_stat( psz_filepath, &st ) ||
+        !S_ISREG( st.st_mode ) || strlen( psz_filepath ) > UINT32_MAX )
+        return VLC_EGENERIC;
+
+    p_cache->psz_filepath = strdup( psz_filepath );
+    p_cache->psz_cachepath = cachefile_Path( psz_dir, psz_filepath,
+                                             p_key, i_key );
+    if( p_cache->psz_filepath == NULL || p_cache->psz_cachepath == NULL )
+    {
+        cachefile_Clean( p_cache );
+        return VLC_ENOMEM;
+    }
+
+    cachefile_header_t *p_header = &p_cache->header;
+    memcpy( p_header->magic, psz_magic, sizeof(p_header->magic) );
+    p_header->i_version = i_version;
+    p_header->i_endian = CACHEFILE_ENDIAN;
+    p_header->i_file_size = st.st_size;
+    p_header->i_file_mtime = st.st_mtime;
+    p_header->i_path_length = strlen( psz_filepath );
+    return VLC_SUCCESS;
+}
+
+void cachefile_Clean( cachefile_t *p_cache )
+{
+    free( p_cache->psz_tmppath );
+    free( p_cache->psz_cachepath );
+    free( p_cache->psz_filepath );
+}
+
+block_t *cachefile_Load( vlc_object_t *p_obj, const cachefile_t *p_cache )
+{
+    block_t *p_block = block_FilePath( p_cache->psz_cachepath, false );
+    if( p_block == NULL )
+        return NULL;
+
+    const size_t i_path = p_cache->header.i_path_length;
+    const size_t i_head = sizeof(cachefile_header_t) + cachefile_Pad( i_path );
+
+    if( p_block->i_buffer < i_head ||
+        memcmp( p_block->p_buffer, &p_cache->header,
+                sizeof(cachefile_header_t) ) ||
+        memcmp( &p_block->p_buffer[sizeof(cachefile_header_t)],
+                p_cache->psz_filepath, i_path ) )
+    {
+        msg_Dbg( p_obj, "ignoring stale cache file %s",
+                 p_cache->psz_cachepath );
+        block_Release( p_block );
+        return NULL;
+    }
+
+    p_block->p_buffer += i_head;
+    p_block->i_buffer -= i_head;
+    return p_block;
+}
+
+int cachefile_Write( FILE *file, const void *p_data, size_t i_data )
+{
+    if( i_data == 0 )
+        return 0;
+    return fwrite( p_data, 1, i_data, file ) == i_data ? 0 : -1;
+}
+
+FILE *cachefile_Create( vlc_object_t *p_obj, cachefile_t *p_cache )
+{
+    const cachefile_header_t *p_header = &p_cache->header;
+    struct stat st;
+
+    /* The data would not match the file if it changed during the playback */
+    if( vlc_stat( p_cache->psz_filepath, &st ) ||
+        (uint64_t)st.st_size != p_header->i_file_size ||
+        (int64_t)st.st_mtime != p_header->i_file_mtime )
+        return NULL;
+
+    /* Create the parent directories */
+    char *psz_cachepath = p_cache->psz_cachepath;
+    for( char *psz = strchr( psz_cachepath + 1, DIR_SEP_CHAR ); psz != NULL;
+         psz = strchr( psz + 1, DIR_SEP_CHAR ) )
+    {
+        *psz = '\0';
+        vlc_mkdir( psz_cachepath, 0700 );
+        *psz = DIR_SEP_CHAR;
+    }
+
+    assert( p_cache->psz_tmppath == NULL );
+    if( asprintf( &p_cache->psz_tmppath, "%s.XXXXXX", psz_cachepath ) == -1 )
+    {
+        p_cache->psz_tmppath = NULL;
+        return NULL;
+    }
+
+    int fd = vlc_mkstemp( p_cache->psz_tmppath );
+    if( fd == -1 )
+    {
+        msg_Warn( p_obj, "cannot create %s: %s", p_cache->psz_tmppath,
+                  vlc_strerror_c(errno) );
+        goto error;
+    }
+
+    FILE *file = fdopen( fd, "wb" );
+    if( file == NULL )
+    {
+        vlc_close( fd );
+        goto error_unlink;
+    }
+
+    static const uint8_t padding[CACHEFILE_ALIGN];
+    const size_t i_path = p_header->i_path_length;
+
+    if( cachefile_Write( file, p_header, sizeof(*p_header) ) ||
+        cachefile_Write( file, p_cache->psz_filepath, i_path ) ||
+        cachefile_Write( file, padding, cachefile_Pad( i_path ) - i_path ) )
+    {
+        fclose( file );
+        goto error_unlink;
+    }
+    return file;
+
+error_unlink:
+    msg_Warn( p_obj, "cannot write %s", p_cache->psz_tmppath );
+    vlc_unlink( p_cache->psz_tmppath );
+error:
+    free( p_cache->psz_tmppath );
+    p_cache->psz_tmppath = NULL;
+    return NULL;
+}
+
+void cachefile_Commit( vlc_object_t *p_obj, cachefile_t *p_cache, FILE *file,
+                       bool b_ok )
+{
+    if( fclose( file ) || !b_ok )
+    {
+        msg_Warn( p_obj, "cannot write %s", p_cache->psz_tmppath );
+        vlc_unlink( p_cache->psz_tmppath );
+    }
+    else
+    {
+        msg_Dbg( p_obj, "saved cache file %s", p_cache->psz_cachepath );
+#if defined( _WIN32 ) || defined( __OS2__ )
+        vlc_unlink( p_cache->psz_cachepath );
+#endif
+        if( vlc_rename( p_cache->psz_tmppath, p_cache->psz_cachepath ) )
+            vlc_unlink( p_cache->psz_tmppath );
+    }
+    free( p_cache->psz_tmppath );
+    p_cache->psz_tmppath = NULL;
+}
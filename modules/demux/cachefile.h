@@ -0,0 +1,114 @@
+/*****************************************************************************
+ * cachefile.h: cache files of local media files
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_DEMUX_CACHEFILE_H_
+#define VLC_DEMUX_CACHEFILE_H_
+
+#include <stdio.h>
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/* Data computed from a local media file, such as an index, can be kept in a
+ * file of the user cache directory, named after the media file path, and
+ * reused while the size and modification time of the media file match.
+ *
+ * Cache files are made of naturally aligned, host endian records: a common
+ * header, the media file path padded to 8 bytes, then the records of the
+ * demuxer, which must keep them aligned to 8 bytes. */
+#define CACHEFILE_ALIGN 8
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t i_version;
+    uint32_t i_endian;
+    uint64_t i_file_size;
+    int64_t  i_file_mtime;
+    uint32_t i_path_length;
+    uint32_t i_reserved;
+} cachefile_header_t;
+
+typedef struct
+{
+    char               *psz_filepath;
+    char               *psz_cachepath;
+    char               *psz_tmppath; /* while being written */
+    cachefile_header_t  header; /* expected from the media file */
+} cachefile_t;
+
+static inline size_t cachefile_Pad( size_t i_size )
+{
+    return (i_size + CACHEFILE_ALIGN - 1) & ~(size_t)(CACHEFILE_ALIGN - 1);
+}
+
+/**
+ * Looks the media file up.
+ *
+ * \param psz_dir subdirectory of the user cache directory
+ * \param psz_magic 8 characters identifying the format of the cache file
+ * \param p_key data telling apart several cache files of a media file
+ * (or NULL)
+ * \return VLC_SUCCESS, or an error if the media file is not a local regular
+ * file
+ */
+int cachefile_Init( cachefile_t *, const char *psz_dir, const char *psz_magic,
+                    uint32_t i_version, const char *psz_filepath,
+                    const void *p_key, size_t i_key );
+void cachefile_Clean( cachefile_t * );
+
+/**
+ * Maps the cache file.
+ *
+ * \return the cache file, from the records of the demuxer on, or NULL if
+ * there is none or if it does not match the media file
+ */
+block_t *cachefile_Load( vlc_object_t *, const cachefile_t * );
+
+/**
+ * Starts writing the cache file, unless the media file changed since
+ * cachefile_Init().
+ *
+ * The file is written under a unique temporary name, and only replaces the
+ * cache file in cachefile_Commit(), so that other readers or writers never
+ * see it incomplete.
+ *
+ * \return a file to write the records of the demuxer to, or NULL
+ */
+FILE *cachefile_Create( vlc_object_t *, cachefile_t * );
+
+/**
+ * Writes to the cache file.
+ *
+ * \return 0 on success, -1 on error
+ */
+int cachefile_Write( FILE *, const void *p_data, size_t i_data );
+
+/**
+ * Closes the cache file, and makes it the current one if b_ok is true and
+ * no error occurred, or discards it.
+ */
+void cachefile_Commit( vlc_object_t *, cachefile_t *, FILE *, bool b_ok );
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif
@@ -32,6 +32,10 @@
 #include <new>
 #include <iterator>
 
+/* Cues further apart than this, in ms like i_duration, are completed by
+ * indexing the clusters in the background */
+#define MKV_SPARSE_CUES_INTERVAL 10000
+
 matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estream, KaxSegment *p_seg )
     :segment(p_seg)
     ,es(estream)
@@ -66,6 +70,8 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
 
 matroska_segment_c::~matroska_segment_c()
 {
+    _seeker.save_cache( *this );
+
     free( psz_writing_application );
     free( psz_muxing_application );
     free( psz_segment_filename );
@@ -789,6 +795,38 @@ bool matroska_segment_c::LoadSeekHeadItem( const EbmlCallbacks & ClassInfos, int
     return true;
 }
 
+/* Reuses the seekpoints found during a previous playback, and looks for
+ * the missing ones in the background if the Cues are missing or sparse */
+void matroska_segment_c::InitSeekpoints()
+{
+    if( !b_preloaded || cluster == NULL )
+        return;
+
+    if( var_InheritBool( &sys.demuxer, "mkv-seek-cache" ) )
+        _seeker.load_cache( *this, sys.demuxer.psz_filepath );
+
+    if( !sys.b_fastseekable ||
+        !var_InheritBool( &sys.demuxer, "mkv-seek-index-background" ) )
+        return;
+
+    if( b_cues && !priority_tracks.empty() )
+    {
+        SegmentSeeker::tracks_seekpoints_t::const_iterator it =
+            _seeker._tracks_seekpoints.find( priority_tracks[0] );
+        int64_t i_cue_points = it != _seeker._tracks_seekpoints.end() ? it->second.size() : 0;
+
+        if( i_duration <= 0 || i_cue_points * MKV_SPARSE_CUES_INTERVAL >= i_duration )
+            return;
+    }
+
+    _seeker.start_indexing( *this, sys.demuxer.psz_url );
+}
+
+void matroska_segment_c::UpdateSeekpoints()
+{
+    _seeker.merge_indexed( *this );
+}
+
 bool matroska_segment_c::Seek( demux_t &demuxer, vlc_tick_t i_absolute_mk_date, vlc_tick_t i_mk_time_offset, bool b_accurate )
 {
     SegmentSeeker::tracks_seekpoint_t seekpoints;
@@ -835,6 +873,8 @@ bool matroska_segment_c::Seek( demux_t &demuxer, vlc_tick_t i_absolute_mk_date,
 
     // find appropriate seekpoints //
 
+    UpdateSeekpoints();
+
     try {
         seekpoints = _seeker.get_seekpoints( *this, i_mk_date, priority, selected_tracks );
     }
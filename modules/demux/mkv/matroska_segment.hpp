@@ -142,6 +142,8 @@ public:
     bool PreloadClusters( uint64 i_cluster_position );
     void InformationCreate();
 
+    void InitSeekpoints();
+    void UpdateSeekpoints();
     bool Seek( demux_t &, vlc_tick_t i_mk_date, vlc_tick_t i_mk_time_offset, bool b_accurate );
 
     int BlockGet( KaxBlock * &, KaxSimpleBlock * &, bool *, bool *, int64_t *);
@@ -29,8 +29,13 @@
 #include "util.hpp"
 #include "stream_io_callback.hpp"
 
+#include <vlc_block.h>
+#include <vlc_interrupt.h>
+
 #include <sstream>
 #include <limits>
+#include <atomic>
+#include <new>
 
 namespace { 
     template<class It, class T>
@@ -49,6 +54,20 @@ namespace {
     template<class It> It next_( It it ) { return ++it; }
 }
 
+SegmentSeeker::SegmentSeeker()
+    : _indexer( NULL )
+    , _cache_set( false )
+    , _modified( false )
+{
+}
+
+SegmentSeeker::~SegmentSeeker()
+{
+    stop_indexing();
+    if( _cache_set )
+        cachefile_Clean( &_cache );
+}
+
 SegmentSeeker::cluster_positions_t::iterator
 SegmentSeeker::add_cluster_position( fptr_t fpos )
 {
@@ -58,6 +77,9 @@ SegmentSeeker::add_cluster_position( fptr_t fpos )
       fpos
     );
 
+    if( insertion_point != _cluster_positions.begin() && *prev_( insertion_point ) == fpos )
+        return prev_( insertion_point ); // already known
+
     return _cluster_positions.insert( insertion_point, fpos );
 }
 
@@ -73,6 +95,12 @@ SegmentSeeker::add_cluster( KaxCluster * const p_cluster )
             : UINT64_MAX
     };
 
+    return add_cluster( cinfo );
+}
+
+SegmentSeeker::cluster_map_t::iterator
+SegmentSeeker::add_cluster( Cluster const& cinfo )
+{
     add_cluster_position( cinfo.fpos );
 
     cluster_map_t::iterator it = _clusters.lower_bound( cinfo.pts );
@@ -84,6 +112,7 @@ SegmentSeeker::add_cluster( KaxCluster * const p_cluster )
     else
     {
         it = _clusters.insert( cluster_map_t::value_type( cinfo.pts, cinfo ) ).first;
+        _modified = true;
     }
 
     // ------------------------------------------------------------------
@@ -128,6 +157,8 @@ SegmentSeeker::add_seekpoint( track_id_t track_id, Seekpoint sp )
     {
         seekpoints.insert( it, sp );
     }
+
+    _modified = true;
 }
 
 SegmentSeeker::tracks_seekpoint_t
@@ -421,6 +452,8 @@ SegmentSeeker::mark_range_as_searched( Range data )
 
         _ranges_searched = merged;
     }
+
+    _modified = true;
 }
 
 
@@ -521,3 +554,763 @@ SegmentSeeker::mkv_jump_to( matroska_segment_c& ms, fptr_t fpos )
         ms.es.I_O().setFilePointer( fpos );
 }
 
+
+/*****************************************************************************
+ * Background indexing
+ *****************************************************************************
+ * The clusters of the segment are walked with a minimal EBML reader, from a
+ * stream of its own, by a low priority thread. The cluster timestamps, the
+ * keyframes and the ranges searched are handed over in batches, and merged
+ * by the demux thread as if index_unsearched_range() had found them.
+ *****************************************************************************/
+namespace {
+    enum {
+        MKV_ID_CLUSTER        = 0x1F43B675,
+        MKV_ID_TIMECODE       = 0xE7,
+        MKV_ID_SIMPLEBLOCK    = 0xA3,
+        MKV_ID_BLOCKGROUP     = 0xA0,
+        MKV_ID_BLOCK          = 0xA1,
+        MKV_ID_REFERENCEBLOCK = 0xFB,
+    };
+
+    // clusters scanned between two batches
+    const unsigned MKV_INDEXER_BATCH = 64;
+
+    // elements which end a cluster of unknown size
+    bool is_level1_id( uint32_t id )
+    {
+        switch( id )
+        {
+            case 0x1F43B675: // Cluster
+            case 0x1C53BB6B: // Cues
+            case 0x114D9B74: // SeekHead
+            case 0x1549A966: // Info
+            case 0x1654AE6B: // Tracks
+            case 0x1043A770: // Chapters
+            case 0x1941A469: // Attachments
+            case 0x1254C367: // Tags
+            case 0x18538067: // Segment
+            case 0x1A45DFA3: // EBML
+                return true;
+        }
+        return false;
+    }
+
+    unsigned vint_length( uint8_t first )
+    {
+        for( unsigned i = 0; i < 8; i++ )
+        {
+            if( first & ( 0x80 >> i ) )
+                return i + 1;
+        }
+        return 0;
+    }
+}
+
+class SegmentSeeker::Indexer
+{
+    public:
+        struct Entry
+        {
+            track_id_t track_id;
+            Seekpoint  seekpoint;
+        };
+
+        struct Batch
+        {
+            std::vector<Cluster> clusters;
+            std::vector<Entry>   seekpoints;
+            ranges_t             ranges;
+        };
+
+        Indexer( stream_t *, uint64_t timescale, Range area,
+                 ranges_t const& searched, track_ids_t const& theora_tracks );
+        ~Indexer();
+
+        bool start();
+        void stop();
+        bool take( Batch&, bool * pb_done );
+
+    private:
+        static void *thread_main( void * );
+        void run();
+        fptr_t scan_cluster( fptr_t fpos, fptr_t data, fptr_t end, bool b_unknown_size );
+        void scan_block_group( fptr_t data, fptr_t end, uint64_t timecode );
+        void add_range( fptr_t start, fptr_t end );
+        bool read_element( uint32_t * pi_id, uint64_t * pi_size, bool * pb_unknown_size );
+        bool read_vint( uint64_t * pi_value, bool * pb_all_ones );
+        bool read_block_header( track_id_t *, int16_t * pi_timecode, uint8_t * pi_flags );
+        bool is_searched( fptr_t start, fptr_t end ) const;
+        vlc_tick_t block_pts( uint64_t timecode, int16_t i_block_timecode ) const;
+        void publish( bool b_done );
+
+        stream_t        * _s;
+        vlc_interrupt_t * _interrupt;
+        vlc_thread_t      _thread;
+        bool              _started;
+        uint64_t          _timescale;
+        Range             _area;
+        ranges_t          _searched;
+        track_ids_t       _theora_tracks;
+
+        Batch             _local; // not published yet, used by the thread only
+        unsigned          _local_clusters;
+
+        vlc_mutex_t       _lock;
+        Batch             _pending;
+        bool              _done;
+        std::atomic<bool> _update;
+};
+
+SegmentSeeker::Indexer::Indexer( stream_t *s, uint64_t timescale, Range area,
+                                 ranges_t const& searched, track_ids_t const& theora_tracks )
+    : _s( s )
+    , _interrupt( vlc_interrupt_create() )
+    , _started( false )
+    , _timescale( timescale )
+    , _area( area )
+    , _searched( searched )
+    , _theora_tracks( theora_tracks )
+    , _local_clusters( 0 )
+    , _done( false )
+    , _update( false )
+{
+    vlc_mutex_init( &_lock );
+}
+
+SegmentSeeker::Indexer::~Indexer()
+{
+    stop();
+    vlc_mutex_destroy( &_lock );
+    if( _interrupt )
+        vlc_interrupt_destroy( _interrupt );
+    vlc_stream_Delete( _s );
+}
+
+bool SegmentSeeker::Indexer::start()
+{
+    if( _interrupt == NULL )
+        return false;
+
+    _started = !vlc_clone( &_thread, thread_main, this, VLC_THREAD_PRIORITY_LOW );
+    return _started;
+}
+
+void SegmentSeeker::Indexer::stop()
+{
+    if( !_started )
+        return;
+
+    vlc_interrupt_kill( _interrupt );
+    vlc_join( _thread, NULL );
+    _started = false;
+}
+
+bool SegmentSeeker::Indexer::take( Batch& batch, bool * pb_done )
+{
+    if( !_update.exchange( false ) )
+        return false;
+
+    vlc_mutex_locker locker( &_lock );
+
+    std::swap( batch, _pending );
+    *pb_done = _done;
+    return true;
+}
+
+void SegmentSeeker::Indexer::publish( bool b_done )
+{
+    {
+        vlc_mutex_locker locker( &_lock );
+
+        _pending.clusters.insert( _pending.clusters.end(),
+                                  _local.clusters.begin(), _local.clusters.end() );
+        _pending.seekpoints.insert( _pending.seekpoints.end(),
+                                    _local.seekpoints.begin(), _local.seekpoints.end() );
+        _pending.ranges.insert( _pending.ranges.end(),
+                                _local.ranges.begin(), _local.ranges.end() );
+        _done = b_done;
+    }
+
+    _local = Batch();
+    _local_clusters = 0;
+    _update.store( true );
+}
+
+void *SegmentSeeker::Indexer::thread_main( void * p_data )
+{
+    Indexer *p_indexer = static_cast<Indexer *>( p_data );
+
+    vlc_interrupt_set( p_indexer->_interrupt );
+    p_indexer->run();
+    p_indexer->publish( true );
+    return NULL;
+}
+
+void SegmentSeeker::Indexer::run()
+{
+    fptr_t fpos = _area.start;
+
+    while( fpos < _area.end && !vlc_killed() )
+    {
+        uint32_t id;
+        uint64_t size;
+        bool     b_unknown_size;
+
+        if( vlc_stream_Seek( _s, fpos ) || !read_element( &id, &size, &b_unknown_size ) )
+            break;
+
+        fptr_t const data = vlc_stream_Tell( _s );
+        fptr_t next;
+
+        if( id == MKV_ID_CLUSTER )
+        {
+            fptr_t const end = b_unknown_size ? _area.end : std::min( data + size, _area.end );
+
+            if( !b_unknown_size && is_searched( fpos, end ) )
+                next = end;
+            else
+                next = scan_cluster( fpos, data, end, b_unknown_size );
+
+            if( ++_local_clusters >= MKV_INDEXER_BATCH )
+                publish( false );
+        }
+        else if( !b_unknown_size )
+        {
+            next = std::min( data + size, _area.end ); // Cues, Tags, Void...
+            add_range( fpos, next );
+        }
+        else
+            break;
+
+        if( next <= fpos )
+            break;
+        fpos = next;
+    }
+}
+
+SegmentSeeker::fptr_t
+SegmentSeeker::Indexer::scan_cluster( fptr_t fpos, fptr_t data, fptr_t end, bool b_unknown_size )
+{
+    uint64_t timecode = 0;
+    bool     b_timecode = false;
+    fptr_t   pos = data;
+
+    while( pos < end )
+    {
+        uint32_t id;
+        uint64_t size;
+        bool     b_unknown_child_size;
+
+        if( vlc_stream_Seek( _s, pos ) ||
+            !read_element( &id, &size, &b_unknown_child_size ) ||
+            ( b_unknown_size && is_level1_id( id ) ) )
+        {
+            end = pos;
+            break;
+        }
+
+        fptr_t const child = vlc_stream_Tell( _s );
+
+        if( b_unknown_child_size || child > end || size > end - child )
+        {
+            end = pos; // broken cluster
+            break;
+        }
+
+        switch( id )
+        {
+            case MKV_ID_TIMECODE:
+            {
+                uint8_t buf[8];
+
+                if( size > sizeof( buf ) || vlc_stream_Read( _s, buf, size ) != ssize_t( size ) )
+                    break;
+
+                timecode = 0;
+                for( uint64_t i = 0; i < size; i++ )
+                    timecode = ( timecode << 8 ) | buf[i];
+                b_timecode = true;
+
+                Cluster cinfo = {
+                    /* fpos     */ fpos,
+                    /* pts      */ vlc_tick_t( timecode * _timescale / INT64_C( 1000 ) ),
+                    /* duration */ vlc_tick_t( -1 ),
+                    /* size     */ b_unknown_size ? UINT64_MAX : end - fpos
+                };
+                _local.clusters.push_back( cinfo );
+                break;
+            }
+            case MKV_ID_SIMPLEBLOCK:
+            {
+                track_id_t track_id;
+                int16_t    i_block_timecode;
+                uint8_t    i_flags;
+
+                if( b_timecode && read_block_header( &track_id, &i_block_timecode, &i_flags ) &&
+                    ( i_flags & 0x80 ) )
+                {
+                    Entry entry = { track_id, Seekpoint( pos, block_pts( timecode, i_block_timecode ) ) };
+                    _local.seekpoints.push_back( entry );
+                }
+                break;
+            }
+            case MKV_ID_BLOCKGROUP:
+                if( b_timecode )
+                    scan_block_group( child, child + size, timecode );
+                break;
+        }
+
+        if( vlc_killed() )
+        {
+            end = pos; // the element may have been read partially
+            break;
+        }
+
+        pos = child + size;
+    }
+
+    add_range( fpos, end );
+    return end;
+}
+
+void
+SegmentSeeker::Indexer::scan_block_group( fptr_t data, fptr_t end, uint64_t timecode )
+{
+    fptr_t     block_pos = 0;
+    track_id_t track_id = 0;
+    int16_t    i_block_timecode = 0;
+    bool       b_block = false;
+    bool       b_key_picture = true;
+
+    for( fptr_t pos = data; pos < end; )
+    {
+        uint32_t id;
+        uint64_t size;
+        bool     b_unknown_size;
+
+        if( vlc_stream_Seek( _s, pos ) || !read_element( &id, &size, &b_unknown_size ) ||
+            b_unknown_size )
+            return;
+
+        fptr_t const child = vlc_stream_Tell( _s );
+
+        if( id == MKV_ID_BLOCK )
+        {
+            uint8_t i_flags;
+
+            if( !read_block_header( &track_id, &i_block_timecode, &i_flags ) )
+                return;
+            block_pos = pos;
+            b_block = true;
+
+            /* if the second bit of a Theora frame is 1 it's not a keyframe */
+            if( ( i_flags & 0x06 ) == 0 &&
+                std::find( _theora_tracks.begin(), _theora_tracks.end(), track_id ) != _theora_tracks.end() )
+            {
+                uint8_t i_first;
+                if( vlc_stream_Read( _s, &i_first, 1 ) != 1 || ( i_first & 0x40 ) )
+                    b_key_picture = false;
+            }
+        }
+        else if( id == MKV_ID_REFERENCEBLOCK )
+            b_key_picture = false;
+
+        pos = child + size;
+    }
+
+    if( b_block && b_key_picture )
+    {
+        Entry entry = { track_id, Seekpoint( block_pos, block_pts( timecode, i_block_timecode ) ) };
+        _local.seekpoints.push_back( entry );
+    }
+}
+
+void SegmentSeeker::Indexer::add_range( fptr_t start, fptr_t end )
+{
+    if( end <= start )
+        return;
+
+    if( !_local.ranges.empty() && _local.ranges.back().end + 1 >= start )
+        _local.ranges.back().end = std::max( _local.ranges.back().end, end );
+    else
+        _local.ranges.push_back( Range( start, end ) );
+}
+
+bool SegmentSeeker::Indexer::read_element( uint32_t * pi_id, uint64_t * pi_size, bool * pb_unknown_size )
+{
+    uint8_t buf[4];
+
+    if( vlc_stream_Read( _s, buf, 1 ) != 1 )
+        return false;
+
+    unsigned const len = vint_length( buf[0] );
+    if( len == 0 || len > sizeof( buf ) ||
+        ( len > 1 && vlc_stream_Read( _s, &buf[1], len - 1 ) != ssize_t( len - 1 ) ) )
+        return false;
+
+    *pi_id = 0;
+    for( unsigned i = 0; i < len; i++ )
+        *pi_id = ( *pi_id << 8 ) | buf[i];
+
+    return read_vint( pi_size, pb_unknown_size );
+}
+
+bool SegmentSeeker::Indexer::read_vint( uint64_t * pi_value, bool * pb_all_ones )
+{
+    uint8_t buf[8];
+
+    if( vlc_stream_Read( _s, buf, 1 ) != 1 )
+        return false;
+
+    unsigned const len = vint_length( buf[0] );
+    if( len == 0 ||
+        ( len > 1 && vlc_stream_Read( _s, &buf[1], len - 1 ) != ssize_t( len - 1 ) ) )
+        return false;
+
+    uint64_t value = buf[0] & ( 0xFF >> len );
+    bool b_all_ones = value == uint64_t( 0xFF >> len );
+
+    for( unsigned i = 1; i < len; i++ )
+    {
+        value = ( value << 8 ) | buf[i];
+        b_all_ones &= buf[i] == 0xFF;
+    }
+
+    *pi_value = value;
+    if( pb_all_ones )
+        *pb_all_ones = b_all_ones;
+    return true;
+}
+
+bool SegmentSeeker::Indexer::read_block_header( track_id_t * p_track_id, int16_t * pi_timecode,
+                                                uint8_t * pi_flags )
+{
+    uint64_t track_id;
+    uint8_t  buf[3];
+
+    if( !read_vint( &track_id, NULL ) || vlc_stream_Read( _s, buf, 3 ) != 3 )
+        return false;
+
+    *p_track_id  = track_id;
+    *pi_timecode = int16_t( GetWBE( buf ) );
+    *pi_flags    = buf[2];
+    return true;
+}
+
+bool SegmentSeeker::Indexer::is_searched( fptr_t start, fptr_t end ) const
+{
+    ranges_t::const_iterator it = greatest_lower_bound( _searched.begin(), _searched.end(), Range( start, end ) );
+
+    return it != _searched.end() && it->start <= start && it->end >= end;
+}
+
+vlc_tick_t SegmentSeeker::Indexer::block_pts( uint64_t timecode, int16_t i_block_timecode ) const
+{
+    return vlc_tick_t( ( int64_t( timecode ) + i_block_timecode ) * int64_t( _timescale ) / INT64_C( 1000 ) );
+}
+
+bool
+SegmentSeeker::start_indexing( matroska_segment_c& ms, const char * psz_url )
+{
+    if( _indexer != NULL || ms.cluster == NULL || psz_url == NULL )
+        return false;
+
+    stream_t *s = vlc_stream_NewURL( &ms.sys.demuxer, psz_url );
+    if( s == NULL )
+        return false;
+
+    Range area( ms.cluster->GetElementPosition(), stream_Size( s ) );
+
+    if( ms.segment->IsFiniteSize() )
+        area.end = std::min<fptr_t>( area.end, ms.segment->GetEndPosition() );
+
+    if( get_search_areas( area.start, area.end ).empty() )
+    {
+        vlc_stream_Delete( s );
+        return false; // every cluster was searched already
+    }
+
+    track_ids_t theora_tracks;
+
+    for( matroska_segment_c::tracks_map_t::const_iterator it = ms.tracks.begin(); it != ms.tracks.end(); ++it )
+    {
+        if( it->second->fmt.i_codec == VLC_CODEC_THEORA )
+            theora_tracks.push_back( it->first );
+    }
+
+    _indexer = new (std::nothrow) Indexer( s, ms.i_timescale, area, _ranges_searched, theora_tracks );
+    if( _indexer == NULL )
+    {
+        vlc_stream_Delete( s );
+        return false;
+    }
+
+    if( !_indexer->start() )
+    {
+        delete _indexer;
+        _indexer = NULL;
+        return false;
+    }
+
+    msg_Dbg( &ms.sys.demuxer, "indexing clusters from %" PRIu64 " in the background", area.start );
+    return true;
+}
+
+void
+SegmentSeeker::stop_indexing()
+{
+    delete _indexer;
+    _indexer = NULL;
+}
+
+void
+SegmentSeeker::merge_indexed( matroska_segment_c& ms )
+{
+    Indexer::Batch batch;
+    bool b_done;
+
+    if( _indexer == NULL || !_indexer->take( batch, &b_done ) )
+        return;
+
+    for( std::vector<Cluster>::const_iterator it = batch.clusters.begin(); it != batch.clusters.end(); ++it )
+        add_cluster( *it );
+
+    for( std::vector<Indexer::Entry>::const_iterator it = batch.seekpoints.begin(); it != batch.seekpoints.end(); ++it )
+    {
+        if( ms.tracks.find( it->track_id ) != ms.tracks.end() )
+            add_seekpoint( it->track_id, it->seekpoint );
+    }
+
+    for( ranges_t::const_iterator it = batch.ranges.begin(); it != batch.ranges.end(); ++it )
+        mark_range_as_searched( *it );
+
+    if( b_done )
+    {
+        stop_indexing();
+        msg_Dbg( &ms.sys.demuxer, "background indexing done, %zu clusters known", _clusters.size() );
+    }
+}
+
+/*****************************************************************************
+ * Seekpoint cache
+ *****************************************************************************
+ * The seekpoints of each segment of a local file are kept in a cache file,
+ * holding after the common header the segment position and timescale, the
+ * record counts, then the searched ranges, the cluster positions, the
+ * clusters and the seekpoints.
+ *****************************************************************************/
+namespace {
+    const char     SEEK_CACHE_MAGIC[]  = "VLCMKVSK";
+    const uint32_t SEEK_CACHE_VERSION  = 2;
+
+    struct cache_header
+    {
+        uint64_t segment_fpos;
+        uint64_t timescale;
+    };
+
+    struct cache_counts
+    {
+        uint32_t ranges;
+        uint32_t cluster_positions;
+        uint32_t clusters;
+        uint32_t seekpoints;
+    };
+
+    struct cache_range
+    {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct cache_cluster
+    {
+        uint64_t fpos;
+        int64_t  pts;
+        int64_t  duration;
+        uint64_t size;
+    };
+
+    struct cache_seekpoint
+    {
+        uint64_t fpos;
+        int64_t  pts;
+        uint32_t track_id;
+        int32_t  trust_level;
+    };
+
+    static_assert( sizeof( cache_header ) % CACHEFILE_ALIGN == 0, "misaligned" );
+    static_assert( sizeof( cache_counts ) % CACHEFILE_ALIGN == 0, "misaligned" );
+    static_assert( sizeof( cache_range ) % CACHEFILE_ALIGN == 0, "misaligned" );
+    static_assert( sizeof( cache_cluster ) % CACHEFILE_ALIGN == 0, "misaligned" );
+    static_assert( sizeof( cache_seekpoint ) % CACHEFILE_ALIGN == 0, "misaligned" );
+
+    bool cache_write( FILE * file, const void * p_data, size_t i_data )
+    {
+        return cachefile_Write( file, p_data, i_data ) == 0;
+    }
+}
+
+bool
+SegmentSeeker::load_cache( matroska_segment_c& ms, const char * psz_filepath )
+{
+    uint64_t const segment_fpos = ms.segment->GetElementPosition();
+
+    if( _cache_set )
+        cachefile_Clean( &_cache );
+
+    // the seekpoints will be saved on close, even if none were loaded
+    _cache_set = cachefile_Init( &_cache, "mkvseek", SEEK_CACHE_MAGIC, SEEK_CACHE_VERSION,
+                                 psz_filepath, &segment_fpos, sizeof( segment_fpos ) ) == VLC_SUCCESS;
+    _modified  = false;
+    if( !_cache_set )
+        return false;
+
+    block_t *p_block = cachefile_Load( VLC_OBJECT( &ms.sys.demuxer ), &_cache );
+    if( p_block == NULL )
+        return false;
+
+    cache_header expected, header;
+    expected.segment_fpos = segment_fpos;
+    expected.timescale    = ms.i_timescale;
+
+    const uint8_t *p_data = p_block->p_buffer;
+    size_t i_data = p_block->i_buffer;
+    cache_counts counts;
+
+    if( i_data < sizeof( header ) + sizeof( counts ) )
+    {
+        block_Release( p_block );
+        return false;
+    }
+    memcpy( &header, p_data, sizeof( header ) );
+    memcpy( &counts, p_data + sizeof( header ), sizeof( counts ) );
+
+    if( memcmp( &header, &expected, sizeof( header ) ) ||
+        i_data - sizeof( header ) - sizeof( counts ) !=
+            uint64_t( counts.ranges ) * sizeof( cache_range ) +
+            uint64_t( counts.cluster_positions ) * sizeof( uint64_t ) +
+            uint64_t( counts.clusters ) * sizeof( cache_cluster ) +
+            uint64_t( counts.seekpoints ) * sizeof( cache_seekpoint ) )
+    {
+        msg_Dbg( &ms.sys.demuxer, "outdated seekpoint cache" );
+        block_Release( p_block );
+        return false;
+    }
+    p_data += sizeof( header ) + sizeof( counts );
+
+    for( uint32_t i = 0; i < counts.ranges; i++, p_data += sizeof( cache_range ) )
+    {
+        cache_range range;
+        memcpy( &range, p_data, sizeof( range ) );
+        if( range.start <= range.end )
+            mark_range_as_searched( Range( range.start, range.end ) );
+    }
+
+    for( uint32_t i = 0; i < counts.cluster_positions; i++, p_data += sizeof( uint64_t ) )
+    {
+        uint64_t fpos;
+        memcpy( &fpos, p_data, sizeof( fpos ) );
+        add_cluster_position( fpos );
+    }
+
+    for( uint32_t i = 0; i < counts.clusters; i++, p_data += sizeof( cache_cluster ) )
+    {
+        cache_cluster cluster;
+        memcpy( &cluster, p_data, sizeof( cluster ) );
+
+        Cluster cinfo = { cluster.fpos, cluster.pts, cluster.duration, cluster.size };
+        add_cluster( cinfo );
+    }
+
+    for( uint32_t i = 0; i < counts.seekpoints; i++, p_data += sizeof( cache_seekpoint ) )
+    {
+        cache_seekpoint sp;
+        memcpy( &sp, p_data, sizeof( sp ) );
+
+        if( ms.tracks.find( sp.track_id ) == ms.tracks.end() )
+            continue;
+
+        switch( sp.trust_level )
+        {
+            case Seekpoint::TRUSTED:
+            case Seekpoint::QUESTIONABLE:
+            case Seekpoint::DISABLED:
+                add_seekpoint( sp.track_id, Seekpoint( sp.fpos, sp.pts,
+                               static_cast<Seekpoint::TrustLevel>( sp.trust_level ) ) );
+                break;
+        }
+    }
+
+    block_Release( p_block );
+
+    msg_Dbg( &ms.sys.demuxer, "loaded %" PRIu32 " clusters and %" PRIu32 " seekpoints from the cache",
+             counts.clusters, counts.seekpoints );
+    _modified = false;
+    return true;
+}
+
+void
+SegmentSeeker::save_cache( matroska_segment_c& ms )
+{
+    if( _indexer != NULL )
+    {
+        // keep what was indexed so far
+        _indexer->stop();
+        merge_indexed( ms );
+        stop_indexing();
+    }
+
+    if( !_cache_set || !_modified )
+        return; // nothing new
+
+    cache_header header;
+    header.segment_fpos = ms.segment->GetElementPosition();
+    header.timescale    = ms.i_timescale;
+
+    std::vector<cache_range> ranges;
+    for( ranges_t::const_iterator it = _ranges_searched.begin(); it != _ranges_searched.end(); ++it )
+    {
+        cache_range range = { it->start, it->end };
+        ranges.push_back( range );
+    }
+
+    std::vector<cache_cluster> clusters;
+    for( cluster_map_t::const_iterator it = _clusters.begin(); it != _clusters.end(); ++it )
+    {
+        cache_cluster cluster = { it->second.fpos, it->second.pts, it->second.duration, it->second.size };
+        clusters.push_back( cluster );
+    }
+
+    std::vector<cache_seekpoint> seekpoints;
+    for( tracks_seekpoints_t::const_iterator it = _tracks_seekpoints.begin(); it != _tracks_seekpoints.end(); ++it )
+    {
+        for( seekpoints_t::const_iterator sp = it->second.begin(); sp != it->second.end(); ++sp )
+        {
+            cache_seekpoint entry = { sp->fpos, sp->pts, it->first, sp->trust_level };
+            seekpoints.push_back( entry );
+        }
+    }
+
+    cache_counts counts = {
+        /* ranges            */ uint32_t( ranges.size() ),
+        /* cluster_positions */ uint32_t( _cluster_positions.size() ),
+        /* clusters          */ uint32_t( clusters.size() ),
+        /* seekpoints        */ uint32_t( seekpoints.size() )
+    };
+
+    // unless the file changed during the playback
+    FILE *file = cachefile_Create( VLC_OBJECT( &ms.sys.demuxer ), &_cache );
+    if( file == NULL )
+        return;
+
+    bool b_ok = cache_write( file, &header, sizeof( header ) ) &&
+                cache_write( file, &counts, sizeof( counts ) ) &&
+                cache_write( file, ranges.data(), ranges.size() * sizeof( cache_range ) ) &&
+                cache_write( file, _cluster_positions.data(), _cluster_positions.size() * sizeof( uint64_t ) ) &&
+                cache_write( file, clusters.data(), clusters.size() * sizeof( cache_cluster ) ) &&
+                cache_write( file, seekpoints.data(), seekpoints.size() * sizeof( cache_seekpoint ) );
+
+    cachefile_Commit( VLC_OBJECT( &ms.sys.demuxer ), &_cache, file, b_ok );
+}
@@ -25,6 +25,7 @@
 #define MKV_MATROSKA_SEGMENT_SEEKER_HPP_
 
 #include "mkv.hpp"
+#include "../cachefile.h"
 
 #include <algorithm>
 #include <vector>
@@ -86,6 +87,8 @@ class SegmentSeeker
             fptr_t  size;
         };
 
+        class Indexer;
+
     public:
         typedef std::vector<track_id_t> track_ids_t;
         typedef std::vector<Range> ranges_t;
@@ -98,6 +101,9 @@ class SegmentSeeker
 
         typedef std::pair<Seekpoint, Seekpoint> seekpoint_pair_t;
 
+        SegmentSeeker();
+        ~SegmentSeeker();
+
         void add_seekpoint( track_id_t, Seekpoint );
 
         seekpoint_pair_t get_seekpoints_around( vlc_tick_t, seekpoints_t const& );
@@ -109,6 +115,7 @@ class SegmentSeeker
 
         cluster_positions_t::iterator add_cluster_position( fptr_t pos );
         cluster_map_t      ::iterator add_cluster( KaxCluster * const );
+        cluster_map_t      ::iterator add_cluster( Cluster const& );
 
         void mkv_jump_to( matroska_segment_c&, fptr_t );
 
@@ -118,11 +125,31 @@ class SegmentSeeker
         void mark_range_as_searched( Range );
         ranges_t get_search_areas( fptr_t start, fptr_t end ) const;
 
+        // background indexing of the clusters not searched yet, from a
+        // stream of its own; its seekpoints are merged by merge_indexed()
+        bool start_indexing( matroska_segment_c&, const char * psz_url );
+        void stop_indexing();
+        void merge_indexed( matroska_segment_c& );
+
+        // seekpoints found during a previous playback of the same file, and
+        // saved for the next one
+        bool load_cache( matroska_segment_c&, const char * psz_filepath );
+        void save_cache( matroska_segment_c& );
+
     public:
         ranges_t            _ranges_searched;
         tracks_seekpoints_t _tracks_seekpoints;
         cluster_positions_t _cluster_positions;
         cluster_map_t       _clusters;
+
+    private:
+        SegmentSeeker( SegmentSeeker const& ) = delete;
+        SegmentSeeker& operator=( SegmentSeeker const& ) = delete;
+
+        Indexer *           _indexer;
+        cachefile_t         _cache;  // loaded, saved on close
+        bool                _cache_set;
+        bool                _modified;
 };
 
 #endif /* include-guard */
@@ -74,6 +74,14 @@ vlc_module_begin ()
             N_("Preload clusters"),
             N_("Find all cluster positions by jumping cluster-to-cluster before playback"), true );
 
+    add_bool( "mkv-seek-index-background", true,
+            N_("Index clusters in the background"),
+            N_("Look for the seek points of files with missing or sparse cues during playback."), true );
+
+    add_bool( "mkv-seek-cache", false,
+            N_("Seek points cache"),
+            N_("Store the seek points found in local files, and reuse them on the next playback."), true );
+
     add_shortcut( "mka", "mkv" )
 vlc_module_end ()
 
@@ -133,6 +141,7 @@ static int Open( vlc_object_t * p_this )
     for (size_t i=0; i<p_stream->segments.size(); i++)
     {
         p_stream->segments[i]->Preload();
+        p_stream->segments[i]->InitSeekpoints();
         b_need_preload |= p_stream->segments[i]->b_ref_external_segments;
         if ( p_stream->segments[i]->translations.size() &&
              p_stream->segments[i]->translations[0]->codec_id == MATROSKA_CHAPTER_CODEC_DVD &&
@@ -714,6 +723,8 @@ static int Demux( demux_t *p_demux)
     if ( p_segment == NULL )
         return 0;
 
+    p_segment->UpdateSeekpoints();
+
     KaxBlock *block;
     KaxSimpleBlock *simpleblock;
     int64_t i_block_duration = 0;
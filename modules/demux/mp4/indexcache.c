@@ -0,0 +1,409 @@
+/*****************************************************************************
+ * indexcache.c : MP4 sample index cache
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_md5.h>
+
+#include "../cachefile.h"
+#include "indexcache.h"
+
+/* After the common header of cache files, the cache file holds a header,
+ * then for each track a track record, its chunk records, its dts and pts
+ * runs, its sample size blocks and their data, padded to 8 bytes. */
+#define INDEX_MAGIC   "VLCMP4IX"
+#define INDEX_VERSION 3
+
+typedef struct
+{
+    uint8_t  moov_digest[16];
+    uint32_t i_tracks;
+    uint32_t i_reserved;
+} index_header_t;
+
+typedef struct
+{
+    uint32_t i_track_ID;
+    uint32_t i_chunk_count;
+    uint32_t i_sample_count;
+    uint32_t i_sample_size;  /* if 0, the sample size blocks are present */
+    uint32_t i_dts_runs;
+    uint32_t i_pts_runs;     /* 0 if there is no ctts */
+    uint32_t i_size_blocks;
+    uint32_t i_size_data;
+} index_track_t;
+
+typedef struct
+{
+    uint64_t i_offset;
+    uint64_t i_first_dts;
+    uint64_t i_duration;
+    uint32_t i_sample_description_index;
+    uint32_t i_sample_count;
+    uint32_t i_sample_first;
+    uint32_t i_dts_run;
+    uint32_t i_entries_dts;
+    uint32_t i_pts_run;
+    uint32_t i_entries_pts;
+    uint32_t i_reserved;
+} index_chunk_t;
+
+static_assert( sizeof(index_header_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(index_track_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(index_chunk_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(mp4_dts_run_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(mp4_pts_run_t) % CACHEFILE_ALIGN == 0, "misaligned" );
+static_assert( sizeof(mp4_size_block_t) % sizeof(uint32_t) == 0, "misaligned" );
+
+struct mp4_index_cache_t
+{
+    cachefile_t     file;
+    index_header_t  header; /* expected from the media file */
+
+    block_t        *p_block; /* mapped cache file, or NULL */
+    struct
+    {
+        const index_track_t *p_record;
+        bool                 b_loaded;
+    }              *p_tracks;
+    unsigned        i_tracks;
+};
+
+/* Size of a track record with its tables, without padding */
+static uint64_t IndexTrackLength( const index_track_t *p_record )
+{
+    return sizeof(index_track_t)
+         + (uint64_t)p_record->i_chunk_count * sizeof(index_chunk_t)
+         + (uint64_t)p_record->i_dts_runs * sizeof(mp4_dts_run_t)
+         + (uint64_t)p_record->i_pts_runs * sizeof(mp4_pts_run_t)
+         + (uint64_t)p_record->i_size_blocks * sizeof(mp4_size_block_t)
+         + p_record->i_size_data;
+}
+
+/* Size of a track record with its tables, or 0 if it is too large */
+static size_t IndexTrackSize( const index_track_t *p_record )
+{
+    uint64_t i_size = IndexTrackLength( p_record );
+    if( i_size > SIZE_MAX - CACHEFILE_ALIGN )
+        return 0;
+    return cachefile_Pad( i_size );
+}
+
+/* Hashes the position of every box of the moov, which changes whenever
+ * the sample tables are rewritten */
+static void IndexHashBoxes( struct md5_s *p_md5, const MP4_Box_t *p_box )
+{
+    for( ; p_box != NULL; p_box = p_box->p_next )
+    {
+        AddMD5( p_md5, &p_box->i_type, sizeof(p_box->i_type) );
+        AddMD5( p_md5, &p_box->i_pos, sizeof(p_box->i_pos) );
+        AddMD5( p_md5, &p_box->i_size, sizeof(p_box->i_size) );
+        IndexHashBoxes( p_md5, p_box->p_first );
+    }
+}
+
+/* Validates the mapped cache against the media file, and lists its tracks */
+static void IndexCacheMap( vlc_object_t *p_obj, mp4_index_cache_t *p_cache )
+{
+    block_t *p_block = cachefile_Load( p_obj, &p_cache->file );
+    if( p_block == NULL )
+        return;
+
+    const uint8_t *p_data = p_block->p_buffer;
+    size_t i_data = p_block->i_buffer;
+    index_header_t header;
+
+    if( i_data < sizeof(header) )
+        goto error;
+
+    memcpy( &header, p_data, sizeof(header) );
+    p_cache->header.i_tracks = header.i_tracks;
+    if( memcmp( &header, &p_cache->header, sizeof(header) ) ||
+        header.i_tracks > (i_data - sizeof(header)) / sizeof(index_track_t) )
+        goto error;
+
+    p_cache->p_tracks = vlc_alloc( header.i_tracks,
+                                   sizeof(*p_cache->p_tracks) );
+    if( header.i_tracks > 0 && p_cache->p_tracks == NULL )
+        goto error;
+
+    p_data += sizeof(header);
+    i_data -= sizeof(header);
+    for( unsigned i = 0; i < header.i_tracks; i++ )
+    {
+        const index_track_t *p_record = (const index_track_t *) p_data;
+        size_t i_size;
+
+        if( i_data < sizeof(*p_record) ||
+            (i_size = IndexTrackSize( p_record )) == 0 || i_size > i_data )
+            goto error;
+
+        p_cache->p_tracks[i].p_record = p_record;
+        p_cache->p_tracks[i].b_loaded = false;
+        p_data += i_size;
+        i_data -= i_size;
+    }
+
+    msg_Dbg( p_obj, "using sample index cache %s",
+             p_cache->file.psz_cachepath );
+    p_cache->p_block = p_block;
+    p_cache->i_tracks = header.i_tracks;
+    return;
+
+error:
+    msg_Dbg( p_obj, "ignoring stale sample index cache %s",
+             p_cache->file.psz_cachepath );
+    free( p_cache->p_tracks );
+    p_cache->p_tracks = NULL;
+    block_Release( p_block );
+}
+
+mp4_index_cache_t * MP4_IndexCache_New( vlc_object_t *p_obj,
+                                        const char *psz_filepath,
+                                        const MP4_Box_t *p_moov )
+{
+    mp4_index_cache_t *p_cache = calloc( 1, sizeof(*p_cache) );
+    if( unlikely(p_cache == NULL) )
+        return NULL;
+
+    if( cachefile_Init( &p_cache->file, "mp4index", INDEX_MAGIC,
+                        INDEX_VERSION, psz_filepath, NULL, 0 ) )
+    {
+        free( p_cache );
+        return NULL;
+    }
+
+    index_header_t *p_header = &p_cache->header;
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, &p_moov->i_pos, sizeof(p_moov->i_pos) );
+    AddMD5( &md5, &p_moov->i_size, sizeof(p_moov->i_size) );
+    IndexHashBoxes( &md5, p_moov->p_first );
+    EndMD5( &md5 );
+    memcpy( p_header->moov_digest, md5.buf, sizeof(p_header->moov_digest) );
+
+    IndexCacheMap( p_obj, p_cache );
+    return p_cache;
+}
+
+void MP4_IndexCache_Delete( mp4_index_cache_t *p_cache )
+{
+    if( p_cache->p_block )
+        block_Release( p_cache->p_block );
+    free( p_cache->p_tracks );
+    cachefile_Clean( &p_cache->file );
+    free( p_cache );
+}
+
+bool MP4_IndexCache_LoadTrack( mp4_index_cache_t *p_cache,
+                               mp4_track_t *p_track )
+{
+    const index_track_t *p_record = NULL;
+    unsigned i;
+
+    for( i = 0; i < p_cache->i_tracks; i++ )
+    {
+        p_record = p_cache->p_tracks[i].p_record;
+        if( !p_cache->p_tracks[i].b_loaded &&
+            p_record->i_track_ID == p_track->i_track_ID )
+            break;
+    }
+    if( i == p_cache->i_tracks )
+        return false;
+
+    const index_chunk_t *p_chunks = (const index_chunk_t *) &p_record[1];
+    const mp4_dts_run_t *p_dts_runs =
+        (const mp4_dts_run_t *) &p_chunks[p_record->i_chunk_count];
+    const mp4_pts_run_t *p_pts_runs =
+        (const mp4_pts_run_t *) &p_dts_runs[p_record->i_dts_runs];
+    const mp4_size_block_t *p_size_blocks =
+        (const mp4_size_block_t *) &p_pts_runs[p_record->i_pts_runs];
+    const uint8_t *p_size_data =
+        (const uint8_t *) &p_size_blocks[p_record->i_size_blocks];
+
+    /* The chunks must follow each other and use runs of the tables */
+    uint64_t i_sample = 0;
+    for( uint32_t j = 0; j < p_record->i_chunk_count; j++ )
+    {
+        const index_chunk_t *p_chunk = &p_chunks[j];
+
+        if( p_chunk->i_sample_first != i_sample ||
+            p_chunk->i_dts_run > p_record->i_dts_runs ||
+            p_chunk->i_entries_dts > p_record->i_dts_runs - p_chunk->i_dts_run ||
+            p_chunk->i_pts_run > p_record->i_pts_runs ||
+            p_chunk->i_entries_pts > p_record->i_pts_runs - p_chunk->i_pts_run )
+            return false;
+        i_sample += p_chunk->i_sample_count;
+    }
+    if( i_sample != p_record->i_sample_count )
+        return false;
+
+    /* The size blocks must cover the samples, within the data */
+    if( p_record->i_sample_size == 0 )
+    {
+        if( p_record->i_size_blocks != p_record->i_sample_count / MP4_SIZE_BLOCK
+                                     + !!(p_record->i_sample_count % MP4_SIZE_BLOCK) )
+            return false;
+        for( uint32_t j = 0; j < p_record->i_size_blocks; j++ )
+        {
+            const mp4_size_block_t *p_block = &p_size_blocks[j];
+            const uint32_t i_width = p_block->i_width;
+            const uint32_t i_count = __MIN( p_record->i_sample_count -
+                                            j * MP4_SIZE_BLOCK, MP4_SIZE_BLOCK );
+
+            if( (i_width != 0 && i_width != 1 && i_width != 2 && i_width != 4) ||
+                (i_width > 1 && p_block->i_offset % i_width) ||
+                p_block->i_offset > p_record->i_size_data ||
+                i_count * i_width > p_record->i_size_data - p_block->i_offset )
+                return false;
+        }
+    }
+
+    mp4_chunk_t *chunk = calloc( p_record->i_chunk_count, sizeof(*chunk) );
+    if( p_record->i_chunk_count > 0 && chunk == NULL )
+        return false;
+
+    for( uint32_t j = 0; j < p_record->i_chunk_count; j++ )
+    {
+        const index_chunk_t *p_chunk = &p_chunks[j];
+        mp4_chunk_t *ck = &chunk[j];
+
+        ck->i_offset = p_chunk->i_offset;
+        ck->i_sample_description_index = p_chunk->i_sample_description_index;
+        ck->i_sample_count = p_chunk->i_sample_count;
+        ck->i_sample_first = p_chunk->i_sample_first;
+        ck->i_first_dts = p_chunk->i_first_dts;
+        ck->i_duration = p_chunk->i_duration;
+        ck->i_dts_run = p_chunk->i_dts_run;
+        ck->i_entries_dts = p_chunk->i_entries_dts;
+        ck->i_pts_run = p_chunk->i_pts_run;
+        ck->i_entries_pts = p_chunk->i_entries_pts;
+    }
+
+    p_track->chunk = chunk;
+    p_track->i_chunk_count = p_record->i_chunk_count;
+    p_track->i_sample_count = p_record->i_sample_count;
+    p_track->i_sample_size = p_record->i_sample_size;
+
+    /* The tables are only read, so they are used in place */
+    p_track->p_dts_runs = (mp4_dts_run_t *) p_dts_runs;
+    p_track->i_dts_runs = p_record->i_dts_runs;
+    p_track->p_pts_runs = p_record->i_pts_runs ? (mp4_pts_run_t *) p_pts_runs
+                                               : NULL;
+    p_track->i_pts_runs = p_record->i_pts_runs;
+    if( p_record->i_sample_size == 0 )
+    {
+        p_track->sample_sizes.p_blocks = (mp4_size_block_t *) p_size_blocks;
+        p_track->sample_sizes.i_blocks = p_record->i_size_blocks;
+        p_track->sample_sizes.p_data = (uint8_t *) p_size_data;
+        p_track->sample_sizes.i_data = p_record->i_size_data;
+    }
+    p_track->b_index_cached = true;
+    p_cache->p_tracks[i].b_loaded = true;
+    return true;
+}
+
+static int IndexWriteTrack( FILE *file, const mp4_track_t *p_track )
+{
+    const mp4_sample_sizes_t *p_sizes = &p_track->sample_sizes;
+    const index_track_t record = {
+        .i_track_ID = p_track->i_track_ID,
+        .i_chunk_count = p_track->i_chunk_count,
+        .i_sample_count = p_track->i_sample_count,
+        .i_sample_size = p_track->i_sample_size,
+        .i_dts_runs = p_track->i_dts_runs,
+        .i_pts_runs = p_track->p_pts_runs ? p_track->i_pts_runs : 0,
+        .i_size_blocks = p_track->i_sample_size ? 0 : p_sizes->i_blocks,
+        .i_size_data = p_track->i_sample_size ? 0 : p_sizes->i_data,
+    };
+
+    if( cachefile_Write( file, &record, sizeof(record) ) )
+        return -1;
+
+    for( uint32_t i = 0; i < p_track->i_chunk_count; i++ )
+    {
+        const mp4_chunk_t *ck = &p_track->chunk[i];
+        const index_chunk_t chunk = {
+            .i_offset = ck->i_offset,
+            .i_first_dts = ck->i_first_dts,
+            .i_duration = ck->i_duration,
+            .i_sample_description_index = ck->i_sample_description_index,
+            .i_sample_count = ck->i_sample_count,
+            .i_sample_first = ck->i_sample_first,
+            .i_dts_run = ck->i_dts_run,
+            .i_entries_dts = ck->i_entries_dts,
+            .i_pts_run = record.i_pts_runs ? ck->i_pts_run : 0,
+            .i_entries_pts = record.i_pts_runs ? ck->i_entries_pts : 0,
+        };
+        if( cachefile_Write( file, &chunk, sizeof(chunk) ) )
+            return -1;
+    }
+
+    if( cachefile_Write( file, p_track->p_dts_runs,
+                         record.i_dts_runs * sizeof(mp4_dts_run_t) ) ||
+        cachefile_Write( file, p_track->p_pts_runs,
+                         record.i_pts_runs * sizeof(mp4_pts_run_t) ) ||
+        cachefile_Write( file, p_sizes->p_blocks,
+                         record.i_size_blocks * sizeof(mp4_size_block_t) ) ||
+        cachefile_Write( file, p_sizes->p_data, record.i_size_data ) )
+        return -1;
+
+    static const uint8_t padding[CACHEFILE_ALIGN];
+    const size_t i_padding = IndexTrackSize( &record )
+                           - IndexTrackLength( &record );
+    return cachefile_Write( file, padding, i_padding );
+}
+
+void MP4_IndexCache_Save( vlc_object_t *p_obj, mp4_index_cache_t *p_cache,
+                          const mp4_track_t *p_tracks, unsigned i_tracks )
+{
+    unsigned i_count = 0;
+    bool b_dirty = false;
+
+    for( unsigned i = 0; i < i_tracks; i++ )
+    {
+        if( !p_tracks[i].b_ok )
+            continue;
+        i_count++;
+        b_dirty |= !p_tracks[i].b_index_cached;
+    }
+    if( !b_dirty )
+        return;
+
+    FILE *file = cachefile_Create( p_obj, &p_cache->file );
+    if( file == NULL )
+        return;
+
+    index_header_t header = p_cache->header;
+    header.i_tracks = i_count;
+
+    int i_ret = cachefile_Write( file, &header, sizeof(header) );
+    for( unsigned i = 0; i < i_tracks && i_ret == 0; i++ )
+        if( p_tracks[i].b_ok )
+            i_ret = IndexWriteTrack( file, &p_tracks[i] );
+
+    cachefile_Commit( p_obj, &p_cache->file, file, i_ret == 0 );
+}
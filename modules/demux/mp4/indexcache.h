@@ -0,0 +1,43 @@
+/*****************************************************************************
+ * indexcache.h : MP4 sample index cache
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_MP4_INDEXCACHE_H_
+#define VLC_MP4_INDEXCACHE_H_
+
+#include "mp4.h"
+
+/* The chunk and sample tables of the tracks of a local file are kept in a
+ * file of the user cache directory, named after the file path, and reused
+ * while the size, modification time and moov layout of the file match.
+ * Tracks loaded from the cache point to its memory-mapped tables. */
+typedef struct mp4_index_cache_t mp4_index_cache_t;
+
+mp4_index_cache_t * MP4_IndexCache_New( vlc_object_t *p_obj,
+                                        const char *psz_filepath,
+                                        const MP4_Box_t *p_moov );
+void MP4_IndexCache_Delete( mp4_index_cache_t *p_cache );
+
+/* Sets up the chunk and sample tables of the track from the cache, if any */
+bool MP4_IndexCache_LoadTrack( mp4_index_cache_t *p_cache,
+                               mp4_track_t *p_track );
+/* Stores the tables of the usable tracks, unless they were all loaded */
+void MP4_IndexCache_Save( vlc_object_t *p_obj, mp4_index_cache_t *p_cache,
+                          const mp4_track_t *p_tracks, unsigned i_tracks );
+
+#endif
@@ -39,6 +39,7 @@
 #include <limits.h>
 #include "../codec/cc.h"
 #include "heif.h"
+#include "indexcache.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -51,6 +52,11 @@ static void Close( vlc_object_t * );
 #define MP4_M4A_TEXT     N_("M4A audio only")
 #define MP4_M4A_LONGTEXT N_("Ignore non audio tracks from iTunes audio files")
 
+#define MP4_INDEX_CACHE_TEXT N_("Cache sample indexes")
+#define MP4_INDEX_CACHE_LONGTEXT N_( \
+    "Store the sample indexes of local files in the cache directory, " \
+    "to open them faster the next time.")
+
 #define HEIF_DURATION_TEXT N_("Duration in seconds")
 #define HEIF_DURATION_LONGTEXT N_( \
     "Duration in seconds before simulating an end of file. " \
@@ -64,6 +70,9 @@ vlc_module_begin ()
     set_capability( "demux", 240 )
     set_callbacks( Open, Close )
 
+    add_bool( CFG_PREFIX"index-cache", false, MP4_INDEX_CACHE_TEXT,
+              MP4_INDEX_CACHE_LONGTEXT, true )
+
     add_category_hint("Hacks", NULL)
     add_bool( CFG_PREFIX"m4a-audioonly", false, MP4_M4A_TEXT, MP4_M4A_LONGTEXT, true )
 
@@ -141,6 +150,7 @@ typedef struct
     } hacks;
 
     mp4_fragments_index_t *p_fragsindex;
+    mp4_index_cache_t     *p_indexcache;
 } demux_sys_t;
 
 #define DEMUX_INCREMENT VLC_TICK_FROM_MS(250) /* How far the pcr will go, each round */
@@ -318,6 +328,7 @@ static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
     const mp4_chunk_t *p_chunk = &p_track->chunk[p_track->i_chunk];
+    const mp4_dts_run_t *p_run = &p_track->p_dts_runs[p_chunk->i_dts_run];
 
     unsigned int i_index = 0;
     unsigned int i_sample = p_track->i_sample - p_chunk->i_sample_first;
@@ -325,16 +336,15 @@ static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 
     while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        if( i_sample > p_run[i_index].i_count )
         {
-            i_dts += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
+            i_dts += p_run[i_index].i_count * p_run[i_index].i_delta;
+            i_sample -= p_run[i_index].i_count;
             i_index++;
         }
         else
         {
-            i_dts += i_sample * p_chunk->p_sample_delta_dts[i_index];
+            i_dts += i_sample * p_run[i_index].i_delta;
             break;
         }
     }
@@ -372,19 +382,20 @@ static inline bool MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track,
     unsigned int i_index = 0;
     unsigned int i_sample = p_track->i_sample - ck->i_sample_first;
 
-    if( ck->p_sample_count_pts == NULL || ck->p_sample_offset_pts == NULL )
+    if( p_track->p_pts_runs == NULL )
         return false;
 
+    const mp4_pts_run_t *p_run = &p_track->p_pts_runs[ck->i_pts_run];
     for( i_index = 0; i_index < ck->i_entries_pts ; i_index++ )
     {
-        if( i_sample < ck->p_sample_count_pts[i_index] )
+        if( i_sample < p_run[i_index].i_count )
         {
-            *pi_delta = MP4_rescale( ck->p_sample_offset_pts[i_index],
+            *pi_delta = MP4_rescale( p_run[i_index].i_offset,
                                      p_track->i_timescale, CLOCK_FREQ );
             return true;
         }
 
-        i_sample -= ck->p_sample_count_pts[i_index];
+        i_sample -= p_run[i_index].i_count;
     }
     return false;
 }
@@ -395,6 +406,7 @@ static inline vlc_tick_t MP4_GetSamplesDuration( demux_t *p_demux, mp4_track_t *
     VLC_UNUSED( p_demux );
 
     const mp4_chunk_t *p_chunk = &p_track->chunk[p_track->i_chunk];
+    const mp4_dts_run_t *p_run = &p_track->p_dts_runs[p_chunk->i_dts_run];
     stime_t i_duration = 0;
 
     /* Forward to right index, and set remaining count in that index */
@@ -403,9 +415,9 @@ static inline vlc_tick_t MP4_GetSamplesDuration( demux_t *p_demux, mp4_track_t *
     for( unsigned i = p_chunk->i_sample_first;
          i<p_track->i_sample && i_index < p_chunk->i_entries_dts; )
     {
-        if( p_track->i_sample - i >= p_chunk->p_sample_count_dts[i_index] )
+        if( p_track->i_sample - i >= p_run[i_index].i_count )
         {
-            i += p_chunk->p_sample_count_dts[i_index];
+            i += p_run[i_index].i_count;
             i_index++;
         }
         else
@@ -418,17 +430,17 @@ static inline vlc_tick_t MP4_GetSamplesDuration( demux_t *p_demux, mp4_track_t *
     /* Compute total duration from all samples from index */
     while( i_nb_samples > 0 && i_index < p_chunk->i_entries_dts )
     {
-        if( i_nb_samples >= p_chunk->p_sample_count_dts[i_index] - i_remain )
+        if( i_nb_samples >= p_run[i_index].i_count - i_remain )
         {
-            i_duration += (p_chunk->p_sample_count_dts[i_index] - i_remain) *
-                          (int64_t) p_chunk->p_sample_delta_dts[i_index];
-            i_nb_samples -= (p_chunk->p_sample_count_dts[i_index] - i_remain);
+            i_duration += (p_run[i_index].i_count - i_remain) *
+                          (int64_t) p_run[i_index].i_delta;
+            i_nb_samples -= (p_run[i_index].i_count - i_remain);
             i_index++;
             i_remain = 0;
         }
         else
         {
-            i_duration += i_nb_samples * p_chunk->p_sample_delta_dts[i_index];
+            i_duration += i_nb_samples * p_run[i_index].i_delta;
             break;
         }
     }
@@ -978,6 +990,10 @@ static int Open( vlc_object_t * p_this )
     if( (p_sys->p_meta = vlc_meta_New()) )
         MP4_LoadMeta( p_sys, p_sys->p_meta );
 
+    if( var_InheritBool( p_demux, CFG_PREFIX"index-cache" ) )
+        p_sys->p_indexcache = MP4_IndexCache_New( p_this, p_demux->psz_filepath,
+                                                  p_sys->p_moov );
+
     /* now process each track and extract all useful information */
     for( unsigned i = 0; i < p_sys->i_tracks; i++ )
     {
@@ -1066,6 +1082,9 @@ static int Open( vlc_object_t * p_this )
         p_demux->pf_demux = DemuxFrag;
         msg_Dbg( p_demux, "Set Fragmented demux mode" );
     }
+    else if( p_sys->p_indexcache )
+        MP4_IndexCache_Save( p_this, p_sys->p_indexcache,
+                             p_sys->track, p_sys->i_tracks );
 
     if( !p_sys->b_seekable && p_demux->pf_demux == Demux )
     {
@@ -2236,6 +2255,9 @@ static void Close ( vlc_object_t * p_this )
         MP4_TrackClean( p_demux->out, &p_sys->track[i_track] );
     free( p_sys->track );
 
+    if( p_sys->p_indexcache )
+        MP4_IndexCache_Delete( p_sys->p_indexcache );
+
     free( p_sys );
 }
 
@@ -2427,11 +2449,7 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
 
         ck->i_first_dts = 0;
         ck->i_entries_dts = 0;
-        ck->p_sample_count_dts = NULL;
-        ck->p_sample_delta_dts = NULL;
         ck->i_entries_pts = 0;
-        ck->p_sample_count_pts = NULL;
-        ck->p_sample_offset_pts = NULL;
     }
 
     /* now we read index for SampleEntry( soun vide mp4a mp4v ...)
@@ -2541,6 +2559,85 @@ static int xTTS_CountEntries( demux_t *p_demux, uint32_t *pi_entry /* out */,
     return VLC_SUCCESS;
 }
 
+/* Packs the sizes by blocks of MP4_SIZE_BLOCK samples, each one stored as
+ * an offset from the smallest size of its block, on the fewest bytes */
+static int TrackCreateSampleSizes( mp4_sample_sizes_t *p_sizes,
+                                   const uint32_t *pi_size, uint32_t i_count )
+{
+    uint64_t i_data = 0;
+
+    p_sizes->i_blocks = i_count / MP4_SIZE_BLOCK + !!(i_count % MP4_SIZE_BLOCK);
+    p_sizes->p_blocks = vlc_alloc( p_sizes->i_blocks, sizeof(mp4_size_block_t) );
+    if( p_sizes->i_blocks && p_sizes->p_blocks == NULL )
+        return VLC_ENOMEM;
+
+    for( uint32_t i_block = 0; i_block < p_sizes->i_blocks; i_block++ )
+    {
+        mp4_size_block_t *p_block = &p_sizes->p_blocks[i_block];
+        const uint32_t *p_size = &pi_size[i_block * MP4_SIZE_BLOCK];
+        const uint32_t i_size_count =
+            __MIN( i_count - i_block * MP4_SIZE_BLOCK, MP4_SIZE_BLOCK );
+
+        uint32_t i_min = p_size[0], i_max = p_size[0];
+        for( uint32_t i = 1; i < i_size_count; i++ )
+        {
+            i_min = __MIN( i_min, p_size[i] );
+            i_max = __MAX( i_max, p_size[i] );
+        }
+
+        p_block->i_base = i_min;
+        if( i_max == i_min )
+            p_block->i_width = 0;
+        else if( i_max - i_min <= UINT8_MAX )
+            p_block->i_width = 1;
+        else if( i_max - i_min <= UINT16_MAX )
+            p_block->i_width = 2;
+        else
+            p_block->i_width = 4;
+
+        if( p_block->i_width > 1 )
+            i_data = (i_data + p_block->i_width - 1) & ~(uint64_t)(p_block->i_width - 1);
+        if( i_data > UINT32_MAX )
+            return VLC_EGENERIC;
+        p_block->i_offset = i_data;
+        i_data += i_size_count * p_block->i_width;
+    }
+
+    if( i_data > UINT32_MAX )
+        return VLC_EGENERIC;
+    p_sizes->i_data = i_data;
+    p_sizes->p_data = malloc( i_data );
+    if( i_data && p_sizes->p_data == NULL )
+        return VLC_ENOMEM;
+
+    for( uint32_t i_block = 0; i_block < p_sizes->i_blocks; i_block++ )
+    {
+        const mp4_size_block_t *p_block = &p_sizes->p_blocks[i_block];
+        const uint32_t *p_size = &pi_size[i_block * MP4_SIZE_BLOCK];
+        const uint32_t i_size_count =
+            __MIN( i_count - i_block * MP4_SIZE_BLOCK, MP4_SIZE_BLOCK );
+        void *p_data = &p_sizes->p_data[p_block->i_offset];
+
+        for( uint32_t i = 0; i < i_size_count; i++ )
+        {
+            switch( p_block->i_width )
+            {
+                case 1:
+                    ((uint8_t *)p_data)[i] = p_size[i] - p_block->i_base;
+                    break;
+                case 2:
+                    ((uint16_t *)p_data)[i] = p_size[i] - p_block->i_base;
+                    break;
+                case 4:
+                    ((uint32_t *)p_data)[i] = p_size[i] - p_block->i_base;
+                    break;
+            }
+        }
+    }
+
+    return VLC_SUCCESS;
+}
+
 static int TrackCreateSamplesIndex( demux_t *p_demux,
                                     mp4_track_t *p_demux_track )
 {
@@ -2574,22 +2671,16 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     {
         /* 1: all sample have the same size, so no need to construct a table */
         p_demux_track->i_sample_size = stsz->i_sample_size;
-        p_demux_track->p_sample_size = NULL;
     }
     else
     {
         /* 2: each sample can have a different size */
         p_demux_track->i_sample_size = 0;
-        p_demux_track->p_sample_size =
-            calloc( p_demux_track->i_sample_count, sizeof( uint32_t ) );
-        if( p_demux_track->p_sample_size == NULL )
-            return VLC_ENOMEM;
-
-        for( uint32_t i_sample = 0; i_sample < p_demux_track->i_sample_count; i_sample++ )
-        {
-            p_demux_track->p_sample_size[i_sample] =
-                    stsz->i_entry_size[i_sample];
-        }
+        int i_ret = TrackCreateSampleSizes( &p_demux_track->sample_sizes,
+                                            stsz->i_entry_size,
+                                            p_demux_track->i_sample_count );
+        if( i_ret != VLC_SUCCESS )
+            return i_ret;
     }
 
     if ( p_demux_track->i_chunk_count && p_demux_track->i_sample_size == 0 )
@@ -2627,9 +2718,22 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "STTS table of %"PRIu32" entries", stts->i_entry_count );
 
-        /* Create sample -> dts table per chunk */
+        /* Create sample -> dts table, each chunk using the runs it overlaps:
+         * at most every stts entry, plus one split entry per chunk */
         uint32_t i_index = 0;
         uint32_t i_current_index_samples_left = 0;
+        const uint64_t i_max_runs = (uint64_t)stts->i_entry_count +
+                                    p_demux_track->i_chunk_count;
+
+        if( i_max_runs > UINT32_MAX )
+            return VLC_EGENERIC;
+        p_demux_track->p_dts_runs = calloc( i_max_runs, sizeof( mp4_dts_run_t ) );
+        if( i_max_runs && !p_demux_track->p_dts_runs )
+        {
+            msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu64, i_max_runs );
+            return VLC_ENOMEM;
+        }
+        p_demux_track->i_dts_runs = 0;
 
         for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
@@ -2639,8 +2743,7 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
             /* save first dts */
             ck->i_first_dts = i_next_dts;
 
-            /* count how many entries are needed for this chunk
-             * for p_sample_delta_dts and p_sample_count_dts */
+            /* count how many entries are needed for this chunk */
             ck->i_entries_dts = 0;
 
             int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_dts, i_index,
@@ -2651,17 +2754,15 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
             if ( i_ret == VLC_EGENERIC )
                 return i_ret;
 
-            /* allocate them */
-            ck->p_sample_count_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            ck->p_sample_delta_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            if( !ck->p_sample_count_dts || !ck->p_sample_delta_dts )
+            if( i_max_runs - p_demux_track->i_dts_runs < ck->i_entries_dts )
             {
-                free( ck->p_sample_count_dts );
-                free( ck->p_sample_delta_dts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_dts );
+                msg_Err( p_demux, "invalid STTS table" );
                 ck->i_entries_dts = 0;
-                return VLC_ENOMEM;
+                return VLC_EGENERIC;
             }
+            ck->i_dts_run = p_demux_track->i_dts_runs;
+            p_demux_track->i_dts_runs += ck->i_entries_dts;
+            mp4_dts_run_t *p_run = &p_demux_track->p_dts_runs[ck->i_dts_run];
 
             /* now copy */
             i_sample_count = ck->i_sample_count;
@@ -2672,9 +2773,9 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                 {
                     if ( i_current_index_samples_left > i_sample_count )
                     {
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
+                        p_run[i].i_count = i_sample_count;
+                        p_run[i].i_delta = stts->pi_sample_delta[i_index];
+                        i_next_dts += p_run[i].i_count * stts->pi_sample_delta[i_index];
                         if ( i_sample_count ) ck->i_duration = i_next_dts - ck->i_first_dts;
                         i_current_index_samples_left -= i_sample_count;
                         i_sample_count = 0;
@@ -2683,9 +2784,9 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                     }
                     else
                     {
-                        ck->p_sample_count_dts[i] = i_current_index_samples_left;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
+                        p_run[i].i_count = i_current_index_samples_left;
+                        p_run[i].i_delta = stts->pi_sample_delta[i_index];
+                        i_next_dts += p_run[i].i_count * stts->pi_sample_delta[i_index];
                         if ( i_current_index_samples_left ) ck->i_duration = i_next_dts - ck->i_first_dts;
                         i_sample_count -= i_current_index_samples_left;
                         i_current_index_samples_left = 0;
@@ -2696,9 +2797,9 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                 {
                     if ( stts->pi_sample_count[i_index] > i_sample_count )
                     {
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
+                        p_run[i].i_count = i_sample_count;
+                        p_run[i].i_delta = stts->pi_sample_delta[i_index];
+                        i_next_dts += p_run[i].i_count * stts->pi_sample_delta[i_index];
                         if ( i_sample_count ) ck->i_duration = i_next_dts - ck->i_first_dts;
                         i_current_index_samples_left = stts->pi_sample_count[i_index] - i_sample_count;
                         i_sample_count = 0;
@@ -2707,9 +2808,9 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                     }
                     else
                     {
-                        ck->p_sample_count_dts[i] = stts->pi_sample_count[i_index];
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
+                        p_run[i].i_count = stts->pi_sample_count[i_index];
+                        p_run[i].i_delta = stts->pi_sample_delta[i_index];
+                        i_next_dts += p_run[i].i_count * stts->pi_sample_delta[i_index];
                         if ( stts->pi_sample_count[i_index] ) ck->i_duration = i_next_dts - ck->i_first_dts;
                         i_sample_count -= stts->pi_sample_count[i_index];
                         i_index++;
@@ -2736,17 +2837,28 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
         if( p_cslg && BOXDATA(p_cslg) )
             i_cts_shift = BOXDATA(p_cslg)->ct_to_dts_shift;
 
-        /* Create pts-dts table per chunk */
+        /* Create pts-dts table, the same way as the dts one */
         uint32_t i_index = 0;
         uint32_t i_current_index_samples_left = 0;
+        const uint64_t i_max_runs = (uint64_t)ctts->i_entry_count +
+                                    p_demux_track->i_chunk_count;
+
+        if( i_max_runs > UINT32_MAX )
+            return VLC_EGENERIC;
+        p_demux_track->p_pts_runs = calloc( i_max_runs, sizeof( mp4_pts_run_t ) );
+        if( i_max_runs && !p_demux_track->p_pts_runs )
+        {
+            msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu64, i_max_runs );
+            return VLC_ENOMEM;
+        }
+        p_demux_track->i_pts_runs = 0;
 
         for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
         {
             mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
             uint32_t i_sample_count;
 
-            /* count how many entries are needed for this chunk
-             * for p_sample_offset_pts and p_sample_count_pts */
+            /* count how many entries are needed for this chunk */
             ck->i_entries_pts = 0;
             int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_pts, i_index,
                                            i_current_index_samples_left,
@@ -2756,17 +2868,15 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
             if ( i_ret == VLC_EGENERIC )
                 return i_ret;
 
-            /* allocate them */
-            ck->p_sample_count_pts = calloc( ck->i_entries_pts, sizeof( uint32_t ) );
-            ck->p_sample_offset_pts = calloc( ck->i_entries_pts, sizeof( int32_t ) );
-            if( !ck->p_sample_count_pts || !ck->p_sample_offset_pts )
+            if( i_max_runs - p_demux_track->i_pts_runs < ck->i_entries_pts )
             {
-                free( ck->p_sample_count_pts );
-                free( ck->p_sample_offset_pts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_pts );
+                msg_Err( p_demux, "invalid CTTS table" );
                 ck->i_entries_pts = 0;
-                return VLC_ENOMEM;
+                return VLC_EGENERIC;
             }
+            ck->i_pts_run = p_demux_track->i_pts_runs;
+            p_demux_track->i_pts_runs += ck->i_entries_pts;
+            mp4_pts_run_t *p_run = &p_demux_track->p_pts_runs[ck->i_pts_run];
 
             /* now copy */
             i_sample_count = ck->i_sample_count;
@@ -2777,8 +2887,8 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                 {
                     if ( i_current_index_samples_left > i_sample_count )
                     {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
+                        p_run[i].i_count = i_sample_count;
+                        p_run[i].i_offset = ctts->pi_sample_offset[i_index] + i_cts_shift;
                         i_current_index_samples_left -= i_sample_count;
                         i_sample_count = 0;
                         assert( i == ck->i_entries_pts - 1 );
@@ -2786,8 +2896,8 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                     }
                     else
                     {
-                        ck->p_sample_count_pts[i] = i_current_index_samples_left;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
+                        p_run[i].i_count = i_current_index_samples_left;
+                        p_run[i].i_offset = ctts->pi_sample_offset[i_index] + i_cts_shift;
                         i_sample_count -= i_current_index_samples_left;
                         i_current_index_samples_left = 0;
                         i_index++;
@@ -2797,8 +2907,8 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                 {
                     if ( ctts->pi_sample_count[i_index] > i_sample_count )
                     {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
+                        p_run[i].i_count = i_sample_count;
+                        p_run[i].i_offset = ctts->pi_sample_offset[i_index] + i_cts_shift;
                         i_current_index_samples_left = ctts->pi_sample_count[i_index] - i_sample_count;
                         i_sample_count = 0;
                         assert( i == ck->i_entries_pts - 1 );
@@ -2806,8 +2916,8 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
                     }
                     else
                     {
-                        ck->p_sample_count_pts[i] = ctts->pi_sample_count[i_index];
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index] + i_cts_shift;
+                        p_run[i].i_count = ctts->pi_sample_count[i_index];
+                        p_run[i].i_offset = ctts->pi_sample_offset[i_index] + i_cts_shift;
                         i_sample_count -= ctts->pi_sample_count[i_index];
                         i_index++;
                     }
@@ -3071,7 +3181,7 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
     uint64_t     i_dts;
     unsigned int i_sample;
     unsigned int i_chunk;
-    int          i_index;
+    uint32_t     i_index;
 
     /* FIXME see if it's needed to check p_track->i_chunk_count */
     if( p_track->i_chunk_count == 0 )
@@ -3115,49 +3225,43 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         i_start = MP4_rescale( i_start, CLOCK_FREQ, p_track->i_timescale );
     }
 
-    /* we start from sample 0/chunk 0, hope it won't take too much time */
     /* *** find good chunk *** */
-    for( i_chunk = 0; ; i_chunk++ )
-    {
-        if( i_chunk + 1 >= p_track->i_chunk_count )
-        {
-            /* at the end and can't check if i_start in this chunk,
-               it will be check while searching i_sample */
-            i_chunk = p_track->i_chunk_count - 1;
-            break;
-        }
-
-        if( (uint64_t)i_start >= p_track->chunk[i_chunk].i_first_dts &&
-            (uint64_t)i_start <  p_track->chunk[i_chunk + 1].i_first_dts )
-        {
-            break;
-        }
+    /* the chunks dts are increasing: look for the last one starting
+       at or before i_start, or the last chunk, where i_start will be
+       checked while searching i_sample */
+    uint32_t i_low = 0, i_high = p_track->i_chunk_count;
+    while( i_high - i_low > 1 )
+    {
+        uint32_t i_mid = i_low + (i_high - i_low) / 2;
+        if( (uint64_t)i_start >= p_track->chunk[i_mid].i_first_dts )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
     }
+    i_chunk = i_low;
 
     /* *** find sample in the chunk *** */
-    i_sample = p_track->chunk[i_chunk].i_sample_first;
-    i_dts    = p_track->chunk[i_chunk].i_first_dts;
-    for( i_index = 0; i_sample < p_track->chunk[i_chunk].i_sample_count; )
-    {
-        if( i_dts +
-            p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-            p_track->chunk[i_chunk].p_sample_delta_dts[i_index] < (uint64_t)i_start )
-        {
-            i_dts    +=
-                p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-
-            i_sample += p_track->chunk[i_chunk].p_sample_count_dts[i_index];
+    const mp4_chunk_t *ck = &p_track->chunk[i_chunk];
+    const mp4_dts_run_t *p_run = &p_track->p_dts_runs[ck->i_dts_run];
+    i_sample = ck->i_sample_first;
+    i_dts    = ck->i_first_dts;
+    for( i_index = 0; i_sample < ck->i_sample_count &&
+                      i_index < ck->i_entries_dts; )
+    {
+        if( i_dts + p_run[i_index].i_count * p_run[i_index].i_delta
+                < (uint64_t)i_start )
+        {
+            i_dts    += p_run[i_index].i_count * p_run[i_index].i_delta;
+            i_sample += p_run[i_index].i_count;
             i_index++;
         }
         else
         {
-            if( p_track->chunk[i_chunk].p_sample_delta_dts[i_index] <= 0 )
+            if( p_run[i_index].i_delta <= 0 )
             {
                 break;
             }
-            i_sample += ( i_start - i_dts ) /
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
+            i_sample += ( i_start - i_dts ) / p_run[i_index].i_delta;
             break;
         }
     }
@@ -3496,8 +3600,12 @@ static void MP4_TrackSetup( demux_t *p_demux, mp4_track_t *p_track,
     }
 
     /* Create chunk index table and sample index table */
-    if( TrackCreateChunksIndex( p_demux,p_track  ) ||
-        TrackCreateSamplesIndex( p_demux, p_track ) )
+    if( p_sys->p_indexcache &&
+        MP4_IndexCache_LoadTrack( p_sys->p_indexcache, p_track ) )
+        msg_Dbg( p_demux, "track[Id 0x%x] loaded %"PRIu32" samples from cache",
+                 p_track->i_track_ID, p_track->i_sample_count );
+    else if( TrackCreateChunksIndex( p_demux,p_track  ) ||
+             TrackCreateSamplesIndex( p_demux, p_track ) )
     {
         msg_Err( p_demux, "cannot create chunks index" );
         return; /* cannot create chunks index */
@@ -3591,15 +3699,6 @@ static void MP4_TrackSetup( demux_t *p_demux, mp4_track_t *p_track,
     p_track->b_ok = true;
 }
 
-static void DestroyChunk( mp4_chunk_t *ck )
-{
-    free( ck->p_sample_count_dts );
-    free( ck->p_sample_delta_dts );
-    free( ck->p_sample_count_pts );
-    free( ck->p_sample_offset_pts );
-    free( ck->p_sample_size );
-}
-
 /****************************************************************************
  * MP4_TrackClean:
  ****************************************************************************
@@ -3612,15 +3711,15 @@ static void MP4_TrackClean( es_out_t *out, mp4_track_t *p_track )
     if( p_track->p_es )
         es_out_Del( out, p_track->p_es );
 
-    if( p_track->chunk )
-    {
-        for( unsigned int i_chunk = 0; i_chunk < p_track->i_chunk_count; i_chunk++ )
-            DestroyChunk( &p_track->chunk[i_chunk] );
-    }
     free( p_track->chunk );
 
-    if( !p_track->i_sample_size )
-        free( p_track->p_sample_size );
+    if( !p_track->b_index_cached )
+    {
+        free( p_track->p_dts_runs );
+        free( p_track->p_pts_runs );
+        free( p_track->sample_sizes.p_blocks );
+        free( p_track->sample_sizes.p_data );
+    }
 
     if ( p_track->asfinfo.p_frame )
         block_ChainRelease( p_track->asfinfo.p_frame );
@@ -3741,7 +3840,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
         *pi_nb_samples = 1;
 
         if( p_track->i_sample_size == 0 ) /* all sizes are different */
-            return p_track->p_sample_size[p_track->i_sample];
+            return MP4_SampleSizesGet( &p_track->sample_sizes, p_track->i_sample );
         else
             return p_track->i_sample_size;
     }
@@ -3774,7 +3873,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
         if( p_track->i_sample_size == 0 )
         {
             *pi_nb_samples = 1;
-            return p_track->p_sample_size[p_track->i_sample];
+            return MP4_SampleSizesGet( &p_track->sample_sizes, p_track->i_sample );
         }
 
         if( p_soun->i_qt_version == 1 )
@@ -3785,7 +3884,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
                 if ( p_track->i_sample_size )
                     return p_track->i_sample_size;
                 else
-                    return p_track->p_sample_size[p_track->i_sample];
+                    return MP4_SampleSizesGet( &p_track->sample_sizes, p_track->i_sample );
             }
             else if ( p_soun->i_compressionid != 0 || p_soun->i_bytes_per_sample > 1 ) /* compressed */
             {
@@ -3865,7 +3964,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
         {
             (*pi_nb_samples)++;
             if ( p_track->i_sample_size == 0 )
-                i_size += p_track->p_sample_size[i];
+                i_size += MP4_SampleSizesGet( &p_track->sample_sizes, i );
             else
                 i_size += MP4_GetFixedSampleSize( p_track, p_soun );
 
@@ -3932,7 +4031,7 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
         for( i_sample = p_track->chunk[p_track->i_chunk].i_sample_first;
              i_sample < p_track->i_sample; i_sample++ )
         {
-            i_pos += p_track->p_sample_size[i_sample];
+            i_pos += MP4_SampleSizesGet( &p_track->sample_sizes, i_sample );
         }
     }
 
@@ -47,20 +47,67 @@ typedef struct
     uint64_t     i_first_dts;   /* DTS of the first sample */
     uint64_t     i_duration;    /* total duration of all samples */
 
+    /* runs of the track tables covering the samples of this chunk */
+    uint32_t     i_dts_run;     /* first run in p_dts_runs */
     uint32_t     i_entries_dts;
-    uint32_t     *p_sample_count_dts;
-    uint32_t     *p_sample_delta_dts;   /* dts delta */
-
+    uint32_t     i_pts_run;     /* first run in p_pts_runs */
     uint32_t     i_entries_pts;
-    uint32_t     *p_sample_count_pts;
-    int32_t      *p_sample_offset_pts;  /* pts-dts */
-
-    uint32_t     *p_sample_size;
-    /* TODO if needed add pts
-        but quickly *add* support for edts and seeking */
 
 } mp4_chunk_t;
 
+/* Run of samples with the same dts delta (stts) */
+typedef struct
+{
+    uint32_t i_count;
+    uint32_t i_delta;
+} mp4_dts_run_t;
+
+/* Run of samples with the same pts-dts offset (ctts) */
+typedef struct
+{
+    uint32_t i_count;
+    int32_t  i_offset;
+} mp4_pts_run_t;
+
+/* Sample sizes are stored by blocks of MP4_SIZE_BLOCK samples, as offsets
+ * from the smallest size of the block, on the fewest bytes needed */
+#define MP4_SIZE_BLOCK 256
+
+typedef struct
+{
+    uint32_t i_base;   /* smallest size of the block */
+    uint32_t i_offset; /* of the block in p_data, aligned on i_width */
+    uint32_t i_width;  /* bytes per size: 0 (all equal), 1, 2 or 4 */
+} mp4_size_block_t;
+
+typedef struct
+{
+    mp4_size_block_t *p_blocks;
+    uint8_t          *p_data;
+    uint32_t          i_blocks;
+    uint32_t          i_data;
+} mp4_sample_sizes_t;
+
+static inline uint32_t MP4_SampleSizesGet( const mp4_sample_sizes_t *p_sizes,
+                                           uint32_t i_sample )
+{
+    const mp4_size_block_t *p_block = &p_sizes->p_blocks[i_sample / MP4_SIZE_BLOCK];
+    if( p_block->i_width == 0 )
+        return p_block->i_base;
+
+    const uint8_t *p_data = &p_sizes->p_data[p_block->i_offset];
+    i_sample %= MP4_SIZE_BLOCK;
+    switch( p_block->i_width )
+    {
+        case 1:
+            return p_block->i_base + p_data[i_sample];
+        case 2:
+            return p_block->i_base + ((const uint16_t *)p_data)[i_sample];
+        default:
+            return p_block->i_base + ((const uint32_t *)p_data)[i_sample];
+    }
+}
+
 typedef struct
 {
     uint64_t i_offset;
@@ -116,12 +163,18 @@ typedef struct
     uint32_t         i_sample_count;
 
     mp4_chunk_t    *chunk; /* always defined  for each chunk */
+    bool            b_index_cached; /* tables mapped from the index cache */
+
+    /* dts and pts-dts runs of all the chunks, in chunk order */
+    mp4_dts_run_t   *p_dts_runs;
+    uint32_t         i_dts_runs;
+    mp4_pts_run_t   *p_pts_runs;    /* NULL without ctts */
+    uint32_t         i_pts_runs;
 
-    /* sample size, p_sample_size defined only if i_sample_size == 0
+    /* sample size, sample_sizes defined only if i_sample_size == 0
         else i_sample_size is size for all sample */
     uint32_t         i_sample_size;
-    uint32_t         *p_sample_size; /* XXX perhaps add file offset if take
-//                                    too much time to do sumations each time*/
+    mp4_sample_sizes_t sample_sizes;
 
     uint32_t     i_sample_first; /* i_sample_first value
                                                    of the next chunk */
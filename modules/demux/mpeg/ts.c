@@ -115,6 +115,11 @@ static void Close ( vlc_object_t * );
 #define CC_CHECK_LONGTEXT   "Detect discontinuities and drop packet duplicates. " \
                             "(bluRay sources are known broken and have false positives). "
 
+#define READ_BATCH_TEXT N_("Packets per read")
+#define READ_BATCH_LONGTEXT N_( \
+    "Number of TS packets fetched from the input at once. Larger values " \
+    "reduce per packet overhead on high bitrate multiplexes." )
+
 #define PCR_TEXT N_("Trust in-stream PCR")
 #define PCR_LONGTEXT N_("Use the stream PCR as a reference.")
 
@@ -153,6 +158,8 @@ vlc_module_begin ()
     add_bool( "ts-split-es", true, SPLIT_ES_TEXT, SPLIT_ES_LONGTEXT, false )
     add_bool( "ts-seek-percent", false, SEEK_PERCENT_TEXT, SEEK_PERCENT_LONGTEXT, true )
     add_bool( "ts-cc-check", true, CC_CHECK_TEXT, CC_CHECK_LONGTEXT, true )
+    add_integer_with_range( "ts-read-batch", 64, 16, 1024,
+                            READ_BATCH_TEXT, READ_BATCH_LONGTEXT, true )
 
     add_obsolete_bool( "ts-silent" );
 
@@ -186,6 +193,10 @@ static bool GatherSectionsData( demux_t *p_demux, ts_pid_t *, block_t *, size_t
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_prg, stime_t i_pcr );
 
 static block_t* ReadTSPacket( demux_t *p_demux );
+static block_t* ReadTSPacketDetach( block_t *p_pkt );
+static void DescrambleTSPackets( demux_t *p_demux, const block_t *p_pkt );
+static uint64_t TsStreamTell( demux_sys_t *p_sys );
+static int TsStreamSeek( demux_sys_t *p_sys, uint64_t i_pos );
 static int SeekToTime( demux_t *p_demux, const ts_pmt_t *, stime_t time );
 static void ReadyQueuesPostSeek( demux_t *p_demux );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, stime_t );
@@ -394,7 +405,10 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_packet_size = i_packet_size;
     p_sys->i_packet_header_size = i_packet_header_size;
     p_sys->i_ts_read = 50;
+    p_sys->readbatch.i_size = i_packet_size *
+                              var_InheritInteger( p_demux, "ts-read-batch" );
     p_sys->csa = NULL;
+    p_sys->i_csa_cw = 0;
     p_sys->b_start_record = false;
 
     vlc_dictionary_init( &p_sys->attachments, 0 );
@@ -580,6 +594,8 @@ static void Close( vlc_object_t *p_this )
     /* Clear up attachments */
     vlc_dictionary_clear( &p_sys->attachments, FreeDictAttachment, NULL );
 
+    free( p_sys->readbatch.p_scrambled );
+    free( p_sys->readbatch.p_buffer );
     free( p_sys );
 }
 
@@ -600,7 +616,7 @@ static int ChangeKeyCallback( vlc_object_t *p_this, char const *psz_cmd,
         i_tmp = csa_SetCW( p_this, p_sys->csa, newval.psz_string, true );
     else
         i_tmp = csa_SetCW( p_this, p_sys->csa, newval.psz_string, false );
-
+    p_sys->i_csa_cw++;
     vlc_mutex_unlock( &p_sys->csa_lock );
     return i_tmp;
 }
@@ -632,6 +648,9 @@ static int Demux( demux_t *p_demux )
             return VLC_DEMUXER_EOF;
         }
 
+        if( p_sys->csa )
+            DescrambleTSPackets( p_demux, p_pkt );
+
         if( p_sys->b_start_record )
         {
             /* Enable recording once synchronized */
@@ -721,7 +740,9 @@ static int Demux( demux_t *p_demux )
 
             if( p_pid->u.p_stream->transport == TS_TRANSPORT_PES )
             {
-                b_frame = GatherPESData( p_demux, p_pid, p_pkt, i_header );
+                p_pkt = ReadTSPacketDetach( p_pkt );
+                if( p_pkt )
+                    b_frame = GatherPESData( p_demux, p_pid, p_pkt, i_header );
             }
             else if( p_pid->u.p_stream->transport == TS_TRANSPORT_SECTIONS )
             {
@@ -943,7 +964,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         if( (i64 = stream_Size( p_sys->stream) ) > 0 )
         {
-            uint64_t offset = vlc_stream_Tell( p_sys->stream );
+            uint64_t offset = TsStreamTell( p_sys );
             *pf = (double)offset / (double)i64;
             return VLC_SUCCESS;
         }
@@ -990,7 +1011,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         i64 = stream_Size( p_sys->stream );
         if( i64 > 0 &&
-            vlc_stream_Seek( p_sys->stream, (int64_t)(i64 * f) ) == VLC_SUCCESS )
+            TsStreamSeek( p_sys, (int64_t)(i64 * f) ) == VLC_SUCCESS )
         {
             ReadyQueuesPostSeek( p_demux );
             return VLC_SUCCESS;
@@ -1718,14 +1739,84 @@ static bool PushPESBlock( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt, bool
     return b_ret;
 }
 
+/*****************************************************************************
+ * Packet reading:
+ *  packets are read from the stream by slabs and handed out as views on
+ *  the slab. Only the ones which have to outlive the next read (PES data
+ *  being gathered) get their own block.
+ *****************************************************************************/
+static void ReadTSPacketViewRelease( block_t *p_pkt )
+{
+    VLC_UNUSED(p_pkt); /* storage belongs to the read slab */
+}
+
+static uint64_t TsStreamTell( demux_sys_t *p_sys )
+{
+    return vlc_stream_Tell( p_sys->stream ) -
+           ( p_sys->readbatch.i_data - p_sys->readbatch.i_offset );
+}
+
+static int TsStreamSeek( demux_sys_t *p_sys, uint64_t i_pos )
+{
+    p_sys->readbatch.i_offset = 0;
+    p_sys->readbatch.i_data = 0;
+    p_sys->readbatch.i_descrambled = 0;
+    return vlc_stream_Seek( p_sys->stream, i_pos );
+}
+
+/* Makes at least i_min bytes available from the current slab offset.
+ * Only returns what is already available from the stream above that. */
+static bool ReadTSPacketFill( demux_sys_t *p_sys, size_t i_min )
+{
+    size_t i_avail = p_sys->readbatch.i_data - p_sys->readbatch.i_offset;
+    if( i_avail >= i_min )
+        return true;
+
+    assert( i_min <= p_sys->readbatch.i_size );
+    if( p_sys->readbatch.p_buffer == NULL )
+    {
+        p_sys->readbatch.p_buffer = malloc( p_sys->readbatch.i_size );
+        if( p_sys->readbatch.p_buffer == NULL )
+            return false;
+    }
+
+    uint8_t *p_buf = p_sys->readbatch.p_buffer;
+    if( p_sys->readbatch.i_offset > 0 )
+    {
+        memmove( p_buf, &p_buf[p_sys->readbatch.i_offset], i_avail );
+        if( p_sys->readbatch.i_descrambled > p_sys->readbatch.i_offset )
+        {
+            p_sys->readbatch.i_descrambled -= p_sys->readbatch.i_offset;
+            memmove( p_sys->readbatch.p_scrambled,
+                     &p_sys->readbatch.p_scrambled[p_sys->readbatch.i_offset],
+                     p_sys->readbatch.i_descrambled );
+        }
+        else
+            p_sys->readbatch.i_descrambled = 0;
+        p_sys->readbatch.i_offset = 0;
+        p_sys->readbatch.i_data = i_avail;
+    }
+
+    while( p_sys->readbatch.i_data < i_min )
+    {
+        ssize_t i_read = vlc_stream_ReadPartial( p_sys->stream,
+                                                 &p_buf[p_sys->readbatch.i_data],
+                                                 p_sys->readbatch.i_size - p_sys->readbatch.i_data );
+        if( i_read <= 0 )
+            return false;
+        p_sys->readbatch.i_data += i_read;
+    }
+    return true;
+}
+
 static block_t* ReadTSPacket( demux_t *p_demux )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-
-    block_t     *p_pkt;
+    const size_t i_packet_size = p_sys->i_packet_size;
+    const size_t i_header_size = p_sys->i_packet_header_size;
 
     /* Get a new TS packet */
-    if( !( p_pkt = vlc_stream_Block( p_sys->stream, p_sys->i_packet_size ) ) )
+    if( !ReadTSPacketFill( p_sys, i_packet_size ) )
     {
         int64_t size = stream_Size( p_sys->stream );
         if( size >= 0 && (uint64_t)size == vlc_stream_Tell( p_sys->stream ) )
@@ -1735,65 +1826,143 @@ static block_t* ReadTSPacket( demux_t *p_demux )
         return NULL;
     }
 
-    if( p_pkt->i_buffer < TS_HEADER_SIZE + p_sys->i_packet_header_size )
-    {
-        block_Release( p_pkt );
-        return NULL;
-    }
-
-    /* Skip header (BluRay streams).
-     * re-sync logic would do this (by adjusting packet start), but this would result in losing first and last ts packets.
-     * First packet is usually PAT, and losing it means losing whole first GOP. This is fatal with still-image based menus.
-     */
-    p_pkt->p_buffer += p_sys->i_packet_header_size;
-    p_pkt->i_buffer -= p_sys->i_packet_header_size;
-
     /* Check sync byte and re-sync if needed */
-    if( p_pkt->p_buffer[0] != 0x47 )
+    if( p_sys->readbatch.p_buffer[p_sys->readbatch.i_offset + i_header_size] != 0x47 )
     {
         msg_Warn( p_demux, "lost synchro" );
-        block_Release( p_pkt );
         for( ;; )
         {
-            const uint8_t *p_peek;
-            int i_peek = 0;
-            unsigned i_skip = 0;
+            const bool b_eof = !ReadTSPacketFill( p_sys, i_packet_size * 10 );
+            const uint8_t *p_peek = &p_sys->readbatch.p_buffer[p_sys->readbatch.i_offset];
+            size_t i_peek = p_sys->readbatch.i_data - p_sys->readbatch.i_offset;
+            size_t i_skip = 0;
 
-            i_peek = vlc_stream_Peek( p_sys->stream, &p_peek,
-                    p_sys->i_packet_size * 10 );
-            if( i_peek < 0 || (unsigned)i_peek < p_sys->i_packet_size + 1 )
+            if( i_peek < i_packet_size + 1 )
             {
                 msg_Dbg( p_demux, "eof ?" );
                 return NULL;
             }
 
-            while( i_skip < i_peek - p_sys->i_packet_size )
+            while( i_skip + i_header_size + i_packet_size < i_peek )
             {
-                if( p_peek[i_skip + p_sys->i_packet_header_size] == 0x47 &&
-                        p_peek[i_skip + p_sys->i_packet_header_size + p_sys->i_packet_size] == 0x47 )
+                if( p_peek[i_skip + i_header_size] == 0x47 &&
+                        p_peek[i_skip + i_header_size + i_packet_size] == 0x47 )
                 {
                     break;
                 }
                 i_skip++;
             }
-            msg_Dbg( p_demux, "skipping %d bytes of garbage", i_skip );
-            if (vlc_stream_Read( p_sys->stream, NULL, i_skip ) != i_skip)
-                return NULL;
+            msg_Dbg( p_demux, "skipping %zu bytes of garbage", i_skip );
+            p_sys->readbatch.i_offset += i_skip;
 
-            if( i_skip < i_peek - p_sys->i_packet_size )
+            if( i_skip + i_header_size + i_packet_size < i_peek )
             {
                 break;
             }
+            else if( b_eof )
+            {
+                msg_Dbg( p_demux, "eof ?" );
+                return NULL;
+            }
         }
-        if( !( p_pkt = vlc_stream_Block( p_sys->stream, p_sys->i_packet_size ) ) )
+        if( !ReadTSPacketFill( p_sys, i_packet_size ) )
         {
             msg_Dbg( p_demux, "eof ?" );
             return NULL;
         }
     }
+
+    block_t *p_pkt = &p_sys->readbatch.pkt;
+    block_Init( p_pkt, &p_sys->readbatch.p_buffer[p_sys->readbatch.i_offset],
+                i_packet_size );
+    p_pkt->pf_release = ReadTSPacketViewRelease;
+    p_sys->readbatch.i_offset += i_packet_size;
+
+    /* Skip header (BluRay streams).
+     * re-sync logic would do this (by adjusting packet start), but this would result in losing first and last ts packets.
+     * First packet is usually PAT, and losing it means losing whole first GOP. This is fatal with still-image based menus.
+     */
+    p_pkt->p_buffer += i_header_size;
+    p_pkt->i_buffer -= i_header_size;
+
     return p_pkt;
 }
 
+/* Descrambles at once the packets from p_pkt up to the end of the read
+ * slab, unless already done. ProcessTSPacket() then sees them as clear.
+ * If the control words change in the mean time, the packets not processed
+ * yet are restored and descrambled again with the new ones. */
+static void DescrambleTSPackets( demux_t *p_demux, const block_t *p_pkt )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_packet_size = p_sys->i_packet_size;
+    const size_t i_header_size = p_sys->i_packet_header_size;
+    uint8_t *p_buf = p_sys->readbatch.p_buffer;
+    const size_t i_start = p_pkt->p_buffer - i_header_size - p_buf;
+    size_t i_offset = i_start;
+    uint8_t *pp_scrambled[CSA_BATCH_MAX];
+    unsigned i_scrambled = 0;
+
+    if( p_sys->readbatch.p_scrambled == NULL )
+    {
+        p_sys->readbatch.p_scrambled = malloc( p_sys->readbatch.i_size );
+        if( unlikely(p_sys->readbatch.p_scrambled == NULL) )
+            return; /* ProcessTSPacket() will descramble packet by packet */
+    }
+
+    vlc_mutex_lock( &p_sys->csa_lock );
+    if( i_offset < p_sys->readbatch.i_descrambled )
+    {
+        if( p_sys->readbatch.i_descrambled_cw == p_sys->i_csa_cw )
+        {
+            vlc_mutex_unlock( &p_sys->csa_lock );
+            return;
+        }
+        memcpy( &p_buf[i_offset], &p_sys->readbatch.p_scrambled[i_offset],
+                p_sys->readbatch.i_descrambled - i_offset );
+    }
+
+    while( i_scrambled < CSA_BATCH_MAX &&
+           i_offset + i_packet_size <= p_sys->readbatch.i_data )
+    {
+        uint8_t *p = &p_buf[i_offset + i_header_size];
+
+        /* stop where the re-sync will happen */
+        if( p[0] != 0x47 )
+            break;
+        i_offset += i_packet_size;
+
+        /* same packets as ProcessTSPacket() decrypts */
+        if( (p[3]&0x80) && !(p[1]&0x80) && ( ((p[1]&0x1f) << 8) | p[2] ) != 0x1FFF )
+            pp_scrambled[i_scrambled++] = p;
+    }
+    memcpy( &p_sys->readbatch.p_scrambled[i_start], &p_buf[i_start],
+            i_offset - i_start );
+    p_sys->readbatch.i_descrambled = i_offset;
+    p_sys->readbatch.i_descrambled_cw = p_sys->i_csa_cw;
+
+    if( i_scrambled > 0 )
+        csa_DecryptBatch( p_sys->csa, pp_scrambled, i_scrambled,
+                          p_sys->i_csa_pkt_size );
+    vlc_mutex_unlock( &p_sys->csa_lock );
+}
+
+/* Gives a packet its own storage so it can be kept past the next read */
+static block_t* ReadTSPacketDetach( block_t *p_pkt )
+{
+    if( p_pkt->pf_release != ReadTSPacketViewRelease )
+        return p_pkt;
+
+    block_t *p_copy = block_Alloc( p_pkt->i_buffer );
+    if( likely(p_copy) )
+    {
+        memcpy( p_copy->p_buffer, p_pkt->p_buffer, p_pkt->i_buffer );
+        p_copy->i_flags = p_pkt->i_flags;
+    }
+    block_Release( p_pkt );
+    return p_copy;
+}
+
 static stime_t GetPCR( const block_t *p_pkt )
 {
     const uint8_t *p = p_pkt->p_buffer;
@@ -1900,13 +2069,13 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, stime_t i_scaled
 
     /* Deal with common but worst binary search case */
     if( p_pmt->pcr.i_first == i_scaledtime && p_sys->b_canseek )
-        return vlc_stream_Seek( p_sys->stream, 0 );
+        return TsStreamSeek( p_sys, 0 );
 
     const int64_t i_stream_size = stream_Size( p_sys->stream );
     if( !p_sys->b_canfastseek || i_stream_size < p_sys->i_packet_size )
         return VLC_EGENERIC;
 
-    const uint64_t i_initial_pos = vlc_stream_Tell( p_sys->stream );
+    const uint64_t i_initial_pos = TsStreamTell( p_sys );
 
     /* Find the time position by using binary search algorithm. */
     uint64_t i_head_pos = 0;
@@ -1922,7 +2091,7 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, stime_t i_scaled
         uint64_t i_div = i_splitpos % p_sys->i_packet_size;
         i_splitpos -= i_div;
 
-        if ( vlc_stream_Seek( p_sys->stream, i_splitpos ) != VLC_SUCCESS )
+        if ( TsStreamSeek( p_sys, i_splitpos ) != VLC_SUCCESS )
             break;
 
         uint64_t i_pos = i_splitpos;
@@ -1936,7 +2105,7 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, stime_t i_scaled
                 break;
             }
             else
-                i_pos = vlc_stream_Tell( p_sys->stream );
+                i_pos = TsStreamTell( p_sys );
 
             int i_pid = PIDGet( p_pkt );
             ts_pid_t *p_pid = GetPID(p_sys, i_pid);
@@ -1993,7 +2162,7 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, stime_t i_scaled
     if( !b_found )
     {
         msg_Dbg( p_demux, "Seek():cannot find a time position." );
-        vlc_stream_Seek( p_sys->stream, i_initial_pos );
+        TsStreamSeek( p_sys, i_initial_pos );
         return VLC_EGENERIC;
     }
     return VLC_SUCCESS;
@@ -2074,7 +2243,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, stime_t *pi_
                         if( b_end )
                         {
                             p_pmt->i_last_dts = *pi_pcr;
-                            p_pmt->i_last_dts_byte = vlc_stream_Tell( p_sys->stream );
+                            p_pmt->i_last_dts_byte = TsStreamTell( p_sys );
                         }
                         /* Start, only keep first */
                         else if( b_pcrresult && p_pmt->pcr.i_first == -1 )
@@ -2102,7 +2271,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, stime_t *pi_
 int ProbeStart( demux_t *p_demux, int i_program )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    const uint64_t i_initial_pos = vlc_stream_Tell( p_sys->stream );
+    const uint64_t i_initial_pos = TsStreamTell( p_sys );
     int64_t i_stream_size = stream_Size( p_sys->stream );
 
     int i_probe_count = 0;
@@ -2115,7 +2284,7 @@ int ProbeStart( demux_t *p_demux, int i_program )
         i_pos = p_sys->i_packet_size * i_probe_count;
         i_pos = __MIN( i_pos, i_stream_size );
 
-        if( vlc_stream_Seek( p_sys->stream, i_pos ) )
+        if( TsStreamSeek( p_sys, i_pos ) )
             return VLC_EGENERIC;
 
         ProbeChunk( p_demux, i_program, false, &i_pcr, &b_found );
@@ -2125,7 +2294,7 @@ int ProbeStart( demux_t *p_demux, int i_program )
     } while( i_pos < i_stream_size && !b_found &&
              i_probe_count < PROBE_MAX );
 
-    if( vlc_stream_Seek( p_sys->stream, i_initial_pos ) )
+    if( TsStreamSeek( p_sys, i_initial_pos ) )
         return VLC_EGENERIC;
 
     return (b_found) ? VLC_SUCCESS : VLC_EGENERIC;
@@ -2134,7 +2303,7 @@ int ProbeStart( demux_t *p_demux, int i_program )
 int ProbeEnd( demux_t *p_demux, int i_program )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    const uint64_t i_initial_pos = vlc_stream_Tell( p_sys->stream );
+    const uint64_t i_initial_pos = TsStreamTell( p_sys );
     int64_t i_stream_size = stream_Size( p_sys->stream );
 
     int i_probe_count = PROBE_CHUNK_COUNT;
@@ -2147,7 +2316,7 @@ int ProbeEnd( demux_t *p_demux, int i_program )
         i_pos = i_stream_size - (p_sys->i_packet_size * i_probe_count);
         i_pos = __MAX( i_pos, 0 );
 
-        if( vlc_stream_Seek( p_sys->stream, i_pos ) )
+        if( TsStreamSeek( p_sys, i_pos ) )
             return VLC_EGENERIC;
 
         ProbeChunk( p_demux, i_program, true, &i_pcr, &b_found );
@@ -2157,7 +2326,7 @@ int ProbeEnd( demux_t *p_demux, int i_program )
     } while( i_pos > 0 && !b_found &&
              i_probe_count < PROBE_MAX );
 
-    if( vlc_stream_Seek( p_sys->stream, i_initial_pos ) )
+    if( TsStreamSeek( p_sys, i_initial_pos ) )
         return VLC_EGENERIC;
 
     return (b_found) ? VLC_SUCCESS : VLC_EGENERIC;
@@ -2208,14 +2377,14 @@ static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, stime_t i_pcr )
         es_out_Control( p_demux->out, ES_OUT_SET_GROUP_PCR, p_pmt->i_number, FROM_SCALE(i_pcr) );
         /* growing files/named fifo handling */
         if( p_sys->b_access_control == false &&
-            vlc_stream_Tell( p_sys->stream ) > p_pmt->i_last_dts_byte )
+            TsStreamTell( p_sys ) > p_pmt->i_last_dts_byte )
         {
             if( p_pmt->i_last_dts_byte == 0 ) /* first run */
                 p_pmt->i_last_dts_byte = stream_Size( p_sys->stream );
             else
             {
                 p_pmt->i_last_dts = i_pcr;
-                p_pmt->i_last_dts_byte = vlc_stream_Tell( p_sys->stream );
+                p_pmt->i_last_dts_byte = TsStreamTell( p_sys );
             }
         }
     }
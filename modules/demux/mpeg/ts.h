@@ -63,6 +63,19 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     unsigned    i_ts_read;
 
+    /* Slab of packets read in one go from the stream */
+    struct
+    {
+        uint8_t    *p_buffer;
+        size_t      i_size;   /* allocated size */
+        size_t      i_offset; /* next packet to process */
+        size_t      i_data;   /* valid bytes */
+        size_t      i_descrambled; /* end of the already descrambled packets */
+        unsigned    i_descrambled_cw; /* control words used for them */
+        uint8_t    *p_scrambled; /* their scrambled data, at the same offsets */
+        block_t     pkt;      /* view on the current packet */
+    } readbatch;
+
     bool        b_cc_check;
     bool        b_ignore_time_for_positions;
 
@@ -96,6 +109,7 @@ struct demux_sys_t
 
     csa_t       *csa;
     int         i_csa_pkt_size;
+    unsigned    i_csa_cw; /* control words changes count */
     bool        b_split_es;
     bool        b_valid_scrambling;
 
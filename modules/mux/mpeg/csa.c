@@ -26,10 +26,21 @@
 # include "config.h"
 #endif
 
+#include <assert.h>
+
 #include <vlc_common.h>
+#include <vlc_cpu.h>
 
 #include "csa.h"
 
+#if defined(__GNUC__) && defined(HAVE_ATTRIBUTE_TARGET) \
+ && (defined(__i386__) || defined(__x86_64__))
+#   define CSA_BS_HAVE_SIMD
+#endif
+
+/* payload bytes of a 188 bytes packet after the minimal header */
+#define CSA_PAYLOAD_MAX (188 - 4)
+
 struct csa_t
 {
     /* odd and even keys */
@@ -47,6 +58,9 @@ struct csa_t
     int     p, q, r;
 
     bool    use_odd;
+
+    /* keystream of the packets of a batch */
+    uint8_t stream[CSA_BATCH_MAX][CSA_PAYLOAD_MAX];
 };
 
 static void csa_ComputeKey( uint8_t kk[57], uint8_t ck[8] );
@@ -56,6 +70,14 @@ static void csa_StreamCypher( csa_t *c, int b_init, uint8_t *ck, uint8_t *sb, ui
 static void csa_BlockDecypher( uint8_t kk[57], uint8_t ib[8], uint8_t bd[8] );
 static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] );
 
+static void csa_StreamCypherBatch( const uint8_t ck[8], uint8_t *const *pp_sb,
+                                   unsigned i_count, uint8_t (*p_cb)[CSA_PAYLOAD_MAX],
+                                   unsigned i_blocks );
+static void csa_BlockDecypherBatch( const uint8_t kk[57], uint8_t *const *pp_ib,
+                                    uint8_t (*p_bd)[8], unsigned i_count );
+static void csa_BlockCypherBatch( const uint8_t kk[57], uint8_t *const *pp_bd,
+                                  unsigned i_count );
+
 /*****************************************************************************
  * csa_New:
  *****************************************************************************/
@@ -307,6 +329,234 @@ void csa_Encrypt( csa_t *c, uint8_t *pkt, int i_pkt_size )
     }
 }
 
+/*****************************************************************************
+ * csa_DecryptBatch:
+ *****************************************************************************
+ * The keystream of a packet only depends on the key and on its first
+ * cyphered block, so it is generated for all the packets using the same key
+ * at once. The block decyphers of all the blocks are then independent.
+ *****************************************************************************/
+static void csa_DecryptLanes( csa_t *c, bool odd, uint8_t *const *pp_pkt,
+                              unsigned i_count, int i_pkt_size )
+{
+    uint8_t *kk = odd ? c->o_kk : c->e_kk;
+    uint8_t *pp_ib[CSA_BATCH_MAX];
+    uint8_t  bd[CSA_BATCH_MAX][8];
+    int      pi_hdr[CSA_BATCH_MAX], pi_n[CSA_BATCH_MAX];
+    int      i_n_max = 0, i_stream_max = 0;
+
+    for( unsigned l = 0; l < i_count; l++ )
+    {
+        const uint8_t *pkt = pp_pkt[l];
+
+        pi_hdr[l] = 4;
+        if( pkt[3]&0x20 )
+            pi_hdr[l] += pkt[4] + 1;
+        pi_n[l] = (i_pkt_size - pi_hdr[l]) / 8;
+        i_n_max = __MAX( i_n_max, pi_n[l] );
+
+        /* blocks 2..n and the residue are xored with the keystream */
+        const int i_stream = __MAX( pi_n[l] - 1, 0 ) +
+                             ( (i_pkt_size - pi_hdr[l]) % 8 > 0 );
+        i_stream_max = __MAX( i_stream_max, i_stream );
+
+        pp_ib[l] = &pp_pkt[l][pi_hdr[l]];
+    }
+
+    if( i_stream_max > 0 )
+        csa_StreamCypherBatch( odd ? c->o_ck : c->e_ck, pp_ib, i_count,
+                               c->stream, i_stream_max );
+
+    for( unsigned l = 0; l < i_count; l++ )
+    {
+        uint8_t *pkt = pp_pkt[l];
+        const int i_residue = (i_pkt_size - pi_hdr[l]) % 8;
+
+        /* xor ib with stream */
+        for( int i = 1; i < pi_n[l]; i++ )
+        {
+            for( int j = 0; j < 8; j++ )
+                pkt[pi_hdr[l]+8*i+j] ^= c->stream[l][8*(i-1)+j];
+        }
+        if( i_residue > 0 )
+        {
+            const uint8_t *stream = &c->stream[l][8*__MAX( pi_n[l] - 1, 0 )];
+            for( int j = 0; j < i_residue; j++ )
+                pkt[i_pkt_size - i_residue + j] ^= stream[j];
+        }
+    }
+
+    for( int i = 0; i < i_n_max; i++ )
+    {
+        unsigned i_blocks = 0;
+
+        for( unsigned l = 0; l < i_count; l++ )
+        {
+            if( i < pi_n[l] )
+                pp_ib[i_blocks++] = &pp_pkt[l][pi_hdr[l]+8*i];
+        }
+        csa_BlockDecypherBatch( kk, pp_ib, bd, i_blocks );
+
+        i_blocks = 0;
+        for( unsigned l = 0; l < i_count; l++ )
+        {
+            if( i >= pi_n[l] )
+                continue;
+
+            uint8_t *block = &pp_pkt[l][pi_hdr[l]+8*i];
+            /* xor the next ib (zero after the last block) with block */
+            for( int j = 0; j < 8; j++ )
+                block[j] = ( i + 1 < pi_n[l] ? block[8+j] : 0 ) ^ bd[i_blocks][j];
+            i_blocks++;
+        }
+    }
+}
+
+void csa_DecryptBatch( csa_t *c, uint8_t *const *pp_pkt, unsigned i_count,
+                       int i_pkt_size )
+{
+    uint8_t *pp_lanes[2][CSA_BATCH_MAX];
+    unsigned pi_lanes[2] = { 0, 0 };
+
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        uint8_t *pkt = pp_pkt[i];
+        int i_hdr;
+
+        /* transport scrambling control */
+        if( (pkt[3]&0x80) == 0 )
+            continue;
+
+        const bool odd = pkt[3]&0x40;
+
+        /* clear transport scrambling control */
+        pkt[3] &= 0x3f;
+
+        i_hdr = 4;
+        if( pkt[3]&0x20 )
+            i_hdr += pkt[4] + 1;
+
+        if( 188 - i_hdr < 8 || i_pkt_size < i_hdr )
+            continue;
+
+        pp_lanes[odd][pi_lanes[odd]++] = pkt;
+        if( pi_lanes[odd] == CSA_BATCH_MAX )
+        {
+            csa_DecryptLanes( c, odd, pp_lanes[odd], pi_lanes[odd], i_pkt_size );
+            pi_lanes[odd] = 0;
+        }
+    }
+
+    for( int odd = 0; odd < 2; odd++ )
+    {
+        if( pi_lanes[odd] > 0 )
+            csa_DecryptLanes( c, odd, pp_lanes[odd], pi_lanes[odd], i_pkt_size );
+    }
+}
+
+/*****************************************************************************
+ * csa_EncryptBatch:
+ *****************************************************************************
+ * The block cypher chains of all the packets run together, from their last
+ * block, then the keystreams are generated at once from their first blocks.
+ *****************************************************************************/
+static void csa_EncryptLanes( csa_t *c, uint8_t *const *pp_pkt,
+                              unsigned i_count, int i_pkt_size )
+{
+    uint8_t *ck = c->use_odd ? c->o_ck : c->e_ck;
+    uint8_t *kk = c->use_odd ? c->o_kk : c->e_kk;
+    uint8_t *pp_lanes[CSA_BATCH_MAX];
+    uint8_t *pp_ib[CSA_BATCH_MAX];
+    int      pi_hdr[CSA_BATCH_MAX], pi_n[CSA_BATCH_MAX];
+    unsigned i_lanes = 0;
+    int      i_n_max = 0, i_stream_max = 0;
+
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        uint8_t *pkt = pp_pkt[i];
+        int i_hdr, n;
+
+        /* set transport scrambling control */
+        pkt[3] |= 0x80;
+        if( c->use_odd )
+            pkt[3] |= 0x40;
+
+        i_hdr = 4;
+        if( pkt[3]&0x20 )
+            i_hdr += pkt[4] + 1;
+        n = (i_pkt_size - i_hdr) / 8;
+
+        if( n <= 0 )
+        {
+            pkt[3] &= 0x3f;
+            continue;
+        }
+
+        const int i_stream = n - 1 + ( (i_pkt_size - i_hdr) % 8 > 0 );
+        i_stream_max = __MAX( i_stream_max, i_stream );
+        i_n_max = __MAX( i_n_max, n );
+
+        pp_lanes[i_lanes] = pkt;
+        pi_hdr[i_lanes] = i_hdr;
+        pi_n[i_lanes] = n;
+        i_lanes++;
+    }
+
+    /* ib of block i is the cyphered block i xor ib of block i+1,
+     * replacing the plain block */
+    for( int i = i_n_max - 1; i >= 0; i-- )
+    {
+        unsigned i_blocks = 0;
+
+        for( unsigned l = 0; l < i_lanes; l++ )
+        {
+            if( i >= pi_n[l] )
+                continue;
+
+            uint8_t *block = &pp_lanes[l][pi_hdr[l]+8*i];
+            if( i + 1 < pi_n[l] )
+            {
+                for( int j = 0; j < 8; j++ )
+                    block[j] ^= block[8+j];
+            }
+            pp_ib[i_blocks++] = block;
+        }
+        csa_BlockCypherBatch( kk, pp_ib, i_blocks );
+    }
+
+    /* init csa state with the first ib */
+    for( unsigned l = 0; l < i_lanes; l++ )
+        pp_ib[l] = &pp_lanes[l][pi_hdr[l]];
+    if( i_stream_max > 0 )
+        csa_StreamCypherBatch( ck, pp_ib, i_lanes, c->stream, i_stream_max );
+
+    for( unsigned l = 0; l < i_lanes; l++ )
+    {
+        uint8_t *pkt = pp_lanes[l];
+        const int i_residue = (i_pkt_size - pi_hdr[l]) % 8;
+
+        for( int i = 1; i < pi_n[l]; i++ )
+        {
+            for( int j = 0; j < 8; j++ )
+                pkt[pi_hdr[l]+8*i+j] ^= c->stream[l][8*(i-1)+j];
+        }
+        if( i_residue > 0 )
+        {
+            const uint8_t *stream = &c->stream[l][8*(pi_n[l]-1)];
+            for( int j = 0; j < i_residue; j++ )
+                pkt[i_pkt_size - i_residue + j] ^= stream[j];
+        }
+    }
+}
+
+void csa_EncryptBatch( csa_t *c, uint8_t *const *pp_pkt, unsigned i_count,
+                       int i_pkt_size )
+{
+    for( unsigned i = 0; i < i_count; i += CSA_BATCH_MAX )
+        csa_EncryptLanes( c, &pp_pkt[i], __MIN( i_count - i, CSA_BATCH_MAX ),
+                          i_pkt_size );
+}
+
 /*****************************************************************************
  * Divers
  *****************************************************************************/
@@ -610,3 +860,160 @@ static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] )
     }
 }
 
+/* Same as csa_BlockDecypher on i_count independent blocks. The registers
+ * of a block are packed in a 64 bits word, R[1] in the low byte, and each
+ * round runs on all the blocks to hide the latency of the table lookups. */
+static void csa_BlockDecypherBatch( const uint8_t kk[57], uint8_t *const *pp_ib,
+                                    uint8_t (*p_bd)[8], unsigned i_count )
+{
+    uint64_t R[CSA_BATCH_MAX];
+
+    assert( i_count <= CSA_BATCH_MAX );
+    for( unsigned l = 0; l < i_count; l++ )
+    {
+        R[l] = 0;
+        for( int i = 0; i < 8; i++ )
+            R[l] |= (uint64_t)pp_ib[l][i] << (8*i);
+    }
+
+    // loop over kk[56]..kk[1]
+    for( int i = 56; i > 0; i-- )
+    {
+        for( unsigned l = 0; l < i_count; l++ )
+        {
+            const uint8_t sbox_out = block_sbox[ kk[i]^(uint8_t)(R[l] >> 48) ];
+            const uint8_t perm_out = block_perm[sbox_out];
+            const uint64_t next_R1 = (uint8_t)(R[l] >> 56) ^ sbox_out;
+
+            /* R[k+1] = R[k], then R[1], R[3], R[4], R[5] ^= R[8] ^ sbox_out
+             * and R[7] ^= perm_out */
+            R[l] = ( R[l] << 8 ) ^ ( next_R1 * 0x0101010001 ) ^
+                   ( (uint64_t)perm_out << 48 );
+        }
+    }
+
+    for( unsigned l = 0; l < i_count; l++ )
+    {
+        for( int i = 0; i < 8; i++ )
+            p_bd[l][i] = R[l] >> (8*i);
+    }
+}
+
+/* Same as csa_BlockCypher on i_count independent blocks, in place */
+static void csa_BlockCypherBatch( const uint8_t kk[57], uint8_t *const *pp_bd,
+                                  unsigned i_count )
+{
+    uint64_t R[CSA_BATCH_MAX];
+
+    assert( i_count <= CSA_BATCH_MAX );
+    for( unsigned l = 0; l < i_count; l++ )
+    {
+        R[l] = 0;
+        for( int i = 0; i < 8; i++ )
+            R[l] |= (uint64_t)pp_bd[l][i] << (8*i);
+    }
+
+    // loop over kk[1]..kk[56]
+    for( int i = 1; i <= 56; i++ )
+    {
+        for( unsigned l = 0; l < i_count; l++ )
+        {
+            const uint8_t sbox_out = block_sbox[ kk[i]^(uint8_t)(R[l] >> 56) ];
+            const uint8_t perm_out = block_perm[sbox_out];
+            const uint64_t R1 = (uint8_t)R[l];
+
+            /* R[k] = R[k+1], then R[2], R[3], R[4] ^= R[1],
+             * R[6] ^= perm_out and R[8] = R[1] ^ sbox_out */
+            R[l] = ( R[l] >> 8 ) ^ ( R1 * 0x01010100 ) ^
+                   ( (uint64_t)perm_out << 40 ) ^ ( ( R1 ^ sbox_out ) << 56 );
+        }
+    }
+
+    for( unsigned l = 0; l < i_count; l++ )
+    {
+        for( int i = 0; i < 8; i++ )
+            pp_bd[l][i] = R[l] >> (8*i);
+    }
+}
+
+/* Transposes the 8x8 bits matrix made of the bytes of x */
+static inline uint64_t csa_Transpose8x8( uint64_t x )
+{
+    uint64_t t;
+
+    t = ( x ^ (x >> 7) ) & UINT64_C(0x00AA00AA00AA00AA);
+    x ^= t ^ (t << 7);
+    t = ( x ^ (x >> 14) ) & UINT64_C(0x0000CCCC0000CCCC);
+    x ^= t ^ (t << 14);
+    t = ( x ^ (x >> 28) ) & UINT64_C(0x00000000F0F0F0F0);
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+/* Bitsliced stream cypher, one lane per packet */
+typedef uint64_t csa_bs64_t;
+#define csa_bs_t      csa_bs64_t
+#define CSA_BS(name)  name##_64
+#define CSA_BS_TARGET
+#include "csa_bitslice.h"
+#undef CSA_BS_TARGET
+#undef CSA_BS
+#undef csa_bs_t
+
+#ifdef CSA_BS_HAVE_SIMD
+typedef uint64_t csa_bs128_t __attribute__ ((vector_size (16)));
+#define csa_bs_t      csa_bs128_t
+#define CSA_BS(name)  name##_sse2
+#define CSA_BS_TARGET VLC_TARGET("sse2")
+#include "csa_bitslice.h"
+#undef CSA_BS_TARGET
+#undef CSA_BS
+#undef csa_bs_t
+
+typedef uint64_t csa_bs256_t __attribute__ ((vector_size (32)));
+#define csa_bs_t      csa_bs256_t
+#define CSA_BS(name)  name##_avx2
+#define CSA_BS_TARGET VLC_TARGET("avx2")
+#include "csa_bitslice.h"
+#undef CSA_BS_TARGET
+#undef CSA_BS
+#undef csa_bs_t
+#endif
+
+/* Runs csa_StreamCypher on i_count packets, initialised with their 8 bytes at
+ * pp_sb, and writes i_blocks blocks of output for each to p_cb. The widest
+ * word the CPU supports is only used if the batch needs it. */
+static void csa_StreamCypherBatch( const uint8_t ck[8], uint8_t *const *pp_sb,
+                                   unsigned i_count, uint8_t (*p_cb)[CSA_PAYLOAD_MAX],
+                                   unsigned i_blocks )
+{
+    while( i_count > 0 )
+    {
+        unsigned i_lanes;
+
+#ifdef CSA_BS_HAVE_SIMD
+        if( i_count > 128 && vlc_CPU_AVX2() )
+        {
+            i_lanes = __MIN( i_count, 256 );
+            csa_bs_StreamCypher_avx2( ck, pp_sb, i_lanes, *p_cb,
+                                      CSA_PAYLOAD_MAX, i_blocks );
+        }
+        else if( i_count > 64 && vlc_CPU_SSE2() )
+        {
+            i_lanes = __MIN( i_count, 128 );
+            csa_bs_StreamCypher_sse2( ck, pp_sb, i_lanes, *p_cb,
+                                      CSA_PAYLOAD_MAX, i_blocks );
+        }
+        else
+#endif
+        {
+            i_lanes = __MIN( i_count, 64 );
+            csa_bs_StreamCypher_64( ck, pp_sb, i_lanes, *p_cb,
+                                    CSA_PAYLOAD_MAX, i_blocks );
+        }
+
+        pp_sb += i_lanes;
+        p_cb += i_lanes;
+        i_count -= i_lanes;
+    }
+}
@@ -0,0 +1,453 @@
+/*****************************************************************************
+ * csa_bitslice.h: bitsliced CSA stream cypher
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* This file is included by csa.c once per word type. Before including it,
+ * define:
+ *  - csa_bs_t: the word type, each bit of a word being one packet (lane),
+ *  - CSA_BS(name): the suffixed name of the functions for that word type,
+ *  - CSA_BS_TARGET: the function attributes for that word type.
+ *
+ * Each nibble register of csa_StreamCypher() is stored as 4 words, bit 0
+ * first, so that the same boolean operations run for all the lanes at
+ * once. The s-boxes are expressed as boolean functions of their 5 input
+ * bits, x4 being the most significant bit of the table index. */
+
+#define CSA_BS_CHUNKS (sizeof(csa_bs_t) / sizeof(uint64_t))
+#define CSA_BS_LANES  (8 * sizeof(csa_bs_t))
+
+typedef struct
+{
+    csa_bs_t A[11][4];
+    csa_bs_t B[11][4];
+    csa_bs_t X[4], Y[4], Z[4];
+    csa_bs_t D[4], E[4], F[4];
+    csa_bs_t p, q, r;
+} CSA_BS(csa_bs_state_t);
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox1)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = x2 & x3;
+    const csa_bs_t t2 = ~t1;
+    const csa_bs_t t3 = ~x3;
+    const csa_bs_t t4 = x2 & t3;
+    const csa_bs_t t5 = t3 ^ t4;
+    const csa_bs_t t6 = x1 & t5;
+    const csa_bs_t t7 = t2 ^ t6;
+    const csa_bs_t t8 = x3 ^ t4;
+    const csa_bs_t t9 = x1 & t8;
+    const csa_bs_t t10 = t5 ^ t9;
+    const csa_bs_t t11 = x4 & t10;
+    const csa_bs_t t12 = t7 ^ t11;
+    const csa_bs_t t13 = t5 ^ x1;
+    const csa_bs_t t14 = x1 & t3;
+    const csa_bs_t t15 = x4 & t14;
+    const csa_bs_t t16 = t13 ^ t15;
+    const csa_bs_t t17 = x0 & t16;
+    const csa_bs_t t18 = t12 ^ t17;
+    const csa_bs_t t19 = x3 ^ x1;
+    const csa_bs_t t20 = x3 ^ t1;
+    const csa_bs_t t21 = x1 & x3;
+    const csa_bs_t t22 = t20 ^ t21;
+    const csa_bs_t t23 = x4 & t22;
+    const csa_bs_t t24 = t19 ^ t23;
+    const csa_bs_t t25 = x3 ^ x2;
+    const csa_bs_t t26 = t25 ^ t21;
+    const csa_bs_t t27 = x4 & t2;
+    const csa_bs_t t28 = t26 ^ t27;
+    const csa_bs_t t29 = x0 & t28;
+    const csa_bs_t t30 = t24 ^ t29;
+    *hi = t18;
+    *lo = t30;
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox2)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = ~x3;
+    const csa_bs_t t2 = x3 & x4;
+    const csa_bs_t t3 = x2 & t2;
+    const csa_bs_t t4 = t1 ^ t3;
+    const csa_bs_t t5 = ~t2;
+    const csa_bs_t t6 = ~x4;
+    const csa_bs_t t7 = x2 & t6;
+    const csa_bs_t t8 = t5 ^ t7;
+    const csa_bs_t t9 = x1 & t8;
+    const csa_bs_t t10 = t4 ^ t9;
+    const csa_bs_t t11 = t5 ^ x2;
+    const csa_bs_t t12 = t2 ^ x2;
+    const csa_bs_t t13 = x1 & t12;
+    const csa_bs_t t14 = t11 ^ t13;
+    const csa_bs_t t15 = x0 & t14;
+    const csa_bs_t t16 = t10 ^ t15;
+    const csa_bs_t t17 = t8 ^ x1;
+    const csa_bs_t t18 = x3 & t6;
+    const csa_bs_t t19 = ~t18;
+    const csa_bs_t t20 = x2 & t19;
+    const csa_bs_t t21 = x4 ^ t18;
+    const csa_bs_t t22 = x1 & t21;
+    const csa_bs_t t23 = t20 ^ t22;
+    const csa_bs_t t24 = x0 & t23;
+    const csa_bs_t t25 = t17 ^ t24;
+    *hi = t16;
+    *lo = t25;
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox3)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = ~x1;
+    const csa_bs_t t2 = x3 & t1;
+    const csa_bs_t t3 = t1 ^ t2;
+    const csa_bs_t t4 = x4 & t1;
+    const csa_bs_t t5 = t3 ^ t4;
+    const csa_bs_t t6 = x1 ^ t2;
+    const csa_bs_t t7 = x4 & t3;
+    const csa_bs_t t8 = t6 ^ t7;
+    const csa_bs_t t9 = x2 & t8;
+    const csa_bs_t t10 = t5 ^ t9;
+    const csa_bs_t t11 = ~t2;
+    const csa_bs_t t12 = x1 ^ x3;
+    const csa_bs_t t13 = x4 & t12;
+    const csa_bs_t t14 = t11 ^ t13;
+    const csa_bs_t t15 = t1 ^ t4;
+    const csa_bs_t t16 = x2 & t15;
+    const csa_bs_t t17 = t14 ^ t16;
+    const csa_bs_t t18 = x0 & t17;
+    const csa_bs_t t19 = t10 ^ t18;
+    const csa_bs_t t20 = t12 ^ x4;
+    const csa_bs_t t21 = x1 ^ x2;
+    const csa_bs_t t22 = x0 & t21;
+    const csa_bs_t t23 = t20 ^ t22;
+    *hi = t19;
+    *lo = t23;
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox4)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = ~x2;
+    const csa_bs_t t2 = x1 & x2;
+    const csa_bs_t t3 = ~t2;
+    const csa_bs_t t4 = x3 & t3;
+    const csa_bs_t t5 = t1 ^ t4;
+    const csa_bs_t t6 = ~x1;
+    const csa_bs_t t7 = t1 ^ t2;
+    const csa_bs_t t8 = x3 & t7;
+    const csa_bs_t t9 = t6 ^ t8;
+    const csa_bs_t t10 = x4 & t9;
+    const csa_bs_t t11 = t5 ^ t10;
+    const csa_bs_t t12 = x1 & t1;
+    const csa_bs_t t13 = ~t12;
+    const csa_bs_t t14 = x3 & t6;
+    const csa_bs_t t15 = t3 ^ t14;
+    const csa_bs_t t16 = x4 & t15;
+    const csa_bs_t t17 = t13 ^ t16;
+    const csa_bs_t t18 = x0 & t17;
+    const csa_bs_t t19 = t11 ^ t18;
+    const csa_bs_t t20 = t1 ^ x1;
+    const csa_bs_t t21 = x3 & x2;
+    const csa_bs_t t22 = t20 ^ t21;
+    const csa_bs_t t23 = x1 ^ t8;
+    const csa_bs_t t24 = x4 & t23;
+    const csa_bs_t t25 = t22 ^ t24;
+    const csa_bs_t t26 = x1 ^ t14;
+    const csa_bs_t t27 = t26 ^ t16;
+    const csa_bs_t t28 = x0 & t27;
+    const csa_bs_t t29 = t25 ^ t28;
+    *hi = t19;
+    *lo = t29;
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox5)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = ~x1;
+    const csa_bs_t t2 = x0 & t1;
+    const csa_bs_t t3 = t1 ^ t2;
+    const csa_bs_t t4 = x1 ^ x0;
+    const csa_bs_t t5 = x4 & t4;
+    const csa_bs_t t6 = t3 ^ t5;
+    const csa_bs_t t7 = ~t2;
+    const csa_bs_t t8 = t7 ^ t5;
+    const csa_bs_t t9 = x3 & t8;
+    const csa_bs_t t10 = t6 ^ t9;
+    const csa_bs_t t11 = x1 ^ t2;
+    const csa_bs_t t12 = x0 & x1;
+    const csa_bs_t t13 = t1 ^ t12;
+    const csa_bs_t t14 = x4 & t13;
+    const csa_bs_t t15 = t11 ^ t14;
+    const csa_bs_t t16 = t4 ^ t5;
+    const csa_bs_t t17 = x3 & t16;
+    const csa_bs_t t18 = t15 ^ t17;
+    const csa_bs_t t19 = x2 & t18;
+    const csa_bs_t t20 = t10 ^ t19;
+    const csa_bs_t t21 = x4 & x0;
+    const csa_bs_t t22 = t12 ^ t21;
+    const csa_bs_t t23 = x4 & t3;
+    const csa_bs_t t24 = t4 ^ t23;
+    const csa_bs_t t25 = x3 & t24;
+    const csa_bs_t t26 = t22 ^ t25;
+    const csa_bs_t t27 = t7 ^ t23;
+    const csa_bs_t t28 = x3 & x0;
+    const csa_bs_t t29 = t27 ^ t28;
+    const csa_bs_t t30 = x2 & t29;
+    const csa_bs_t t31 = t26 ^ t30;
+    *hi = t20;
+    *lo = t31;
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox6)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = ~x3;
+    const csa_bs_t t2 = x0 & t1;
+    const csa_bs_t t3 = x3 ^ t2;
+    const csa_bs_t t4 = x2 & t3;
+    const csa_bs_t t5 = x0 & x3;
+    const csa_bs_t t6 = ~t5;
+    const csa_bs_t t7 = x4 & t6;
+    const csa_bs_t t8 = t4 ^ t7;
+    const csa_bs_t t9 = x4 & x0;
+    const csa_bs_t t10 = t6 ^ t9;
+    const csa_bs_t t11 = x1 & t10;
+    const csa_bs_t t12 = t8 ^ t11;
+    const csa_bs_t t13 = x2 & t1;
+    const csa_bs_t t14 = x0 ^ t13;
+    const csa_bs_t t15 = t1 ^ x0;
+    const csa_bs_t t16 = x2 & t15;
+    const csa_bs_t t17 = x3 ^ t16;
+    const csa_bs_t t18 = t2 ^ t16;
+    const csa_bs_t t19 = x4 & t18;
+    const csa_bs_t t20 = t17 ^ t19;
+    const csa_bs_t t21 = x1 & t20;
+    const csa_bs_t t22 = t14 ^ t21;
+    *hi = t12;
+    *lo = t22;
+}
+
+CSA_BS_TARGET
+static inline void CSA_BS(sbox7)( csa_bs_t x4, csa_bs_t x3, csa_bs_t x2,
+                                  csa_bs_t x1, csa_bs_t x0,
+                                  csa_bs_t *hi, csa_bs_t *lo )
+{
+    const csa_bs_t t1 = x2 ^ x0;
+    const csa_bs_t t2 = x4 & t1;
+    const csa_bs_t t3 = t1 ^ t2;
+    const csa_bs_t t4 = t3 ^ x3;
+    const csa_bs_t t5 = ~x0;
+    const csa_bs_t t6 = ~x2;
+    const csa_bs_t t7 = x0 & t6;
+    const csa_bs_t t8 = x2 ^ t7;
+    const csa_bs_t t9 = x4 & t8;
+    const csa_bs_t t10 = t5 ^ t9;
+    const csa_bs_t t11 = x0 ^ t2;
+    const csa_bs_t t12 = x3 & t11;
+    const csa_bs_t t13 = t10 ^ t12;
+    const csa_bs_t t14 = x1 & t13;
+    const csa_bs_t t15 = t4 ^ t14;
+    const csa_bs_t t16 = t1 ^ x4;
+    const csa_bs_t t17 = x3 & t6;
+    const csa_bs_t t18 = t16 ^ t17;
+    const csa_bs_t t19 = x4 & t5;
+    const csa_bs_t t20 = x3 & t19;
+    const csa_bs_t t21 = t8 ^ t20;
+    const csa_bs_t t22 = x1 & t21;
+    const csa_bs_t t23 = t18 ^ t22;
+    *hi = t15;
+    *lo = t23;
+}
+
+CSA_BS_TARGET
+static inline csa_bs_t CSA_BS(csa_bs_Fill)( unsigned i_bit )
+{
+    csa_bs_t w;
+    memset( &w, i_bit ? 0xff : 0x00, sizeof(w) );
+    return w;
+}
+
+/* One iteration of the inner loop of csa_StreamCypher(), for all lanes.
+ * in_a and in_b are the input nibbles during initialisation, NULL after. */
+CSA_BS_TARGET
+static inline void CSA_BS(csa_bs_Clock)( CSA_BS(csa_bs_state_t) *s,
+                                         const csa_bs_t *in_a,
+                                         const csa_bs_t *in_b )
+{
+    csa_bs_t s1h, s1l, s2h, s2l, s3h, s3l, s4h, s4l, s5h, s5l, s6h, s6l, s7h, s7l;
+    csa_bs_t extra_B[4], next_A1[4], next_B1[4], rot_B1[4];
+    csa_bs_t carry;
+
+    CSA_BS(sbox1)( s->A[4][0], s->A[1][2], s->A[6][1], s->A[7][3], s->A[9][0], &s1h, &s1l );
+    CSA_BS(sbox2)( s->A[2][1], s->A[3][2], s->A[6][3], s->A[7][0], s->A[9][1], &s2h, &s2l );
+    CSA_BS(sbox3)( s->A[1][3], s->A[2][0], s->A[5][1], s->A[5][3], s->A[6][2], &s3h, &s3l );
+    CSA_BS(sbox4)( s->A[3][3], s->A[1][1], s->A[2][3], s->A[4][2], s->A[8][0], &s4h, &s4l );
+    CSA_BS(sbox5)( s->A[5][2], s->A[4][3], s->A[6][0], s->A[8][1], s->A[9][2], &s5h, &s5l );
+    CSA_BS(sbox6)( s->A[3][1], s->A[4][1], s->A[5][0], s->A[7][2], s->A[9][3], &s6h, &s6l );
+    CSA_BS(sbox7)( s->A[2][2], s->A[3][0], s->A[7][1], s->A[8][2], s->A[8][3], &s7h, &s7l );
+
+    /* 4x4 xor to produce extra nibble for T3 */
+    extra_B[3] = s->B[3][0] ^ s->B[6][1] ^ s->B[7][2] ^ s->B[9][3];
+    extra_B[2] = s->B[6][0] ^ s->B[8][1] ^ s->B[3][3] ^ s->B[4][2];
+    extra_B[1] = s->B[5][3] ^ s->B[8][2] ^ s->B[4][0] ^ s->B[5][1];
+    extra_B[0] = s->B[9][2] ^ s->B[6][3] ^ s->B[3][1] ^ s->B[8][0];
+
+    for( int b = 0; b < 4; b++ )
+    {
+        /* T1 and T2 */
+        next_A1[b] = s->A[10][b] ^ s->X[b];
+        next_B1[b] = s->B[7][b] ^ s->B[10][b] ^ s->Y[b];
+        if( in_a )
+        {
+            next_A1[b] ^= s->D[b] ^ in_a[b];
+            next_B1[b] ^= in_b[b];
+        }
+    }
+
+    /* rotate next_B1 left where p is set */
+    for( int b = 0; b < 4; b++ )
+        rot_B1[b] = next_B1[(b + 3) & 3];
+    for( int b = 0; b < 4; b++ )
+        next_B1[b] ^= ( next_B1[b] ^ rot_B1[b] ) & s->p;
+
+    /* T3 and T4: F = q ? Z + E + r : E, r being the carry */
+    carry = s->r;
+    for( int b = 0; b < 4; b++ )
+    {
+        const csa_bs_t ze = s->Z[b] ^ s->E[b];
+        const csa_bs_t sum = ze ^ carry;
+        const csa_bs_t next_F = s->E[b] ^ ( ( sum ^ s->E[b] ) & s->q );
+
+        carry = ( s->Z[b] & s->E[b] ) | ( carry & ze );
+        s->D[b] = ze ^ extra_B[b];
+        s->E[b] = s->F[b];
+        s->F[b] = next_F;
+    }
+    s->r ^= ( carry ^ s->r ) & s->q;
+
+    memmove( &s->A[2], &s->A[1], 9 * sizeof(s->A[1]) );
+    memmove( &s->B[2], &s->B[1], 9 * sizeof(s->B[1]) );
+    memcpy( s->A[1], next_A1, sizeof(next_A1) );
+    memcpy( s->B[1], next_B1, sizeof(next_B1) );
+
+    s->X[3] = s4l; s->X[2] = s3l; s->X[1] = s2h; s->X[0] = s1h;
+    s->Y[3] = s6l; s->Y[2] = s5l; s->Y[1] = s4h; s->Y[0] = s3h;
+    s->Z[3] = s2l; s->Z[2] = s1l; s->Z[1] = s6h; s->Z[0] = s5h;
+    s->p = s7h;
+    s->q = s7l;
+}
+
+/* Initialises the stream cypher of each lane with the control word and the
+ * 8 bytes at pp_sb[lane], then writes i_blocks blocks of 8 output bytes for
+ * each lane to p_cb + lane * i_pitch. */
+CSA_BS_TARGET
+static void CSA_BS(csa_bs_StreamCypher)( const uint8_t ck[8],
+                                         uint8_t *const *pp_sb, unsigned i_lanes,
+                                         uint8_t *p_cb, size_t i_pitch,
+                                         unsigned i_blocks )
+{
+    CSA_BS(csa_bs_state_t) s;
+    uint64_t bits[8][8][CSA_BS_CHUNKS];
+
+    assert( i_lanes <= CSA_BS_LANES );
+
+    /* load first 32 bits of CK into A[1]..A[8], last 32 bits into B[1]..B[8]
+     * all other regs = 0 */
+    memset( &s, 0, sizeof(s) );
+    for( int i = 0; i < 4; i++ )
+    {
+        for( int b = 0; b < 4; b++ )
+        {
+            s.A[1+2*i+0][b] = CSA_BS(csa_bs_Fill)( ( ck[i] >> (4 + b) )&1 );
+            s.A[1+2*i+1][b] = CSA_BS(csa_bs_Fill)( ( ck[i] >> b )&1 );
+            s.B[1+2*i+0][b] = CSA_BS(csa_bs_Fill)( ( ck[4+i] >> (4 + b) )&1 );
+            s.B[1+2*i+1][b] = CSA_BS(csa_bs_Fill)( ( ck[4+i] >> b )&1 );
+        }
+    }
+
+    /* transpose the input bytes: bits[byte][bit] holds that bit of all
+     * lanes, 8 lanes at a time */
+    memset( bits, 0, sizeof(bits) );
+    for( unsigned l = 0; l < i_lanes; l += 8 )
+    {
+        for( int i = 0; i < 8; i++ )
+        {
+            uint64_t x = 0;
+            for( unsigned k = 0; k < 8 && l + k < i_lanes; k++ )
+                x |= (uint64_t)pp_sb[l + k][i] << (8*k);
+            x = csa_Transpose8x8( x );
+            for( int b = 0; b < 8; b++ )
+                bits[i][b][l / 64] |= ( ( x >> (8*b) )&0xff ) << (l % 64);
+        }
+    }
+
+    for( int i = 0; i < 8; i++ )
+    {
+        csa_bs_t in1[4], in2[4];
+
+        memcpy( in1, bits[i][4], sizeof(in1) );
+        memcpy( in2, bits[i][0], sizeof(in2) );
+        for( int j = 0; j < 4; j++ )
+        {
+            if( j % 2 )
+                CSA_BS(csa_bs_Clock)( &s, in2, in1 );
+            else
+                CSA_BS(csa_bs_Clock)( &s, in1, in2 );
+        }
+    }
+
+    for( unsigned i = 0; i < 8 * i_blocks; i++ )
+    {
+        csa_bs_t op[8];
+
+        /* 2 output bits per clock, a function of the 4 bits of D */
+        for( int j = 0; j < 4; j++ )
+        {
+            CSA_BS(csa_bs_Clock)( &s, NULL, NULL );
+            op[7-2*j] = s.D[3] ^ s.D[2];
+            op[6-2*j] = s.D[1] ^ s.D[0];
+        }
+
+        memcpy( bits[0], op, sizeof(op) );
+        for( unsigned l = 0; l < i_lanes; l += 8 )
+        {
+            uint64_t x = 0;
+            for( int b = 0; b < 8; b++ )
+                x |= ( ( bits[0][b][l / 64] >> (l % 64) )&0xff ) << (8*b);
+            x = csa_Transpose8x8( x );
+            for( unsigned k = 0; k < 8 && l + k < i_lanes; k++ )
+                p_cb[(l + k) * i_pitch + i] = x >> (8*k);
+        }
+    }
+}
+
+#undef CSA_BS_LANES
+#undef CSA_BS_CHUNKS
@@ -182,6 +182,11 @@ static const char *const ts_standards_list_text[] =
 #define CU_LONGTEXT N_("CSA encryption key used. It can be the odd/first/1 " \
   "(default) or the even/second/2 one.")
 
+#define THREADS_TEXT N_("Threads")
+#define THREADS_LONGTEXT N_("Number of threads packetizing the elementary " \
+  "streams into TS packets. This speeds up muxing many streams, such as " \
+  "multiple programs transport streams.")
+
 #define CPKT_TEXT N_("Packet size in bytes to encrypt")
 #define CPKT_LONGTEXT N_("Size of the TS packet to encrypt. " \
     "The encryption routines subtract the TS-header from the value before " \
@@ -229,6 +234,8 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "bmin", 0, BMIN_TEXT, BMIN_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmax", 0, BMAX_TEXT, BMAX_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "dts-delay", 400, DTS_TEXT, DTS_LONGTEXT, true)
+    add_integer( SOUT_CFG_PREFIX "threads", 1, THREADS_TEXT, THREADS_LONGTEXT, true)
+        change_integer_range( 1, 64 )
 
     add_bool( SOUT_CFG_PREFIX "crypt-audio", true, ACRYPT_TEXT, ACRYPT_LONGTEXT, true)
     add_bool( SOUT_CFG_PREFIX "crypt-video", true, VCRYPT_TEXT, VCRYPT_LONGTEXT, true)
@@ -249,7 +256,7 @@ static const char *const ppsz_sout_options[] = {
     "netid", "sdtdesc",
     "es-id-pid", "shaping", "pcr", "bmin", "bmax", "use-key-frames",
     "dts-delay", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
-    "muxpmt", "program-pmt", "alignment",
+    "muxpmt", "program-pmt", "alignment", "threads",
     NULL
 };
 
@@ -333,11 +340,32 @@ typedef struct
 
 } pes_state_t;
 
+/* TS packet of a muxing round, stored in a stream slab or a PSI block */
+typedef struct
+{
+    uint8_t    *p_buffer;
+    vlc_tick_t  i_dts;
+    uint32_t    i_flags;
+} ts_packet_t;
+
+/* TS packets of a stream for the current muxing round, built in one
+ * contiguous buffer reused from round to round */
+typedef struct
+{
+    uint8_t     *p_buffer;
+    ts_packet_t *p_packets;
+    vlc_tick_t  *p_keys;    /* stream date before each packet, to interleave */
+    size_t       i_count;
+    size_t       i_pos;     /* next packet to interleave */
+    size_t       i_alloc;
+} ts_slab_t;
+
 typedef struct
 {
     tsmux_stream_t  ts;
     pesmux_stream_t pes;
     pes_state_t  state;
+    ts_slab_t    slab;
 } sout_input_sys_t;
 
 typedef struct
@@ -385,6 +413,25 @@ typedef struct
     int             i_csa_pkt_size;
     bool            b_crypt_audio;
     bool            b_crypt_video;
+
+    /* TS packets of the current muxing round, in output order */
+    ts_packet_t     *p_packets;
+    size_t          i_packets;
+    size_t          i_packets_alloc;
+    sout_buffer_chain_t chain_psi; /* PSI blocks of the current round */
+
+    /* Worker threads packetizing the streams along with the muxer thread */
+    unsigned        i_threads;
+    vlc_thread_t    *threads;
+    vlc_mutex_t     work_lock;
+    vlc_cond_t      work_wait;
+    vlc_cond_t      work_done;
+    sout_input_sys_t **pp_work;
+    int             i_work;
+    int             i_work_next;
+    int             i_work_done;
+    vlc_tick_t      i_work_dts;
+    bool            b_work_exit;
 } sout_mux_sys_t;
 
 
@@ -473,15 +520,20 @@ static int Mux      ( sout_mux_t * );
 
 static block_t *FixPES( sout_mux_t *p_mux, block_fifo_t *p_fifo );
 static block_t *Add_ADTS( block_t *, const es_format_t * );
-static void TSSchedule  ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+static void TSSchedule  ( sout_mux_t *p_mux, ts_packet_t *p_packets,
+                          int i_packet_count,
                           vlc_tick_t i_pcr_length, vlc_tick_t i_pcr_dts );
-static void TSDate      ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+static void TSDate      ( sout_mux_t *p_mux, ts_packet_t *p_packets,
+                          int i_packet_count,
                           vlc_tick_t i_pcr_length, vlc_tick_t i_pcr_dts );
 static void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 
-static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream, bool b_pcr );
-static void TSSetPCR( block_t *p_ts, vlc_tick_t i_dts );
+static void TSNew( sout_input_sys_t *p_stream, bool b_pcr,
+                   uint8_t *p_buffer, ts_packet_t *p_ts );
+static void TSSetPCR( uint8_t *p_buffer, vlc_tick_t i_dts );
+static void TSPacketizeStreams( sout_mux_t *p_mux, vlc_tick_t i_max_dts );
+static void *TSWorkerThread( void * );
 
 static csa_t *csaSetup( vlc_object_t *p_this )
 {
@@ -739,6 +791,26 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->csa = csaSetup(p_this);
 
+    BufferChainInit( &p_sys->chain_psi );
+
+    vlc_mutex_init( &p_sys->work_lock );
+    vlc_cond_init( &p_sys->work_wait );
+    vlc_cond_init( &p_sys->work_done );
+
+    /* The muxer thread packetizes streams too */
+    int64_t i_threads = var_GetInteger( p_mux, SOUT_CFG_PREFIX "threads" ) - 1;
+    if( i_threads > 0 )
+    {
+        p_sys->threads = vlc_alloc( i_threads, sizeof (*p_sys->threads) );
+        if( p_sys->threads != NULL )
+            while( p_sys->i_threads < i_threads
+                && !vlc_clone( &p_sys->threads[p_sys->i_threads],
+                               TSWorkerThread, p_sys,
+                               VLC_THREAD_PRIORITY_OUTPUT ) )
+                p_sys->i_threads++;
+        msg_Dbg( p_mux, "using %u packetizing threads", p_sys->i_threads + 1 );
+    }
+
     p_mux->pf_control   = Control;
     p_mux->pf_addstream = AddStream;
     p_mux->pf_delstream = DelStream;
@@ -755,6 +827,19 @@ static void Close( vlc_object_t * p_this )
     sout_mux_t          *p_mux = (sout_mux_t*)p_this;
     sout_mux_sys_t      *p_sys = p_mux->p_sys;
 
+    vlc_mutex_lock( &p_sys->work_lock );
+    p_sys->b_work_exit = true;
+    vlc_cond_broadcast( &p_sys->work_wait );
+    vlc_mutex_unlock( &p_sys->work_lock );
+
+    for( unsigned i = 0; i < p_sys->i_threads; i++ )
+        vlc_join( p_sys->threads[i], NULL );
+    free( p_sys->threads );
+    vlc_cond_destroy( &p_sys->work_done );
+    vlc_cond_destroy( &p_sys->work_wait );
+    vlc_mutex_destroy( &p_sys->work_lock );
+    free( p_sys->p_packets );
+
     if( p_sys->p_dvbpsi )
         dvbpsi_delete( p_sys->p_dvbpsi );
 
@@ -990,6 +1075,13 @@ oom:
     return VLC_ENOMEM;
 }
 
+static void SlabClean( ts_slab_t *p_slab )
+{
+    free( p_slab->p_keys );
+    free( p_slab->p_packets );
+    free( p_slab->p_buffer );
+}
+
 /*****************************************************************************
  * DelStream: called before a stream deletion
  *****************************************************************************/
@@ -1029,6 +1121,7 @@ static void DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
         msg_Dbg( p_mux, "freeing spu PID %d", pid);
     }
 
+    SlabClean( &p_stream->slab );
     free(p_stream->pes.lang);
     free( p_stream );
 
@@ -1037,18 +1130,6 @@ static void DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
     p_sys->i_pmt_version_number %= 32;
 }
 
-static void SetHeader( sout_buffer_chain_t *c,
-                        int depth )
-{
-    block_t *p_ts = BufferChainPeek( c );
-    while( depth > 0 )
-    {
-        p_ts = p_ts->p_next;
-        depth--;
-    }
-    p_ts->i_flags |= BLOCK_FLAG_HEADER;
-}
-
 static block_t *Pack_Opus(block_t *p_data)
 {
     lldiv_t d = lldiv(p_data->i_buffer, 255);
@@ -1191,13 +1272,102 @@ static block_t *Encap_J2K( block_t *p_data, const es_format_t *p_fmt )
     return p_data;
 }
 
+static void TSDropPES( sout_input_sys_t *p_stream )
+{
+    BufferChainClean( &p_stream->state.chain_pes );
+    p_stream->state.i_pes_dts = 0;
+    p_stream->state.i_pes_used = 0;
+    p_stream->state.i_pes_length = 0;
+}
+
+/* Upper bound of the number of TS packets needed for the pending PES */
+static size_t SlabMaxPackets( const sout_input_sys_t *p_stream, int i_payload )
+{
+    size_t i_count = 0;
+
+    for( const block_t *p_pes = p_stream->state.chain_pes.p_first;
+         p_pes != NULL; p_pes = p_pes->p_next )
+        i_count += p_pes->i_buffer / i_payload + 1;
+    return i_count;
+}
+
+static bool SlabReserve( ts_slab_t *p_slab, size_t i_count )
+{
+    if( i_count <= p_slab->i_alloc )
+        return true;
+
+    i_count = __MAX( i_count, p_slab->i_alloc * 2 );
+
+    uint8_t *p_buffer = realloc( p_slab->p_buffer, i_count * 188 );
+    if( p_buffer == NULL )
+        return false;
+    p_slab->p_buffer = p_buffer;
+
+    ts_packet_t *p_packets = realloc( p_slab->p_packets,
+                                      i_count * sizeof (*p_packets) );
+    if( p_packets == NULL )
+        return false;
+    p_slab->p_packets = p_packets;
+
+    vlc_tick_t *p_keys = realloc( p_slab->p_keys,
+                                  i_count * sizeof (*p_keys) );
+    if( p_keys == NULL )
+        return false;
+    p_slab->p_keys = p_keys;
+
+    p_slab->i_alloc = i_count;
+    return true;
+}
+
+static bool TSAppendPacket( sout_mux_sys_t *p_sys, const ts_packet_t *p_ts )
+{
+    if( p_sys->i_packets == p_sys->i_packets_alloc )
+    {
+        size_t i_alloc = __MAX( p_sys->i_packets_alloc * 2, 256 );
+        ts_packet_t *p_packets = realloc( p_sys->p_packets,
+                                          i_alloc * sizeof (*p_packets) );
+        if( unlikely(p_packets == NULL) )
+            return false;
+        p_sys->p_packets = p_packets;
+        p_sys->i_packets_alloc = i_alloc;
+    }
+    p_sys->p_packets[p_sys->i_packets++] = *p_ts;
+    return true;
+}
+
+static bool TSAppendPSI( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    sout_buffer_chain_t chain_psi;
+    bool b_ok = true;
+
+    BufferChainInit( &chain_psi );
+    GetPAT( p_mux, &chain_psi );
+    GetPMT( p_mux, &chain_psi );
+
+    for( block_t *p_psi = chain_psi.p_first; p_psi != NULL;
+         p_psi = p_psi->p_next )
+    {
+        const ts_packet_t ts = {
+            .p_buffer = p_psi->p_buffer,
+            .i_dts = p_psi->i_dts,
+            .i_flags = p_psi->i_flags,
+        };
+        if( !TSAppendPacket( p_sys, &ts ) )
+            b_ok = false;
+    }
+
+    if( chain_psi.p_first != NULL )
+        BufferChainAppend( &p_sys->chain_psi, chain_psi.p_first );
+    return b_ok;
+}
+
 /* returns true if needs more data */
 static bool MuxStreams(sout_mux_t *p_mux )
 {
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
     sout_input_sys_t *p_pcr_stream = (sout_input_sys_t*)p_sys->p_pcr_input->p_sys;
 
-    sout_buffer_chain_t chain_ts;
     vlc_tick_t i_shaping_delay = p_pcr_stream->state.b_key_frame
         ? p_pcr_stream->state.i_pes_length
         : p_sys->i_shaping_delay;
@@ -1486,14 +1656,28 @@ static bool MuxStreams(sout_mux_t *p_mux )
     /* add overhead for PCR (not really exact) */
     i_packet_count += (8 * i_pcr_length / p_sys->i_pcr_delay + 175) / 176;
 
-    /* 3: mux PES into TS */
-    BufferChainInit( &chain_ts );
+    /* 3: packetize the PES of all the streams but the PCR one */
+    TSPacketizeStreams( p_mux, p_pcr_stream->state.i_pes_dts + i_pcr_length );
+
+    /* The PCR stream is packetized while interleaving, as the PCR positions
+     * depend on the other streams packets */
+    ts_slab_t *p_pcr_slab = &p_pcr_stream->slab;
+    p_pcr_slab->i_count = 0;
+    if( !SlabReserve( p_pcr_slab, SlabMaxPackets( p_pcr_stream, 184 - 8 ) ) )
+    {
+        TSDropPES( p_pcr_stream );
+        return true;
+    }
+
+    /* 4: interleave the TS packets */
+    p_sys->i_packets = 0;
     /* append PAT/PMT  -> FIXME with big pcr delay it won't have enough pat/pmt */
     bool pat_was_previous = true; //This is to prevent unnecessary double PAT/PMT insertions
-    GetPAT( p_mux, &chain_ts );
-    GetPMT( p_mux, &chain_ts );
+    /* If the packets cannot be stored, the streams are still consumed, but
+     * the whole round is dropped */
+    bool b_dropped = !TSAppendPSI( p_mux );
     int i_packet_pos = 0;
-    i_packet_count += chain_ts.i_depth;
+    i_packet_count += p_sys->i_packets;
     /* msg_Dbg( p_mux, "estimated pck=%d", i_packet_count ); */
 
     const vlc_tick_t i_pcr_dts = p_pcr_stream->state.i_pes_dts;
@@ -1506,17 +1690,25 @@ static bool MuxStreams(sout_mux_t *p_mux )
         /* Select stream (lowest dts) */
         for (int i = 0; i < p_mux->i_nb_inputs; i++ )
         {
+            vlc_tick_t i_key;
+
             p_stream = (sout_input_sys_t*)p_mux->pp_inputs[i]->p_sys;
+            if( p_stream == p_pcr_stream )
+                i_key = p_stream->state.i_pes_dts;
+            else if( p_stream->slab.i_pos < p_stream->slab.i_count )
+                i_key = p_stream->slab.p_keys[p_stream->slab.i_pos];
+            else
+                continue;
 
-            if( p_stream->state.i_pes_dts == 0 )
+            if( i_key == 0 )
             {
                 continue;
             }
 
-            if( i_stream == -1 || p_stream->state.i_pes_dts < i_dts )
+            if( i_stream == -1 || i_key < i_dts )
             {
                 i_stream = i;
-                i_dts = p_stream->state.i_pes_dts;
+                i_dts = i_key;
             }
         }
         if( i_stream == -1 || i_dts > i_pcr_dts + i_pcr_length )
@@ -1525,25 +1717,34 @@ static bool MuxStreams(sout_mux_t *p_mux )
         }
         p_stream = (sout_input_sys_t*)p_mux->pp_inputs[i_stream]->p_sys;
         sout_input_t *p_input = p_mux->pp_inputs[i_stream];
+        ts_packet_t ts;
 
-        /* do we need to issue pcr */
-        bool b_pcr = false;
-        if( p_stream == p_pcr_stream &&
-            i_pcr_dts + i_packet_pos * i_pcr_length / i_packet_count >=
-            p_sys->i_pcr + p_sys->i_pcr_delay )
+        if( p_stream == p_pcr_stream )
         {
-            b_pcr = true;
-            p_sys->i_pcr = i_pcr_dts + i_packet_pos *
-                i_pcr_length / i_packet_count;
+            /* do we need to issue pcr */
+            bool b_pcr = false;
+            if( i_pcr_dts + i_packet_pos * i_pcr_length / i_packet_count >=
+                p_sys->i_pcr + p_sys->i_pcr_delay )
+            {
+                b_pcr = true;
+                p_sys->i_pcr = i_pcr_dts + i_packet_pos *
+                    i_pcr_length / i_packet_count;
+            }
+
+            /* Build the TS packet */
+            size_t i = p_pcr_slab->i_count++;
+            TSNew( p_stream, b_pcr, &p_pcr_slab->p_buffer[i * 188],
+                   &p_pcr_slab->p_packets[i] );
+            ts = p_pcr_slab->p_packets[i];
         }
+        else
+            ts = p_stream->slab.p_packets[p_stream->slab.i_pos++];
 
-        /* Build the TS packet */
-        block_t *p_ts = TSNew( p_mux, p_stream, b_pcr );
         if( p_sys->csa != NULL &&
              (p_input->p_fmt->i_cat != AUDIO_ES || p_sys->b_crypt_audio) &&
              (p_input->p_fmt->i_cat != VIDEO_ES || p_sys->b_crypt_video) )
         {
-            p_ts->i_flags |= BLOCK_FLAG_SCRAMBLED;
+            ts.i_flags |= BLOCK_FLAG_SCRAMBLED;
         }
         i_packet_pos++;
 
@@ -1552,27 +1753,35 @@ static bool MuxStreams(sout_mux_t *p_mux )
          * and start new one with pat,pmt,keyframe*/
         if( ( p_sys->b_use_key_frames ) &&
             ( p_input->p_fmt->i_cat == VIDEO_ES ) &&
-            ( p_ts->i_flags & BLOCK_FLAG_TYPE_I ) )
+            ( ts.i_flags & BLOCK_FLAG_TYPE_I ) )
         {
             if( likely( !pat_was_previous ) )
             {
-                int startcount = chain_ts.i_depth;
-                GetPAT( p_mux, &chain_ts );
-                GetPMT( p_mux, &chain_ts );
-                SetHeader( &chain_ts, startcount );
-                i_packet_count += (chain_ts.i_depth - startcount );
-            } else {
-                SetHeader( &chain_ts, 0); //We just inserted pat/pmt,so just flag it instead of adding new one
+                size_t startcount = p_sys->i_packets;
+                if( !TSAppendPSI( p_mux ) )
+                    b_dropped = true;
+                if( startcount < p_sys->i_packets )
+                    p_sys->p_packets[startcount].i_flags |= BLOCK_FLAG_HEADER;
+                i_packet_count += p_sys->i_packets - startcount;
+            } else if( p_sys->i_packets > 0 ) {
+                p_sys->p_packets[0].i_flags |= BLOCK_FLAG_HEADER; //We just inserted pat/pmt,so just flag it instead of adding new one
             }
         }
         pat_was_previous = false;
 
         /* */
-        BufferChainAppend( &chain_ts, p_ts );
+        if( !TSAppendPacket( p_sys, &ts ) )
+            b_dropped = true;
     }
 
-    /* 4: date and send */
-    TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
+    /* 5: date and send */
+    if( likely(!b_dropped) )
+        TSSchedule( p_mux, p_sys->p_packets, p_sys->i_packets,
+                    i_pcr_length, i_pcr_dts );
+    else
+        msg_Err( p_mux, "out of memory, dropping %zu TS packets",
+                 p_sys->i_packets );
+    BufferChainClean( &p_sys->chain_psi );
     return false;
 }
 
@@ -1706,14 +1915,11 @@ static block_t *Add_ADTS( block_t *p_data, const es_format_t *p_fmt )
     return p_new_block;
 }
 
-static void TSSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+static void TSSchedule( sout_mux_t *p_mux, ts_packet_t *p_packets,
+                        int i_packet_count,
                         vlc_tick_t i_pcr_length, vlc_tick_t i_pcr_dts )
 {
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
-    sout_buffer_chain_t new_chain;
-    int i_packet_count = p_chain_ts->i_depth;
-
-    BufferChainInit( &new_chain );
 
     if ( i_pcr_length <= 0 )
     {
@@ -1722,51 +1928,47 @@ static void TSSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
 
     for (int i = 0; i < i_packet_count; i++ )
     {
-        block_t *p_ts = BufferChainGet( p_chain_ts );
+        const ts_packet_t *p_ts = &p_packets[i];
         vlc_tick_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
 
-        BufferChainAppend( &new_chain, p_ts );
-
         if (!p_ts->i_dts || p_ts->i_dts + p_sys->i_dts_delay * 2/3 >= i_new_dts)
             continue;
 
         vlc_tick_t i_max_diff = i_new_dts - p_ts->i_dts;
         vlc_tick_t i_cut_dts = p_ts->i_dts;
 
-        p_ts = BufferChainPeek( p_chain_ts );
-        i++;
-        i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
-        while ( p_ts != NULL && i_new_dts - p_ts->i_dts >= i_max_diff )
+        /* Move the cut past the packets that are even later */
+        for( i++; i < i_packet_count; i++ )
         {
-            p_ts = BufferChainGet( p_chain_ts );
+            p_ts = &p_packets[i];
+            i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
+            if( i_new_dts - p_ts->i_dts < i_max_diff )
+                break;
             i_max_diff = i_new_dts - p_ts->i_dts;
             i_cut_dts = p_ts->i_dts;
-            BufferChainAppend( &new_chain, p_ts );
-
-            p_ts = BufferChainPeek( p_chain_ts );
-            i++;
-            i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
         }
         msg_Dbg( p_mux, "adjusting rate at %"PRId64"/%"PRId64" (%d/%d)",
-                 i_cut_dts - i_pcr_dts, i_pcr_length, new_chain.i_depth,
-                 p_chain_ts->i_depth );
-        if ( new_chain.i_depth )
-            TSDate( p_mux, &new_chain, i_cut_dts - i_pcr_dts, i_pcr_dts );
-        if ( p_chain_ts->i_depth )
-            TSSchedule( p_mux, p_chain_ts, i_pcr_dts + i_pcr_length - i_cut_dts,
-                        i_cut_dts );
+                 i_cut_dts - i_pcr_dts, i_pcr_length, i,
+                 i_packet_count - i );
+        TSDate( p_mux, p_packets, i, i_cut_dts - i_pcr_dts, i_pcr_dts );
+        if ( i < i_packet_count )
+            TSSchedule( p_mux, p_packets + i, i_packet_count - i,
+                        i_pcr_dts + i_pcr_length - i_cut_dts, i_cut_dts );
         return;
     }
 
-    if ( new_chain.i_depth )
-        TSDate( p_mux, &new_chain, i_pcr_length, i_pcr_dts );
+    if ( i_packet_count > 0 )
+        TSDate( p_mux, p_packets, i_packet_count, i_pcr_length, i_pcr_dts );
 }
 
-static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+/* Maximum number of TS packets sent in one block, i.e. one UDP datagram */
+#define TS_PACKETS_PER_BLOCK 7
+
+static void TSDate( sout_mux_t *p_mux, ts_packet_t *p_packets,
+                    int i_packet_count,
                     vlc_tick_t i_pcr_length, vlc_tick_t i_pcr_dts )
 {
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
-    int i_packet_count = p_chain_ts->i_depth;
 
     if ( i_pcr_length / 1000 > 0 )
     {
@@ -1788,37 +1990,79 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
     }
 
     /* msg_Dbg( p_mux, "real pck=%d", i_packet_count ); */
+    uint8_t *pp_scrambled[CSA_BATCH_MAX];
+    unsigned i_scrambled = 0;
+
     for (int i = 0; i < i_packet_count; i++ )
     {
-        block_t *p_ts = BufferChainGet( p_chain_ts );
-        vlc_tick_t i_new_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
+        ts_packet_t *p_ts = &p_packets[i];
 
-        p_ts->i_dts    = i_new_dts;
-        p_ts->i_length = i_pcr_length / i_packet_count;
+        p_ts->i_dts = i_pcr_dts + i_pcr_length * i / i_packet_count;
 
         if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
         {
             /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
-            TSSetPCR( p_ts, p_ts->i_dts - p_sys->first_dts );
+            TSSetPCR( p_ts->p_buffer, p_ts->i_dts - p_sys->first_dts );
         }
+
+        /* latency */
+        p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
+
+        /* scramble the packets by batches */
         if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+            pp_scrambled[i_scrambled++] = p_ts->p_buffer;
+        if( i_scrambled == CSA_BATCH_MAX
+         || ( i_scrambled > 0 && i == i_packet_count - 1 ) )
         {
             vlc_mutex_lock( &p_sys->csa_lock );
-            csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
+            csa_EncryptBatch( p_sys->csa, pp_scrambled, i_scrambled,
+                              p_sys->i_csa_pkt_size );
             vlc_mutex_unlock( &p_sys->csa_lock );
+            i_scrambled = 0;
         }
+    }
 
-        /* latency */
-        p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
-
-        sout_AccessOutWrite( p_mux->p_access, p_ts );
+    /* Send the packets by blocks. Header packets are sent alone, and random
+     * access points and PCRs start new blocks, so that the access outputs
+     * can still split the stream on these packets and pace them.
+     *
+     * A block only has the flags and date of its first packet: the other
+     * packets have the same flags but those starting blocks, and follow at
+     * i_length intervals, as they were dated above. */
+    const uint32_t i_start_flags = BLOCK_FLAG_HEADER | BLOCK_FLAG_TYPE_I
+                                 | BLOCK_FLAG_CLOCK;
+    const vlc_tick_t i_length = i_pcr_length / i_packet_count;
+
+    for (int i = 0; i < i_packet_count; )
+    {
+        uint32_t i_flags = p_packets[i].i_flags;
+        int i_count = 1;
+
+        if( !(i_flags & BLOCK_FLAG_HEADER) )
+            while( i_count < TS_PACKETS_PER_BLOCK && i + i_count < i_packet_count
+                && (p_packets[i + i_count].i_flags & i_start_flags) == 0
+                && ((p_packets[i + i_count].i_flags ^ i_flags)
+                    & ~i_start_flags) == 0 )
+                i_count++;
+
+        block_t *p_block = block_Alloc( i_count * 188 );
+        if( likely(p_block != NULL) )
+        {
+            for( int j = 0; j < i_count; j++ )
+                memcpy( &p_block->p_buffer[j * 188],
+                        p_packets[i + j].p_buffer, 188 );
+            p_block->i_dts    = p_packets[i].i_dts;
+            p_block->i_length = i_length * i_count;
+            p_block->i_flags  = i_flags;
+            sout_AccessOutWrite( p_mux->p_access, p_block );
+        }
+        i += i_count;
     }
 }
 
-static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
-                       bool b_pcr )
+static void TSNew( sout_input_sys_t *p_stream, bool b_pcr,
+                   uint8_t *p_buffer, ts_packet_t *p_ts )
 {
-    VLC_UNUSED(p_mux);
     block_t *p_pes = p_stream->state.chain_pes.p_first;
 
     bool b_new_pes = false;
@@ -1838,7 +2082,8 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
         b_adaptation_field = true;
     }
 
-    block_t *p_ts = block_Alloc( 188 );
+    p_ts->p_buffer = p_buffer;
+    p_ts->i_flags = 0;
 
     if (b_new_pes && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) && p_pes->i_flags & BLOCK_FLAG_TYPE_I)
     {
@@ -1847,11 +2092,11 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
 
     p_ts->i_dts = p_pes->i_dts;
 
-    p_ts->p_buffer[0] = 0x47;
-    p_ts->p_buffer[1] = ( b_new_pes ? 0x40 : 0x00 ) |
+    p_buffer[0] = 0x47;
+    p_buffer[1] = ( b_new_pes ? 0x40 : 0x00 ) |
         ( ( p_stream->ts.i_pid >> 8 )&0x1f );
-    p_ts->p_buffer[2] = p_stream->ts.i_pid & 0xff;
-    p_ts->p_buffer[3] = ( b_adaptation_field ? 0x30 : 0x10 ) |
+    p_buffer[2] = p_stream->ts.i_pid & 0xff;
+    p_buffer[3] = ( b_adaptation_field ? 0x30 : 0x10 ) |
         p_stream->ts.i_continuity_counter;
 
     p_stream->ts.i_continuity_counter = (p_stream->ts.i_continuity_counter+1)%16;
@@ -1864,28 +2109,28 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
         {
             p_ts->i_flags |= BLOCK_FLAG_CLOCK;
 
-            p_ts->p_buffer[4] = 7 + i_stuffing;
-            p_ts->p_buffer[5] = 1 << 4; /* PCR_flag */
+            p_buffer[4] = 7 + i_stuffing;
+            p_buffer[5] = 1 << 4; /* PCR_flag */
             if( p_stream->ts.b_discontinuity )
             {
-                p_ts->p_buffer[5] |= 0x80; /* flag TS dicontinuity */
+                p_buffer[5] |= 0x80; /* flag TS dicontinuity */
                 p_stream->ts.b_discontinuity = false;
             }
-            memset(&p_ts->p_buffer[12], 0xff, i_stuffing);
+            memset(&p_buffer[12], 0xff, i_stuffing);
         }
         else
         {
-            p_ts->p_buffer[4] = --i_stuffing;
+            p_buffer[4] = --i_stuffing;
             if( i_stuffing-- )
             {
-                p_ts->p_buffer[5] = 0;
-                memset(&p_ts->p_buffer[6], 0xff, i_stuffing);
+                p_buffer[5] = 0;
+                memset(&p_buffer[6], 0xff, i_stuffing);
             }
         }
     }
 
     /* copy payload */
-    memcpy( &p_ts->p_buffer[188 - i_payload],
+    memcpy( &p_buffer[188 - i_payload],
             &p_pes->p_buffer[p_stream->state.i_pes_used], i_payload );
 
     p_stream->state.i_pes_used += i_payload;
@@ -1914,21 +2159,114 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
         }
         p_stream->state.i_pes_used = 0;
     }
-
-    return p_ts;
 }
 
-static void TSSetPCR( block_t *p_ts, vlc_tick_t i_dts )
+static void TSSetPCR( uint8_t *p_buffer, vlc_tick_t i_dts )
 {
     vlc_tick_t i_pcr = 9 * i_dts / 100;
 
-    p_ts->p_buffer[6]  = ( i_pcr >> 25 )&0xff;
-    p_ts->p_buffer[7]  = ( i_pcr >> 17 )&0xff;
-    p_ts->p_buffer[8]  = ( i_pcr >> 9  )&0xff;
-    p_ts->p_buffer[9]  = ( i_pcr >> 1  )&0xff;
-    p_ts->p_buffer[10] = ( i_pcr << 7  )&0x80;
-    p_ts->p_buffer[10] |= 0x7e;
-    p_ts->p_buffer[11] = 0; /* we don't set PCR extension */
+    p_buffer[6]  = ( i_pcr >> 25 )&0xff;
+    p_buffer[7]  = ( i_pcr >> 17 )&0xff;
+    p_buffer[8]  = ( i_pcr >> 9  )&0xff;
+    p_buffer[9]  = ( i_pcr >> 1  )&0xff;
+    p_buffer[10] = ( i_pcr << 7  )&0x80;
+    p_buffer[10] |= 0x7e;
+    p_buffer[11] = 0; /* we don't set PCR extension */
+}
+
+/* Packetizes the PES of a stream, up to the given date */
+static void TSPacketize( sout_input_sys_t *p_stream, vlc_tick_t i_max_dts )
+{
+    ts_slab_t *p_slab = &p_stream->slab;
+
+    p_slab->i_count = 0;
+    p_slab->i_pos = 0;
+
+    if( !SlabReserve( p_slab, SlabMaxPackets( p_stream, 184 ) ) )
+    {
+        TSDropPES( p_stream );
+        return;
+    }
+
+    while( p_stream->state.i_pes_dts != 0
+        && p_stream->state.i_pes_dts <= i_max_dts )
+    {
+        size_t i = p_slab->i_count++;
+
+        p_slab->p_keys[i] = p_stream->state.i_pes_dts;
+        TSNew( p_stream, false, &p_slab->p_buffer[i * 188],
+               &p_slab->p_packets[i] );
+    }
+}
+
+/* Packetizes the pending streams; the work lock must be held */
+static void TSWork( sout_mux_sys_t *p_sys )
+{
+    while( p_sys->i_work_next < p_sys->i_work )
+    {
+        sout_input_sys_t *p_stream = p_sys->pp_work[p_sys->i_work_next++];
+        vlc_tick_t i_max_dts = p_sys->i_work_dts;
+
+        vlc_mutex_unlock( &p_sys->work_lock );
+        TSPacketize( p_stream, i_max_dts );
+        vlc_mutex_lock( &p_sys->work_lock );
+
+        if( ++p_sys->i_work_done == p_sys->i_work )
+            vlc_cond_signal( &p_sys->work_done );
+    }
+}
+
+static void *TSWorkerThread( void *data )
+{
+    sout_mux_sys_t *p_sys = data;
+
+    vlc_mutex_lock( &p_sys->work_lock );
+    while( !p_sys->b_work_exit )
+    {
+        if( p_sys->i_work_next < p_sys->i_work )
+            TSWork( p_sys );
+        else
+            vlc_cond_wait( &p_sys->work_wait, &p_sys->work_lock );
+    }
+    vlc_mutex_unlock( &p_sys->work_lock );
+    return NULL;
+}
+
+/* Packetizes all the streams but the PCR one, sharing the streams between
+ * the muxer thread and the worker threads (if any) */
+static void TSPacketizeStreams( sout_mux_t *p_mux, vlc_tick_t i_max_dts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    sout_input_sys_t *streams[p_mux->i_nb_inputs];
+    int i_streams = 0;
+
+    for (int i = 0; i < p_mux->i_nb_inputs; i++ )
+        if( p_mux->pp_inputs[i] != p_sys->p_pcr_input )
+            streams[i_streams++] = p_mux->pp_inputs[i]->p_sys;
+
+    if( p_sys->i_threads == 0 || i_streams < 2 )
+    {
+        for (int i = 0; i < i_streams; i++ )
+            TSPacketize( streams[i], i_max_dts );
+        return;
+    }
+
+    vlc_mutex_lock( &p_sys->work_lock );
+    p_sys->pp_work = streams;
+    p_sys->i_work = i_streams;
+    p_sys->i_work_next = 0;
+    p_sys->i_work_done = 0;
+    p_sys->i_work_dts = i_max_dts;
+    vlc_cond_broadcast( &p_sys->work_wait );
+
+    TSWork( p_sys );
+    while( p_sys->i_work_done < p_sys->i_work )
+        vlc_cond_wait( &p_sys->work_done, &p_sys->work_lock );
+
+    p_sys->pp_work = NULL;
+    p_sys->i_work = 0;
+    p_sys->i_work_next = 0;
+    vlc_mutex_unlock( &p_sys->work_lock );
 }
 
 void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
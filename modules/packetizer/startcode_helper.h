@@ -25,6 +25,15 @@
 #if !defined(CAN_COMPILE_SSE2) && defined(HAVE_SSE2_INTRINSICS)
    #include <emmintrin.h>
 #endif
+#if defined(HAVE_SSE2_INTRINSICS) && defined(HAVE_ATTRIBUTE_TARGET) \
+ && (defined(__i386__) || defined(__x86_64__))
+   #include <immintrin.h>
+   #define STARTCODE_HAVE_AVX2
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+   #include <arm_neon.h>
+   #define STARTCODE_HAVE_NEON
+#endif
 
 /* Looks up efficiently for an AnnexB startcode 0x00 0x00 0x01
  * by using a 4 times faster trick than single byte lookup. */
@@ -46,7 +55,7 @@
 
 #if defined(CAN_COMPILE_SSE2) || defined(HAVE_SSE2_INTRINSICS)
 
-__attribute__ ((__target__ ("sse2")))
+VLC_TARGET("sse2")
 static inline const uint8_t * startcode_FindAnnexB_SSE2( const uint8_t *p, const uint8_t *end )
 {
     /* First align to 16 */
@@ -109,6 +118,69 @@ static inline const uint8_t * startcode_FindAnnexB_SSE2( const uint8_t *p, const
 
 #endif
 
+#ifdef STARTCODE_HAVE_AVX2
+/* Matches the whole 00 00 01 pattern on 32 positions at once, by comparing
+ * the data with itself shifted by one and two bytes. */
+VLC_TARGET("avx2")
+static inline const uint8_t * startcode_FindAnnexB_AVX2( const uint8_t *p, const uint8_t *end )
+{
+    const __m256i zeros = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi8( 0x01 );
+
+    /* the last load reads up to p + 33 */
+    for( ; end - p >= 34; p += 32 )
+    {
+        __m256i v0 = _mm256_loadu_si256( (const __m256i *)p );
+        __m256i v1 = _mm256_loadu_si256( (const __m256i *)(p + 1) );
+        __m256i v2 = _mm256_loadu_si256( (const __m256i *)(p + 2) );
+        __m256i m = _mm256_and_si256( _mm256_cmpeq_epi8( v0, zeros ),
+                    _mm256_and_si256( _mm256_cmpeq_epi8( v1, zeros ),
+                                      _mm256_cmpeq_epi8( v2, ones ) ) );
+        uint32_t match = _mm256_movemask_epi8( m );
+        if( match )
+            return p + ctz( match );
+    }
+
+    for( end -= 3; p <= end; p++ )
+    {
+        if( p[0] == 0 && p[1] == 0 && p[2] == 1 )
+            return p;
+    }
+
+    return NULL;
+}
+#endif
+
+#ifdef STARTCODE_HAVE_NEON
+/* Same as the AVX2 version, on 16 positions at once */
+static inline const uint8_t * startcode_FindAnnexB_NEON( const uint8_t *p, const uint8_t *end )
+{
+    const uint8x16_t ones = vdupq_n_u8( 0x01 );
+
+    for( ; end - p >= 18; p += 16 )
+    {
+        uint8x16_t v0 = vld1q_u8( p );
+        uint8x16_t v1 = vld1q_u8( p + 1 );
+        uint8x16_t v2 = vld1q_u8( p + 2 );
+        uint8x16_t m = vandq_u8( vceqzq_u8( v0 ),
+                       vandq_u8( vceqzq_u8( v1 ), vceqq_u8( v2, ones ) ) );
+        /* narrow to 4 bits per byte to get a 64 bits mask */
+        uint64_t match = vget_lane_u64( vreinterpret_u64_u8(
+                            vshrn_n_u16( vreinterpretq_u16_u8( m ), 4 ) ), 0 );
+        if( match )
+            return p + (ctz( match ) >> 2);
+    }
+
+    for( end -= 3; p <= end; p++ )
+    {
+        if( p[0] == 0 && p[1] == 0 && p[2] == 1 )
+            return p;
+    }
+
+    return NULL;
+}
+#endif
+
 /* That code is adapted from libav's ff_avc_find_startcode_internal
  * and i believe the trick originated from
  * https://graphics.stanford.edu/~seander/bithacks.html#ZeroInWord
@@ -143,11 +215,17 @@ static inline const uint8_t * startcode_FindAnnexB_Bits( const uint8_t *p, const
 #if defined(CAN_COMPILE_SSE2) || defined(HAVE_SSE2_INTRINSICS)
 static inline const uint8_t * startcode_FindAnnexB( const uint8_t *p, const uint8_t *end )
 {
+#ifdef STARTCODE_HAVE_AVX2
+    if (vlc_CPU_AVX2())
+        return startcode_FindAnnexB_AVX2(p, end);
+#endif
     if (vlc_CPU_SSE2())
         return startcode_FindAnnexB_SSE2(p, end);
     else
         return startcode_FindAnnexB_Bits(p, end);
 }
+#elif defined(STARTCODE_HAVE_NEON)
+    #define startcode_FindAnnexB startcode_FindAnnexB_NEON
 #else
     #define startcode_FindAnnexB startcode_FindAnnexB_Bits
 #endif
@@ -68,6 +68,7 @@
 typedef struct
 {
     block_bytestream_t cache; /* bytestream chain for storing cache */
+    uint64_t offset; /* stream position of the cache read pointer */
 
     struct
     {
@@ -176,6 +177,7 @@ static void AStreamControlReset(stream_t *s)
     stream_sys_t *sys = s->p_sys;
 
     block_BytestreamEmpty( &sys->cache );
+    sys->offset = 0;
 
     /* Do the prebuffering */
     AStreamPrebufferBlock(s);
@@ -185,14 +187,19 @@ static int AStreamSeekBlock(stream_t *s, uint64_t i_pos)
 {
     stream_sys_t *sys = s->p_sys;
 
-    if( block_SkipBytes( &sys->cache, i_pos) == VLC_SUCCESS )
+    if( i_pos >= sys->offset &&
+        block_SkipBytes( &sys->cache, i_pos - sys->offset ) == VLC_SUCCESS )
+    {
+        sys->offset = i_pos;
         return VLC_SUCCESS;
+    }
 
     /* Not enought bytes, empty and seek */
     /* Do the access seek */
     if (vlc_stream_Seek(s->s, i_pos)) return VLC_EGENERIC;
 
     block_BytestreamEmpty( &sys->cache );
+    sys->offset = i_pos;
 
     /* Refill a block */
     if (AStreamRefillBlock(s))
@@ -224,6 +231,7 @@ static ssize_t AStreamReadBlock(stream_t *s, void *buf, size_t len)
     /* Copy data */
     if( block_GetBytes( &sys->cache, buf, i_copy ) )
         return -1;
+    sys->offset += i_copy;
 
 
     /* If we ended up on refill, try to read refilled cache */
@@ -291,6 +299,7 @@ static int Open(vlc_object_t *obj)
 
     /* Init all fields of sys->block */
     block_BytestreamInit( &sys->cache );
+    sys->offset = 0;
 
     s->p_sys = sys;
     /* Do the prebuffering */
@@ -272,6 +272,14 @@ static int Send( sout_stream_t *p_stream, void *_id, block_t *p_buffer )
 
         p_buffer->p_next = NULL;
 
+        /* Share the payload between the outputs rather than copying it */
+        if( p_sys->i_nb_streams > 1 )
+        {
+            block_t *p_shared = block_shared_Alloc( p_buffer );
+            if( p_shared )
+                p_buffer = p_shared;
+        }
+
         for( i_stream = 0; i_stream < p_sys->i_nb_streams - 1; i_stream++ )
         {
             p_dup_stream = p_sys->pp_streams[i_stream];
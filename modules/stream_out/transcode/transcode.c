@@ -604,6 +604,10 @@ static int Send( sout_stream_t *p_stream, void *_id, block_t *p_buffer )
             goto error;
     }
 
+    /* Decoders may modify their input in place */
+    if( p_buffer && (p_buffer = block_MakeWritable( p_buffer )) == NULL )
+        return VLC_ENOMEM;
+
     switch( id->p_decoder->fmt_in.i_cat )
     {
     case AUDIO_ES:
@@ -70,6 +70,7 @@
 #include "platform_fonts.h"
 #include "freetype.h"
 #include "text_layout.h"
+#include "text_cache.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -111,6 +112,10 @@ static void Destroy( vlc_object_t * );
 #define TEXT_DIRECTION_LONGTEXT N_("Paragraph base direction for the Unicode bi-directional algorithm.")
 
 
+#define CACHE_SIZE_TEXT N_("Glyph cache size (KiB)")
+#define CACHE_SIZE_LONGTEXT N_("Memory used to keep the rendered glyphs and " \
+  "the laid out texts for reuse. 0 disables the cache." )
+
 #define YUVP_TEXT N_("Use YUVP renderer")
 #define YUVP_LONGTEXT N_("This renders the font using \"paletized YUV\". " \
   "This option is only needed if you want to encode into DVB subtitles" )
@@ -211,6 +216,8 @@ vlc_module_begin ()
 
     add_bool( "freetype-yuvp", false, YUVP_TEXT,
               YUVP_LONGTEXT, true )
+    add_integer( "freetype-cache-size", 4096, CACHE_SIZE_TEXT,
+                 CACHE_SIZE_LONGTEXT, true )
 
 #ifdef HAVE_FRIBIDI
     add_integer_with_range( "freetype-text-direction", 0, 0, 2, TEXT_DIRECTION_TEXT,
@@ -1427,6 +1434,11 @@ static int Create( vlc_object_t *p_this )
     vlc_dictionary_init( &p_sys->family_map, 50 );
     vlc_dictionary_init( &p_sys->fallback_map, 20 );
 
+    /* Glyphs and layouts cache, optional */
+    int64_t i_cache_size = var_InheritInteger( p_filter, "freetype-cache-size" );
+    if( i_cache_size > 0 )
+        p_sys->p_cache = TextCache_New( i_cache_size * 1024 );
+
     p_sys->i_scale = 100;
 
     /* default style to apply to uncomplete segmeents styles */
@@ -1577,6 +1589,9 @@ static void Destroy( vlc_object_t *p_this )
 #endif
 
     /* Freetype */
+    if( p_sys->p_cache )
+        TextCache_Delete( p_sys->p_cache );
+
     if( p_sys->p_stroker )
         FT_Stroker_Done( p_sys->p_stroker );
 
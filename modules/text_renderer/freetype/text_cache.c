@@ -0,0 +1,174 @@
+/*****************************************************************************
+ * text_cache.c : LRU cache of glyphs and layouts
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/** \ingroup freetype
+ * @{
+ * \file
+ * LRU cache of glyphs and layouts
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_list.h>
+
+#include "text_cache.h"
+
+#define TEXT_CACHE_BUCKETS 1024
+
+typedef struct text_cache_entry_t text_cache_entry_t;
+struct text_cache_entry_t
+{
+    text_cache_entry_t *p_next;     /**< next entry of the same bucket */
+    struct vlc_list     lru;
+    uint32_t            i_hash;
+    void               *p_value;
+    size_t              i_size;
+    void              (*pf_free)( void * );
+    size_t              i_key;
+    uint8_t             key[];
+};
+
+struct text_cache_t
+{
+    text_cache_entry_t *pp_buckets[TEXT_CACHE_BUCKETS];
+    struct vlc_list     lru;        /**< most recently used first */
+    size_t              i_size;
+    size_t              i_budget;
+};
+
+static uint32_t Hash( const void *p_key, size_t i_key )
+{
+    /* FNV-1a */
+    const uint8_t *p = p_key;
+    uint32_t i_hash = 2166136261u;
+
+    for( size_t i = 0; i < i_key; i++ )
+        i_hash = ( i_hash ^ p[i] ) * 16777619u;
+    return i_hash;
+}
+
+static text_cache_entry_t **Find( text_cache_t *p_cache, uint32_t i_hash,
+                                  const void *p_key, size_t i_key )
+{
+    text_cache_entry_t **pp_entry =
+        &p_cache->pp_buckets[i_hash % TEXT_CACHE_BUCKETS];
+
+    for( ; *pp_entry; pp_entry = &(*pp_entry)->p_next )
+    {
+        const text_cache_entry_t *p_entry = *pp_entry;
+        if( p_entry->i_hash == i_hash && p_entry->i_key == i_key
+         && !memcmp( p_entry->key, p_key, i_key ) )
+            break;
+    }
+    return pp_entry;
+}
+
+static void Remove( text_cache_t *p_cache, text_cache_entry_t **pp_entry )
+{
+    text_cache_entry_t *p_entry = *pp_entry;
+
+    *pp_entry = p_entry->p_next;
+    vlc_list_remove( &p_entry->lru );
+    p_cache->i_size -= p_entry->i_size;
+    p_entry->pf_free( p_entry->p_value );
+    free( p_entry );
+}
+
+text_cache_t *TextCache_New( size_t i_budget )
+{
+    text_cache_t *p_cache = calloc( 1, sizeof( *p_cache ) );
+    if( !p_cache )
+        return NULL;
+
+    vlc_list_init( &p_cache->lru );
+    p_cache->i_budget = i_budget;
+    return p_cache;
+}
+
+void TextCache_Delete( text_cache_t *p_cache )
+{
+    for( size_t i = 0; i < TEXT_CACHE_BUCKETS; i++ )
+        while( p_cache->pp_buckets[i] )
+            Remove( p_cache, &p_cache->pp_buckets[i] );
+    free( p_cache );
+}
+
+void *TextCache_Get( text_cache_t *p_cache, const void *p_key, size_t i_key )
+{
+    text_cache_entry_t *p_entry =
+        *Find( p_cache, Hash( p_key, i_key ), p_key, i_key );
+    if( !p_entry )
+        return NULL;
+
+    vlc_list_remove( &p_entry->lru );
+    vlc_list_prepend( &p_entry->lru, &p_cache->lru );
+    return p_entry->p_value;
+}
+
+void TextCache_Put( text_cache_t *p_cache, const void *p_key, size_t i_key,
+                    void *p_value, size_t i_size, void (*pf_free)( void * ) )
+{
+    const uint32_t i_hash = Hash( p_key, i_key );
+    text_cache_entry_t **pp_entry = Find( p_cache, i_hash, p_key, i_key );
+
+    if( *pp_entry )
+        Remove( p_cache, pp_entry );
+
+    i_size += sizeof( text_cache_entry_t ) + i_key;
+    if( i_size > p_cache->i_budget )
+    {
+        pf_free( p_value );
+        return;
+    }
+
+    text_cache_entry_t *p_entry = malloc( sizeof( *p_entry ) + i_key );
+    if( !p_entry )
+    {
+        pf_free( p_value );
+        return;
+    }
+
+    /* Evict the least recently used values */
+    while( p_cache->i_size + i_size > p_cache->i_budget )
+    {
+        text_cache_entry_t *p_last =
+            vlc_list_last_entry_or_null( &p_cache->lru, text_cache_entry_t, lru );
+        Remove( p_cache, Find( p_cache, p_last->i_hash,
+                               p_last->key, p_last->i_key ) );
+    }
+
+    p_entry->i_hash = i_hash;
+    p_entry->p_value = p_value;
+    p_entry->i_size = i_size;
+    p_entry->pf_free = pf_free;
+    p_entry->i_key = i_key;
+    memcpy( p_entry->key, p_key, i_key );
+
+    pp_entry = &p_cache->pp_buckets[i_hash % TEXT_CACHE_BUCKETS];
+    p_entry->p_next = *pp_entry;
+    *pp_entry = p_entry;
+    vlc_list_prepend( &p_entry->lru, &p_cache->lru );
+    p_cache->i_size += i_size;
+}
+
+/** @} */
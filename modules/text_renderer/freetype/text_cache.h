@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * text_cache.h : LRU cache of glyphs and layouts
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_FREETYPE_TEXT_CACHE_H
+#define VLC_FREETYPE_TEXT_CACHE_H
+
+/** \ingroup freetype
+ * @{
+ * \file
+ * LRU cache of glyphs and layouts
+ *
+ * Values are looked up by binary keys and evicted, least recently used first,
+ * when the total of their sizes exceeds the memory budget of the cache.
+ */
+
+typedef struct text_cache_t text_cache_t;
+
+/**
+ * Creates a cache.
+ *
+ * \param i_budget maximum total size of the cached values, in bytes
+ */
+text_cache_t *TextCache_New( size_t i_budget );
+
+/**
+ * Destroys a cache and all its values.
+ */
+void TextCache_Delete( text_cache_t *p_cache );
+
+/**
+ * Looks a value up, and makes it the most recently used one.
+ *
+ * \return the value, still owned by the cache, or NULL if there is none
+ */
+void *TextCache_Get( text_cache_t *p_cache, const void *p_key, size_t i_key );
+
+/**
+ * Adds a value, replacing the previous value for the same key if any.
+ *
+ * The cache takes ownership of the value in all cases: the value may be
+ * freed immediately if it does not fit in the cache at all.
+ *
+ * \param i_size the memory used by the value, accounted in the budget
+ * \param pf_free function freeing the value
+ */
+void TextCache_Put( text_cache_t *p_cache, const void *p_key, size_t i_key,
+                    void *p_value, size_t i_size, void (*pf_free)( void * ) );
+
+/** @} */
+
+#endif
@@ -42,6 +42,7 @@
 #include <vlc_common.h>
 #include <vlc_filter.h>
 #include <vlc_text_style.h>
+#include <vlc_memstream.h>
 
 /* Freetype */
 #include <ft2build.h>
@@ -65,6 +66,7 @@
 #include "freetype.h"
 #include "text_layout.h"
 #include "platform_fonts.h"
+#include "text_cache.h"
 
 /* Win32 */
 #ifdef _WIN32
@@ -115,11 +117,69 @@ typedef struct run_desc_t
 
 } run_desc_t;
 
+/**
+ * Text cache keys, starting with their type
+ */
+enum
+{
+    CACHE_KEY_OUTLINES = 1,
+    CACHE_KEY_BITMAP,
+    CACHE_KEY_LAYOUT,
+};
+
+/**
+ * Identifies the loaded outlines of a glyph. Keys are compared as bytes,
+ * so they must be zeroed before being filled.
+ */
+typedef struct glyph_key_t
+{
+    uint8_t  i_type;
+    bool     b_embolden;
+    bool     b_oblique;
+    FT_UInt  i_index;
+    FT_Face  p_face;
+    FT_Fixed i_outline_radius;      /**< -1 without outline */
+} glyph_key_t;
+
+/**
+ * Identifies the bitmap of a glyph, or of its outline, rendered at a
+ * subpixel position
+ */
+typedef struct glyph_bitmap_key_t
+{
+    glyph_key_t glyph;
+    bool        b_outline;
+    uint8_t     i_x_frac;           /**< 26.6 fractional part of the pen */
+    uint8_t     i_y_frac;
+} glyph_bitmap_key_t;
+
+/**
+ * Cached outlines of a glyph, and its advance
+ */
+typedef struct glyph_outlines_t
+{
+    FT_Glyph  p_glyph;
+    FT_Glyph  p_outline;
+    FT_Vector advance;
+} glyph_outlines_t;
+
+/**
+ * Cached layout of a text block
+ */
+typedef struct cached_layout_t
+{
+    line_desc_t *p_lines;
+    size_t      *pi_styles;         /**< text block style of each character */
+    FT_BBox      bbox;
+    int          i_max_face_height;
+} cached_layout_t;
+
 /**
  * Glyph bitmaps. Advance and offset are 26.6 values
  */
 typedef struct glyph_bitmaps_t
 {
+    glyph_key_t key;
     FT_Glyph p_glyph;
     FT_Glyph p_outline;
     FT_Glyph p_shadow;
@@ -1010,6 +1070,125 @@ static int ZeroNsmAdvance( paragraph_t *p_paragraph )
 #endif
 #endif
 
+/**
+ * Memory used by a glyph, for the cache budget
+ */
+static size_t GlyphSize( FT_Glyph p_glyph )
+{
+    if( !p_glyph )
+        return 0;
+
+    if( p_glyph->format == FT_GLYPH_FORMAT_BITMAP )
+    {
+        const FT_Bitmap *p_bitmap = &((FT_BitmapGlyph)p_glyph)->bitmap;
+        return sizeof( FT_BitmapGlyphRec ) + p_bitmap->rows * abs( p_bitmap->pitch );
+    }
+    if( p_glyph->format == FT_GLYPH_FORMAT_OUTLINE )
+    {
+        const FT_Outline *p_outline = &((FT_OutlineGlyph)p_glyph)->outline;
+        return sizeof( FT_OutlineGlyphRec )
+             + p_outline->n_points * ( sizeof( FT_Vector ) + 1 )
+             + p_outline->n_contours * sizeof( short );
+    }
+    return sizeof( FT_GlyphRec );
+}
+
+static void FreeOutlines( void *p_data )
+{
+    glyph_outlines_t *p_outlines = p_data;
+
+    FT_Done_Glyph( p_outlines->p_glyph );
+    if( p_outlines->p_outline )
+        FT_Done_Glyph( p_outlines->p_outline );
+    free( p_outlines );
+}
+
+static void FreeBitmap( void *p_data )
+{
+    FT_Done_Glyph( (FT_Glyph) p_data );
+}
+
+/**
+ * Keep copies of the freshly loaded outlines of a glyph
+ */
+static void CacheOutlines( text_cache_t *p_cache,
+                           const glyph_bitmaps_t *p_bitmaps,
+                           const FT_Vector *p_advance )
+{
+    glyph_outlines_t *p_outlines = malloc( sizeof( *p_outlines ) );
+    if( !p_outlines )
+        return;
+
+    p_outlines->p_outline = NULL;
+    p_outlines->advance = *p_advance;
+    if( FT_Glyph_Copy( p_bitmaps->p_glyph, &p_outlines->p_glyph ) )
+    {
+        free( p_outlines );
+        return;
+    }
+    if( p_bitmaps->p_outline
+     && FT_Glyph_Copy( p_bitmaps->p_outline, &p_outlines->p_outline ) )
+    {
+        FreeOutlines( p_outlines );
+        return;
+    }
+
+    TextCache_Put( p_cache, &p_bitmaps->key, sizeof( p_bitmaps->key ),
+                   p_outlines, sizeof( *p_outlines )
+                   + GlyphSize( p_outlines->p_glyph )
+                   + GlyphSize( p_outlines->p_outline ), FreeOutlines );
+}
+
+/**
+ * Renders a glyph, or its outline, at the pen position like
+ * FT_Glyph_To_Bitmap() does.
+ *
+ * Rendering is invariant by whole pixel translations, so the bitmaps are
+ * cached by subpixel position and then moved to the pen.
+ */
+static int RenderGlyph( filter_sys_t *p_sys, FT_Glyph *pp_glyph,
+                        const glyph_key_t *p_key, bool b_outline,
+                        const FT_Vector *p_pen, bool b_destroy )
+{
+    if( !p_sys->p_cache || (*pp_glyph)->format != FT_GLYPH_FORMAT_OUTLINE )
+        return FT_Glyph_To_Bitmap( pp_glyph, FT_RENDER_MODE_NORMAL,
+                                   (FT_Vector *) p_pen, b_destroy )
+               ? VLC_EGENERIC : VLC_SUCCESS;
+
+    glyph_bitmap_key_t key;
+    memset( &key, 0, sizeof( key ) );
+    key.glyph = *p_key;
+    key.glyph.i_type = CACHE_KEY_BITMAP;
+    key.b_outline = b_outline;
+    key.i_x_frac = p_pen->x & 63;
+    key.i_y_frac = p_pen->y & 63;
+
+    FT_Glyph p_bitmap = TextCache_Get( p_sys->p_cache, &key, sizeof( key ) );
+    if( p_bitmap )
+    {
+        if( FT_Glyph_Copy( p_bitmap, &p_bitmap ) )
+            return VLC_ENOMEM;
+    }
+    else
+    {
+        FT_Vector origin = { .x = key.i_x_frac, .y = key.i_y_frac };
+        FT_Glyph p_copy;
+
+        p_bitmap = *pp_glyph;
+        if( FT_Glyph_To_Bitmap( &p_bitmap, FT_RENDER_MODE_NORMAL, &origin, 0 ) )
+            return VLC_EGENERIC;
+        if( !FT_Glyph_Copy( p_bitmap, &p_copy ) )
+            TextCache_Put( p_sys->p_cache, &key, sizeof( key ), p_copy,
+                           GlyphSize( p_copy ), FreeBitmap );
+    }
+
+    if( b_destroy )
+        FT_Done_Glyph( *pp_glyph );
+    ShiftGlyph( (FT_BitmapGlyph) p_bitmap, p_pen->x >> 6, p_pen->y >> 6 );
+    *pp_glyph = p_bitmap;
+    return VLC_SUCCESS;
+}
+
 /**
  * Load the glyphs of a paragraph. When shaping with HarfBuzz the glyph indices
  * have already been determined at this point, as well as the advance values.
@@ -1052,18 +1231,26 @@ static int LoadGlyphs( filter_t *p_filter, paragraph_t *p_paragraph,
         else
             p_face = p_run->p_face;
 
-        if( p_sys->p_stroker && (p_style->i_style_flags & STYLE_OUTLINE) )
+        const bool b_stroke = p_sys->p_stroker
+                           && (p_style->i_style_flags & STYLE_OUTLINE);
+        int i_radius = 0;
+        if( b_stroke )
         {
             double f_outline_thickness =
                 var_InheritInteger( p_filter, "freetype-outline-thickness" ) / 100.0;
             f_outline_thickness = VLC_CLIP( f_outline_thickness, 0.0, 0.5 );
-            int i_radius = ( i_live_size << 6 ) * f_outline_thickness;
+            i_radius = ( i_live_size << 6 ) * f_outline_thickness;
             FT_Stroker_Set( p_sys->p_stroker,
                             i_radius,
                             FT_STROKER_LINECAP_ROUND,
                             FT_STROKER_LINEJOIN_ROUND, 0 );
         }
 
+        const bool b_embolden = ( p_style->i_style_flags & STYLE_BOLD )
+                             && !( p_face->style_flags & FT_STYLE_FLAG_BOLD );
+        const bool b_oblique = ( p_style->i_style_flags & STYLE_ITALIC )
+                            && !( p_face->style_flags & FT_STYLE_FLAG_ITALIC );
+
         for( int j = p_run->i_start_offset; j < p_run->i_end_offset; ++j )
         {
             int i_glyph_index;
@@ -1114,30 +1301,58 @@ static int LoadGlyphs( filter_t *p_filter, paragraph_t *p_paragraph,
                     SKIP_GLYPH( p_bitmaps )
             }
 
-            if( FT_Load_Glyph( p_face, i_glyph_index,
-                               FT_LOAD_NO_BITMAP | FT_LOAD_DEFAULT )
-             && FT_Load_Glyph( p_face, i_glyph_index, FT_LOAD_DEFAULT ) )
-                SKIP_GLYPH( p_bitmaps )
-
-            if( ( p_style->i_style_flags & STYLE_BOLD )
-                  && !( p_face->style_flags & FT_STYLE_FLAG_BOLD ) )
-                FT_GlyphSlot_Embolden( p_face->glyph );
-            if( ( p_style->i_style_flags & STYLE_ITALIC )
-                  && !( p_face->style_flags & FT_STYLE_FLAG_ITALIC ) )
-                FT_GlyphSlot_Oblique( p_face->glyph );
+            glyph_key_t *p_key = &p_bitmaps->key;
+            memset( p_key, 0, sizeof( *p_key ) );
+            p_key->i_type = CACHE_KEY_OUTLINES;
+            p_key->b_embolden = b_embolden;
+            p_key->b_oblique = b_oblique;
+            p_key->i_index = i_glyph_index;
+            p_key->p_face = p_face;
+            p_key->i_outline_radius = b_stroke ? i_radius : -1;
 
-            if( FT_Get_Glyph( p_face->glyph, &p_bitmaps->p_glyph ) )
-                SKIP_GLYPH( p_bitmaps )
+            const glyph_outlines_t *p_cached = p_sys->p_cache ?
+                TextCache_Get( p_sys->p_cache, p_key, sizeof( *p_key ) ) : NULL;
+            FT_Vector advance;
 
-#undef SKIP_GLYPH
-
-            if( p_sys->p_stroker && (p_style->i_style_flags & STYLE_OUTLINE) )
+            p_bitmaps->p_outline = 0;
+            if( p_cached )
             {
-                p_bitmaps->p_outline = p_bitmaps->p_glyph;
-                if( FT_Glyph_StrokeBorder( &p_bitmaps->p_outline,
-                                           p_sys->p_stroker, 0, 0 ) )
+                if( FT_Glyph_Copy( p_cached->p_glyph, &p_bitmaps->p_glyph ) )
+                    SKIP_GLYPH( p_bitmaps )
+                if( p_cached->p_outline
+                 && FT_Glyph_Copy( p_cached->p_outline, &p_bitmaps->p_outline ) )
                     p_bitmaps->p_outline = 0;
+                advance = p_cached->advance;
             }
+            else
+            {
+                if( FT_Load_Glyph( p_face, i_glyph_index,
+                                   FT_LOAD_NO_BITMAP | FT_LOAD_DEFAULT )
+                 && FT_Load_Glyph( p_face, i_glyph_index, FT_LOAD_DEFAULT ) )
+                    SKIP_GLYPH( p_bitmaps )
+
+                if( b_embolden )
+                    FT_GlyphSlot_Embolden( p_face->glyph );
+                if( b_oblique )
+                    FT_GlyphSlot_Oblique( p_face->glyph );
+
+                if( FT_Get_Glyph( p_face->glyph, &p_bitmaps->p_glyph ) )
+                    SKIP_GLYPH( p_bitmaps )
+
+                if( b_stroke )
+                {
+                    p_bitmaps->p_outline = p_bitmaps->p_glyph;
+                    if( FT_Glyph_StrokeBorder( &p_bitmaps->p_outline,
+                                               p_sys->p_stroker, 0, 0 ) )
+                        p_bitmaps->p_outline = 0;
+                }
+
+                advance = p_face->glyph->advance;
+                if( p_sys->p_cache )
+                    CacheOutlines( p_sys->p_cache, p_bitmaps, &advance );
+            }
+
+#undef SKIP_GLYPH
 
             if( p_style->i_shadow_alpha != STYLE_ALPHA_TRANSPARENT )
                 p_bitmaps->p_shadow = p_bitmaps->p_outline ?
@@ -1145,8 +1360,8 @@ static int LoadGlyphs( filter_t *p_filter, paragraph_t *p_paragraph,
 
             if( b_overwrite_advance )
             {
-                p_bitmaps->i_x_advance = p_face->glyph->advance.x;
-                p_bitmaps->i_y_advance = p_face->glyph->advance.y;
+                p_bitmaps->i_x_advance = advance.x;
+                p_bitmaps->i_y_advance = advance.y;
             }
 
             unsigned i_x_advance = FT_FLOOR( p_bitmaps->i_x_advance );
@@ -1253,8 +1468,9 @@ static int LayoutLine( filter_t *p_filter,
 
         if( p_bitmaps->p_shadow )
         {
-            if( FT_Glyph_To_Bitmap( &p_bitmaps->p_shadow, FT_RENDER_MODE_NORMAL,
-                                    &pen_shadow, 0 ) )
+            if( RenderGlyph( p_sys, &p_bitmaps->p_shadow, &p_bitmaps->key,
+                             p_bitmaps->p_shadow == p_bitmaps->p_outline,
+                             &pen_shadow, false ) )
                 p_bitmaps->p_shadow = 0;
             else
                 FT_Glyph_Get_CBox( p_bitmaps->p_shadow, ft_glyph_bbox_pixels,
@@ -1262,8 +1478,8 @@ static int LayoutLine( filter_t *p_filter,
         }
         if( p_bitmaps->p_glyph )
         {
-            if( FT_Glyph_To_Bitmap( &p_bitmaps->p_glyph, FT_RENDER_MODE_NORMAL,
-                                    &pen_new, 1 ) )
+            if( RenderGlyph( p_sys, &p_bitmaps->p_glyph, &p_bitmaps->key,
+                             false, &pen_new, true ) )
             {
                 FT_Done_Glyph( p_bitmaps->p_glyph );
                 if( p_bitmaps->p_outline )
@@ -1278,8 +1494,8 @@ static int LayoutLine( filter_t *p_filter,
         }
         if( p_bitmaps->p_outline )
         {
-            if( FT_Glyph_To_Bitmap( &p_bitmaps->p_outline, FT_RENDER_MODE_NORMAL,
-                                    &pen_new, 1 ) )
+            if( RenderGlyph( p_sys, &p_bitmaps->p_outline, &p_bitmaps->key,
+                             true, &pen_new, true ) )
             {
                 FT_Done_Glyph( p_bitmaps->p_outline );
                 p_bitmaps->p_outline = 0;
@@ -1731,10 +1947,222 @@ static int LayoutRubyText( filter_t *p_filter,
     return VLC_SUCCESS;
 }
 
-int LayoutTextBlock( filter_t *p_filter,
-                     const layout_text_block_t *p_textblock,
-                     line_desc_t **pp_lines, FT_BBox *p_bbox,
-                     int *pi_max_face_height )
+/**
+ * Build the layout cache key of a text block, from everything the glyphs and
+ * their positions depend on. Colors and alpha values are not part of it, as
+ * the characters of cached layouts get the styles of the new text block.
+ */
+static int LayoutCacheKey( filter_t *p_filter,
+                           const layout_text_block_t *p_textblock,
+                           struct vlc_memstream *p_key )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    /* Ruby and karaoke layouts are not cached */
+    if( p_textblock->pi_k_durations )
+        return VLC_EGENERIC;
+    for( size_t i = 0; p_textblock->pp_ruby && i < p_textblock->i_count; i++ )
+        if( p_textblock->pp_ruby[i] )
+            return VLC_EGENERIC;
+
+    if( vlc_memstream_open( p_key ) )
+        return VLC_ENOMEM;
+
+    struct
+    {
+        uint8_t  i_type;
+        bool     b_balanced;
+        bool     b_grid;
+        unsigned i_max_width;
+        unsigned i_max_height;
+        size_t   i_count;
+        FT_Face  p_default_face;
+        int64_t  i_outline_thickness;
+        int64_t  i_direction;
+    } header;
+    memset( &header, 0, sizeof( header ) );
+    header.i_type = CACHE_KEY_LAYOUT;
+    header.b_balanced = p_textblock->b_balanced;
+    header.b_grid = p_textblock->b_grid;
+    header.i_max_width = p_textblock->i_max_width;
+    header.i_max_height = p_textblock->i_max_height;
+    header.i_count = p_textblock->i_count;
+    header.p_default_face = p_sys->p_face;
+    header.i_outline_thickness =
+        var_InheritInteger( p_filter, "freetype-outline-thickness" );
+#ifdef HAVE_FRIBIDI
+    header.i_direction = var_InheritInteger( p_filter, "freetype-text-direction" );
+#endif
+    vlc_memstream_write( p_key, &header, sizeof( header ) );
+    vlc_memstream_write( p_key, p_textblock->p_uchars,
+                         p_textblock->i_count * sizeof( *p_textblock->p_uchars ) );
+
+    /* Each character refers to the first one sharing its style, so that the
+     * styles of a cached layout can be mapped to the ones of the new block */
+    text_style_t *const *pp_styles = p_textblock->pp_styles;
+    size_t i_first = 0;
+    for( size_t i = 0; i < p_textblock->i_count; i++ )
+    {
+        const text_style_t *p_style = pp_styles[i];
+        if( i == 0 || p_style != pp_styles[i - 1] )
+            for( i_first = 0; pp_styles[i_first] != p_style; i_first++ );
+
+        vlc_memstream_write( p_key, &i_first, sizeof( i_first ) );
+        if( i_first != i )
+            continue;
+
+        struct
+        {
+            int      i_size;
+            uint16_t i_style_flags;
+            bool     b_shadow;
+            int      i_wrap;
+        } style;
+        memset( &style, 0, sizeof( style ) );
+        style.i_size = ConvertToLiveSize( p_filter, p_style );
+        style.i_style_flags = p_style->i_style_flags;
+        style.b_shadow = p_style->i_shadow_alpha != STYLE_ALPHA_TRANSPARENT;
+        style.i_wrap = p_style->e_wrapinfo;
+        vlc_memstream_write( p_key, &style, sizeof( style ) );
+
+        const char *psz_fontname = p_style->psz_fontname ? p_style->psz_fontname : "";
+        const char *psz_monofontname = p_style->psz_monofontname ? p_style->psz_monofontname : "";
+        vlc_memstream_write( p_key, psz_fontname, strlen( psz_fontname ) + 1 );
+        vlc_memstream_write( p_key, psz_monofontname, strlen( psz_monofontname ) + 1 );
+    }
+
+    return vlc_memstream_close( p_key ) ? VLC_ENOMEM : VLC_SUCCESS;
+}
+
+/**
+ * Deep copy of laid out lines, with their glyphs
+ */
+static int CopyLines( const line_desc_t *p_lines, line_desc_t **pp_copy,
+                      size_t *pi_size )
+{
+    line_desc_t *p_first = NULL, **pp_line = &p_first;
+    size_t i_size = 0;
+
+    for( ; p_lines; p_lines = p_lines->p_next )
+    {
+        line_desc_t *p_line = NewLine( p_lines->i_character_count );
+        if( !p_line )
+            goto error;
+
+        line_character_t *p_characters = p_line->p_character;
+        *p_line = *p_lines;
+        p_line->p_next = NULL;
+        p_line->p_character = p_characters;
+        p_line->i_character_count = 0;
+        *pp_line = p_line;
+        pp_line = &p_line->p_next;
+        i_size += sizeof( *p_line );
+
+        for( int i = 0; i < p_lines->i_character_count; i++ )
+        {
+            const line_character_t *p_src = &p_lines->p_character[i];
+            line_character_t *p_ch = &p_characters[i];
+            FT_BitmapGlyph *pp_dst[3] = { &p_ch->p_glyph, &p_ch->p_outline, &p_ch->p_shadow };
+            const FT_BitmapGlyph p_glyphs[3] = { p_src->p_glyph, p_src->p_outline, p_src->p_shadow };
+
+            *p_ch = *p_src;
+            p_ch->p_glyph = p_ch->p_outline = p_ch->p_shadow = NULL;
+            p_line->i_character_count++;
+            i_size += sizeof( *p_ch );
+
+            for( int j = 0; j < 3; j++ )
+            {
+                if( !p_glyphs[j] )
+                    continue;
+                if( FT_Glyph_Copy( (FT_Glyph) p_glyphs[j], (FT_Glyph *) pp_dst[j] ) )
+                    goto error;
+                i_size += GlyphSize( (FT_Glyph) p_glyphs[j] );
+            }
+        }
+    }
+
+    *pp_copy = p_first;
+    if( pi_size )
+        *pi_size = i_size;
+    return VLC_SUCCESS;
+
+error:
+    FreeLines( p_first );
+    return VLC_ENOMEM;
+}
+
+static void FreeCachedLayout( void *p_data )
+{
+    cached_layout_t *p_layout = p_data;
+
+    FreeLines( p_layout->p_lines );
+    free( p_layout->pi_styles );
+    free( p_layout );
+}
+
+static void CacheLayout( text_cache_t *p_cache, const struct vlc_memstream *p_key,
+                         const layout_text_block_t *p_textblock,
+                         const line_desc_t *p_lines, const FT_BBox *p_bbox,
+                         int i_max_face_height )
+{
+    cached_layout_t *p_layout = malloc( sizeof( *p_layout ) );
+    if( !p_layout )
+        return;
+
+    size_t i_size;
+    if( CopyLines( p_lines, &p_layout->p_lines, &i_size ) )
+    {
+        free( p_layout );
+        return;
+    }
+    p_layout->bbox = *p_bbox;
+    p_layout->i_max_face_height = i_max_face_height;
+
+    size_t i_characters = 0;
+    for( const line_desc_t *p_line = p_lines; p_line; p_line = p_line->p_next )
+        i_characters += p_line->i_character_count;
+    p_layout->pi_styles = vlc_alloc( i_characters, sizeof( *p_layout->pi_styles ) );
+    if( i_characters && !p_layout->pi_styles )
+    {
+        FreeCachedLayout( p_layout );
+        return;
+    }
+
+    size_t *pi_style = p_layout->pi_styles;
+    for( const line_desc_t *p_line = p_lines; p_line; p_line = p_line->p_next )
+        for( int i = 0; i < p_line->i_character_count; i++ )
+        {
+            const text_style_t *p_style = p_line->p_character[i].p_style;
+            size_t i_style = 0;
+            while( p_textblock->pp_styles[i_style] != p_style )
+                i_style++;
+            *pi_style++ = i_style;
+        }
+
+    TextCache_Put( p_cache, p_key->ptr, p_key->length, p_layout,
+                   sizeof( *p_layout ) + i_size
+                   + i_characters * sizeof( *p_layout->pi_styles ),
+                   FreeCachedLayout );
+}
+
+static int GetCachedLayout( const cached_layout_t *p_layout,
+                            const layout_text_block_t *p_textblock,
+                            line_desc_t **pp_lines )
+{
+    if( CopyLines( p_layout->p_lines, pp_lines, NULL ) )
+        return VLC_ENOMEM;
+
+    const size_t *pi_style = p_layout->pi_styles;
+    for( line_desc_t *p_line = *pp_lines; p_line; p_line = p_line->p_next )
+        for( int i = 0; i < p_line->i_character_count; i++ )
+            p_line->p_character[i].p_style = p_textblock->pp_styles[*pi_style++];
+    return VLC_SUCCESS;
+}
+
+static int LayoutBlock( filter_t *p_filter,
+                        const layout_text_block_t *p_textblock,
+                        line_desc_t **pp_lines, FT_BBox *p_bbox,
+                        int *pi_max_face_height )
 {
     line_desc_t *p_first_line = 0;
     line_desc_t **pp_line = &p_first_line;
@@ -1846,3 +2274,38 @@ int LayoutTextBlock( filter_t *p_filter,
     return VLC_SUCCESS;
 }
 
+int LayoutTextBlock( filter_t *p_filter,
+                     const layout_text_block_t *p_textblock,
+                     line_desc_t **pp_lines, FT_BBox *p_bbox,
+                     int *pi_max_face_height )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    struct vlc_memstream key;
+    const bool b_cache = p_sys->p_cache
+                      && LayoutCacheKey( p_filter, p_textblock, &key ) == VLC_SUCCESS;
+
+    if( b_cache )
+    {
+        const cached_layout_t *p_layout =
+            TextCache_Get( p_sys->p_cache, key.ptr, key.length );
+        if( p_layout && GetCachedLayout( p_layout, p_textblock, pp_lines ) == VLC_SUCCESS )
+        {
+            *p_bbox = p_layout->bbox;
+            *pi_max_face_height = p_layout->i_max_face_height;
+            free( key.ptr );
+            return VLC_SUCCESS;
+        }
+    }
+
+    int i_ret = LayoutBlock( p_filter, p_textblock, pp_lines, p_bbox,
+                             pi_max_face_height );
+
+    if( b_cache )
+    {
+        if( i_ret == VLC_SUCCESS )
+            CacheLayout( p_sys->p_cache, &key, p_textblock, *pp_lines,
+                         p_bbox, *pi_max_face_height );
+        free( key.ptr );
+    }
+    return i_ret;
+}
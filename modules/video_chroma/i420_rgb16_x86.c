@@ -32,6 +32,7 @@
 #include <vlc_cpu.h>
 
 #include "i420_rgb.h"
+#undef VLC_TARGET /* of vlc_common.h */
 #ifdef SSE2
 # include "i420_rgb_sse2.h"
 # define VLC_TARGET VLC_SSE
@@ -44,6 +44,7 @@
 
 #define SRC_FOURCC  "I420,IYUV,YV12"
 
+#undef VLC_TARGET /* of vlc_common.h */
 #if defined (MODULE_NAME_IS_i420_yuy2)
 #    define DEST_FOURCC "YUY2,YUNV,YVYU,UYVY,UYNV,Y422,IUYV,Y211"
 #    define VLC_TARGET
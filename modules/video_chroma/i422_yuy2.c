@@ -66,6 +66,7 @@ static picture_t *I422_Y211_Filter  ( filter_t *, picture_t * );
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
+#undef VLC_TARGET /* of vlc_common.h */
 vlc_module_begin ()
 #if defined (MODULE_NAME_IS_i422_yuy2)
     set_description( N_("Conversions from " SRC_FOURCC " to " DEST_FOURCC) )
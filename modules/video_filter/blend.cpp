@@ -32,18 +32,36 @@
 #include <vlc_plugin.h>
 #include <vlc_filter.h>
 #include <vlc_picture.h>
+#include <vlc_cpu.h>
 #include "filter_picture.h"
 
+#if defined(HAVE_SSE2_INTRINSICS) && defined(HAVE_ATTRIBUTE_TARGET) \
+ && (defined(__i386__) || defined(__x86_64__))
+# include <immintrin.h>
+# define BLEND_HAVE_X86
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define BLEND_HAVE_NEON
+#endif
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
 static int  Open (vlc_object_t *);
+static int  OpenC(vlc_object_t *);
 static void Close(vlc_object_t *);
 
 vlc_module_begin()
     set_description(N_("Video pictures blending"))
     set_capability("video blending", 100)
     set_callbacks(Open, Close)
+    add_submodule()
+    /* without the vectorized blendings, as a reference for blendbench */
+    set_description(N_("Video pictures blending (C)"))
+    set_capability("video blending", 0)
+    set_callbacks(OpenC, Close)
+    add_shortcut("blend_c")
 vlc_module_end()
 
 static inline unsigned div255(unsigned v)
@@ -551,6 +569,293 @@ void Blend(const CPicture &dst_data, const CPicture &src_data,
 typedef void (*blend_function_t)(const CPicture &dst_data, const CPicture &src_data,
                                  unsigned width, unsigned height, int alpha);
 
+/* Direct access to the lines of a picture, for the vectorized blendings */
+class CPictureLines : public CPicture {
+public:
+    CPictureLines(const CPicture &cfg) : CPicture(cfg)
+    {
+    }
+    unsigned getX() const
+    {
+        return x;
+    }
+    unsigned getY() const
+    {
+        return y;
+    }
+    uint8_t *getLine(unsigned plane, unsigned line) const
+    {
+        return &picture->p[plane].p_pixels[line * picture->p[plane].i_pitch];
+    }
+};
+
+/* Same as Blend<>() for a single 8 bits sample */
+static inline void BlendSample(uint8_t *dst, unsigned src, unsigned src_a,
+                               unsigned alpha)
+{
+    unsigned a = div255(alpha * src_a);
+    if (a > 0)
+        ::merge(dst, src, a);
+}
+
+/* Same as Blend<>() for a single RGBA pixel onto an RGBA pixel */
+static inline void BlendPixelRGBA(uint8_t *dst, const uint8_t *src,
+                                  unsigned alpha)
+{
+    unsigned a = div255(alpha * src[3]);
+    if (a <= 0)
+        return;
+
+    for (int i = 0; i < 3; i++)
+        ::merge(&dst[i], src[i], 255 - dst[3]);
+    for (int i = 0; i < 3; i++)
+        ::merge(&dst[i], src[i], a);
+    ::merge(&dst[3], 255, a);
+}
+
+#ifdef BLEND_HAVE_X86
+namespace sse4_1 {
+#define BLEND_SIMD_TARGET VLC_TARGET("sse4.1")
+struct V {
+    typedef __m128i word;
+    static const unsigned lanes = 8;
+
+    BLEND_SIMD_TARGET static word load(const uint8_t *p)
+    {
+        return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)p));
+    }
+    BLEND_SIMD_TARGET static word loadEven(const uint8_t *p)
+    {
+        return _mm_and_si128(_mm_loadu_si128((const __m128i *)p),
+                             _mm_set1_epi16(0xff));
+    }
+    BLEND_SIMD_TARGET static void store(uint8_t *p, word v)
+    {
+        _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(v, v));
+    }
+    BLEND_SIMD_TARGET static word set1(unsigned v)
+    {
+        return _mm_set1_epi16(v);
+    }
+    BLEND_SIMD_TARGET static word set4(unsigned v0, unsigned v1,
+                                       unsigned v2, unsigned v3)
+    {
+        return _mm_setr_epi16(v0, v1, v2, v3, v0, v1, v2, v3);
+    }
+    BLEND_SIMD_TARGET static word add(word a, word b)
+    {
+        return _mm_add_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word sub(word a, word b)
+    {
+        return _mm_sub_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word mul(word a, word b)
+    {
+        return _mm_mullo_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word srl8(word a)
+    {
+        return _mm_srli_epi16(a, 8);
+    }
+    BLEND_SIMD_TARGET static word and_(word a, word b)
+    {
+        return _mm_and_si128(a, b);
+    }
+    BLEND_SIMD_TARGET static word or_(word a, word b)
+    {
+        return _mm_or_si128(a, b);
+    }
+    BLEND_SIMD_TARGET static void zip(word a, word b, word &lo, word &hi)
+    {
+        lo = _mm_unpacklo_epi16(a, b);
+        hi = _mm_unpackhi_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word broadcast3(word a)
+    {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(3,3,3,3)),
+                                   _MM_SHUFFLE(3,3,3,3));
+    }
+    BLEND_SIMD_TARGET static word selectZero(word c, word a, word b)
+    {
+        return _mm_blendv_epi8(b, a, _mm_cmpeq_epi16(c, _mm_setzero_si128()));
+    }
+};
+#include "blend_simd.h"
+#undef BLEND_SIMD_TARGET
+}
+
+namespace avx2 {
+#define BLEND_SIMD_TARGET VLC_TARGET("avx2")
+struct V {
+    typedef __m256i word;
+    static const unsigned lanes = 16;
+
+    BLEND_SIMD_TARGET static word load(const uint8_t *p)
+    {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+    }
+    BLEND_SIMD_TARGET static word loadEven(const uint8_t *p)
+    {
+        return _mm256_and_si256(_mm256_loadu_si256((const __m256i *)p),
+                                _mm256_set1_epi16(0xff));
+    }
+    BLEND_SIMD_TARGET static void store(uint8_t *p, word v)
+    {
+        /* packus works within each 128 bits half */
+        v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v),
+                                     _MM_SHUFFLE(3,1,2,0));
+        _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(v));
+    }
+    BLEND_SIMD_TARGET static word set1(unsigned v)
+    {
+        return _mm256_set1_epi16(v);
+    }
+    BLEND_SIMD_TARGET static word set4(unsigned v0, unsigned v1,
+                                       unsigned v2, unsigned v3)
+    {
+        return _mm256_setr_epi16(v0, v1, v2, v3, v0, v1, v2, v3,
+                                 v0, v1, v2, v3, v0, v1, v2, v3);
+    }
+    BLEND_SIMD_TARGET static word add(word a, word b)
+    {
+        return _mm256_add_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word sub(word a, word b)
+    {
+        return _mm256_sub_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word mul(word a, word b)
+    {
+        return _mm256_mullo_epi16(a, b);
+    }
+    BLEND_SIMD_TARGET static word srl8(word a)
+    {
+        return _mm256_srli_epi16(a, 8);
+    }
+    BLEND_SIMD_TARGET static word and_(word a, word b)
+    {
+        return _mm256_and_si256(a, b);
+    }
+    BLEND_SIMD_TARGET static word or_(word a, word b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+    BLEND_SIMD_TARGET static void zip(word a, word b, word &lo, word &hi)
+    {
+        /* unpack works within each 128 bits half */
+        word l = _mm256_unpacklo_epi16(a, b);
+        word h = _mm256_unpackhi_epi16(a, b);
+        lo = _mm256_permute2x128_si256(l, h, 0x20);
+        hi = _mm256_permute2x128_si256(l, h, 0x31);
+    }
+    BLEND_SIMD_TARGET static word broadcast3(word a)
+    {
+        return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, _MM_SHUFFLE(3,3,3,3)),
+                                      _MM_SHUFFLE(3,3,3,3));
+    }
+    BLEND_SIMD_TARGET static word selectZero(word c, word a, word b)
+    {
+        return _mm256_blendv_epi8(b, a, _mm256_cmpeq_epi16(c, _mm256_setzero_si256()));
+    }
+};
+#include "blend_simd.h"
+#undef BLEND_SIMD_TARGET
+}
+#endif
+
+#ifdef BLEND_HAVE_NEON
+namespace neon {
+#define BLEND_SIMD_TARGET
+struct V {
+    typedef uint16x8_t word;
+    static const unsigned lanes = 8;
+
+    static word load(const uint8_t *p)
+    {
+        return vmovl_u8(vld1_u8(p));
+    }
+    static word loadEven(const uint8_t *p)
+    {
+        return vmovl_u8(vld2_u8(p).val[0]);
+    }
+    static void store(uint8_t *p, word v)
+    {
+        vst1_u8(p, vmovn_u16(v));
+    }
+    static word set1(unsigned v)
+    {
+        return vdupq_n_u16(v);
+    }
+    static word set4(unsigned v0, unsigned v1, unsigned v2, unsigned v3)
+    {
+        const uint16_t v[8] = { (uint16_t)v0, (uint16_t)v1, (uint16_t)v2, (uint16_t)v3,
+                                (uint16_t)v0, (uint16_t)v1, (uint16_t)v2, (uint16_t)v3 };
+        return vld1q_u16(v);
+    }
+    static word add(word a, word b)
+    {
+        return vaddq_u16(a, b);
+    }
+    static word sub(word a, word b)
+    {
+        return vsubq_u16(a, b);
+    }
+    static word mul(word a, word b)
+    {
+        return vmulq_u16(a, b);
+    }
+    static word srl8(word a)
+    {
+        return vshrq_n_u16(a, 8);
+    }
+    static word and_(word a, word b)
+    {
+        return vandq_u16(a, b);
+    }
+    static word or_(word a, word b)
+    {
+        return vorrq_u16(a, b);
+    }
+    static void zip(word a, word b, word &lo, word &hi)
+    {
+        lo = vzip1q_u16(a, b);
+        hi = vzip2q_u16(a, b);
+    }
+    static word broadcast3(word a)
+    {
+        static const uint8_t index[16] = { 6, 7, 6, 7, 6, 7, 6, 7,
+                                           14, 15, 14, 15, 14, 15, 14, 15 };
+        return vreinterpretq_u16_u8(vqtbl1q_u8(vreinterpretq_u8_u16(a),
+                                               vld1q_u8(index)));
+    }
+    static word selectZero(word c, word a, word b)
+    {
+        return vbslq_u16(vceqq_u16(c, vdupq_n_u16(0)), a, b);
+    }
+};
+#include "blend_simd.h"
+#undef BLEND_SIMD_TARGET
+}
+#endif
+
+/* Returns the vectorized blending for the CPU, if there is one */
+static blend_function_t FindSimdBlend(vlc_fourcc_t dst, vlc_fourcc_t src)
+{
+    blend_function_t blend = NULL;
+#ifdef BLEND_HAVE_X86
+    if (vlc_CPU_AVX2())
+        blend = avx2::Find(dst, src);
+    else if (vlc_CPU_SSE4_1())
+        blend = sse4_1::Find(dst, src);
+#endif
+#ifdef BLEND_HAVE_NEON
+    blend = neon::Find(dst, src);
+#endif
+    VLC_UNUSED(dst); VLC_UNUSED(src);
+    return blend;
+}
+
 static const struct {
     vlc_fourcc_t     dst;
     vlc_fourcc_t     src;
@@ -666,14 +971,16 @@ static void Blend(filter_t *filter,
                width, height, alpha);
 }
 
-static int Open(vlc_object_t *object)
+static int OpenCommon(vlc_object_t *object, bool simd)
 {
     filter_t *filter = (filter_t *)object;
     const vlc_fourcc_t src = filter->fmt_in.video.i_chroma;
     const vlc_fourcc_t dst = filter->fmt_out.video.i_chroma;
 
     filter_sys_t *sys = new filter_sys_t();
-    for (size_t i = 0; i < sizeof(blends) / sizeof(*blends); i++) {
+    if (simd)
+        sys->blend = FindSimdBlend(dst, src);
+    for (size_t i = 0; i < sizeof(blends) / sizeof(*blends) && !sys->blend; i++) {
         if (blends[i].src == src && blends[i].dst == dst)
             sys->blend = blends[i].blend;
     }
@@ -690,6 +997,16 @@ static int Open(vlc_object_t *object)
     return VLC_SUCCESS;
 }
 
+static int Open(vlc_object_t *object)
+{
+    return OpenCommon(object, true);
+}
+
+static int OpenC(vlc_object_t *object)
+{
+    return OpenCommon(object, false);
+}
+
 static void Close(vlc_object_t *object)
 {
     filter_t *filter = (filter_t *)object;
@@ -0,0 +1,274 @@
+/*****************************************************************************
+ * blend_simd.h: vectorized blending of rows of pixels
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* This file is included by blend.cpp in one namespace per instruction set.
+ * That namespace defines BLEND_SIMD_TARGET, the VLC_TARGET() of the
+ * instruction set for the functions (or nothing if the baseline has it), and
+ * V, the operations on a vector of V::lanes 16 bits unsigned integers:
+ *  - load(p): V::lanes bytes at p,
+ *  - loadEven(p): the V::lanes bytes at even offsets from p,
+ *  - store(p, v): the V::lanes lanes of v, known to fit in bytes, at p,
+ *  - zip(a, b, lo, hi): a0 b0 a1 b1 ... in lo then hi,
+ *  - broadcast3(v): the 4th lane of each group of 4 lanes to the whole group,
+ *  - selectZero(c, a, b): a where c is zero, b elsewhere,
+ *  - and the usual arithmetic and bitwise operations.
+ *
+ * The results are exactly the ones of the generic Blend<>() function: all
+ * the intermediate values of div255() and merge() fit in 16 bits for 8 bits
+ * components and an alpha up to 255. The pixels the vectors can not cover
+ * are blended with the scalar functions. */
+
+BLEND_SIMD_TARGET
+static inline V::word div255(V::word v)
+{
+    return V::srl8(V::add(V::add(v, V::srl8(v)), V::set1(1)));
+}
+
+BLEND_SIMD_TARGET
+static inline V::word merge(V::word dst, V::word src, V::word f)
+{
+    return div255(V::add(V::mul(V::sub(V::set1(255), f), dst),
+                         V::mul(src, f)));
+}
+
+/* Blends n samples of src with alpha src_a onto dst */
+BLEND_SIMD_TARGET
+static void BlendPlane(uint8_t *dst, const uint8_t *src, const uint8_t *src_a,
+                       unsigned n, unsigned alpha)
+{
+    const V::word valpha = V::set1(alpha);
+    unsigned x = 0;
+
+    for (; x + V::lanes <= n; x += V::lanes) {
+        V::word a = div255(V::mul(V::load(&src_a[x]), valpha));
+        V::store(&dst[x], merge(V::load(&dst[x]), V::load(&src[x]), a));
+    }
+    for (; x < n; x++)
+        BlendSample(&dst[x], src[x], src_a[x], alpha);
+}
+
+/* Same as BlendPlane() with src and src_a subsampled by 2 */
+BLEND_SIMD_TARGET
+static void BlendPlaneSub2(uint8_t *dst, const uint8_t *src, const uint8_t *src_a,
+                           unsigned n, unsigned alpha)
+{
+    const V::word valpha = V::set1(alpha);
+    unsigned x = 0;
+
+    /* the last vector must not read past the last used source byte */
+    for (; x + V::lanes < n; x += V::lanes) {
+        V::word a = div255(V::mul(V::loadEven(&src_a[2 * x]), valpha));
+        V::store(&dst[x], merge(V::load(&dst[x]),
+                                V::loadEven(&src[2 * x]), a));
+    }
+    for (; x < n; x++)
+        BlendSample(&dst[x], src[2 * x], src_a[2 * x], alpha);
+}
+
+/* Blends n pairs of samples of src_0/src_1, subsampled by 2, onto the
+ * interleaved dst, like the chroma planes of NV12 */
+BLEND_SIMD_TARGET
+static void BlendPlaneSub2Interleaved(uint8_t *dst,
+                                      const uint8_t *src_0, const uint8_t *src_1,
+                                      const uint8_t *src_a,
+                                      unsigned n, unsigned alpha)
+{
+    const V::word valpha = V::set1(alpha);
+    unsigned x = 0;
+
+    for (; x + V::lanes < n; x += V::lanes) {
+        V::word a = div255(V::mul(V::loadEven(&src_a[2 * x]), valpha));
+        V::word a_lo, a_hi, s_lo, s_hi;
+
+        V::zip(a, a, a_lo, a_hi);
+        V::zip(V::loadEven(&src_0[2 * x]), V::loadEven(&src_1[2 * x]),
+               s_lo, s_hi);
+        V::store(&dst[2 * x], merge(V::load(&dst[2 * x]), s_lo, a_lo));
+        V::store(&dst[2 * x + V::lanes],
+                 merge(V::load(&dst[2 * x + V::lanes]), s_hi, a_hi));
+    }
+    for (; x < n; x++) {
+        BlendSample(&dst[2 * x + 0], src_0[2 * x], src_a[2 * x], alpha);
+        BlendSample(&dst[2 * x + 1], src_1[2 * x], src_a[2 * x], alpha);
+    }
+}
+
+/* Blends n RGBA pixels onto RGBA pixels, like CPictureRGBA::merge() */
+BLEND_SIMD_TARGET
+static void BlendRGBA(uint8_t *dst, const uint8_t *src, unsigned n, unsigned alpha)
+{
+    const V::word valpha = V::set1(alpha);
+    /* the first merge() leaves the alpha component as is with a 0 factor,
+     * the second one merges 255 into it */
+    const V::word color_mask = V::set4(0xffff, 0xffff, 0xffff, 0);
+    const V::word alpha_fill = V::set4(0, 0, 0, 255);
+    unsigned x = 0;
+
+    for (; x + V::lanes / 4 <= n; x += V::lanes / 4) {
+        const V::word d = V::load(&dst[4 * x]);
+        const V::word s = V::or_(V::load(&src[4 * x]), alpha_fill);
+        const V::word a = div255(V::mul(V::broadcast3(V::load(&src[4 * x])),
+                                        valpha));
+        const V::word f = V::and_(V::sub(V::set1(255), V::broadcast3(d)),
+                                  color_mask);
+
+        V::word r = merge(merge(d, s, f), s, a);
+        V::store(&dst[4 * x], V::selectZero(a, d, r));
+    }
+    for (; x < n; x++)
+        BlendPixelRGBA(&dst[4 * x], &src[4 * x], alpha);
+}
+
+/* YUVA onto 4:2:0 planar YUV, U and V swapped for YV12 */
+template <bool swap_uv>
+static void BlendYUVAToI420(const CPicture &dst_data, const CPicture &src_data,
+                            unsigned width, unsigned height, int alpha)
+{
+    const CPictureLines dst(dst_data), src(src_data);
+    const unsigned dx = dst.getX(), sx = src.getX();
+    /* the first pixel with chroma on the even lines */
+    const unsigned cx = dx % 2;
+    const unsigned cwidth = width > cx ? (width - cx + 1) / 2 : 0;
+
+    for (unsigned y = 0; y < height; y++) {
+        const unsigned dy = dst.getY() + y, sy = src.getY() + y;
+        const uint8_t *src_a = &src.getLine(3, sy)[sx];
+
+        BlendPlane(&dst.getLine(0, dy)[dx], &src.getLine(0, sy)[sx],
+                   src_a, width, alpha);
+        if (dy % 2)
+            continue;
+        BlendPlaneSub2(&dst.getLine(swap_uv ? 2 : 1, dy / 2)[(dx + cx) / 2],
+                       &src.getLine(1, sy)[sx + cx], &src_a[cx], cwidth, alpha);
+        BlendPlaneSub2(&dst.getLine(swap_uv ? 1 : 2, dy / 2)[(dx + cx) / 2],
+                       &src.getLine(2, sy)[sx + cx], &src_a[cx], cwidth, alpha);
+    }
+}
+
+/* YUVA onto 4:4:4 planar YUV */
+static void BlendYUVAToI444(const CPicture &dst_data, const CPicture &src_data,
+                            unsigned width, unsigned height, int alpha)
+{
+    const CPictureLines dst(dst_data), src(src_data);
+    const unsigned dx = dst.getX(), sx = src.getX();
+
+    for (unsigned y = 0; y < height; y++) {
+        const unsigned dy = dst.getY() + y, sy = src.getY() + y;
+        const uint8_t *src_a = &src.getLine(3, sy)[sx];
+
+        for (unsigned plane = 0; plane < 3; plane++)
+            BlendPlane(&dst.getLine(plane, dy)[dx], &src.getLine(plane, sy)[sx],
+                       src_a, width, alpha);
+    }
+}
+
+/* YUVA onto NV12, U and V swapped for NV21 */
+template <bool swap_uv>
+static void BlendYUVAToNV12(const CPicture &dst_data, const CPicture &src_data,
+                            unsigned width, unsigned height, int alpha)
+{
+    const CPictureLines dst(dst_data), src(src_data);
+    const unsigned dx = dst.getX(), sx = src.getX();
+    const unsigned cx = dx % 2;
+    const unsigned cwidth = width > cx ? (width - cx + 1) / 2 : 0;
+
+    for (unsigned y = 0; y < height; y++) {
+        const unsigned dy = dst.getY() + y, sy = src.getY() + y;
+        const uint8_t *src_a = &src.getLine(3, sy)[sx];
+
+        BlendPlane(&dst.getLine(0, dy)[dx], &src.getLine(0, sy)[sx],
+                   src_a, width, alpha);
+        if (dy % 2)
+            continue;
+        BlendPlaneSub2Interleaved(&dst.getLine(1, dy / 2)[dx + cx],
+                                  &src.getLine(swap_uv ? 2 : 1, sy)[sx + cx],
+                                  &src.getLine(swap_uv ? 1 : 2, sy)[sx + cx],
+                                  &src_a[cx], cwidth, alpha);
+    }
+}
+
+static void BlendRGBAToRGBA(const CPicture &dst_data, const CPicture &src_data,
+                            unsigned width, unsigned height, int alpha)
+{
+    const CPictureLines dst(dst_data), src(src_data);
+
+    for (unsigned y = 0; y < height; y++)
+        BlendRGBA(&dst.getLine(0, dst.getY() + y)[4 * dst.getX()],
+                  &src.getLine(0, src.getY() + y)[4 * src.getX()],
+                  width, alpha);
+}
+
+/* The YUV to RGB conversion is done with the scalar code, by chunks, so that
+ * the results stay the same as the generic blending */
+static void BlendYUVAToRGBA(const CPicture &dst_data, const CPicture &src_data,
+                            unsigned width, unsigned height, int alpha)
+{
+    const CPictureLines dst(dst_data), src(src_data);
+    uint8_t rgba[4 * 256];
+
+    for (unsigned y = 0; y < height; y++) {
+        const unsigned sy = src.getY() + y;
+        const uint8_t *src_y = &src.getLine(0, sy)[src.getX()];
+        const uint8_t *src_u = &src.getLine(1, sy)[src.getX()];
+        const uint8_t *src_v = &src.getLine(2, sy)[src.getX()];
+        const uint8_t *src_a = &src.getLine(3, sy)[src.getX()];
+        uint8_t *dst_line = &dst.getLine(0, dst.getY() + y)[4 * dst.getX()];
+
+        for (unsigned x = 0; x < width; x += 256) {
+            const unsigned n = __MIN(width - x, 256u);
+
+            for (unsigned i = 0; i < n; i++) {
+                int r, g, b;
+                yuv_to_rgb(&r, &g, &b, src_y[x + i], src_u[x + i], src_v[x + i]);
+                rgba[4 * i + 0] = r;
+                rgba[4 * i + 1] = g;
+                rgba[4 * i + 2] = b;
+                rgba[4 * i + 3] = src_a[x + i];
+            }
+            BlendRGBA(&dst_line[4 * x], rgba, n, alpha);
+        }
+    }
+}
+
+/* Returns the vectorized blending from src to dst, if there is one */
+static blend_function_t Find(vlc_fourcc_t dst, vlc_fourcc_t src)
+{
+    static const struct {
+        vlc_fourcc_t     dst;
+        vlc_fourcc_t     src;
+        blend_function_t blend;
+    } simd_blends[] = {
+        { VLC_CODEC_I420, VLC_CODEC_YUVA, BlendYUVAToI420<false> },
+        { VLC_CODEC_J420, VLC_CODEC_YUVA, BlendYUVAToI420<false> },
+        { VLC_CODEC_YV12, VLC_CODEC_YUVA, BlendYUVAToI420<true> },
+        { VLC_CODEC_I444, VLC_CODEC_YUVA, BlendYUVAToI444 },
+        { VLC_CODEC_J444, VLC_CODEC_YUVA, BlendYUVAToI444 },
+        { VLC_CODEC_NV12, VLC_CODEC_YUVA, BlendYUVAToNV12<false> },
+        { VLC_CODEC_NV21, VLC_CODEC_YUVA, BlendYUVAToNV12<true> },
+        { VLC_CODEC_RGBA, VLC_CODEC_YUVA, BlendYUVAToRGBA },
+        { VLC_CODEC_RGBA, VLC_CODEC_RGBA, BlendRGBAToRGBA },
+    };
+
+    for (size_t i = 0; i < sizeof(simd_blends) / sizeof(*simd_blends); i++) {
+        if (simd_blends[i].src == src && simd_blends[i].dst == dst)
+            return simd_blends[i].blend;
+    }
+    return NULL;
+}
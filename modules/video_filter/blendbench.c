@@ -69,6 +69,10 @@ static picture_t *Filter( filter_t *, picture_t * );
 #define BLEND_CHROMA_LONGTEXT N_("Chroma which the blend image will be loaded" \
                                  " in")
 
+#define CHECK_TEXT N_("Check the blending")
+#define CHECK_LONGTEXT N_("Compare the results and the speed of the " \
+                          "blending with the ones of the C blending")
+
 #define CFG_PREFIX "blendbench-"
 
 vlc_module_begin ()
@@ -83,6 +87,7 @@ vlc_module_begin ()
               LOOPS_LONGTEXT, false )
     add_integer_with_range( CFG_PREFIX "alpha", 128, 0, 255, ALPHA_TEXT,
               ALPHA_LONGTEXT, false )
+    add_bool( CFG_PREFIX "check", true, CHECK_TEXT, CHECK_LONGTEXT, false )
 
     set_section( N_("Base image"), NULL )
     add_loadfile(CFG_PREFIX "base-image", NULL,
@@ -101,7 +106,7 @@ vlc_module_end ()
 
 static const char *const ppsz_filter_options[] = {
     "loops", "alpha", "base-image", "base-chroma", "blend-image",
-    "blend-chroma", NULL
+    "blend-chroma", "check", NULL
 };
 
 /*****************************************************************************
@@ -110,6 +115,7 @@ static const char *const ppsz_filter_options[] = {
 typedef struct
 {
     bool b_done;
+    bool b_check;
     int i_loops, i_alpha;
 
     picture_t *p_base_image;
@@ -175,6 +181,7 @@ static int Create( vlc_object_t *p_this )
                                                   CFG_PREFIX "loops" );
     p_sys->i_alpha = var_CreateGetIntegerCommand( p_filter,
                                                   CFG_PREFIX "alpha" );
+    p_sys->b_check = var_CreateGetBoolCommand( p_filter, CFG_PREFIX "check" );
 
     psz_temp = var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-chroma" );
     p_sys->i_base_chroma = !psz_temp || strlen( psz_temp ) != 4 ? 0 :
@@ -225,41 +232,108 @@ static void Destroy( vlc_object_t *p_this )
 }
 
 /*****************************************************************************
- * Render: displays previously rendered output
+ * blendbench_Blend: blends the blend image onto p_dst i_loops times
+ *****************************************************************************
+ * It returns the duration, or -1 if there is no such blending module.
  *****************************************************************************/
-static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+static vlc_tick_t blendbench_Blend( filter_t *p_filter, const char *psz_module,
+                                    picture_t *p_dst, int i_x, int i_y,
+                                    int i_loops )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
     filter_t *p_blend;
 
-    if( p_sys->b_done )
-        return p_pic;
-
     p_blend = vlc_object_create( p_filter, sizeof(filter_t) );
     if( !p_blend )
-    {
-        picture_Release( p_pic );
-        return NULL;
-    }
+        return -1;
     p_blend->fmt_out.video = p_sys->p_base_image->format;
     p_blend->fmt_in.video = p_sys->p_blend_image->format;
-    p_blend->p_module = module_need( p_blend, "video blending", NULL, false );
+    p_blend->p_module = module_need( p_blend, "video blending", psz_module,
+                                     psz_module != NULL );
     if( !p_blend->p_module )
     {
-        picture_Release( p_pic );
         vlc_object_release( p_blend );
-        return NULL;
+        return -1;
     }
 
     vlc_tick_t time = vlc_tick_now();
-    for( int i_iter = 0; i_iter < p_sys->i_loops; ++i_iter )
+    for( int i_iter = 0; i_iter < i_loops; ++i_iter )
     {
-        p_blend->pf_video_blend( p_blend,
-                                 p_sys->p_base_image, p_sys->p_blend_image,
-                                 0, 0, p_sys->i_alpha );
+        p_blend->pf_video_blend( p_blend, p_dst, p_sys->p_blend_image,
+                                 i_x, i_y, p_sys->i_alpha );
     }
     time = vlc_tick_now() - time;
 
+    module_unneed( p_blend, p_blend->p_module );
+    vlc_object_release( p_blend );
+    return time;
+}
+
+/*****************************************************************************
+ * blendbench_Check: compares the blending with the C one
+ *****************************************************************************/
+static void blendbench_Check( filter_t *p_filter, int i_x, int i_y )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    picture_t *p_base = p_sys->p_base_image;
+    picture_t *p_ref = picture_NewFromFormat( &p_base->format );
+    picture_t *p_test = picture_NewFromFormat( &p_base->format );
+
+    if( !p_ref || !p_test )
+        goto end;
+
+    picture_Copy( p_ref, p_base );
+    picture_Copy( p_test, p_base );
+    if( blendbench_Blend( p_filter, "blend_c", p_ref, i_x, i_y, 1 ) < 0 ||
+        blendbench_Blend( p_filter, NULL, p_test, i_x, i_y, 1 ) < 0 )
+    {
+        msg_Warn( p_filter, "Unable to check the blending" );
+        goto end;
+    }
+
+    for( int i_plane = 0; i_plane < p_ref->i_planes; i_plane++ )
+    {
+        const plane_t *p_r = &p_ref->p[i_plane], *p_t = &p_test->p[i_plane];
+        unsigned i_diff = 0;
+
+        for( int i_line = 0; i_line < p_r->i_visible_lines; i_line++ )
+        {
+            const uint8_t *r = &p_r->p_pixels[i_line * p_r->i_pitch];
+            const uint8_t *t = &p_t->p_pixels[i_line * p_t->i_pitch];
+
+            for( int i = 0; i < p_r->i_visible_pitch; i++ )
+                i_diff += r[i] != t[i];
+        }
+        if( i_diff > 0 )
+            msg_Err( p_filter, "Blending at %dx%d differs from the C blending "
+                     "in %u bytes of plane %d", i_x, i_y, i_diff, i_plane );
+    }
+
+end:
+    if( p_ref )
+        picture_Release( p_ref );
+    if( p_test )
+        picture_Release( p_test );
+}
+
+/*****************************************************************************
+ * Render: displays previously rendered output
+ *****************************************************************************/
+static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    if( p_sys->b_done )
+        return p_pic;
+
+    vlc_tick_t time = blendbench_Blend( p_filter, NULL, p_sys->p_base_image,
+                                        0, 0, p_sys->i_loops );
+    if( time < 0 )
+    {
+        picture_Release( p_pic );
+        return NULL;
+    }
+
     msg_Info( p_filter, "Blended %d images in %f sec", p_sys->i_loops,
               time / (float)CLOCK_FREQ );
     msg_Info( p_filter, "Speed is: %f images/second, %f pixels/second",
@@ -268,9 +342,20 @@ static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
                   p_sys->p_blend_image->p[Y_PLANE].i_visible_pitch *
                   p_sys->p_blend_image->p[Y_PLANE].i_visible_lines );
 
-    module_unneed( p_blend, p_blend->p_module );
-
-    vlc_object_release( p_blend );
+    if( p_sys->b_check )
+    {
+        /* odd offsets exercise the chroma subsampling edges */
+        blendbench_Check( p_filter, 0, 0 );
+        blendbench_Check( p_filter, 1, 1 );
+
+        vlc_tick_t time_c = blendbench_Blend( p_filter, "blend_c",
+                                              p_sys->p_base_image, 0, 0,
+                                              p_sys->i_loops );
+        if( time_c >= 0 )
+            msg_Info( p_filter, "C blending in %f sec, speedup is %.2fx",
+                      time_c / (float)CLOCK_FREQ,
+                      (float) time_c / (time > 0 ? time : 1) );
+    }
 
     p_sys->b_done = true;
     return p_pic;
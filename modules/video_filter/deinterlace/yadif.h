@@ -40,6 +40,8 @@ const ATTR_USED alignas (16) xmm_reg pw_1 = {
     0x0001000100010001ULL, 0x0001000100010001ULL
 };
 
+#undef VLC_TARGET /* of vlc_common.h */
+
 #ifdef CAN_COMPILE_SSSE3
 #if defined(__SSE__) || defined(__GNUC__) || defined(__clang__)
 // ================ SSSE3 =================
@@ -40,6 +40,7 @@
 #include <vlc_codec.h>
 #include <vlc_spu.h>
 #include <vlc_meta.h>
+#include <vlc_metrics.h>
 #include <vlc_dialog.h>
 #include <vlc_modules.h>
 
@@ -85,6 +86,18 @@ struct decoder_owner
     decoder_t *p_packetizer;
     bool b_packetizer;
 
+    /* Optional packetizer stage running in its own thread, and feeding
+     * p_fifo with packetized blocks */
+    bool b_packetizer_thread;
+    vlc_thread_t packetizer_thread;
+    block_fifo_t *p_packetizer_fifo;
+    vlc_cond_t wait_packetizer_fifo;
+    es_format_t packetizer_fmt; /* last format sent to the decoder */
+    bool packetizer_flushing;
+    bool b_packetizer_draining;
+    bool b_packetizer_busy;
+    unsigned i_flush_seq;
+
     /* Current format in use by the output */
     es_format_t    fmt;
 
@@ -141,6 +154,11 @@ struct decoder_owner
 
     /* Delay */
     vlc_tick_t i_ts_delay;
+
+    /* Metrics */
+    vlc_metric_t *decode_metric;
+    vlc_metric_t *queue_metric;
+    size_t i_queue_reported; /* decoder FIFO depth accounted in queue_metric */
 };
 
 /* Pictures which are DECODER_BOGUS_VIDEO_DELAY or more in advance probably have
@@ -150,6 +168,10 @@ struct decoder_owner
 /* */
 #define DECODER_SPU_VOUT_WAIT_DURATION   VLC_TICK_FROM_MS(200)
 #define BLOCK_FLAG_CORE_PRIVATE_RELOADED (1 << BLOCK_FLAG_CORE_PRIVATE_SHIFT)
+#define BLOCK_FLAG_CORE_PRIVATE_FORMAT   (2 << BLOCK_FLAG_CORE_PRIVATE_SHIFT)
+
+/* Maximum number of packetized blocks queued ahead of the decoder */
+#define DECODER_PACKETIZER_QUEUE 8
 
 #define VLC_TS_OLDEST  (VLC_TICK_INVALID + 1)
 
@@ -158,6 +180,16 @@ static inline struct decoder_owner *dec_get_owner( decoder_t *p_dec )
     return container_of( p_dec, struct decoder_owner, dec );
 }
 
+/* Reports the decoder FIFO depth changes; the FIFO must be locked */
+static void DecoderQueueMetric( struct decoder_owner *p_owner )
+{
+    size_t count = vlc_fifo_GetCount( p_owner->p_fifo );
+
+    vlc_metric_Add( p_owner->queue_metric,
+                    (int64_t)count - (int64_t)p_owner->i_queue_reported );
+    p_owner->i_queue_reported = count;
+}
+
 /**
  * Load a decoder module
  */
@@ -1290,12 +1322,71 @@ static void DecoderQueueSpu( decoder_t *p_dec, subpicture_t *p_spu )
         vlc_object_release( p_vout );
 }
 
+/*
+ * Format changes detected by the packetizer thread are sent to the decoder
+ * thread in band, as empty blocks carrying the new format.
+ */
+struct decoder_format_block
+{
+    block_t self;
+    es_format_t fmt;
+};
+
+static void DecoderFormatBlockRelease( block_t *p_block )
+{
+    struct decoder_format_block *p_fb =
+        container_of( p_block, struct decoder_format_block, self );
+
+    es_format_Clean( &p_fb->fmt );
+    free( p_fb );
+}
+
+static block_t *DecoderFormatBlockNew( const es_format_t *p_fmt )
+{
+    struct decoder_format_block *p_fb = malloc( sizeof( *p_fb ) );
+    if( unlikely(p_fb == NULL) )
+        return NULL;
+
+    if( es_format_Copy( &p_fb->fmt, p_fmt ) != VLC_SUCCESS )
+    {
+        free( p_fb );
+        return NULL;
+    }
+
+    block_Init( &p_fb->self, NULL, 0 );
+    p_fb->self.pf_release = DecoderFormatBlockRelease;
+    p_fb->self.i_flags = BLOCK_FLAG_CORE_PRIVATE_FORMAT;
+    return &p_fb->self;
+}
+
+static void DecoderDecode( decoder_t *p_dec, block_t *p_block );
+
+static void DecoderProcessFormat( decoder_t *p_dec, block_t *p_block )
+{
+    struct decoder_format_block *p_fb =
+        container_of( p_block, struct decoder_format_block, self );
+
+    if( !es_format_IsSimilar( &p_dec->fmt_in, &p_fb->fmt ) )
+    {
+        msg_Dbg( p_dec, "restarting module due to input format change");
+
+        /* Drain the decoder module */
+        DecoderDecode( p_dec, NULL );
+
+        ReloadDecoder( p_dec, false, &p_fb->fmt, RELOAD_DECODER );
+    }
+    block_Release( p_block );
+}
+
 static void DecoderProcess( decoder_t *p_dec, block_t *p_block );
 static void DecoderDecode( decoder_t *p_dec, block_t *p_block )
 {
     struct decoder_owner *p_owner = dec_get_owner( p_dec );
 
+    vlc_tick_t start = vlc_tick_now();
     int ret = p_dec->pf_decode( p_dec, p_block );
+
+    vlc_metric_Observe( p_owner->decode_metric, vlc_tick_now() - start );
     switch( ret )
     {
         case VLCDEC_SUCCESS:
@@ -1348,15 +1439,27 @@ static void DecoderProcess( decoder_t *p_dec, block_t *p_block )
             goto error;
     }
 
-    bool packetize = p_owner->p_packetizer != NULL;
+    /* With a packetizer thread, blocks are already packetized, and preroll
+     * was updated from the original blocks */
+    bool packetize = p_owner->p_packetizer != NULL
+                  && !p_owner->b_packetizer_thread;
     if( p_block )
     {
+        if( p_block->i_flags & BLOCK_FLAG_CORE_PRIVATE_FORMAT )
+        {
+            DecoderProcessFormat( p_dec, p_block );
+            return;
+        }
+
         if( p_block->i_buffer <= 0 )
             goto error;
 
-        vlc_mutex_lock( &p_owner->lock );
-        DecoderUpdatePreroll( &p_owner->i_preroll_end, p_block );
-        vlc_mutex_unlock( &p_owner->lock );
+        if( !p_owner->b_packetizer_thread )
+        {
+            vlc_mutex_lock( &p_owner->lock );
+            DecoderUpdatePreroll( &p_owner->i_preroll_end, p_block );
+            vlc_mutex_unlock( &p_owner->lock );
+        }
         if( unlikely( p_block->i_flags & BLOCK_FLAG_CORE_PRIVATE_RELOADED ) )
         {
             /* This block has already been packetized */
@@ -1434,7 +1537,9 @@ static void DecoderProcessFlush( decoder_t *p_dec )
     if( p_owner->error )
         return;
 
-    if( p_packetizer != NULL && p_packetizer->pf_flush != NULL )
+    /* The packetizer thread, if any, flushes the packetizer on its own */
+    if( p_packetizer != NULL && p_packetizer->pf_flush != NULL
+     && !p_owner->b_packetizer_thread )
         p_packetizer->pf_flush( p_packetizer );
 
     if ( p_dec->pf_flush != NULL )
@@ -1608,6 +1713,7 @@ static void *DecoderThread( void *p_data )
         vlc_testcancel(); /* forced expedited cancellation in case of stop */
 
         block_t *p_block = vlc_fifo_DequeueUnlocked( p_owner->p_fifo );
+        DecoderQueueMetric( p_owner );
         if( p_block == NULL )
         {
             if( likely(!p_owner->b_draining) )
@@ -1650,6 +1756,167 @@ static void *DecoderThread( void *p_data )
     vlc_assert_unreachable();
 }
 
+/**
+ * Queues packetized blocks to the decoder thread
+ *
+ * Waits for room in the decoder FIFO, and drops the blocks if the decoder
+ * was flushed since the original block was dequeued (sequence \p seq).
+ */
+static void PacketizerQueue( decoder_t *p_dec, block_t *p_block, unsigned seq )
+{
+    struct decoder_owner *p_owner = dec_get_owner( p_dec );
+
+    vlc_fifo_Lock( p_owner->p_fifo );
+    while( vlc_fifo_GetCount( p_owner->p_fifo ) >= DECODER_PACKETIZER_QUEUE
+        && seq == p_owner->i_flush_seq )
+        vlc_fifo_WaitCond( p_owner->p_fifo, &p_owner->wait_fifo );
+
+    if( seq == p_owner->i_flush_seq )
+    {
+        vlc_fifo_QueueUnlocked( p_owner->p_fifo, p_block );
+        DecoderQueueMetric( p_owner );
+        p_block = NULL;
+    }
+    vlc_fifo_Unlock( p_owner->p_fifo );
+
+    if( p_block != NULL )
+        block_ChainRelease( p_block );
+}
+
+/**
+ * Packetizes a block, or drains the packetizer if p_block is NULL
+ */
+static void PacketizerProcess( decoder_t *p_dec, block_t *p_block,
+                               unsigned seq )
+{
+    struct decoder_owner *p_owner = dec_get_owner( p_dec );
+    decoder_t *p_packetizer = p_owner->p_packetizer;
+    block_t **pp_block = p_block ? &p_block : NULL;
+    block_t *p_packetized_block;
+
+    if( p_block )
+    {
+        if( p_block->i_buffer <= 0 )
+        {
+            block_Release( p_block );
+            return;
+        }
+
+        vlc_mutex_lock( &p_owner->lock );
+        DecoderUpdatePreroll( &p_owner->i_preroll_end, p_block );
+        vlc_mutex_unlock( &p_owner->lock );
+    }
+
+    while( (p_packetized_block =
+            p_packetizer->pf_packetize( p_packetizer, pp_block ) ) )
+    {
+        if( !es_format_IsSimilar( &p_owner->packetizer_fmt,
+                                  &p_packetizer->fmt_out ) )
+        {
+            block_t *p_fmt_block =
+                DecoderFormatBlockNew( &p_packetizer->fmt_out );
+            if( likely(p_fmt_block != NULL) )
+            {
+                es_format_Clean( &p_owner->packetizer_fmt );
+                es_format_Copy( &p_owner->packetizer_fmt,
+                                &p_packetizer->fmt_out );
+                PacketizerQueue( p_dec, p_fmt_block, seq );
+            }
+        }
+
+        if( p_packetizer->pf_get_cc )
+            PacketizerGetCc( p_dec, p_packetizer );
+
+        PacketizerQueue( p_dec, p_packetized_block, seq );
+    }
+
+    if( !pp_block )
+    {   /* The packetizer is drained, now drain the decoder */
+        vlc_fifo_Lock( p_owner->p_fifo );
+        if( seq == p_owner->i_flush_seq )
+        {
+            p_owner->b_draining = true;
+            vlc_fifo_Signal( p_owner->p_fifo );
+        }
+        vlc_fifo_Unlock( p_owner->p_fifo );
+    }
+}
+
+/**
+ * The packetizer main loop
+ *
+ * Only used if the packetizer runs in its own thread. It consumes the input
+ * blocks and feeds the decoder thread with packetized blocks.
+ *
+ * \param p_dec the decoder
+ */
+static void *PacketizerThread( void *p_data )
+{
+    decoder_t *p_dec = (decoder_t *)p_data;
+    struct decoder_owner *p_owner = dec_get_owner( p_dec );
+    block_fifo_t *p_fifo = p_owner->p_packetizer_fifo;
+    decoder_t *p_packetizer = p_owner->p_packetizer;
+
+    vlc_fifo_Lock( p_fifo );
+    vlc_fifo_CleanupPush( p_fifo );
+
+    for( ;; )
+    {
+        if( p_owner->packetizer_flushing )
+        {
+            int canc = vlc_savecancel();
+
+            p_owner->packetizer_flushing = false;
+            vlc_fifo_Unlock( p_fifo );
+
+            if( p_packetizer->pf_flush != NULL )
+                p_packetizer->pf_flush( p_packetizer );
+
+            /* The format block may have been flushed before reaching the
+             * decoder: send the format again with the next block. */
+            es_format_Clean( &p_owner->packetizer_fmt );
+            es_format_Init( &p_owner->packetizer_fmt, UNKNOWN_ES, 0 );
+
+            vlc_fifo_Lock( p_fifo );
+            vlc_restorecancel( canc );
+            continue;
+        }
+
+        vlc_cond_signal( &p_owner->wait_packetizer_fifo );
+        vlc_testcancel();
+
+        block_t *p_block = vlc_fifo_DequeueUnlocked( p_fifo );
+        if( p_block == NULL && likely(!p_owner->b_packetizer_draining) )
+        {
+            vlc_fifo_Wait( p_fifo );
+            continue;
+        }
+
+        const unsigned seq = p_owner->i_flush_seq;
+        p_owner->b_packetizer_busy = true;
+        vlc_fifo_Unlock( p_fifo );
+
+        int canc = vlc_savecancel();
+        PacketizerProcess( p_dec, p_block, seq );
+        vlc_restorecancel( canc );
+
+        vlc_fifo_Lock( p_fifo );
+        p_owner->b_packetizer_busy = false;
+        if( p_block == NULL )
+            p_owner->b_packetizer_draining = false;
+        vlc_fifo_Unlock( p_fifo );
+
+        /* Wake up input_DecoderWait() in case nothing was queued */
+        vlc_mutex_lock( &p_owner->lock );
+        vlc_cond_signal( &p_owner->wait_acknowledge );
+        vlc_mutex_unlock( &p_owner->lock );
+
+        vlc_fifo_Lock( p_fifo );
+    }
+    vlc_cleanup_pop();
+    vlc_assert_unreachable();
+}
+
 static const struct decoder_owner_callbacks dec_video_cbs =
 {
     .video = {
@@ -1712,6 +1979,13 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     p_owner->p_sout = p_sout;
     p_owner->p_sout_input = NULL;
     p_owner->p_packetizer = NULL;
+    p_owner->b_packetizer_thread = false;
+    p_owner->p_packetizer_fifo = NULL;
+    es_format_Init( &p_owner->packetizer_fmt, UNKNOWN_ES, 0 );
+    p_owner->packetizer_flushing = false;
+    p_owner->b_packetizer_draining = false;
+    p_owner->b_packetizer_busy = false;
+    p_owner->i_flush_seq = 0;
 
     p_owner->b_fmt_description = false;
     p_owner->p_description = NULL;
@@ -1733,6 +2007,10 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     atomic_init( &p_owner->reload, RELOAD_NO_REQUEST );
     p_owner->b_idle = false;
 
+    p_owner->decode_metric = NULL;
+    p_owner->queue_metric = NULL;
+    p_owner->i_queue_reported = 0;
+
     es_format_Init( &p_owner->fmt, fmt->i_cat, 0 );
 
     /* decoder fifo */
@@ -1748,6 +2026,7 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     vlc_cond_init( &p_owner->wait_acknowledge );
     vlc_cond_init( &p_owner->wait_fifo );
     vlc_cond_init( &p_owner->wait_timed );
+    vlc_cond_init( &p_owner->wait_packetizer_fifo );
 
     /* Load a packetizer module if the input is not already packetized */
     if( p_sout == NULL && !fmt->b_packetized )
@@ -1769,25 +2048,35 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
         }
     }
 
+    const char *decode_metric;
+
     switch( fmt->i_cat )
     {
         case VIDEO_ES:
             p_dec->cbs = &dec_video_cbs;
             p_owner->pf_update_stat = DecoderUpdateStatVideo;
+            decode_metric = "vlc_decoder_decode_seconds{type=\"video\"}";
             break;
         case AUDIO_ES:
             p_dec->cbs = &dec_audio_cbs;
             p_owner->pf_update_stat = DecoderUpdateStatAudio;
+            decode_metric = "vlc_decoder_decode_seconds{type=\"audio\"}";
             break;
         case SPU_ES:
             p_dec->cbs = &dec_spu_cbs;
             p_owner->pf_update_stat = DecoderUpdateStatSpu;
+            decode_metric = "vlc_decoder_decode_seconds{type=\"spu\"}";
             break;
         default:
             msg_Err( p_dec, "unknown ES format" );
             return p_dec;
     }
 
+    p_owner->decode_metric = vlc_metric_Register( p_dec, VLC_METRIC_HISTOGRAM,
+        decode_metric, "Time spent decoding each block" );
+    p_owner->queue_metric = vlc_metric_Register( p_dec, VLC_METRIC_GAUGE,
+        "vlc_decoder_queued_blocks", "Blocks queued ahead of the decoders" );
+
     /* Find a suitable decoder/packetizer module */
     if( LoadDecoder( p_dec, p_sout != NULL, fmt ) )
         return p_dec;
@@ -1820,6 +2109,16 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     for( unsigned i = 0; i < MAX_CC_DECODERS; i++ )
         p_owner->cc.pp_decoder[i] = NULL;
     p_owner->i_ts_delay = 0;
+
+    /* Run the video packetizer in its own thread if requested */
+    if( p_owner->p_packetizer != NULL && fmt->i_cat == VIDEO_ES
+     && var_InheritBool( p_dec, "packetizer-thread" )
+     && es_format_Copy( &p_owner->packetizer_fmt, fmt ) == VLC_SUCCESS )
+    {
+        p_owner->p_packetizer_fifo = block_FifoNew();
+        if( likely(p_owner->p_packetizer_fifo != NULL) )
+            p_owner->b_packetizer_thread = true;
+    }
     return p_dec;
 }
 
@@ -1840,7 +2139,12 @@ static void DeleteDecoder( decoder_t * p_dec )
     UnloadDecoder( p_dec );
 
     /* Free all packets still in the decoder fifo. */
+    vlc_metric_Add( p_owner->queue_metric,
+                    -(int64_t)p_owner->i_queue_reported );
     block_FifoRelease( p_owner->p_fifo );
+    if( p_owner->p_packetizer_fifo != NULL )
+        block_FifoRelease( p_owner->p_packetizer_fifo );
+    es_format_Clean( &p_owner->packetizer_fmt );
 
     /* Cleanup */
 #ifdef ENABLE_SOUT
@@ -1905,6 +2209,7 @@ static void DeleteDecoder( decoder_t * p_dec )
         vlc_object_release( p_owner->p_packetizer );
     }
 
+    vlc_cond_destroy( &p_owner->wait_packetizer_fifo );
     vlc_cond_destroy( &p_owner->wait_timed );
     vlc_cond_destroy( &p_owner->wait_fifo );
     vlc_cond_destroy( &p_owner->wait_acknowledge );
@@ -1992,6 +2297,15 @@ static decoder_t *decoder_New( vlc_object_t *p_parent, input_thread_t *p_input,
         return NULL;
     }
 
+    if( p_owner->b_packetizer_thread
+     && vlc_clone( &p_owner->packetizer_thread, PacketizerThread, p_dec,
+                   i_priority ) )
+    {
+        msg_Warn( p_dec, "cannot spawn packetizer thread" );
+        /* No blocks were queued yet: fall back to in-thread packetizing */
+        p_owner->b_packetizer_thread = false;
+    }
+
     return p_dec;
 }
 
@@ -2032,13 +2346,27 @@ void input_DecoderDelete( decoder_t *p_dec )
 {
     struct decoder_owner *p_owner = dec_get_owner( p_dec );
 
+    if( p_owner->b_packetizer_thread )
+        vlc_cancel( p_owner->packetizer_thread );
     vlc_cancel( p_owner->thread );
 
+    /* The packetizer thread reads i_flush_seq with its own FIFO locked, in
+     * the same lock order as input_DecoderFlush() */
+    if( p_owner->b_packetizer_thread )
+        vlc_fifo_Lock( p_owner->p_packetizer_fifo );
     vlc_fifo_Lock( p_owner->p_fifo );
     /* Signal DecoderTimedWait */
     p_owner->flushing = true;
     vlc_cond_signal( &p_owner->wait_timed );
+    /* Unblock and discard the output of the packetizer thread */
+    p_owner->i_flush_seq++;
+    vlc_cond_signal( &p_owner->wait_fifo );
     vlc_fifo_Unlock( p_owner->p_fifo );
+    if( p_owner->b_packetizer_thread )
+        vlc_fifo_Unlock( p_owner->p_packetizer_fifo );
+
+    if( p_owner->b_packetizer_thread )
+        vlc_join( p_owner->packetizer_thread, NULL );
 
     /* Make sure we aren't waiting/decoding anymore */
     vlc_mutex_lock( &p_owner->lock );
@@ -2079,18 +2407,33 @@ void input_DecoderDelete( decoder_t *p_dec )
 void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
 {
     struct decoder_owner *p_owner = dec_get_owner( p_dec );
+    block_fifo_t *p_fifo = p_owner->p_fifo;
+    vlc_cond_t *p_wait = &p_owner->wait_fifo;
 
-    vlc_fifo_Lock( p_owner->p_fifo );
+    if( p_owner->b_packetizer_thread )
+    {
+        p_fifo = p_owner->p_packetizer_fifo;
+        p_wait = &p_owner->wait_packetizer_fifo;
+    }
+
+    /* Packetizers and decoders may modify their input in place */
+    p_block = block_MakeWritable( p_block );
+    if( unlikely(p_block == NULL) )
+        return;
+
+    vlc_fifo_Lock( p_fifo );
     if( !b_do_pace )
     {
         /* FIXME: ideally we would check the time amount of data
          * in the FIFO instead of its size. */
         /* 400 MiB, i.e. ~ 50mb/s for 60s */
-        if( vlc_fifo_GetBytes( p_owner->p_fifo ) > 400*1024*1024 )
+        if( vlc_fifo_GetBytes( p_fifo ) > 400*1024*1024 )
         {
             msg_Warn( p_dec, "decoder/packetizer fifo full (data not "
                       "consumed quickly enough), resetting fifo!" );
-            block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+            block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_fifo ) );
+            if( p_fifo == p_owner->p_fifo )
+                DecoderQueueMetric( p_owner );
             p_block->i_flags |= BLOCK_FLAG_DISCONTINUITY;
         }
     }
@@ -2099,12 +2442,14 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
     {   /* The FIFO is not consumed when waiting, so pacing would deadlock VLC.
          * Locking is not necessary as b_waiting is only read, not written by
          * the decoder thread. */
-        while( vlc_fifo_GetCount( p_owner->p_fifo ) >= 10 )
-            vlc_fifo_WaitCond( p_owner->p_fifo, &p_owner->wait_fifo );
+        while( vlc_fifo_GetCount( p_fifo ) >= 10 )
+            vlc_fifo_WaitCond( p_fifo, p_wait );
     }
 
-    vlc_fifo_QueueUnlocked( p_owner->p_fifo, p_block );
-    vlc_fifo_Unlock( p_owner->p_fifo );
+    vlc_fifo_QueueUnlocked( p_fifo, p_block );
+    if( p_fifo == p_owner->p_fifo )
+        DecoderQueueMetric( p_owner );
+    vlc_fifo_Unlock( p_fifo );
 }
 
 bool input_DecoderIsEmpty( decoder_t * p_dec )
@@ -2113,6 +2458,18 @@ bool input_DecoderIsEmpty( decoder_t * p_dec )
 
     assert( !p_owner->b_waiting );
 
+    if( p_owner->b_packetizer_thread )
+    {
+        block_fifo_t *p_fifo = p_owner->p_packetizer_fifo;
+
+        vlc_fifo_Lock( p_fifo );
+        bool b_busy = !vlc_fifo_IsEmpty( p_fifo ) || p_owner->b_packetizer_busy
+                   || p_owner->b_packetizer_draining;
+        vlc_fifo_Unlock( p_fifo );
+        if( b_busy )
+            return false;
+    }
+
     vlc_fifo_Lock( p_owner->p_fifo );
     if( !vlc_fifo_IsEmpty( p_owner->p_fifo ) || p_owner->b_draining )
     {
@@ -2152,6 +2509,16 @@ void input_DecoderDrain( decoder_t *p_dec )
 {
     struct decoder_owner *p_owner = dec_get_owner( p_dec );
 
+    if( p_owner->b_packetizer_thread )
+    {   /* The packetizer thread requests the decoder drain once the
+         * packetizer itself is drained */
+        vlc_fifo_Lock( p_owner->p_packetizer_fifo );
+        p_owner->b_packetizer_draining = true;
+        vlc_fifo_Signal( p_owner->p_packetizer_fifo );
+        vlc_fifo_Unlock( p_owner->p_packetizer_fifo );
+        return;
+    }
+
     vlc_fifo_Lock( p_owner->p_fifo );
     p_owner->b_draining = true;
     vlc_fifo_Signal( p_owner->p_fifo );
@@ -2166,10 +2533,23 @@ void input_DecoderFlush( decoder_t *p_dec )
 {
     struct decoder_owner *p_owner = dec_get_owner( p_dec );
 
+    if( p_owner->b_packetizer_thread )
+    {   /* Keep this lock until i_flush_seq is updated, so that the
+         * packetizer thread discards whatever it dequeued before */
+        vlc_fifo_Lock( p_owner->p_packetizer_fifo );
+        block_ChainRelease(
+            vlc_fifo_DequeueAllUnlocked( p_owner->p_packetizer_fifo ) );
+        p_owner->packetizer_flushing = true;
+        vlc_fifo_Signal( p_owner->p_packetizer_fifo );
+    }
+
     vlc_fifo_Lock( p_owner->p_fifo );
 
     /* Empty the fifo */
     block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+    DecoderQueueMetric( p_owner );
+    p_owner->i_flush_seq++;
+    vlc_cond_signal( &p_owner->wait_fifo );
 
     /* Don't need to wait for the DecoderThread to flush. Indeed, if called a
      * second time, this function will clear the FIFO again before anything was
@@ -2188,6 +2568,8 @@ void input_DecoderFlush( decoder_t *p_dec )
     vlc_cond_signal( &p_owner->wait_timed );
 
     vlc_fifo_Unlock( p_owner->p_fifo );
+    if( p_owner->b_packetizer_thread )
+        vlc_fifo_Unlock( p_owner->p_packetizer_fifo );
 }
 
 void input_DecoderGetCcDesc( decoder_t *p_dec, decoder_cc_desc_t *p_desc )
@@ -2365,6 +2747,21 @@ void input_DecoderWait( decoder_t *p_dec )
          * owner */
         if( p_owner->paused )
             break;
+        if( p_owner->b_packetizer_thread )
+        {   /* Check the packetizer first: once idle, it cannot feed the
+             * decoder until more input is queued */
+            block_fifo_t *p_fifo = p_owner->p_packetizer_fifo;
+
+            vlc_fifo_Lock( p_fifo );
+            bool b_busy = !vlc_fifo_IsEmpty( p_fifo )
+                       || p_owner->b_packetizer_busy;
+            vlc_fifo_Unlock( p_fifo );
+            if( b_busy )
+            {
+                vlc_cond_wait( &p_owner->wait_acknowledge, &p_owner->lock );
+                continue;
+            }
+        }
         vlc_fifo_Lock( p_owner->p_fifo );
         if( p_owner->b_idle && vlc_fifo_IsEmpty( p_owner->p_fifo ) )
         {
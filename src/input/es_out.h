@@ -77,6 +77,9 @@ enum es_out_query_private_e
     /* Set position/time/length */
     ES_OUT_SET_TIMES,                               /* arg1=double f_position arg2=vlc_tick_t i_time arg3=vlc_tick_t i_length res=cannot fail */
 
+    /* Seek forward inside the timeshift buffer */
+    ES_OUT_SET_TIMESHIFT_TIME,                      /* arg1=vlc_tick_t i_time res=can fail */
+
     /* Set jitter */
     ES_OUT_SET_JITTER,                              /* arg1=vlc_tick_t i_pts_delay arg2= vlc_tick_t i_pts_jitter, arg2=int i_cr_average res=cannot fail */
 
@@ -142,6 +145,10 @@ static inline void es_out_SetTimes( es_out_t *p_out, double f_position, vlc_tick
     int i_ret = es_out_Control( p_out, ES_OUT_SET_TIMES, f_position, i_time, i_length );
     assert( !i_ret );
 }
+static inline int es_out_SetTimeshiftTime( es_out_t *p_out, vlc_tick_t i_time )
+{
+    return es_out_Control( p_out, ES_OUT_SET_TIMESHIFT_TIME, i_time );
+}
 static inline void es_out_SetJitter( es_out_t *p_out,
                                      vlc_tick_t i_pts_delay, vlc_tick_t i_pts_jitter, int i_cr_average )
 {
@@ -37,6 +37,11 @@
 #endif
 #include <sys/stat.h>
 #include <unistd.h>
+#if defined(HAVE_MMAP) && defined(HAVE_POSIX_FALLOCATE)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  define TS_STORAGE_MMAP 1
+#endif
 
 #include <vlc_common.h>
 #include <vlc_fs.h>
@@ -161,6 +166,46 @@ typedef struct attribute_packed
     } u;
 } ts_cmd_t;
 
+#ifdef TS_STORAGE_MMAP
+/* A temporary file mapped in memory, shared by the blocks read from it */
+typedef struct
+{
+    atomic_uint refs;
+    uint8_t     *p_base;
+    size_t      i_size;
+} ts_segment_t;
+
+typedef struct
+{
+    block_t      self;
+    ts_segment_t *p_segment;
+} ts_segment_block_t;
+
+/* Block properties stored in front of the data in a segment */
+typedef struct
+{
+    vlc_tick_t i_dts;
+    vlc_tick_t i_pts;
+    vlc_tick_t i_length;
+    uint32_t   i_flags;
+    unsigned   i_nb_samples;
+    size_t     i_buffer;
+} ts_segment_header_t;
+
+/* Entries are 16 bytes aligned, and their data is followed by zeroed bytes
+ * so that decoders needing some padding do not have to copy them. */
+#define TS_SEGMENT_ALIGN(x) (((x) + 15) & ~(size_t)15)
+#define TS_SEGMENT_HEADER_SIZE TS_SEGMENT_ALIGN(sizeof(ts_segment_header_t))
+#define TS_SEGMENT_PADDING 64
+#endif
+
+/* Command reached by the input at a given stream time */
+typedef struct
+{
+    vlc_tick_t i_time;
+    int        i_cmd;
+} ts_index_t;
+
 typedef struct ts_storage_t ts_storage_t;
 struct ts_storage_t
 {
@@ -172,6 +217,9 @@ struct ts_storage_t
 #endif
     size_t  i_file_max; /* Max size in bytes */
     int64_t i_file_size;/* Current size in bytes */
+#ifdef TS_STORAGE_MMAP
+    ts_segment_t *p_segment; /* Mapped file, or NULL if using stdio */
+#endif
     FILE    *p_filew;   /* FILE handle for data writing */
     FILE    *p_filer;   /* FILE handle for data reading */
 
@@ -180,6 +228,12 @@ struct ts_storage_t
     int      i_cmd_w;
     int      i_cmd_max;
     ts_cmd_t *p_cmd;
+
+    /* Stream times reported by the input, in increasing order, so as to
+     * seek without replaying the commands */
+    int        i_index;
+    int        i_index_max;
+    ts_index_t *p_index;
 };
 
 typedef struct
@@ -211,6 +265,10 @@ typedef struct
     ts_storage_t   *p_storage_r;
     ts_storage_t   *p_storage_w;
 
+    /* Pending seek target (command of a storage), or NULL */
+    ts_storage_t   *p_seek_storage;
+    int            i_seek_cmd;
+
     vlc_tick_t     i_cmd_delay;
 
 } ts_thread_t;
@@ -261,6 +319,8 @@ static bool         TsHasCmd( ts_thread_t * );
 static bool         TsIsUnused( ts_thread_t * );
 static int          TsChangePause( ts_thread_t *, bool b_source_paused, bool b_paused, vlc_tick_t i_date );
 static int          TsChangeRate( ts_thread_t *, int i_src_rate, int i_rate );
+static int          TsSeek( ts_thread_t *, vlc_tick_t i_time );
+static void         TsSeekLocked( ts_thread_t * );
 
 static void         *TsRun( void * );
 
@@ -270,7 +330,8 @@ static void         TsStoragePack( ts_storage_t *p_storage );
 static bool         TsStorageIsFull( ts_storage_t *, const ts_cmd_t *p_cmd );
 static bool         TsStorageIsEmpty( ts_storage_t * );
 static void         TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd, bool b_flush );
-static void         TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush );
+static int          TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush );
+static int          TsStorageSeek( const ts_storage_t *, vlc_tick_t i_time );
 
 static void CmdClean( ts_cmd_t * );
 static void cmd_cleanup_routine( void *p ) { CmdClean( p ); }
@@ -590,6 +651,14 @@ static int ControlLockedSetRate( es_out_t *p_out, int i_src_rate, int i_rate )
     }
     return i_ret;
 }
+static int ControlLockedSetTimeshiftTime( es_out_t *p_out, vlc_tick_t i_time )
+{
+    es_out_sys_t *p_sys = container_of(p_out, es_out_sys_t, out);
+
+    if( !p_sys->b_delayed )
+        return VLC_EGENERIC;
+    return TsSeek( p_sys->p_ts, i_time );
+}
 static int ControlLockedSetFrameNext( es_out_t *p_out )
 {
     es_out_sys_t *p_sys = container_of(p_out, es_out_sys_t, out);
@@ -687,6 +756,12 @@ static int ControlLocked( es_out_t *p_out, int i_query, va_list args )
     {
         return ControlLockedSetFrameNext( p_out );
     }
+    case ES_OUT_SET_TIMESHIFT_TIME:
+    {
+        const vlc_tick_t i_time = va_arg( args, vlc_tick_t );
+
+        return ControlLockedSetTimeshiftTime( p_out, i_time );
+    }
 
     case ES_OUT_GET_PCR_SYSTEM:
         if( p_sys->b_delayed )
@@ -782,6 +857,7 @@ static int TsStart( es_out_t *p_out )
     p_ts->i_cmd_delay = 0;
     p_ts->p_storage_r = NULL;
     p_ts->p_storage_w = NULL;
+    p_ts->p_seek_storage = NULL;
 
     p_sys->b_delayed = true;
     if( vlc_clone( &p_ts->thread, TsRun, p_ts, VLC_THREAD_PRIORITY_INPUT ) )
@@ -869,22 +945,27 @@ static int TsPopCmdLocked( ts_thread_t *p_ts, ts_cmd_t *p_cmd, bool b_flush )
 {
     vlc_assert_locked( &p_ts->lock );
 
-    if( TsStorageIsEmpty( p_ts->p_storage_r ) )
-        return VLC_EGENERIC;
+    for( ;; )
+    {
+        if( TsStorageIsEmpty( p_ts->p_storage_r ) )
+            return VLC_EGENERIC;
 
-    TsStoragePopCmd( p_ts->p_storage_r, p_cmd, b_flush );
+        int i_ret = TsStoragePopCmd( p_ts->p_storage_r, p_cmd, b_flush );
 
-    while( TsStorageIsEmpty( p_ts->p_storage_r ) )
-    {
-        ts_storage_t *p_next = p_ts->p_storage_r->p_next;
-        if( !p_next )
-            break;
+        while( TsStorageIsEmpty( p_ts->p_storage_r ) )
+        {
+            ts_storage_t *p_next = p_ts->p_storage_r->p_next;
+            if( !p_next )
+                break;
 
-        TsStorageDelete( p_ts->p_storage_r );
-        p_ts->p_storage_r = p_next;
-    }
+            TsStorageDelete( p_ts->p_storage_r );
+            p_ts->p_storage_r = p_next;
+        }
 
-    return VLC_SUCCESS;
+        if( i_ret == VLC_SUCCESS )
+            return VLC_SUCCESS;
+        /* The block could not be read back: skip the command */
+    }
 }
 static bool TsHasCmd( ts_thread_t *p_ts )
 {
@@ -957,6 +1038,84 @@ static int TsChangeRate( ts_thread_t *p_ts, int i_src_rate, int i_rate )
 
     return i_ret;
 }
+static int TsSeek( ts_thread_t *p_ts, vlc_tick_t i_time )
+{
+    int i_ret = VLC_EGENERIC;
+
+    vlc_mutex_lock( &p_ts->lock );
+    for( ts_storage_t *p_storage = p_ts->p_storage_r; p_storage != NULL;
+         p_storage = p_storage->p_next )
+    {
+        const int i_cmd = TsStorageSeek( p_storage, i_time );
+        if( i_cmd < 0 )
+            continue;
+
+        /* The commands already executed are not kept: only seek forward */
+        if( i_cmd >= p_storage->i_cmd_r )
+        {
+            p_ts->p_seek_storage = p_storage;
+            p_ts->i_seek_cmd = i_cmd;
+            vlc_cond_signal( &p_ts->wait );
+            i_ret = VLC_SUCCESS;
+        }
+        break;
+    }
+    vlc_mutex_unlock( &p_ts->lock );
+
+    return i_ret;
+}
+static void TsSeekLocked( ts_thread_t *p_ts )
+{
+    ts_storage_t *p_target = p_ts->p_seek_storage;
+    const int i_target = p_ts->i_seek_cmd;
+    const vlc_tick_t i_target_date = p_target->p_cmd[i_target].i_date;
+    vlc_tick_t i_date = -1;
+
+    vlc_assert_locked( &p_ts->lock );
+    p_ts->p_seek_storage = NULL;
+
+    /* Skip the commands up to the target, still applying the changes of the
+     * ES and of the controls. The blocks are not even read back. */
+    while( p_ts->p_storage_r != p_target || p_target->i_cmd_r < i_target )
+    {
+        ts_cmd_t cmd;
+
+        if( TsPopCmdLocked( p_ts, &cmd, true ) )
+            break;
+        if( i_date < 0 )
+            i_date = cmd.i_date;
+
+        switch( cmd.i_type )
+        {
+        case C_ADD:
+            CmdExecuteAdd( p_ts->p_out, &cmd );
+            CmdCleanAdd( &cmd );
+            break;
+        case C_SEND:
+            CmdCleanSend( &cmd );
+            break;
+        case C_CONTROL:
+            CmdExecuteControl( p_ts->p_out, &cmd );
+            CmdCleanControl( &cmd );
+            break;
+        case C_DEL:
+            CmdExecuteDel( p_ts->p_out, &cmd );
+            break;
+        default:
+            vlc_assert_unreachable();
+            break;
+        }
+    }
+
+    if( i_date >= 0 )
+    {
+        /* Do not wait for the skipped commands */
+        p_ts->i_cmd_delay += p_ts->i_rate_delay - (i_target_date - i_date);
+        p_ts->i_rate_date = -1;
+        p_ts->i_rate_delay = 0;
+    }
+    es_out_Control( p_ts->p_out, ES_OUT_RESET_PCR );
+}
 
 static void *TsRun( void *p_data )
 {
@@ -976,6 +1135,8 @@ static void *TsRun( void *p_data )
         for( ;; )
         {
             const int canc = vlc_savecancel();
+            if( p_ts->p_seek_storage != NULL )
+                TsSeekLocked( p_ts );
             b_buffering = es_out_GetBuffering( p_ts->p_out );
 
             if( ( !p_ts->b_paused || b_buffering ) && !TsPopCmdLocked( p_ts, &cmd, false ) )
@@ -1080,6 +1241,89 @@ static void *TsRun( void *p_data )
 /*****************************************************************************
  *
  *****************************************************************************/
+#ifdef TS_STORAGE_MMAP
+static ts_segment_t *TsSegmentNew( int fd, size_t i_size )
+{
+    /* Reserve the disk space now: running out of it while writing to the
+     * mapping would raise SIGBUS instead of a write error */
+    if( posix_fallocate( fd, 0, i_size ) )
+        return NULL;
+
+    ts_segment_t *p_segment = malloc( sizeof(*p_segment) );
+    if( unlikely(p_segment == NULL) )
+        return NULL;
+
+    p_segment->p_base = mmap( NULL, i_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                              fd, 0 );
+    if( p_segment->p_base == MAP_FAILED )
+    {
+        free( p_segment );
+        return NULL;
+    }
+    p_segment->i_size = i_size;
+    atomic_init( &p_segment->refs, 1 );
+    return p_segment;
+}
+
+static void TsSegmentRelease( ts_segment_t *p_segment )
+{
+    if( atomic_fetch_sub_explicit( &p_segment->refs, 1,
+                                   memory_order_acq_rel ) != 1 )
+        return;
+
+    munmap( p_segment->p_base, p_segment->i_size );
+    free( p_segment );
+}
+
+static void TsSegmentBlockRelease( block_t *p_block )
+{
+    ts_segment_block_t *p_sblock = container_of( p_block, ts_segment_block_t,
+                                                 self );
+
+    TsSegmentRelease( p_sblock->p_segment );
+    free( p_sblock );
+}
+
+/* Returns a block pointing directly to an entry of the segment */
+static block_t *TsSegmentBlockNew( ts_segment_t *p_segment, size_t i_offset )
+{
+    const ts_segment_header_t *p_hdr =
+        (const ts_segment_header_t *)&p_segment->p_base[i_offset];
+    ts_segment_block_t *p_sblock = malloc( sizeof(*p_sblock) );
+    if( unlikely(p_sblock == NULL) )
+        return NULL;
+
+    block_t *p_block = &p_sblock->self;
+    block_Init( p_block, &p_segment->p_base[i_offset + TS_SEGMENT_HEADER_SIZE],
+                p_hdr->i_buffer + TS_SEGMENT_PADDING );
+    p_block->i_buffer     = p_hdr->i_buffer;
+    p_block->i_dts        = p_hdr->i_dts;
+    p_block->i_pts        = p_hdr->i_pts;
+    p_block->i_flags      = p_hdr->i_flags;
+    p_block->i_length     = p_hdr->i_length;
+    p_block->i_nb_samples = p_hdr->i_nb_samples;
+    p_block->pf_release   = TsSegmentBlockRelease;
+
+    atomic_fetch_add_explicit( &p_segment->refs, 1, memory_order_relaxed );
+    p_sblock->p_segment = p_segment;
+    return p_block;
+}
+#endif
+
+/* Returns the number of bytes a block takes in the storage file */
+static size_t TsStorageEntrySize( const ts_storage_t *p_storage,
+                                  const block_t *p_block )
+{
+#ifdef TS_STORAGE_MMAP
+    if( p_storage->p_segment != NULL )
+        return TS_SEGMENT_ALIGN( TS_SEGMENT_HEADER_SIZE + p_block->i_buffer
+                                 + TS_SEGMENT_PADDING );
+#else
+    VLC_UNUSED(p_storage);
+#endif
+    return sizeof(*p_block) + p_block->i_buffer;
+}
+
 static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_max )
 {
     ts_storage_t *p_storage = malloc( sizeof (*p_storage) );
@@ -1094,6 +1338,20 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
         return NULL;
     }
 
+#ifdef TS_STORAGE_MMAP
+    p_storage->p_segment = TsSegmentNew( fd, i_tmp_size_max );
+    if( p_storage->p_segment != NULL )
+    {
+        /* The mapping keeps the file alive */
+        vlc_close( fd );
+        vlc_unlink( psz_file );
+        free( psz_file );
+        p_storage->p_filew = NULL;
+        p_storage->p_filer = NULL;
+        goto opened;
+    }
+#endif
+
     p_storage->p_filew = fdopen( fd, "w+b" );
     if( p_storage->p_filew == NULL )
     {
@@ -1115,6 +1373,9 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
     free( psz_file );
 #else
     p_storage->psz_file = psz_file;
+#endif
+#ifdef TS_STORAGE_MMAP
+opened:
 #endif
     p_storage->p_next = NULL;
 
@@ -1127,6 +1388,9 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
     p_storage->i_cmd_r = 0;
     p_storage->i_cmd_max = 30000;
     p_storage->p_cmd = vlc_alloc( p_storage->i_cmd_max, sizeof(*p_storage->p_cmd) );
+    p_storage->i_index = 0;
+    p_storage->i_index_max = 0;
+    p_storage->p_index = NULL;
     //fprintf( stderr, "\nSTORAGE name=%s size=%d KiB\n", p_storage->psz_file, p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) /1024 );
 
     if( !p_storage->p_cmd )
@@ -1152,9 +1416,17 @@ static void TsStorageDelete( ts_storage_t *p_storage )
         CmdClean( &cmd );
     }
     free( p_storage->p_cmd );
+    free( p_storage->p_index );
 
-    fclose( p_storage->p_filer );
-    fclose( p_storage->p_filew );
+#ifdef TS_STORAGE_MMAP
+    if( p_storage->p_segment != NULL )
+        TsSegmentRelease( p_storage->p_segment );
+    else
+#endif
+    {
+        fclose( p_storage->p_filer );
+        fclose( p_storage->p_filew );
+    }
 #ifdef _WIN32
     vlc_unlink( p_storage->psz_file );
     free( p_storage->psz_file );
@@ -1178,7 +1450,7 @@ static bool TsStorageIsFull( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
 {
     if( p_cmd && p_cmd->i_type == C_SEND && p_storage->i_cmd_w > 0 )
     {
-        size_t i_size = sizeof(*p_cmd->u.send.p_block) + p_cmd->u.send.p_block->i_buffer;
+        size_t i_size = TsStorageEntrySize( p_storage, p_cmd->u.send.p_block );
 
         if( p_storage->i_file_size + i_size >= p_storage->i_file_max )
             return true;
@@ -1189,12 +1461,81 @@ static bool TsStorageIsEmpty( ts_storage_t *p_storage )
 {
     return !p_storage || p_storage->i_cmd_r >= p_storage->i_cmd_w;
 }
+static void TsStorageIndex( ts_storage_t *p_storage, vlc_tick_t i_time )
+{
+    /* Keep the index sorted, the time may go back after a seek */
+    if( p_storage->i_index > 0 &&
+        p_storage->p_index[p_storage->i_index - 1].i_time >= i_time )
+        return;
+
+    if( p_storage->i_index >= p_storage->i_index_max )
+    {
+        const int i_max = __MAX( 2 * p_storage->i_index_max, 64 );
+        ts_index_t *p_new = realloc( p_storage->p_index,
+                                     i_max * sizeof(*p_storage->p_index) );
+        if( !p_new )
+            return; /* Seeking is only less precise */
+        p_storage->p_index = p_new;
+        p_storage->i_index_max = i_max;
+    }
+    p_storage->p_index[p_storage->i_index++] =
+        (ts_index_t){ .i_time = i_time, .i_cmd = p_storage->i_cmd_w };
+}
+static int TsStorageSeek( const ts_storage_t *p_storage, vlc_tick_t i_time )
+{
+    /* Binary search of the first command at or after the time */
+    int i_low = 0;
+    int i_high = p_storage->i_index;
+
+    while( i_low < i_high )
+    {
+        const int i_mid = i_low + (i_high - i_low) / 2;
+
+        if( p_storage->p_index[i_mid].i_time < i_time )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    return i_low < p_storage->i_index ? p_storage->p_index[i_low].i_cmd : -1;
+}
 static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd, bool b_flush )
 {
     ts_cmd_t cmd = *p_cmd;
 
     assert( !TsStorageIsFull( p_storage, p_cmd ) );
 
+    if( cmd.i_type == C_CONTROL && cmd.u.control.i_query == ES_OUT_SET_TIMES )
+        TsStorageIndex( p_storage, cmd.u.control.u.times.i_time );
+
+#ifdef TS_STORAGE_MMAP
+    if( cmd.i_type == C_SEND && p_storage->p_segment != NULL )
+    {
+        block_t *p_block = cmd.u.send.p_block;
+        const size_t i_size = TsStorageEntrySize( p_storage, p_block );
+
+        /* A block larger than the whole segment is kept in memory */
+        if( p_storage->i_file_size + i_size <= p_storage->p_segment->i_size )
+        {
+            uint8_t *p = &p_storage->p_segment->p_base[p_storage->i_file_size];
+            ts_segment_header_t *p_hdr = (ts_segment_header_t *)p;
+
+            p_hdr->i_dts        = p_block->i_dts;
+            p_hdr->i_pts        = p_block->i_pts;
+            p_hdr->i_length     = p_block->i_length;
+            p_hdr->i_flags      = p_block->i_flags;
+            p_hdr->i_nb_samples = p_block->i_nb_samples;
+            p_hdr->i_buffer     = p_block->i_buffer;
+            memcpy( p + TS_SEGMENT_HEADER_SIZE, p_block->p_buffer,
+                    p_block->i_buffer );
+
+            cmd.u.send.p_block = NULL;
+            cmd.u.send.i_offset = p_storage->i_file_size;
+            p_storage->i_file_size += i_size;
+            block_Release( p_block );
+        }
+    }
+    else
+#endif
     if( cmd.i_type == C_SEND )
     {
         block_t *p_block = cmd.u.send.p_block;
@@ -1224,11 +1565,25 @@ static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd, bo
     }
     p_storage->p_cmd[p_storage->i_cmd_w++] = cmd;
 }
-static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush )
+static int TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush )
 {
     assert( !TsStorageIsEmpty( p_storage ) );
 
     *p_cmd = p_storage->p_cmd[p_storage->i_cmd_r++];
+#ifdef TS_STORAGE_MMAP
+    if( p_cmd->i_type == C_SEND && p_storage->p_segment != NULL )
+    {
+        /* Blocks kept in memory are returned as is */
+        if( p_cmd->u.send.p_block == NULL && !b_flush )
+        {
+            p_cmd->u.send.p_block = TsSegmentBlockNew( p_storage->p_segment,
+                                                       p_cmd->u.send.i_offset );
+            if( unlikely(p_cmd->u.send.p_block == NULL) )
+                return VLC_ENOMEM;
+        }
+    }
+    else
+#endif
     if( p_cmd->i_type == C_SEND )
     {
         block_t block;
@@ -1248,6 +1603,8 @@ static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_fl
                 p_block->i_buffer = fread( p_block->p_buffer, 1, block.i_buffer, p_storage->p_filer );
             }
             p_cmd->u.send.p_block = p_block;
+            if( unlikely(p_block == NULL) )
+                return VLC_ENOMEM;
         }
         else
         {
@@ -1255,6 +1612,7 @@ static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_fl
             p_cmd->u.send.p_block = block_Alloc( 1 );
         }
     }
+    return VLC_SUCCESS;
 }
 
 /*****************************************************************************
@@ -493,6 +493,13 @@ static input_thread_t *Create( vlc_object_t *p_parent, input_item_t *p_item,
     else
         priv->stats = NULL;
 
+    if( !priv->b_preparsing )
+        priv->demux_metric = vlc_metric_Register( p_input,
+            VLC_METRIC_HISTOGRAM, "vlc_demux_read_seconds",
+            "Time spent in each demux call" );
+    else
+        priv->demux_metric = NULL;
+
     priv->p_es_out_display = input_EsOutNew( p_input, priv->i_rate );
     priv->p_es_out = NULL;
 
@@ -587,7 +594,13 @@ static void MainLoopDemux( input_thread_t *p_input, bool *pb_changed )
     if( input_priv(p_input)->i_stop > 0 && input_priv(p_input)->i_time >= input_priv(p_input)->i_stop )
         i_ret = VLC_DEMUXER_EOF;
     else
+    {
+        vlc_tick_t start = vlc_tick_now();
+
         i_ret = demux_Demux( p_demux );
+        vlc_metric_Observe( input_priv(p_input)->demux_metric,
+                            vlc_tick_now() - start );
+    }
 
     i_ret = i_ret > 0 ? VLC_DEMUXER_SUCCESS : ( i_ret < 0 ? VLC_DEMUXER_EGENERIC : VLC_DEMUXER_EOF);
 
@@ -1896,6 +1909,13 @@ static bool Control( input_thread_t *p_input,
             if( i_time < 0 )
                 i_time = 0;
 
+            /* Jump inside the timeshift buffer if it holds the target */
+            if( !es_out_SetTimeshiftTime( input_priv(p_input)->p_es_out, i_time ) )
+            {
+                b_force_update = true;
+                break;
+            }
+
             /* Reset the decoders states and clock sync (before calling the demuxer */
             es_out_Control( input_priv(p_input)->p_es_out, ES_OUT_RESET_PCR );
 
@@ -30,6 +30,7 @@
 #include <vlc_access.h>
 #include <vlc_demux.h>
 #include <vlc_input.h>
+#include <vlc_metrics.h>
 #include <vlc_viewpoint.h>
 #include <libvlc.h>
 #include "input_interface.h"
@@ -164,6 +165,7 @@ typedef struct input_thread_private_t
 
     /* Stats counters */
     struct input_stats *stats;
+    vlc_metric_t *demux_metric;
 
     /* Buffer of pending actions */
     vlc_mutex_t lock_control;
@@ -93,6 +93,8 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv = libvlc_priv (p_libvlc);
     priv->playlist = NULL;
     priv->p_vlm = NULL;
+    priv->metrics = vlc_metrics_Create();
+    vlc_block_pool_Init( VLC_OBJECT(p_libvlc) );
 
     vlc_ExitInit( &priv->exit );
 
@@ -416,6 +418,10 @@ void libvlc_InternalDestroy( libvlc_int_t *p_libvlc )
 
     vlc_ExitDestroy( &priv->exit );
 
+    vlc_block_pool_Deinit( VLC_OBJECT(p_libvlc) );
+    if( priv->metrics != NULL )
+        vlc_metrics_Destroy( priv->metrics );
+
     assert( atomic_load(&(vlc_internals(p_libvlc)->refs)) == 1 );
     vlc_object_release( p_libvlc );
 }
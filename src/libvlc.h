@@ -42,6 +42,12 @@ size_t EnumClockSource( const char *, char ***, char *** );
 #endif
 void vlc_CPU_dump(vlc_object_t *);
 
+/*
+ * Data blocks
+ */
+void vlc_block_pool_Init(vlc_object_t *);
+void vlc_block_pool_Deinit(vlc_object_t *);
+
 /*
  * Threads subsystem
  */
@@ -185,6 +191,7 @@ typedef struct libvlc_priv_t
     struct playlist_t *playlist; ///< Playlist for interfaces
     struct input_preparser_t *parser; ///< Input item meta data handler
     vlc_actions_t *actions; ///< Hotkeys handler
+    struct vlc_metrics *metrics; ///< Run-time metrics (or NULL)
 
     /* Exit callback */
     vlc_exit_t       exit;
@@ -199,6 +206,12 @@ int intf_InsertItem(libvlc_int_t *, const char *mrl, unsigned optc,
                     const char * const *optv, unsigned flags);
 void intf_DestroyAll( libvlc_int_t * );
 
+/*
+ * Metrics
+ */
+struct vlc_metrics *vlc_metrics_Create(void);
+void vlc_metrics_Destroy(struct vlc_metrics *);
+
 /*
  * Variables stuff
  */
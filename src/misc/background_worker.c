@@ -23,15 +23,30 @@
 #include <assert.h>
 #include <vlc_common.h>
 #include <vlc_threads.h>
-#include <vlc_arrays.h>
+#include <vlc_list.h>
 
 #include "libvlc.h"
 #include "background_worker.h"
 
+#define BG_LANE_PRIORITY 0
+#define BG_LANE_NORMAL 1
+#define BG_LANE_COUNT 2
+
 struct bg_queued_item {
     void* id; /**< id associated with entity */
     void* entity; /**< the entity to process */
-    int timeout; /**< timeout duration in microseconds */
+    int timeout; /**< timeout duration in milliseconds */
+    struct vlc_list node; /**< node in the lane of the entity */
+    struct vlc_list id_node; /**< node in the bucket of the id, if any */
+};
+
+struct bg_thread {
+    struct background_worker* worker;
+    struct vlc_list node; /**< node in the list of threads */
+    bool busy; /**< true while a task is processed */
+    bool probe_request; /**< true if a probe is requested */
+    vlc_tick_t deadline; /**< deadline of the current task */
+    void* id; /**< id of the current task */
 };
 
 struct background_worker {
@@ -40,142 +55,272 @@ struct background_worker {
 
     vlc_mutex_t lock; /**< acquire to inspect members that follow */
     struct {
-        bool probe_request; /**< true if a probe is requested */
         vlc_cond_t wait; /**< wait for update in terms of head */
         vlc_cond_t worker_wait; /**< wait for probe request or cancelation */
-        vlc_tick_t deadline; /**< deadline of the current task */
-        void* id; /**< id of the current task */
-        bool active; /**< true if there is an active thread */
+        struct vlc_list threads; /**< list of the running threads */
+        int count; /**< number of running threads */
+        int idle; /**< number of threads waiting for an entity */
+        int max; /**< maximum number of threads */
+        bool closing; /**< true if the idle threads shall terminate */
     } head;
 
     struct {
         vlc_cond_t wait; /**< wait for update in terms of tail */
-        vlc_array_t data; /**< queue of pending entities to process */
+        struct vlc_list lanes[BG_LANE_COUNT]; /**< pending entities */
+        size_t count; /**< number of pending entities */
+        struct vlc_list* buckets; /**< pending entities with an id, by id */
+        size_t mask; /**< number of buckets minus one */
     } tail;
 };
 
-static void* Thread( void* data )
+static size_t IdHash( void* id, size_t mask )
 {
-    struct background_worker* worker = data;
+    return ( ( (uint64_t)(uintptr_t)id * UINT64_C(0x9E3779B97F4A7C15) )
+             >> 32 ) & mask;
+}
 
-    for( ;; )
+static void QueueRehash( struct background_worker* worker )
+{
+    size_t mask = worker->tail.mask * 2 + 1;
+    struct vlc_list* buckets = vlc_alloc( mask + 1, sizeof( *buckets ) );
+
+    if( unlikely( !buckets ) )
+        return; /* keep the current buckets, lookups just get slower */
+
+    for( size_t i = 0; i <= mask; ++i )
+        vlc_list_init( &buckets[i] );
+
+    for( size_t i = 0; i <= worker->tail.mask; ++i )
     {
-        struct bg_queued_item* item = NULL;
-        void* handle;
+        struct bg_queued_item* item;
 
-        vlc_mutex_lock( &worker->lock );
-        for( ;; )
-        {
-            if( vlc_array_count( &worker->tail.data ) )
-            {
-                item = vlc_array_item_at_index( &worker->tail.data, 0 );
-                handle = NULL;
+        vlc_list_foreach( item, &worker->tail.buckets[i], id_node )
+            vlc_list_append( &item->id_node, &buckets[IdHash( item->id, mask )] );
+    }
 
-                vlc_array_remove( &worker->tail.data, 0 );
-            }
+    free( worker->tail.buckets );
+    worker->tail.buckets = buckets;
+    worker->tail.mask = mask;
+}
+
+static void QueueAppend( struct background_worker* worker,
+                         struct bg_queued_item* item, bool priority )
+{
+    vlc_list_append( &item->node, &worker->tail.lanes[
+        priority ? BG_LANE_PRIORITY : BG_LANE_NORMAL] );
 
-            if( worker->head.deadline == VLC_TICK_INVALID && item == NULL )
-                worker->head.active = false;
-            worker->head.id = item ? item->id : NULL;
-            vlc_cond_broadcast( &worker->head.wait );
+    if( item->id )
+    {
+        vlc_list_append( &item->id_node,
+            &worker->tail.buckets[IdHash( item->id, worker->tail.mask )] );
+    }
 
-            if( item )
-            {
-                if( item->timeout > 0 )
-                    worker->head.deadline = vlc_tick_now() + item->timeout * 1000;
-                else
-                    worker->head.deadline = INT64_MAX;
-            }
-            else if( worker->head.deadline != VLC_TICK_INVALID )
-            {
-                /* Wait 1 seconds for new inputs before terminating */
-                vlc_tick_t deadline = vlc_tick_now() + VLC_TICK_FROM_SEC(1);
-                int ret = vlc_cond_timedwait( &worker->tail.wait,
-                                              &worker->lock, deadline );
-                if( ret != 0 )
-                {
-                    /* Timeout: if there is still no items, the thread will be
-                     * terminated at next loop iteration (active = false). */
-                    worker->head.deadline = VLC_TICK_INVALID;
-                }
-                continue;
-            }
-            break;
-        }
+    if( ++worker->tail.count > 2 * ( worker->tail.mask + 1 ) )
+        QueueRehash( worker );
+}
+
+static void QueueRemove( struct background_worker* worker,
+                         struct bg_queued_item* item )
+{
+    vlc_list_remove( &item->node );
+    if( item->id )
+        vlc_list_remove( &item->id_node );
+    worker->tail.count--;
+}
+
+static struct bg_queued_item* QueuePop( struct background_worker* worker )
+{
+    for( int i = 0; i < BG_LANE_COUNT; ++i )
+    {
+        struct bg_queued_item* item = vlc_list_first_entry_or_null(
+            &worker->tail.lanes[i], struct bg_queued_item, node );
 
-        if( !worker->head.active )
+        if( item )
         {
-            vlc_mutex_unlock( &worker->lock );
-            break;
+            QueueRemove( worker, item );
+            return item;
         }
-        vlc_mutex_unlock( &worker->lock );
+    }
+    return NULL;
+}
 
-        assert( item != NULL );
+static void ProcessItem( struct bg_thread* thread,
+                         struct bg_queued_item* item )
+{
+    struct background_worker* worker = thread->worker;
+    void* handle = NULL;
+
+    if( worker->conf.pf_start( worker->owner, item->entity, &handle ) )
+    {
+        worker->conf.pf_release( item->entity );
+        free( item );
+        return;
+    }
+
+    for( ;; )
+    {
+        vlc_mutex_lock( &worker->lock );
+
+        bool const b_timeout = thread->deadline <= vlc_tick_now();
+        thread->probe_request = false;
+
+        vlc_mutex_unlock( &worker->lock );
 
-        if( worker->conf.pf_start( worker->owner, item->entity, &handle ) )
+        if( b_timeout ||
+            worker->conf.pf_probe( worker->owner, handle ) )
         {
+            worker->conf.pf_stop( worker->owner, handle );
             worker->conf.pf_release( item->entity );
             free( item );
-            continue;
+            break;
         }
 
-        for( ;; )
+        vlc_mutex_lock( &worker->lock );
+        if( thread->probe_request == false &&
+            thread->deadline > vlc_tick_now() )
         {
-            vlc_mutex_lock( &worker->lock );
+            vlc_cond_timedwait( &worker->head.worker_wait, &worker->lock,
+                                 thread->deadline );
+        }
+        vlc_mutex_unlock( &worker->lock );
+    }
+}
 
-            bool const b_timeout = worker->head.deadline <= vlc_tick_now();
-            worker->head.probe_request = false;
+static void* Thread( void* data )
+{
+    struct bg_thread* thread = data;
+    struct background_worker* worker = thread->worker;
 
-            vlc_mutex_unlock( &worker->lock );
+    vlc_mutex_lock( &worker->lock );
+    for( ;; )
+    {
+        struct bg_queued_item* item = QueuePop( worker );
 
-            if( b_timeout ||
-                worker->conf.pf_probe( worker->owner, handle ) )
-            {
-                worker->conf.pf_stop( worker->owner, handle );
-                worker->conf.pf_release( item->entity );
-                free( item );
+        if( item == NULL )
+        {
+            if( worker->head.closing )
                 break;
-            }
 
-            vlc_mutex_lock( &worker->lock );
-            if( worker->head.probe_request == false &&
-                worker->head.deadline > vlc_tick_now() )
-            {
-                vlc_cond_timedwait( &worker->head.worker_wait, &worker->lock,
-                                     worker->head.deadline );
-            }
-            vlc_mutex_unlock( &worker->lock );
+            /* Wait 1 seconds for new inputs before terminating */
+            vlc_tick_t deadline = vlc_tick_now() + VLC_TICK_FROM_SEC(1);
+
+            worker->head.idle++;
+            int ret = vlc_cond_timedwait( &worker->tail.wait,
+                                          &worker->lock, deadline );
+            worker->head.idle--;
+
+            if( ret != 0 && worker->tail.count == 0 )
+                break;
+            continue;
         }
+
+        thread->busy = true;
+        thread->id = item->id;
+        thread->probe_request = false;
+        if( item->timeout > 0 )
+            thread->deadline = vlc_tick_now() + item->timeout * 1000;
+        else
+            thread->deadline = INT64_MAX;
+        vlc_mutex_unlock( &worker->lock );
+
+        ProcessItem( thread, item );
+
+        vlc_mutex_lock( &worker->lock );
+        thread->busy = false;
+        thread->id = NULL;
+        vlc_cond_broadcast( &worker->head.wait );
     }
 
+    vlc_list_remove( &thread->node );
+    worker->head.count--;
+    vlc_cond_broadcast( &worker->head.wait );
+    vlc_mutex_unlock( &worker->lock );
+
+    free( thread );
     return NULL;
 }
 
+static int SpawnThread( struct background_worker* worker )
+{
+    struct bg_thread* thread = malloc( sizeof( *thread ) );
+
+    if( unlikely( !thread ) )
+        return VLC_ENOMEM;
+
+    thread->worker = worker;
+    thread->busy = false;
+    thread->probe_request = false;
+    thread->deadline = VLC_TICK_INVALID;
+    thread->id = NULL;
+
+    vlc_list_append( &thread->node, &worker->head.threads );
+    worker->head.count++;
+
+    if( vlc_clone_detach( NULL, Thread, thread, VLC_THREAD_PRIORITY_LOW ) )
+    {
+        vlc_list_remove( &thread->node );
+        worker->head.count--;
+        free( thread );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
 static void BackgroundWorkerCancel( struct background_worker* worker, void* id)
 {
+    struct bg_queued_item* item;
+
     vlc_mutex_lock( &worker->lock );
-    for( size_t i = 0; i < vlc_array_count( &worker->tail.data ); )
+    if( id == NULL )
     {
-        struct bg_queued_item* item =
-            vlc_array_item_at_index( &worker->tail.data, i );
+        for( int i = 0; i < BG_LANE_COUNT; ++i )
+        {
+            vlc_list_foreach( item, &worker->tail.lanes[i], node )
+            {
+                worker->conf.pf_release( item->entity );
+                free( item );
+            }
+            vlc_list_init( &worker->tail.lanes[i] );
+        }
 
-        if( id == NULL || item->id == id )
+        for( size_t i = 0; i <= worker->tail.mask; ++i )
+            vlc_list_init( &worker->tail.buckets[i] );
+        worker->tail.count = 0;
+    }
+    else
+    {
+        struct vlc_list* bucket =
+            &worker->tail.buckets[IdHash( id, worker->tail.mask )];
+
+        vlc_list_foreach( item, bucket, id_node )
         {
-            vlc_array_remove( &worker->tail.data, i );
+            if( item->id != id )
+                continue;
+
+            QueueRemove( worker, item );
             worker->conf.pf_release( item->entity );
             free( item );
-            continue;
         }
-
-        ++i;
     }
 
-    while( ( id == NULL && worker->head.active )
-        || ( id != NULL && worker->head.id == id ) )
+    for( ;; )
     {
-        worker->head.deadline = VLC_TICK_INVALID;
-        vlc_cond_signal( &worker->head.worker_wait );
-        vlc_cond_signal( &worker->tail.wait );
+        struct bg_thread* thread;
+        bool running = false;
+
+        vlc_list_foreach( thread, &worker->head.threads, node )
+        {
+            if( thread->busy && ( id == NULL || thread->id == id ) )
+            {
+                thread->deadline = VLC_TICK_INVALID;
+                running = true;
+            }
+        }
+
+        if( !running )
+            break;
+
+        vlc_cond_broadcast( &worker->head.worker_wait );
         vlc_cond_wait( &worker->head.wait, &worker->lock );
     }
     vlc_mutex_unlock( &worker->lock );
@@ -189,24 +334,39 @@ struct background_worker* background_worker_New( void* owner,
     if( unlikely( !worker ) )
         return NULL;
 
+    worker->tail.mask = 15;
+    worker->tail.buckets = vlc_alloc( worker->tail.mask + 1,
+                                      sizeof( *worker->tail.buckets ) );
+    if( unlikely( !worker->tail.buckets ) )
+    {
+        free( worker );
+        return NULL;
+    }
+
+    for( size_t i = 0; i <= worker->tail.mask; ++i )
+        vlc_list_init( &worker->tail.buckets[i] );
+    for( int i = 0; i < BG_LANE_COUNT; ++i )
+        vlc_list_init( &worker->tail.lanes[i] );
+    worker->tail.count = 0;
+
     worker->conf = *conf;
     worker->owner = owner;
-    worker->head.id = NULL;
-    worker->head.active = false;
-    worker->head.deadline = VLC_TICK_INVALID;
+    vlc_list_init( &worker->head.threads );
+    worker->head.count = 0;
+    worker->head.idle = 0;
+    worker->head.max = conf->max_threads > 0 ? conf->max_threads : 1;
+    worker->head.closing = false;
 
     vlc_mutex_init( &worker->lock );
     vlc_cond_init( &worker->head.wait );
     vlc_cond_init( &worker->head.worker_wait );
-
-    vlc_array_init( &worker->tail.data );
     vlc_cond_init( &worker->tail.wait );
 
     return worker;
 }
 
 int background_worker_Push( struct background_worker* worker, void* entity,
-                        void* id, int timeout )
+                        void* id, int timeout, bool priority )
 {
     struct bg_queued_item* item = malloc( sizeof( *item ) );
 
@@ -218,28 +378,26 @@ int background_worker_Push( struct background_worker* worker, void* entity,
     item->timeout = timeout < 0 ? worker->conf.default_timeout : timeout;
 
     vlc_mutex_lock( &worker->lock );
-    int i_ret = vlc_array_append( &worker->tail.data, item );
-    vlc_cond_signal( &worker->tail.wait );
-    if( i_ret != 0 )
+    QueueAppend( worker, item, priority );
+
+    /* Start another thread unless the idle ones can take all the entities */
+    if( worker->tail.count > (size_t)worker->head.idle
+     && worker->head.count < worker->head.max )
+        SpawnThread( worker );
+
+    if( worker->head.count == 0 )
     {
+        QueueRemove( worker, item );
+        vlc_mutex_unlock( &worker->lock );
         free( item );
         return VLC_EGENERIC;
     }
 
-    if( worker->head.active == false )
-    {
-        worker->head.probe_request = false;
-        worker->head.active =
-            !vlc_clone_detach( NULL, Thread, worker, VLC_THREAD_PRIORITY_LOW );
-    }
-
-    if( worker->head.active )
-        worker->conf.pf_hold( item->entity );
-
-    int ret = worker->head.active ? VLC_SUCCESS : VLC_EGENERIC;
+    worker->conf.pf_hold( item->entity );
+    vlc_cond_signal( &worker->tail.wait );
     vlc_mutex_unlock( &worker->lock );
 
-    return ret;
+    return VLC_SUCCESS;
 }
 
 void background_worker_Cancel( struct background_worker* worker, void* id )
@@ -249,16 +407,27 @@ void background_worker_Cancel( struct background_worker* worker, void* id )
 
 void background_worker_RequestProbe( struct background_worker* worker )
 {
+    struct bg_thread* thread;
+
     vlc_mutex_lock( &worker->lock );
-    worker->head.probe_request = true;
-    vlc_cond_signal( &worker->head.worker_wait );
+    vlc_list_foreach( thread, &worker->head.threads, node )
+        thread->probe_request = true;
+    vlc_cond_broadcast( &worker->head.worker_wait );
     vlc_mutex_unlock( &worker->lock );
 }
 
 void background_worker_Delete( struct background_worker* worker )
 {
     BackgroundWorkerCancel( worker, NULL );
-    vlc_array_clear( &worker->tail.data );
+
+    vlc_mutex_lock( &worker->lock );
+    worker->head.closing = true;
+    vlc_cond_broadcast( &worker->tail.wait );
+    while( worker->head.count > 0 )
+        vlc_cond_wait( &worker->head.wait, &worker->lock );
+    vlc_mutex_unlock( &worker->lock );
+
+    free( worker->tail.buckets );
     vlc_mutex_destroy( &worker->lock );
     vlc_cond_destroy( &worker->head.wait );
     vlc_cond_destroy( &worker->head.worker_wait );
@@ -28,12 +28,17 @@
 #include <sys/stat.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <fcntl.h>
 
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_list.h>
+#include <vlc_metrics.h>
+#include "libvlc.h"
 
 #ifndef NDEBUG
 static void BlockNoRelease( block_t *b )
@@ -117,6 +122,371 @@ static void BlockMetaCopy( block_t *restrict out, const block_t *in )
 /** Initial reserved header and footer size. */
 #define BLOCK_PADDING      32
 
+#ifdef ENABLE_BLOCK_POOL
+/* Small blocks are recycled by size classes of powers of two, from 512 bytes
+ * to 64 KiB including the block_t header. Each thread caches a few free
+ * blocks of each class, and exchanges them by batches with a global depot
+ * when it has too many or none left. */
+#define BLOCK_POOL_MIN_SHIFT 9
+#define BLOCK_POOL_MAX_SHIFT 16
+#define BLOCK_POOL_CLASSES (BLOCK_POOL_MAX_SHIFT - BLOCK_POOL_MIN_SHIFT + 1)
+
+/* Caches are bounded in bytes per class: 256 KiB per thread (at most 64
+ * blocks), and 16 times as much in the depot */
+#define BLOCK_POOL_CACHE_MAX(c) \
+    __MIN(64u, (256u * 1024) >> ((c) + BLOCK_POOL_MIN_SHIFT))
+#define BLOCK_POOL_DEPOT_MAX(c) (16 * BLOCK_POOL_CACHE_MAX(c))
+
+struct block_pool_list
+{
+    block_t *head;
+    unsigned count;
+};
+
+struct block_pool_cache
+{
+    struct block_pool_list lists[BLOCK_POOL_CLASSES];
+    unsigned generation;
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+static struct
+{
+    vlc_mutex_t lock;
+    struct block_pool_list list;
+} block_pool_depot[BLOCK_POOL_CLASSES] = {
+#define BLOCK_POOL_DEPOT_INIT { .lock = VLC_STATIC_MUTEX }
+    BLOCK_POOL_DEPOT_INIT, BLOCK_POOL_DEPOT_INIT, BLOCK_POOL_DEPOT_INIT,
+    BLOCK_POOL_DEPOT_INIT, BLOCK_POOL_DEPOT_INIT, BLOCK_POOL_DEPOT_INIT,
+    BLOCK_POOL_DEPOT_INIT, BLOCK_POOL_DEPOT_INIT,
+#undef BLOCK_POOL_DEPOT_INIT
+};
+static_assert (BLOCK_POOL_CLASSES == 8, "Fix the depot initializer");
+
+/* The pool is active while at least one LibVLC instance exists. Thread
+ * statistics are published to the metrics of every instance when exchanging
+ * with the depot.
+ *
+ * The thread variable is kept once created, so that the cache of a thread is
+ * released when the thread exits, even if the pool was torn down meanwhile:
+ * the caches of other threads cannot be freed from the last Deinit call. */
+static vlc_mutex_t block_pool_lock = VLC_STATIC_MUTEX;
+static struct vlc_list block_pool_instances =
+    VLC_LIST_INITIALIZER(&block_pool_instances);
+static unsigned block_pool_users;
+static bool block_pool_key_created;
+static atomic_uint block_pool_generation;
+
+struct block_pool_instance
+{
+    struct vlc_list node;
+    vlc_object_t *obj;
+    vlc_metric_t *hits;
+    vlc_metric_t *misses;
+};
+
+static thread_local struct block_pool_cache *block_pool_cache;
+static vlc_threadvar_t block_pool_key;
+
+static void block_pool_Put(struct block_pool_list *list, block_t *b)
+{
+    b->p_next = list->head;
+    list->head = b;
+    list->count++;
+}
+
+static block_t *block_pool_Take(struct block_pool_list *list)
+{
+    block_t *b = list->head;
+
+    if (b != NULL)
+    {
+        list->head = b->p_next;
+        list->count--;
+    }
+    return b;
+}
+
+static void block_pool_FlushStats(struct block_pool_cache *cache)
+{
+    struct block_pool_instance *inst;
+
+    if (cache->hits == 0 && cache->misses == 0)
+        return;
+
+    vlc_mutex_lock(&block_pool_lock);
+    vlc_list_foreach(inst, &block_pool_instances, node)
+    {
+        vlc_metric_Add(inst->hits, cache->hits);
+        vlc_metric_Add(inst->misses, cache->misses);
+    }
+    vlc_mutex_unlock(&block_pool_lock);
+    cache->hits = cache->misses = 0;
+}
+
+static void block_pool_FreeList(struct block_pool_list *list)
+{
+    block_t *b;
+
+    while ((b = block_pool_Take(list)) != NULL)
+        free(b);
+}
+
+static void block_pool_CacheFree(struct block_pool_cache *cache)
+{
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+        block_pool_FreeList(&cache->lists[c]);
+    free(cache);
+}
+
+static bool block_pool_IsStale(const struct block_pool_cache *cache)
+{
+    return cache->generation != atomic_load_explicit(&block_pool_generation,
+                                                     memory_order_relaxed);
+}
+
+/* Moves up to count blocks from the thread cache to the depot */
+static void block_pool_Drain(struct block_pool_cache *cache, unsigned c,
+                             unsigned count)
+{
+    struct block_pool_list *list = &cache->lists[c];
+    block_t *overflow = NULL;
+
+    vlc_mutex_lock(&block_pool_depot[c].lock);
+    /* The last Deinit call frees the depot after changing the generation,
+     * with the depot locked: blocks of a stale cache would leak there. */
+    const bool stale = block_pool_IsStale(cache);
+
+    while (count-- > 0 && list->count > 0)
+    {
+        block_t *b = block_pool_Take(list);
+
+        if (!stale
+         && block_pool_depot[c].list.count < BLOCK_POOL_DEPOT_MAX(c))
+            block_pool_Put(&block_pool_depot[c].list, b);
+        else
+        {
+            b->p_next = overflow;
+            overflow = b;
+        }
+    }
+    vlc_mutex_unlock(&block_pool_depot[c].lock);
+
+    while (overflow != NULL)
+    {
+        block_t *b = overflow;
+
+        overflow = b->p_next;
+        free(b);
+    }
+    block_pool_FlushStats(cache);
+}
+
+static void block_pool_CacheDestroy(void *data)
+{
+    struct block_pool_cache *cache = data;
+
+    if (block_pool_IsStale(cache))
+        block_pool_CacheFree(cache);
+    else
+    {
+        for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+            block_pool_Drain(cache, c, UINT_MAX);
+        free(cache);
+    }
+    block_pool_cache = NULL;
+}
+
+static struct block_pool_cache *block_pool_GetCache(void)
+{
+    struct block_pool_cache *cache = block_pool_cache;
+
+    if (likely(cache != NULL))
+    {
+        if (likely(!block_pool_IsStale(cache)))
+            return cache;
+
+        /* The pool was torn down since this thread last used it */
+        vlc_threadvar_set(block_pool_key, NULL);
+        block_pool_CacheFree(cache);
+        block_pool_cache = NULL;
+    }
+
+    cache = calloc(1, sizeof (*cache));
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    vlc_mutex_lock(&block_pool_lock);
+    cache->generation = atomic_load_explicit(&block_pool_generation,
+                                             memory_order_relaxed);
+    /* Register the cache to flush it when the thread exits */
+    if (block_pool_users == 0 || vlc_threadvar_set(block_pool_key, cache))
+    {
+        vlc_mutex_unlock(&block_pool_lock);
+        free(cache);
+        return NULL;
+    }
+    vlc_mutex_unlock(&block_pool_lock);
+    block_pool_cache = cache;
+    return cache;
+}
+
+static void block_pool_Release(block_t *block)
+{
+    const size_t size = sizeof (*block) + block->i_size;
+    const unsigned c = ctz(size) - BLOCK_POOL_MIN_SHIFT;
+
+    assert (block->p_start == (unsigned char *)(block + 1));
+    assert ((size & (size - 1)) == 0 && c < BLOCK_POOL_CLASSES);
+    block_Invalidate (block);
+
+    struct block_pool_cache *cache = block_pool_GetCache();
+    if (unlikely(cache == NULL))
+    {
+        free(block);
+        return;
+    }
+
+    block_pool_Put(&cache->lists[c], block);
+    if (cache->lists[c].count > BLOCK_POOL_CACHE_MAX(c))
+        block_pool_Drain(cache, c, BLOCK_POOL_CACHE_MAX(c) / 2);
+}
+
+/* Allocates a block of at least *size bytes, updates *size to the actual
+ * size. Returns NULL if the size is not pooled or on error. */
+static block_t *block_pool_Alloc(size_t *restrict size)
+{
+    if (*size > (1u << BLOCK_POOL_MAX_SHIFT))
+        return NULL;
+
+    unsigned shift = BLOCK_POOL_MIN_SHIFT;
+    if (*size > (1u << BLOCK_POOL_MIN_SHIFT))
+        shift = (sizeof (size_t) * CHAR_BIT) - clz(*size - 1);
+
+    const unsigned c = shift - BLOCK_POOL_MIN_SHIFT;
+    struct block_pool_cache *cache = block_pool_GetCache();
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    *size = (size_t)1 << shift;
+
+    block_t *b = block_pool_Take(&cache->lists[c]);
+    if (b != NULL)
+    {
+        cache->hits++;
+        return b;
+    }
+
+    /* Refill half of the cache from the depot */
+    vlc_mutex_lock(&block_pool_depot[c].lock);
+    for (unsigned i = 0; i < BLOCK_POOL_CACHE_MAX(c) / 2; i++)
+    {
+        b = block_pool_Take(&block_pool_depot[c].list);
+        if (b == NULL)
+            break;
+        block_pool_Put(&cache->lists[c], b);
+    }
+    vlc_mutex_unlock(&block_pool_depot[c].lock);
+
+    b = block_pool_Take(&cache->lists[c]);
+    if (b != NULL)
+        cache->hits++;
+    else
+    {
+        cache->misses++;
+        b = malloc(*size);
+    }
+    block_pool_FlushStats(cache);
+    return b;
+}
+#endif
+
+void vlc_block_pool_Init(vlc_object_t *obj)
+{
+#ifdef ENABLE_BLOCK_POOL
+    struct block_pool_instance *inst = malloc(sizeof (*inst));
+
+    if (likely(inst != NULL))
+    {
+        inst->obj = obj;
+        inst->hits = vlc_metric_Register(obj, VLC_METRIC_COUNTER,
+                                         "vlc_block_pool_hits_total",
+                                         "Data blocks allocated from the pool");
+        inst->misses = vlc_metric_Register(obj, VLC_METRIC_COUNTER,
+                                           "vlc_block_pool_misses_total",
+                                           "Data blocks allocated with malloc "
+                                           "because the pool was empty");
+    }
+
+    vlc_mutex_lock(&block_pool_lock);
+    if (!block_pool_key_created)
+    {
+        if (vlc_threadvar_create(&block_pool_key, block_pool_CacheDestroy))
+        {
+            vlc_mutex_unlock(&block_pool_lock);
+            free(inst);
+            msg_Err(obj, "block pool disabled");
+            return;
+        }
+        block_pool_key_created = true;
+    }
+    block_pool_users++;
+    if (likely(inst != NULL))
+        vlc_list_append(&inst->node, &block_pool_instances);
+    vlc_mutex_unlock(&block_pool_lock);
+#else
+    VLC_UNUSED(obj);
+#endif
+}
+
+void vlc_block_pool_Deinit(vlc_object_t *obj)
+{
+#ifdef ENABLE_BLOCK_POOL
+    struct block_pool_instance *inst;
+    bool last;
+
+    vlc_mutex_lock(&block_pool_lock);
+    vlc_list_foreach(inst, &block_pool_instances, node)
+        if (inst->obj == obj)
+        {
+            vlc_list_remove(&inst->node);
+            free(inst);
+            break;
+        }
+    assert(block_pool_users > 0);
+    last = --block_pool_users == 0;
+
+    if (last)
+    {   /* Stop pooling: the caches of the threads still alive are freed
+         * when they next allocate or release a block, or when they exit. */
+        atomic_fetch_add_explicit(&block_pool_generation, 1,
+                                  memory_order_relaxed);
+    }
+    vlc_mutex_unlock(&block_pool_lock);
+
+    if (!last)
+        return;
+
+    struct block_pool_cache *cache = block_pool_cache;
+    if (cache != NULL)
+    {
+        vlc_threadvar_set(block_pool_key, NULL);
+        block_pool_CacheFree(cache);
+        block_pool_cache = NULL;
+    }
+
+    for (unsigned c = 0; c < BLOCK_POOL_CLASSES; c++)
+    {
+        vlc_mutex_lock(&block_pool_depot[c].lock);
+        block_pool_FreeList(&block_pool_depot[c].list);
+        vlc_mutex_unlock(&block_pool_depot[c].lock);
+    }
+#else
+    VLC_UNUSED(obj);
+#endif
+}
+
 block_t *block_Alloc (size_t size)
 {
     if (unlikely(size >> 27))
@@ -126,25 +496,148 @@ block_t *block_Alloc (size_t size)
     }
 
     /* 2 * BLOCK_PADDING: pre + post padding */
-    const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
-                       + size;
+    size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
+                 + size;
     if (unlikely(alloc <= size))
         return NULL;
 
-    block_t *b = malloc (alloc);
-    if (unlikely(b == NULL))
-        return NULL;
+    block_t *b;
+#ifdef ENABLE_BLOCK_POOL
+    b = block_pool_Alloc (&alloc);
+    if (b != NULL)
+    {
+        block_Init (b, b + 1, alloc - sizeof (*b));
+        b->pf_release = block_pool_Release;
+    }
+    else
+#endif
+    {
+        b = malloc (alloc);
+        if (unlikely(b == NULL))
+            return NULL;
 
-    block_Init (b, b + 1, alloc - sizeof (*b));
+        block_Init (b, b + 1, alloc - sizeof (*b));
+        b->pf_release = block_generic_Release;
+    }
     static_assert ((BLOCK_PADDING % BLOCK_ALIGN) == 0,
                    "BLOCK_PADDING must be a multiple of BLOCK_ALIGN");
     b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
     b->p_buffer = (void *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));
     b->i_buffer = size;
-    b->pf_release = block_generic_Release;
     return b;
 }
 
+/* Shared blocks only own a header. The payload belongs to the original block,
+ * which is released along with the last reference. */
+struct block_shared_payload
+{
+    atomic_uint refs;
+    block_t *block;
+};
+
+typedef struct
+{
+    block_t self;
+    struct block_shared_payload *payload;
+} block_shared_t;
+
+static void block_shared_Release (block_t *block)
+{
+    struct block_shared_payload *payload =
+        ((block_shared_t *)block)->payload;
+
+    block_Invalidate (block);
+    free (block);
+
+    if (atomic_fetch_sub_explicit (&payload->refs, 1,
+                                   memory_order_acq_rel) == 1)
+    {
+        block_Release (payload->block);
+        free (payload);
+    }
+}
+
+/** Whether the payload is also referenced by other blocks */
+static bool block_shared_IsBusy (const block_t *block)
+{
+    if (block->pf_release != block_shared_Release)
+        return false;
+
+    const block_shared_t *sh = (const block_shared_t *)block;
+    return atomic_load_explicit (&sh->payload->refs,
+                                 memory_order_acquire) > 1;
+}
+
+block_t *block_shared_Alloc (block_t *block)
+{
+    if (block->pf_release == block_shared_Release)
+        return block;
+
+    block_shared_t *sh = malloc (sizeof (*sh));
+    struct block_shared_payload *payload = malloc (sizeof (*payload));
+    if (unlikely(sh == NULL || payload == NULL))
+    {
+        free (payload);
+        free (sh);
+        return NULL;
+    }
+
+    atomic_init (&payload->refs, 1);
+    payload->block = block;
+
+    block_Init (&sh->self, block->p_start, block->i_size);
+    sh->self.p_buffer = block->p_buffer;
+    sh->self.i_buffer = block->i_buffer;
+    BlockMetaCopy (&sh->self, block);
+    sh->self.pf_release = block_shared_Release;
+    sh->payload = payload;
+    block->p_next = NULL;
+    return &sh->self;
+}
+
+block_t *block_Duplicate (const block_t *block)
+{
+    if (block->pf_release == block_shared_Release)
+    {
+        const block_shared_t *sh = (const block_shared_t *)block;
+        block_shared_t *dup = malloc (sizeof (*dup));
+        if (unlikely(dup == NULL))
+            return NULL;
+
+        *dup = *sh;
+        dup->self.p_next = NULL;
+        atomic_fetch_add_explicit (&sh->payload->refs, 1,
+                                   memory_order_relaxed);
+        return &dup->self;
+    }
+
+    block_t *dup = block_Alloc (block->i_buffer);
+    if (unlikely(dup == NULL))
+        return NULL;
+
+    block_CopyProperties (dup, block);
+    memcpy (dup->p_buffer, block->p_buffer, block->i_buffer);
+    return dup;
+}
+
+block_t *block_MakeWritable (block_t *block)
+{
+    if (!block_shared_IsBusy (block))
+        return block;
+
+    block_t *copy = block_Alloc (block->i_buffer);
+    if (unlikely(copy == NULL))
+    {
+        block_Release (block);
+        return NULL;
+    }
+
+    memcpy (copy->p_buffer, block->p_buffer, block->i_buffer);
+    BlockMetaCopy (copy, block);
+    block_Release (block);
+    return copy;
+}
+
 block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
 {
     block_Check( p_block );
@@ -178,10 +671,12 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
         p_block->i_buffer = i_body;
 
     size_t requested = i_prebody + i_body;
+    /* Spare buffer space cannot be written to if the payload is shared */
+    const bool b_shared = block_shared_IsBusy( p_block );
 
     if( p_block->i_buffer == 0 )
     {   /* Corner case: nothing to preserve */
-        if( requested <= p_block->i_size )
+        if( requested <= p_block->i_size && (requested == 0 || !b_shared) )
         {   /* Enough room: recycle buffer */
             size_t extra = p_block->i_size - requested;
 
@@ -206,7 +701,8 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
     /* Second, reallocate the buffer if we lack space. */
     assert( i_prebody >= 0 );
     if( (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
-     || (size_t)(p_end - p_block->p_buffer) < i_body )
+     || (size_t)(p_end - p_block->p_buffer) < i_body
+     || (b_shared && (i_prebody > 0 || i_body > p_block->i_buffer)) )
     {
         block_t *p_rea = block_Alloc( requested );
         if( p_rea == NULL )
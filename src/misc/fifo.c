@@ -44,8 +44,21 @@ struct block_fifo_t
     block_t             **pp_last;
     size_t              i_depth;
     size_t              i_size;
+
+    /* Thresholds of the batched consumer waiting in block_FifoGetBatch()
+     * (zero if none: wake up on every queued block). There is a single set
+     * of thresholds per FIFO, so only one thread may wait for a batch with a
+     * deadline at a time. */
+    size_t              i_wake_depth;
+    size_t              i_wake_size;
 };
 
+static bool vlc_fifo_Above(const vlc_fifo_t *fifo, size_t depth, size_t size)
+{
+    return (depth != 0 && fifo->i_depth >= depth)
+        || (size != 0 && fifo->i_size >= size);
+}
+
 void vlc_fifo_Lock(vlc_fifo_t *fifo)
 {
     vlc_mutex_lock(&fifo->lock);
@@ -102,7 +115,10 @@ void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
         block = block->p_next;
     }
 
-    vlc_fifo_Signal(fifo);
+    /* Do not wake a batched consumer up before its batch is complete */
+    if ((fifo->i_wake_depth == 0 && fifo->i_wake_size == 0)
+     || vlc_fifo_Above(fifo, fifo->i_wake_depth, fifo->i_wake_size))
+        vlc_fifo_Signal(fifo);
 }
 
 block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
@@ -127,6 +143,45 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
     return block;
 }
 
+block_t *vlc_fifo_DequeueBatchUnlocked(vlc_fifo_t *fifo, size_t max_depth,
+                                       size_t max_size)
+{
+    vlc_assert_locked(&fifo->lock);
+
+    block_t *first = fifo->p_first, **pp = &fifo->p_first;
+    size_t depth = 0, size = 0;
+
+    /* The first block is always dequeued, even if it exceeds the limits */
+    while (*pp != NULL)
+    {
+        block_t *block = *pp;
+
+        if (depth > 0
+         && ((max_depth != 0 && depth >= max_depth)
+          || (max_size != 0 && size + block->i_buffer > max_size)))
+            break;
+
+        depth++;
+        size += block->i_buffer;
+        pp = &block->p_next;
+    }
+
+    if (depth == 0)
+        return NULL;
+
+    fifo->p_first = *pp;
+    if (*pp == NULL)
+        fifo->pp_last = &fifo->p_first;
+    *pp = NULL;
+
+    assert(fifo->i_depth >= depth);
+    fifo->i_depth -= depth;
+    assert(fifo->i_size >= size);
+    fifo->i_size -= size;
+
+    return first;
+}
+
 block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
@@ -152,6 +207,7 @@ block_fifo_t *block_FifoNew( void )
     p_fifo->p_first = NULL;
     p_fifo->pp_last = &p_fifo->p_first;
     p_fifo->i_depth = p_fifo->i_size = 0;
+    p_fifo->i_wake_depth = p_fifo->i_wake_size = 0;
 
     return p_fifo;
 }
@@ -200,6 +256,51 @@ block_t *block_FifoGet(block_fifo_t *fifo)
     return block;
 }
 
+static void block_FifoBatchCleanup(void *data)
+{
+    vlc_fifo_t *fifo = data;
+
+    fifo->i_wake_depth = fifo->i_wake_size = 0;
+    vlc_fifo_Unlock(fifo);
+}
+
+block_t *block_FifoGetBatch(block_fifo_t *fifo, size_t max_depth,
+                            size_t max_size, vlc_tick_t deadline)
+{
+    block_t *block;
+
+    vlc_testcancel();
+
+    vlc_fifo_Lock(fifo);
+    if (deadline != VLC_TICK_INVALID)
+    {   /* Wait for a complete batch, or until the deadline */
+        assert(fifo->i_wake_depth == 0 && fifo->i_wake_size == 0);
+        fifo->i_wake_depth = max_depth;
+        fifo->i_wake_size = max_size;
+        vlc_cleanup_push(block_FifoBatchCleanup, fifo);
+
+        while ((max_depth != 0 || max_size != 0)
+             ? !vlc_fifo_Above(fifo, max_depth, max_size)
+             : vlc_fifo_IsEmpty(fifo))
+            if (vlc_fifo_TimedWaitCond(fifo, &fifo->wait, deadline))
+                break;
+
+        vlc_cleanup_pop();
+        fifo->i_wake_depth = fifo->i_wake_size = 0;
+    }
+    else
+    {
+        vlc_fifo_CleanupPush(fifo);
+        while (vlc_fifo_IsEmpty(fifo))
+            vlc_fifo_Wait(fifo);
+        vlc_cleanup_pop();
+    }
+    block = vlc_fifo_DequeueBatchUnlocked(fifo, max_depth, max_size);
+    vlc_fifo_Unlock(fifo);
+
+    return block;
+}
+
 block_t *block_FifoShow( block_fifo_t *p_fifo )
 {
     block_t *b;
@@ -0,0 +1,325 @@
+/*****************************************************************************
+ * metrics.c: run-time metrics
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_list.h>
+#include <vlc_memstream.h>
+#include <vlc_metrics.h>
+#include "libvlc.h"
+
+/* Upper bounds of the histogram buckets, the last bucket being unbounded */
+static const vlc_tick_t bounds[] =
+{
+    VLC_TICK_FROM_US(100), VLC_TICK_FROM_US(250), VLC_TICK_FROM_US(500),
+    VLC_TICK_FROM_MS(1), VLC_TICK_FROM_US(2500), VLC_TICK_FROM_MS(5),
+    VLC_TICK_FROM_MS(10), VLC_TICK_FROM_MS(25), VLC_TICK_FROM_MS(50),
+    VLC_TICK_FROM_MS(100), VLC_TICK_FROM_MS(250), VLC_TICK_FROM_MS(500),
+    VLC_TICK_FROM_SEC(1), VLC_TICK_FROM_MS(2500), VLC_TICK_FROM_SEC(5),
+    VLC_TICK_FROM_SEC(10),
+};
+
+#define METRIC_BUCKETS (ARRAY_SIZE(bounds) + 1)
+
+struct vlc_metric
+{
+    struct vlc_list node;
+    enum vlc_metric_type type;
+    char *name;
+    char *help;
+    size_t family_len; /**< Length of the name without the labels */
+
+    atomic_int_least64_t value; /**< Counter or gauge value, histogram sum */
+    atomic_uint_least64_t buckets[METRIC_BUCKETS];
+};
+
+struct vlc_metrics
+{
+    vlc_mutex_t lock;
+    struct vlc_list list; /**< Metrics, sorted by family then name */
+};
+
+struct vlc_metrics *vlc_metrics_Create(void)
+{
+    struct vlc_metrics *metrics = malloc(sizeof (*metrics));
+    if (unlikely(metrics == NULL))
+        return NULL;
+
+    vlc_mutex_init(&metrics->lock);
+    vlc_list_init(&metrics->list);
+    return metrics;
+}
+
+void vlc_metrics_Destroy(struct vlc_metrics *metrics)
+{
+    vlc_metric_t *metric;
+
+    vlc_list_foreach(metric, &metrics->list, node)
+    {
+        free(metric->help);
+        free(metric->name);
+        free(metric);
+    }
+
+    vlc_mutex_destroy(&metrics->lock);
+    free(metrics);
+}
+
+static int vlc_metric_cmp(const char *name, size_t family_len,
+                          const vlc_metric_t *metric)
+{
+    size_t len = __MIN(family_len, metric->family_len);
+    int ret = strncmp(name, metric->name, len);
+
+    if (ret == 0)
+        ret = (family_len > metric->family_len)
+            - (family_len < metric->family_len);
+    if (ret == 0)
+        ret = strcmp(name, metric->name);
+    return ret;
+}
+
+#undef vlc_metric_Register
+vlc_metric_t *vlc_metric_Register(vlc_object_t *obj, enum vlc_metric_type type,
+                                  const char *name, const char *help)
+{
+    struct vlc_metrics *metrics = libvlc_priv(obj->obj.libvlc)->metrics;
+    vlc_metric_t *metric, *next = NULL;
+    size_t family_len = strcspn(name, "{");
+
+    if (unlikely(metrics == NULL))
+        return NULL;
+
+    vlc_mutex_lock(&metrics->lock);
+    vlc_list_foreach(metric, &metrics->list, node)
+    {
+        int cmp = vlc_metric_cmp(name, family_len, metric);
+
+        if (cmp == 0 && type == metric->type)
+            goto out;
+
+        if (family_len == metric->family_len
+         && strncmp(name, metric->name, family_len) == 0
+         && type != metric->type)
+        {
+            msg_Err(obj, "metric %s type mismatch", name);
+            metric = NULL;
+            goto out;
+        }
+
+        if (cmp < 0)
+        {
+            next = metric;
+            break;
+        }
+    }
+
+    metric = malloc(sizeof (*metric));
+    if (unlikely(metric == NULL))
+        goto out;
+
+    metric->type = type;
+    metric->name = strdup(name);
+    metric->help = strdup(help);
+    metric->family_len = family_len;
+    atomic_init(&metric->value, 0);
+    for (size_t i = 0; i < METRIC_BUCKETS; i++)
+        atomic_init(&metric->buckets[i], 0);
+
+    if (unlikely(metric->name == NULL || metric->help == NULL))
+    {
+        free(metric->help);
+        free(metric->name);
+        free(metric);
+        metric = NULL;
+        goto out;
+    }
+
+    if (next != NULL)
+        vlc_list_add_before(&metric->node, &next->node);
+    else
+        vlc_list_append(&metric->node, &metrics->list);
+out:
+    vlc_mutex_unlock(&metrics->lock);
+    return metric;
+}
+
+void vlc_metric_Add(vlc_metric_t *metric, int64_t delta)
+{
+    if (metric == NULL)
+        return;
+
+    assert(metric->type != VLC_METRIC_HISTOGRAM);
+    assert(metric->type != VLC_METRIC_COUNTER || delta >= 0);
+    atomic_fetch_add_explicit(&metric->value, delta, memory_order_relaxed);
+}
+
+void vlc_metric_Set(vlc_metric_t *metric, int64_t value)
+{
+    if (metric == NULL)
+        return;
+
+    assert(metric->type == VLC_METRIC_GAUGE);
+    atomic_store_explicit(&metric->value, value, memory_order_relaxed);
+}
+
+void vlc_metric_Observe(vlc_metric_t *metric, vlc_tick_t duration)
+{
+    if (metric == NULL)
+        return;
+
+    assert(metric->type == VLC_METRIC_HISTOGRAM);
+
+    size_t i = 0;
+
+    if (duration < 0)
+        duration = 0;
+    while (i < ARRAY_SIZE(bounds) && duration > bounds[i])
+        i++;
+
+    atomic_fetch_add_explicit(&metric->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metric->value, duration, memory_order_relaxed);
+}
+
+/* Prints a duration in seconds, independently of the locale */
+static void vlc_metrics_PrintSeconds(struct vlc_memstream *ms, vlc_tick_t t)
+{
+    lldiv_t d = lldiv(t, CLOCK_FREQ);
+    char frac[16];
+
+    if (d.rem == 0)
+    {
+        vlc_memstream_printf(ms, "%lld", d.quot);
+        return;
+    }
+
+    /* Fractional part with trailing zeroes removed */
+    size_t len = snprintf(frac, sizeof (frac), "%06lld",
+                          d.rem * 1000000LL / CLOCK_FREQ);
+    while (len > 1 && frac[len - 1] == '0')
+        frac[--len] = '\0';
+    vlc_memstream_printf(ms, "%lld.%s", d.quot, frac);
+}
+
+static void vlc_metrics_PrintHelp(struct vlc_memstream *ms,
+                                  const vlc_metric_t *metric)
+{
+    static const char *const types[] = {
+        [VLC_METRIC_COUNTER] = "counter",
+        [VLC_METRIC_GAUGE] = "gauge",
+        [VLC_METRIC_HISTOGRAM] = "histogram",
+    };
+
+    vlc_memstream_printf(ms, "# HELP %.*s ", (int)metric->family_len,
+                         metric->name);
+    for (const char *p = metric->help; *p != '\0'; p++)
+        switch (*p)
+        {
+            case '\\':
+                vlc_memstream_puts(ms, "\\\\");
+                break;
+            case '\n':
+                vlc_memstream_puts(ms, "\\n");
+                break;
+            default:
+                vlc_memstream_putc(ms, *p);
+        }
+
+    vlc_memstream_printf(ms, "\n# TYPE %.*s %s\n", (int)metric->family_len,
+                         metric->name, types[metric->type]);
+}
+
+static void vlc_metrics_PrintHistogram(struct vlc_memstream *ms,
+                                       const vlc_metric_t *metric)
+{
+    const char *family = metric->name;
+    int len = metric->family_len;
+    const char *labels = metric->name + len;
+    int labels_len = 0;
+
+    /* Labels without the braces */
+    if (*labels == '{')
+    {
+        labels++;
+        labels_len = strcspn(labels, "}");
+    }
+
+    uint_least64_t count = 0;
+
+    for (size_t i = 0; i < METRIC_BUCKETS; i++)
+    {
+        count += atomic_load_explicit(&metric->buckets[i],
+                                      memory_order_relaxed);
+
+        vlc_memstream_printf(ms, "%.*s_bucket{%.*s%sle=\"", len, family,
+                             labels_len, labels, labels_len ? "," : "");
+        if (i < ARRAY_SIZE(bounds))
+            vlc_metrics_PrintSeconds(ms, bounds[i]);
+        else
+            vlc_memstream_puts(ms, "+Inf");
+        vlc_memstream_printf(ms, "\"} %"PRIuLEAST64"\n", count);
+    }
+
+    vlc_memstream_printf(ms, "%.*s_sum%s ", len, family, metric->name + len);
+    vlc_metrics_PrintSeconds(ms, atomic_load_explicit(&metric->value,
+                                                      memory_order_relaxed));
+    vlc_memstream_printf(ms, "\n%.*s_count%s %"PRIuLEAST64"\n", len, family,
+                         metric->name + len, count);
+}
+
+#undef vlc_metrics_Export
+char *vlc_metrics_Export(vlc_object_t *obj)
+{
+    struct vlc_metrics *metrics = libvlc_priv(obj->obj.libvlc)->metrics;
+    const vlc_metric_t *metric, *prev = NULL;
+    struct vlc_memstream ms;
+
+    if (unlikely(metrics == NULL) || vlc_memstream_open(&ms))
+        return NULL;
+
+    vlc_mutex_lock(&metrics->lock);
+    vlc_list_foreach(metric, &metrics->list, node)
+    {
+        if (prev == NULL || prev->family_len != metric->family_len
+         || strncmp(prev->name, metric->name, metric->family_len))
+            vlc_metrics_PrintHelp(&ms, metric);
+        prev = metric;
+
+        if (metric->type == VLC_METRIC_HISTOGRAM)
+            vlc_metrics_PrintHistogram(&ms, metric);
+        else
+            vlc_memstream_printf(&ms, "%s %"PRIdLEAST64"\n", metric->name,
+                                 atomic_load_explicit(&metric->value,
+                                                      memory_order_relaxed));
+    }
+    vlc_mutex_unlock(&metrics->lock);
+
+    if (vlc_memstream_close(&ms))
+        return NULL;
+    return ms.ptr;
+}
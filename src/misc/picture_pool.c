@@ -34,19 +34,27 @@
 #include <vlc_picture_pool.h>
 #include "picture.h"
 
-#define POOL_MAX (CHAR_BIT * sizeof (unsigned long long))
+#define POOL_WORD_BITS (CHAR_BIT * sizeof (unsigned long long))
+#define POOL_MAX 1024
+#define POOL_WORDS (POOL_MAX / POOL_WORD_BITS)
 
 static_assert ((POOL_MAX & (POOL_MAX - 1)) == 0, "Not a power of two");
+static_assert ((POOL_MAX % POOL_WORD_BITS) == 0, "Not a multiple of words");
 
+/* The free pictures are tracked in a bitmap updated with atomic operations,
+ * so that getting and releasing pictures does not lock the pool.
+ * The mutex and the condition variable are only used to wait for a picture:
+ * releasers signal the condition only if there are waiters. */
 struct picture_pool_t {
     int       (*pic_lock)(picture_t *);
     void      (*pic_unlock)(picture_t *);
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
-    bool               canceled;
-    unsigned long long available;
-    atomic_ushort      refs;
+    atomic_bool        canceled;
+    atomic_uint        waiters;
+    atomic_ullong      available[POOL_WORDS];
+    atomic_uint        refs;
     unsigned short     picture_count;
     picture_t  *picture[];
 };
@@ -69,6 +77,50 @@ void picture_pool_Release(picture_pool_t *pool)
     picture_pool_Destroy(pool);
 }
 
+/* Marks a picture as available again */
+static void picture_pool_Put(picture_pool_t *pool, unsigned offset)
+{
+    unsigned long long bit = 1ULL << (offset % POOL_WORD_BITS);
+    unsigned long long prev;
+
+    prev = atomic_fetch_or(&pool->available[offset / POOL_WORD_BITS], bit);
+    assert(!(prev & bit));
+    (void) prev;
+
+    /* Pairs with the fence after the waiters increment in
+     * picture_pool_Wait(): either the waiter sees the picture, or we see the
+     * waiter. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&pool->waiters) > 0) {
+        vlc_mutex_lock(&pool->lock);
+        vlc_cond_signal(&pool->wait);
+        vlc_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Takes the first available picture, returns its offset or -1 if none */
+static int picture_pool_Take(picture_pool_t *pool)
+{
+    unsigned words = (pool->picture_count + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+
+    for (unsigned w = 0; w < words; w++) {
+        atomic_ullong *word = &pool->available[w];
+        unsigned long long available =
+            atomic_load_explicit(word, memory_order_relaxed);
+
+        while (available != 0) {
+            unsigned long long bit = 1ULL << ctz(available);
+
+            available = atomic_fetch_and_explicit(word, ~bit,
+                                                  memory_order_acquire);
+            if (available & bit)
+                return w * POOL_WORD_BITS + ctz(bit);
+            /* Lost the race for this picture, retry with the new value */
+        }
+    }
+    return -1;
+}
+
 static void picture_pool_ReleasePicture(picture_t *clone)
 {
     picture_priv_t *priv = (picture_priv_t *)clone;
@@ -83,12 +135,7 @@ static void picture_pool_ReleasePicture(picture_t *clone)
         pool->pic_unlock(picture);
     picture_Release(picture);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(!(pool->available & (1ULL << offset)));
-    pool->available |= 1ULL << offset;
-    vlc_cond_signal(&pool->wait);
-    vlc_mutex_unlock(&pool->lock);
-
+    picture_pool_Put(pool, offset);
     picture_pool_Destroy(pool);
 }
 
@@ -133,15 +180,19 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
     pool->pic_unlock = cfg->unlock;
     vlc_mutex_init(&pool->lock);
     vlc_cond_init(&pool->wait);
-    if (cfg->picture_count == POOL_MAX)
-        pool->available = ~0ULL;
-    else
-        pool->available = (1ULL << cfg->picture_count) - 1;
+    for (unsigned w = 0, left = cfg->picture_count; w < POOL_WORDS; w++) {
+        unsigned n = __MIN(left, POOL_WORD_BITS);
+
+        atomic_init(&pool->available[w],
+                    n ? ~0ULL >> (POOL_WORD_BITS - n) : 0);
+        left -= n;
+    }
+    atomic_init(&pool->waiters, 0);
     atomic_init(&pool->refs,  1);
     pool->picture_count = cfg->picture_count;
     memcpy(pool->picture, cfg->picture,
            cfg->picture_count * sizeof (picture_t *));
-    pool->canceled = false;
+    atomic_init(&pool->canceled, false);
     return pool;
 }
 
@@ -204,69 +255,71 @@ error:
 
 picture_t *picture_pool_Get(picture_pool_t *pool)
 {
-    unsigned long long available;
+    assert(atomic_load_explicit(&pool->refs, memory_order_relaxed) > 0);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
-    available = pool->available;
+    /* Pictures that failed to lock are kept out of the pool until the end,
+     * so that the other ones get tried */
+    unsigned long long failed[POOL_WORDS] = { 0 };
+    picture_t *clone = NULL;
+    int i;
 
-    while (available != 0)
+    while (likely(!atomic_load_explicit(&pool->canceled, memory_order_relaxed))
+        && (i = picture_pool_Take(pool)) >= 0)
     {
-        int i = ctz(available);
-
-        if (unlikely(pool->canceled))
-            break;
-
-        pool->available &= ~(1ULL << i);
-        vlc_mutex_unlock(&pool->lock);
-        available &= ~(1ULL << i);
-
         picture_t *picture = pool->picture[i];
 
         if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-            vlc_mutex_lock(&pool->lock);
-            pool->available |= 1ULL << i;
+            failed[i / POOL_WORD_BITS] |= 1ULL << (i % POOL_WORD_BITS);
             continue;
         }
 
-        picture_t *clone = picture_pool_ClonePicture(pool, i);
+        clone = picture_pool_ClonePicture(pool, i);
         if (clone != NULL) {
             assert(clone->p_next == NULL);
             atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
         }
-        return clone;
+        break;
     }
 
-    vlc_mutex_unlock(&pool->lock);
-    return NULL;
+    for (unsigned w = 0; w < POOL_WORDS; w++)
+        while (failed[w] != 0) {
+            unsigned bit = ctz(failed[w]);
+
+            failed[w] &= ~(1ULL << bit);
+            picture_pool_Put(pool, w * POOL_WORD_BITS + bit);
+        }
+    return clone;
 }
 
 picture_t *picture_pool_Wait(picture_pool_t *pool)
 {
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load_explicit(&pool->refs, memory_order_relaxed) > 0);
 
-    while (pool->available == 0)
+    int i = picture_pool_Take(pool);
+    if (i < 0)
     {
-        if (pool->canceled)
+        vlc_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->waiters, 1);
+        /* Pairs with the fence in picture_pool_Put() */
+        atomic_thread_fence(memory_order_seq_cst);
+
+        while ((i = picture_pool_Take(pool)) < 0)
         {
-            vlc_mutex_unlock(&pool->lock);
-            return NULL;
+            if (atomic_load_explicit(&pool->canceled, memory_order_relaxed))
+                break;
+            vlc_cond_wait(&pool->wait, &pool->lock);
         }
-        vlc_cond_wait(&pool->wait, &pool->lock);
-    }
 
-    int i = ctz(pool->available);
-    pool->available &= ~(1ULL << i);
-    vlc_mutex_unlock(&pool->lock);
+        atomic_fetch_sub(&pool->waiters, 1);
+        vlc_mutex_unlock(&pool->lock);
+        if (i < 0)
+            return NULL;
+    }
 
     picture_t *picture = pool->picture[i];
 
     if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-        vlc_mutex_lock(&pool->lock);
-        pool->available |= 1ULL << i;
-        vlc_cond_signal(&pool->wait);
-        vlc_mutex_unlock(&pool->lock);
+        picture_pool_Put(pool, i);
         return NULL;
     }
 
@@ -281,9 +334,9 @@ picture_t *picture_pool_Wait(picture_pool_t *pool)
 void picture_pool_Cancel(picture_pool_t *pool, bool canceled)
 {
     vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load_explicit(&pool->refs, memory_order_relaxed) > 0);
 
-    pool->canceled = canceled;
+    atomic_store_explicit(&pool->canceled, canceled, memory_order_relaxed);
     if (canceled)
         vlc_cond_broadcast(&pool->wait);
     vlc_mutex_unlock(&pool->lock);
@@ -87,7 +87,13 @@ static void vlc_modcap_sort(const void *node, const VISIT which,
     if (which != postorder && which != leaf)
         return;
 
-    qsort(cap->modv, cap->modc, sizeof (*cap->modv), vlc_module_cmp);
+    /* Modules from the plugins cache come already sorted */
+    for (size_t i = 1; i < cap->modc; i++)
+        if (vlc_module_cmp(cap->modv + i - 1, cap->modv + i) > 0)
+        {
+            qsort(cap->modv, cap->modc, sizeof (*cap->modv), vlc_module_cmp);
+            break;
+        }
     (void) depth;
 }
 
@@ -102,14 +108,13 @@ static struct
 vlc_plugin_t *vlc_plugins = NULL;
 
 /**
- * Adds a module to the bank
+ * Looks up a capability in the bank, adding it if needed
  */
-static int vlc_module_store(module_t *mod)
+static vlc_modcap_t *vlc_modcap_get(const char *name)
 {
-    const char *name = module_get_capability(mod);
     vlc_modcap_t *cap = malloc(sizeof (*cap));
     if (unlikely(cap == NULL))
-        return -1;
+        return NULL;
 
     cap->name = strdup(name);
     cap->modv = NULL;
@@ -127,6 +132,20 @@ static int vlc_module_store(module_t *mod)
         vlc_modcap_free(cap);
         cap = *cp;
     }
+    return cap;
+error:
+    vlc_modcap_free(cap);
+    return NULL;
+}
+
+/**
+ * Adds a module to the bank
+ */
+static int vlc_module_store(module_t *mod)
+{
+    vlc_modcap_t *cap = vlc_modcap_get(module_get_capability(mod));
+    if (unlikely(cap == NULL))
+        return -1;
 
     module_t **modv = realloc(cap->modv, sizeof (*modv) * (cap->modc + 1));
     if (unlikely(modv == NULL))
@@ -136,20 +155,25 @@ static int vlc_module_store(module_t *mod)
     cap->modv[cap->modc] = mod;
     cap->modc++;
     return 0;
-error:
-    vlc_modcap_free(cap);
-    return -1;
 }
 
 /**
- * Adds a plugin (and all its modules) to the bank
+ * Adds a plugin (but not its modules) to the bank
  */
-static void vlc_plugin_store(vlc_plugin_t *lib)
+static void vlc_plugin_link(vlc_plugin_t *lib)
 {
     /*vlc_assert_locked (&modules.lock);*/
 
     lib->next = vlc_plugins;
     vlc_plugins = lib;
+}
+
+/**
+ * Adds a plugin (and all its modules) to the bank
+ */
+static void vlc_plugin_store(vlc_plugin_t *lib)
+{
+    vlc_plugin_link(lib);
 
     for (module_t *m = lib->module; m != NULL; m = m->next)
         vlc_module_store(m);
@@ -257,9 +281,43 @@ typedef struct module_bank
 
     size_t        size;
     vlc_plugin_t **plugins;
-    vlc_plugin_t *cache;
+    vlc_plugin_cache_t *cache;
+
+    size_t        dirs_count;
+    struct vlc_cache_dir *dirs; /**< Browsed directories (to be saved) */
 } module_bank_t;
 
+/**
+ * Adds the modules of the plug-ins taken out of a cache to the bank.
+ *
+ * The cache provides the modules already grouped by capability, so each
+ * capability is only looked up and extended once.
+ */
+static void vlc_cache_store(const vlc_plugin_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->caps_count; i++)
+    {
+        const struct vlc_cache_cap *cc = cache->caps + i;
+        vlc_modcap_t *cap = vlc_modcap_get(cc->name);
+        if (unlikely(cap == NULL))
+            continue;
+
+        module_t **modv = realloc(cap->modv,
+                                  sizeof (*modv) * (cap->modc + cc->modc));
+        if (unlikely(modv == NULL))
+            continue;
+
+        cap->modv = modv;
+        for (size_t j = 0; j < cc->modc; j++)
+        {
+            const struct vlc_cache_module *cm = cache->modules + cc->modv[j];
+
+            if (cache->used[cm->plugin])
+                cap->modv[cap->modc++] = cm->module;
+        }
+    }
+}
+
 /**
  * Scans a plug-in from a file.
  */
@@ -269,38 +327,25 @@ static int AllocatePluginFile (module_bank_t *bank, const char *abspath,
     vlc_plugin_t *plugin = NULL;
 
     /* Check our plugins cache first then load plugin if needed */
-    if (bank->mode & CACHE_READ_FILE)
-    {
-        plugin = vlc_cache_lookup(&bank->cache, relpath);
+    if (bank->cache != NULL)
+        plugin = vlc_cache_lookup(bank->cache, relpath, st->st_mtime,
+                                  st->st_size);
 
-        if (plugin != NULL
-         && (plugin->mtime != (int64_t)st->st_mtime
-          || plugin->size != (uint64_t)st->st_size))
-        {
-            msg_Err(bank->obj, "stale plugins cache: modified %s",
-                    plugin->abspath);
-            vlc_plugin_destroy(plugin);
-            plugin = NULL;
-        }
-    }
-
-    if (plugin == NULL)
+    if (plugin != NULL)
+        /* The modules are stored along with the rest of the cache */
+        vlc_plugin_link(plugin);
+    else
     {
         plugin = module_InitDynamic(bank->obj, abspath, true);
+        if (plugin == NULL)
+            return -1;
 
-        if (plugin != NULL)
-        {
-            plugin->path = xstrdup(relpath);
-            plugin->mtime = st->st_mtime;
-            plugin->size = st->st_size;
-        }
+        plugin->path = xstrdup(relpath);
+        plugin->mtime = st->st_mtime;
+        plugin->size = st->st_size;
+        vlc_plugin_store(plugin);
     }
 
-    if (plugin == NULL)
-        return -1;
-
-    vlc_plugin_store(plugin);
-
     if (bank->mode & CACHE_WRITE_FILE) /* Add entry to to-be-saved cache */
     {
         bank->plugins = xrealloc(bank->plugins,
@@ -313,11 +358,45 @@ static int AllocatePluginFile (module_bank_t *bank, const char *abspath,
     return  0;
 }
 
+/**
+ * Checks whether the directories browsed for a plugins cache are unchanged.
+ *
+ * Adding, removing or renaming a plug-in updates the modification time of its
+ * directory, so the cache can then be used without browsing it again.
+ */
+static bool vlc_cache_is_current(const vlc_plugin_cache_t *cache,
+                                 const char *base)
+{
+    if (cache->dirs_count == 0)
+        return false;
+
+    for (size_t i = 0; i < cache->dirs_count; i++)
+    {
+        const struct vlc_cache_dir *dir = cache->dirs + i;
+        char *abspath;
+        struct stat st;
+
+        if (dir->path == NULL)
+            abspath = strdup(base);
+        else if (asprintf(&abspath, "%s"DIR_SEP"%s", base, dir->path) == -1)
+            abspath = NULL;
+        if (unlikely(abspath == NULL))
+            return false;
+
+        int val = vlc_stat(abspath, &st);
+        free(abspath);
+        if (val == -1 || !S_ISDIR(st.st_mode) || st.st_mtime != dir->mtime)
+            return false;
+    }
+    return true;
+}
+
 /**
  * Recursively browses a directory to look for plug-ins.
  */
 static void AllocatePluginDir (module_bank_t *bank, unsigned maxdepth,
-                               const char *absdir, const char *reldir)
+                               const char *absdir, const char *reldir,
+                               int64_t mtime)
 {
     if (maxdepth == 0)
         return;
@@ -327,6 +406,16 @@ static void AllocatePluginDir (module_bank_t *bank, unsigned maxdepth,
     if (dh == NULL)
         return;
 
+    if (bank->mode & CACHE_WRITE_FILE) /* Add entry to to-be-saved cache */
+    {
+        bank->dirs = xrealloc(bank->dirs,
+                              (bank->dirs_count + 1) * sizeof (*bank->dirs));
+        bank->dirs[bank->dirs_count].path = (reldir != NULL) ? xstrdup(reldir)
+                                                             : NULL;
+        bank->dirs[bank->dirs_count].mtime = mtime;
+        bank->dirs_count++;
+    }
+
     /* Parse the directory and try to load all files it contains. */
     for (;;)
     {
@@ -382,7 +471,8 @@ static void AllocatePluginDir (module_bank_t *bank, unsigned maxdepth,
         }
         else if (S_ISDIR (st.st_mode))
             /* Recurse into another directory */
-            AllocatePluginDir (bank, maxdepth, abspath, relpath);
+            AllocatePluginDir (bank, maxdepth, abspath, relpath,
+                               st.st_mtime);
     skip:
         free (relpath);
         free (abspath);
@@ -402,6 +492,9 @@ static void AllocatePluginPath(vlc_object_t *obj, const char *path,
         .obj = obj,
         .base = path,
         .mode = mode,
+        .cache = NULL,
+        .dirs_count = 0,
+        .dirs = NULL,
     };
 
     if (mode & CACHE_READ_FILE)
@@ -409,29 +502,49 @@ static void AllocatePluginPath(vlc_object_t *obj, const char *path,
     else
         msg_Dbg(bank.obj, "ignoring plugins cache file");
 
+    /* Nothing to browse for if the cache is up to date */
+    if ((mode & CACHE_SCAN_DIR) && !(mode & CACHE_WRITE_FILE)
+     && bank.cache != NULL && vlc_cache_is_current(bank.cache, path))
+    {
+        msg_Dbg(obj, "plugins cache of `%s' is up to date", bank.base);
+        mode &= ~CACHE_SCAN_DIR;
+    }
+
     if (mode & CACHE_SCAN_DIR)
     {
+        struct stat st;
+
         msg_Dbg(obj, "recursively browsing `%s'", bank.base);
 
         /* Don't go deeper than 5 subdirectories */
-        AllocatePluginDir(&bank, 5, path, NULL);
+        if (vlc_stat(path, &st) == 0)
+            AllocatePluginDir(&bank, 5, path, NULL, st.st_mtime);
     }
 
-    /* Deal with unmatched cache entries from cache file */
-    while (bank.cache != NULL)
+    if (bank.cache != NULL)
     {
-        vlc_plugin_t *plugin = bank.cache;
-
-        bank.cache = plugin->next;
-        if (mode & CACHE_SCAN_DIR)
-            vlc_plugin_destroy(plugin);
-        else
-            vlc_plugin_store(plugin);
+        vlc_plugin_cache_t *cache = bank.cache;
+
+        /* Deal with unmatched cache entries from cache file */
+        if (!(mode & CACHE_SCAN_DIR))
+            for (size_t i = 0; i < cache->count; i++)
+                if (!cache->used[i])
+                {
+                    cache->used[i] = true;
+                    vlc_plugin_link(cache->plugins[i]);
+                }
+
+        vlc_cache_store(cache);
+        vlc_cache_free(cache);
     }
 
     if (mode & CACHE_WRITE_FILE)
-        CacheSave(obj, path, bank.plugins, bank.size);
+        CacheSave(obj, path, bank.plugins, bank.size, bank.dirs,
+                  bank.dirs_count);
 
+    for (size_t i = 0; i < bank.dirs_count; i++)
+        free((char *)bank.dirs[i].path);
+    free(bank.dirs);
     free(bank.plugins);
 }
 
@@ -36,9 +36,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <assert.h>
+#ifdef HAVE_SEARCH_H
+# include <search.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_memstream.h>
+#include <vlc_modules.h>
 #include "libvlc.h"
 
 #include <vlc_plugin.h>
@@ -57,13 +62,138 @@
 #ifdef HAVE_DYNAMIC_PLUGINS
 /* Sub-version number
  * (only used to avoid breakage in dev version when cache structure changes) */
-#define CACHE_SUBVERSION_NUM 35
+#define CACHE_SUBVERSION_NUM 37
 
 /* Cache filename */
 #define CACHE_NAME "plugins.dat"
 /* Magic for the cache filename */
 #define CACHE_STRING "cache "PACKAGE_NAME" "PACKAGE_VERSION
 
+/*
+ * After the version header, the cache file contains a table of contents
+ * followed by arrays of fixed-size records. The file is memory-mapped and the
+ * records are used in place: they refer to one another by index, and to
+ * strings by byte offset within the string pool (zero standing for NULL).
+ * Plug-ins are sorted by relative path, and the modules of each capability by
+ * decreasing score, so that loading requires neither parsing nor sorting.
+ * The browsed directories are listed with their modification time, so that
+ * the cache can be used without browsing them again if none has changed.
+ */
+enum
+{
+    CACHE_PLUGINS,
+    CACHE_MODULES,
+    CACHE_CONFIGS,
+    CACHE_REFS, /* string references (shortcuts and string choices) */
+    CACHE_INTS, /* integer choices */
+    CACHE_CAPS,
+    CACHE_CAPMODS, /* module indices of all capabilities */
+    CACHE_DIRS, /* browsed directories */
+    CACHE_STRINGS, /* string pool */
+    CACHE_SECTIONS
+};
+
+struct cache_toc
+{
+    struct
+    {
+        uint32_t offset; /**< File offset of the first record */
+        uint32_t count; /**< Number of records */
+    } sections[CACHE_SECTIONS];
+};
+
+struct cache_plugin
+{
+    int64_t mtime;
+    uint64_t size;
+    uint32_t path;
+    uint32_t textdomain;
+    uint32_t modules_count; /**< Modules (following those of the previous
+                                 plug-in in the modules table) */
+    uint32_t configs_count; /**< Configuration items (likewise) */
+    uint8_t unloadable;
+};
+
+struct cache_module
+{
+    uint32_t shortname;
+    uint32_t longname;
+    uint32_t help;
+    uint32_t capability;
+    int32_t score;
+    uint32_t activate;
+    uint32_t deactivate;
+    uint32_t shortcuts; /**< First shortcut in the string references */
+    uint32_t shortcuts_count;
+};
+
+typedef union
+{
+    int64_t i;
+    float f;
+    uint32_t psz;
+} cache_value_t;
+
+#define CACHE_CONFIG_INTERNAL   0x01
+#define CACHE_CONFIG_UNSAVEABLE 0x02
+#define CACHE_CONFIG_SAFE       0x04
+#define CACHE_CONFIG_REMOVED    0x08
+
+struct cache_config
+{
+    cache_value_t orig;
+    cache_value_t min;
+    cache_value_t max;
+    uint32_t type;
+    uint32_t name;
+    uint32_t text;
+    uint32_t longtext;
+    uint32_t list; /**< First choice in the string references or integers */
+    uint32_t list_text; /**< First choice name in the string references */
+    uint32_t list_cb_name;
+    uint16_t list_count;
+    uint8_t i_type;
+    char i_short;
+    uint8_t flags;
+};
+
+struct cache_cap
+{
+    uint32_t name;
+    uint32_t modules; /**< First entry in the capability modules table */
+    uint32_t count;
+};
+
+struct cache_dir
+{
+    int64_t mtime;
+    uint32_t path; /**< Relative path (none for the base directory) */
+    uint32_t reserved;
+};
+
+static const size_t cache_record_size[CACHE_SECTIONS] =
+{
+    [CACHE_PLUGINS] = sizeof (struct cache_plugin),
+    [CACHE_MODULES] = sizeof (struct cache_module),
+    [CACHE_CONFIGS] = sizeof (struct cache_config),
+    [CACHE_REFS] = sizeof (uint32_t),
+    [CACHE_INTS] = sizeof (int),
+    [CACHE_CAPS] = sizeof (struct cache_cap),
+    [CACHE_CAPMODS] = sizeof (uint32_t),
+    [CACHE_DIRS] = sizeof (struct cache_dir),
+    [CACHE_STRINGS] = 1,
+};
+
+/* All sections are aligned to this in the file */
+#define CACHE_ALIGN 8
+
+typedef struct
+{
+    const char *strings;
+    size_t strings_size;
+    const uint32_t *refs;
+    size_t refs_count;
+} cache_pool_t;
 
 static int vlc_cache_load_immediate(void *out, block_t *in, size_t size)
 {
@@ -76,267 +206,251 @@ static int vlc_cache_load_immediate(void *out, block_t *in, size_t size)
     return 0;
 }
 
-static int vlc_cache_load_bool(bool *out, block_t *in)
+static int vlc_cache_load_align(size_t align, block_t *file)
 {
-    unsigned char b;
-
-    if (vlc_cache_load_immediate(&b, in, 1) || b > 1)
-        return -1;
-
-    *out = b;
-    return 0;
-}
+    assert(align > 0);
 
-static int vlc_cache_load_array(const void **p, size_t size, size_t n,
-                                block_t *file)
-{
-    if (n == 0)
-    {
-        *p = NULL;
+    size_t skip = (-(uintptr_t)file->p_buffer) % align;
+    if (skip == 0)
         return 0;
-    }
-
-    if (unlikely(size * n < size))
-        return -1;
 
-    size *= n;
+    assert(skip < align);
 
-    if (file->i_buffer < size)
+    if (file->i_buffer < skip)
         return -1;
 
-    *p = file->p_buffer;
-    file->p_buffer += size;
-    file->i_buffer -= size;
+    file->p_buffer += skip;
+    file->i_buffer -= skip;
+    assert((((uintptr_t)file->p_buffer) % align) == 0);
     return 0;
 }
 
-static int vlc_cache_load_string(const char **restrict p, block_t *file)
+static const void *vlc_cache_load_section(const uint8_t *base, size_t length,
+                                          const struct cache_toc *toc,
+                                          unsigned section, size_t align)
 {
-    uint16_t size;
-
-    if (vlc_cache_load_immediate(&size, file, sizeof (size)) || size > 16384)
-        return -1;
+    size_t offset = toc->sections[section].offset;
+    size_t count = toc->sections[section].count;
 
-    if (size == 0)
-    {
-        *p = NULL;
-        return 0;
-    }
+    if (offset > length
+     || (length - offset) / cache_record_size[section] < count
+     || ((uintptr_t)(base + offset) % align) != 0)
+        return NULL;
 
-    const char *str = (char *)file->p_buffer;
+    return base + offset;
+}
 
-    if (file->i_buffer < size || str[size - 1] != '\0')
+static int vlc_cache_load_string(const char **restrict p,
+                                 const cache_pool_t *pool, uint32_t offset)
+{
+    /* The pool is nul-terminated, so any offset within it is a string */
+    if (offset >= pool->strings_size)
         return -1;
 
-    file->p_buffer += size;
-    file->i_buffer -= size;
-    *p = str;
+    *p = (offset != 0) ? (pool->strings + offset) : NULL;
     return 0;
 }
 
-static int vlc_cache_load_align(size_t align, block_t *file)
+static int vlc_cache_load_refs(const uint32_t **restrict p,
+                               const cache_pool_t *pool, uint32_t first,
+                               size_t count)
 {
-    assert(align > 0);
-
-    size_t skip = (-(uintptr_t)file->p_buffer) % align;
-    if (skip == 0)
-        return 0;
-
-    assert(skip < align);
-
-    if (file->i_buffer < skip)
+    if (first > pool->refs_count || pool->refs_count - first < count)
         return -1;
 
-    file->p_buffer += skip;
-    file->i_buffer -= skip;
-    assert((((uintptr_t)file->p_buffer) % align) == 0);
+    *p = pool->refs + first;
     return 0;
 }
 
-#define LOAD_IMMEDIATE(a) \
-    if (vlc_cache_load_immediate(&(a), file, sizeof (a))) \
+#define LOAD_SECTION(p, s) \
+    if (((p) = vlc_cache_load_section(base, length, &toc, (s), \
+                                      alignof (*(p)))) == NULL) \
         goto error
-#define LOAD_FLAG(a) \
-    do \
-    { \
-        bool b; \
-        if (vlc_cache_load_bool(&b, file)) \
-            goto error; \
-        (a) = b; \
-    } while (0)
-#define LOAD_ARRAY(a,n) \
-    do \
-    { \
-        const void *base; \
-        if (vlc_cache_load_array(&base, sizeof (*(a)), (n), file)) \
-            goto error; \
-        (a) = base; \
-    } while (0)
-#define LOAD_STRING(a) \
-    if (vlc_cache_load_string(&(a), file)) \
+#define LOAD_STRING(a, o) \
+    if (vlc_cache_load_string(&(a), pool, (o))) \
         goto error
-#define LOAD_ALIGNOF(t) \
-    if (vlc_cache_load_align(alignof(t), file)) \
+#define LOAD_REFS(p, first, n) \
+    if (vlc_cache_load_refs(&(p), pool, (first), (n))) \
         goto error
 
-static int vlc_cache_load_config(module_config_t *cfg, block_t *file)
+/* Loads a table of non-NULL strings */
+static const char **vlc_cache_load_list(const cache_pool_t *pool,
+                                        uint32_t first, size_t count)
 {
-    LOAD_IMMEDIATE (cfg->i_type);
-    LOAD_IMMEDIATE (cfg->i_short);
-    LOAD_FLAG (cfg->b_internal);
-    LOAD_FLAG (cfg->b_unsaveable);
-    LOAD_FLAG (cfg->b_safe);
-    LOAD_FLAG (cfg->b_removed);
-    LOAD_STRING (cfg->psz_type);
-    LOAD_STRING (cfg->psz_name);
-    LOAD_STRING (cfg->psz_text);
-    LOAD_STRING (cfg->psz_longtext);
-    LOAD_IMMEDIATE (cfg->list_count);
+    const uint32_t *refs;
+    const char **list;
 
-    if (IsConfigStringType (cfg->i_type))
-    {
-        const char *psz;
-        LOAD_STRING(psz);
-        cfg->orig.psz = (char *)psz;
-        cfg->value.psz = (psz != NULL) ? strdup (cfg->orig.psz) : NULL;
+    LOAD_REFS(refs, first, count);
 
-        if (cfg->list_count)
-            cfg->list.psz = xmalloc (cfg->list_count * sizeof (char *));
-        else
-            LOAD_STRING(cfg->list_cb_name);
-        for (unsigned i = 0; i < cfg->list_count; i++)
-        {
-            LOAD_STRING (cfg->list.psz[i]);
-            if (cfg->list.psz[i] == NULL /* NULL -> empty string */
-             && (cfg->list.psz[i] = calloc (1, 1)) == NULL)
-                goto error;
-        }
-    }
-    else
-    {
-        LOAD_IMMEDIATE (cfg->orig);
-        LOAD_IMMEDIATE (cfg->min);
-        LOAD_IMMEDIATE (cfg->max);
-        cfg->value = cfg->orig;
-
-        if (cfg->list_count)
-        {
-            LOAD_ALIGNOF(*cfg->list.i);
-        }
-        else
-            LOAD_STRING(cfg->list_cb_name);
-
-        LOAD_ARRAY(cfg->list.i, cfg->list_count);
-    }
+    list = vlc_alloc(count, sizeof (*list));
+    if (unlikely(list == NULL))
+        goto error;
 
-    cfg->list_text = xmalloc (cfg->list_count * sizeof (char *));
-    for (unsigned i = 0; i < cfg->list_count; i++)
+    for (size_t i = 0; i < count; i++)
     {
-        LOAD_STRING (cfg->list_text[i]);
-        if (cfg->list_text[i] == NULL /* NULL -> empty string */
-         && (cfg->list_text[i] = calloc (1, 1)) == NULL)
+        LOAD_STRING(list[i], refs[i]);
+        if (list[i] == NULL)
+        {
+            free(list);
             goto error;
+        }
     }
-
-    return 0;
+    return list;
 error:
-    return -1; /* FIXME: leaks */
+    return NULL;
 }
 
-static int vlc_cache_load_plugin_config(vlc_plugin_t *plugin, block_t *file)
+static int vlc_cache_load_config(module_config_t *cfg,
+                                 const struct cache_config *rec,
+                                 const cache_pool_t *pool, const int *ints,
+                                 size_t ints_count)
 {
-    uint16_t lines;
+    cfg->i_type = rec->i_type;
+    cfg->i_short = rec->i_short;
+    cfg->b_internal = (rec->flags & CACHE_CONFIG_INTERNAL) != 0;
+    cfg->b_unsaveable = (rec->flags & CACHE_CONFIG_UNSAVEABLE) != 0;
+    cfg->b_safe = (rec->flags & CACHE_CONFIG_SAFE) != 0;
+    cfg->b_removed = (rec->flags & CACHE_CONFIG_REMOVED) != 0;
+    LOAD_STRING(cfg->psz_type, rec->type);
+    LOAD_STRING(cfg->psz_name, rec->name);
+    LOAD_STRING(cfg->psz_text, rec->text);
+    LOAD_STRING(cfg->psz_longtext, rec->longtext);
+    LOAD_STRING(cfg->list_cb_name, rec->list_cb_name);
+
+    if (IsConfigStringType(cfg->i_type))
+    {
+        const char *psz;
 
-    /* Calculate the structure length */
-    LOAD_IMMEDIATE (lines);
+        LOAD_STRING(psz, rec->orig.psz);
+        cfg->orig.psz = (char *)psz;
 
-    /* Allocate memory */
-    if (lines)
-    {
-        plugin->conf.items = calloc(sizeof (module_config_t), lines);
-        if (unlikely(plugin->conf.items == NULL))
+        if (psz != NULL)
         {
-            plugin->conf.size = 0;
-            return -1;
+            cfg->value.psz = strdup(psz);
+            if (unlikely(cfg->value.psz == NULL))
+                goto error;
+        }
+
+        if (rec->list_count > 0)
+        {
+            cfg->list.psz = vlc_cache_load_list(pool, rec->list,
+                                                rec->list_count);
+            if (cfg->list.psz == NULL)
+                goto error;
         }
     }
     else
-        plugin->conf.items = NULL;
-
-    plugin->conf.size = lines;
-
-    /* Do the duplication job */
-    for (size_t i = 0; i < lines; i++)
     {
-        module_config_t *item = plugin->conf.items + i;
+        if (rec->list > ints_count || ints_count - rec->list < rec->list_count)
+            goto error;
 
-        if (vlc_cache_load_config(item, file))
-            return -1;
+        cfg->orig.i = rec->orig.i;
+        cfg->min.i = rec->min.i;
+        cfg->max.i = rec->max.i;
+        cfg->value = cfg->orig;
 
-        if (CONFIG_ITEM(item->i_type))
-        {
-            plugin->conf.count++;
-            if (item->i_type == CONFIG_ITEM_BOOL)
-                plugin->conf.booleans++;
-        }
-        item->owner = plugin;
+        if (rec->list_count > 0)
+            cfg->list.i = ints + rec->list;
     }
 
+    /* The choices table must only be counted once allocated */
+    cfg->list_count = rec->list_count;
+
+    if (rec->list_count > 0)
+    {
+        cfg->list_text = vlc_cache_load_list(pool, rec->list_text,
+                                             rec->list_count);
+        if (cfg->list_text == NULL)
+            goto error;
+    }
     return 0;
 error:
-    return -1; /* FIXME: leaks */
+    return -1;
 }
 
-static int vlc_cache_load_module(vlc_plugin_t *plugin, block_t *file)
+static module_t *vlc_cache_load_module(vlc_plugin_t *plugin,
+                                       const struct cache_module *rec,
+                                       const cache_pool_t *pool)
 {
     module_t *module = vlc_module_create(plugin);
     if (unlikely(module == NULL))
-        return -1;
+        return NULL;
 
-    LOAD_STRING(module->psz_shortname);
-    LOAD_STRING(module->psz_longname);
-    LOAD_STRING(module->psz_help);
+    LOAD_STRING(module->psz_shortname, rec->shortname);
+    LOAD_STRING(module->psz_longname, rec->longname);
+    LOAD_STRING(module->psz_help, rec->help);
 
-    LOAD_IMMEDIATE(module->i_shortcuts);
-    if (module->i_shortcuts > MODULE_SHORTCUT_MAX)
+    if (rec->shortcuts_count > MODULE_SHORTCUT_MAX)
         goto error;
-    else
+    if (rec->shortcuts_count > 0)
     {
-        module->pp_shortcuts =
-            xmalloc (sizeof (*module->pp_shortcuts) * module->i_shortcuts);
-        for (unsigned j = 0; j < module->i_shortcuts; j++)
-            LOAD_STRING(module->pp_shortcuts[j]);
+        module->pp_shortcuts = vlc_cache_load_list(pool, rec->shortcuts,
+                                                   rec->shortcuts_count);
+        if (module->pp_shortcuts == NULL)
+            goto error;
+        module->i_shortcuts = rec->shortcuts_count;
     }
 
-    LOAD_STRING(module->activate_name);
-    LOAD_STRING(module->deactivate_name);
-    LOAD_STRING(module->psz_capability);
-    LOAD_IMMEDIATE(module->i_score);
-    return 0;
+    LOAD_STRING(module->activate_name, rec->activate);
+    LOAD_STRING(module->deactivate_name, rec->deactivate);
+    LOAD_STRING(module->psz_capability, rec->capability);
+    module->i_score = rec->score;
+    return module;
 error:
-    return -1;
+    return NULL; /* module is destroyed along with the plugin */
 }
 
-static vlc_plugin_t *vlc_cache_load_plugin(block_t *file)
+static vlc_plugin_t *vlc_cache_load_plugin(const struct cache_plugin *rec,
+                                           const struct cache_module *modules,
+                                           const struct cache_config *configs,
+                                           const cache_pool_t *pool,
+                                           const int *ints, size_t ints_count,
+                                           struct vlc_cache_module *entries,
+                                           size_t index)
 {
     vlc_plugin_t *plugin = vlc_plugin_create();
     if (unlikely(plugin == NULL))
         return NULL;
 
-    uint32_t modules;
-    LOAD_IMMEDIATE(modules);
+    for (size_t i = 0; i < rec->modules_count; i++)
+    {
+        module_t *module = vlc_cache_load_module(plugin, modules + i, pool);
+        if (module == NULL)
+            goto error;
 
-    for (size_t i = 0; i < modules; i++)
-        if (vlc_cache_load_module(plugin, file))
+        entries[i].module = module;
+        entries[i].plugin = index;
+    }
+
+    if (rec->configs_count > 0)
+    {
+        plugin->conf.items = calloc(rec->configs_count,
+                                    sizeof (module_config_t));
+        if (unlikely(plugin->conf.items == NULL))
             goto error;
+        plugin->conf.size = rec->configs_count;
+    }
 
-    if (vlc_cache_load_plugin_config(plugin, file))
-        goto error;
+    for (size_t i = 0; i < rec->configs_count; i++)
+    {
+        module_config_t *item = plugin->conf.items + i;
 
-    LOAD_STRING(plugin->textdomain);
+        if (vlc_cache_load_config(item, configs + i, pool, ints, ints_count))
+            goto error;
+
+        if (CONFIG_ITEM(item->i_type))
+        {
+            plugin->conf.count++;
+            if (item->i_type == CONFIG_ITEM_BOOL)
+                plugin->conf.booleans++;
+        }
+        item->owner = plugin;
+    }
 
     const char *path;
-    LOAD_STRING(path);
+
+    LOAD_STRING(plugin->textdomain, rec->textdomain);
+    LOAD_STRING(path, rec->path);
     if (path == NULL)
         goto error;
 
@@ -344,9 +458,9 @@ static vlc_plugin_t *vlc_cache_load_plugin(block_t *file)
     if (unlikely(plugin->path == NULL))
         goto error;
 
-    LOAD_FLAG(plugin->unloadable);
-    LOAD_IMMEDIATE(plugin->mtime);
-    LOAD_IMMEDIATE(plugin->size);
+    plugin->unloadable = rec->unloadable != 0;
+    plugin->mtime = rec->mtime;
+    plugin->size = rec->size;
 
     if (plugin->textdomain != NULL)
         vlc_bindtextdomain(plugin->textdomain);
@@ -366,8 +480,8 @@ error:
  * actually load the dynamically loadable module.
  * This allows us to only fully load plugins when they are actually used.
  */
-vlc_plugin_t *vlc_cache_load(vlc_object_t *p_this, const char *dir,
-                             block_t **backingp)
+vlc_plugin_cache_t *vlc_cache_load(vlc_object_t *p_this, const char *dir,
+                                   block_t **backingp)
 {
     char *psz_filename;
 
@@ -386,6 +500,9 @@ vlc_plugin_t *vlc_cache_load(vlc_object_t *p_this, const char *dir,
     if (file == NULL)
         return NULL;
 
+    const uint8_t *base = file->p_buffer;
+    const size_t length = file->i_buffer;
+
     /* Check the file is a plugins cache */
     char cachestr[sizeof (CACHE_STRING) - 1];
 
@@ -437,24 +554,138 @@ vlc_plugin_t *vlc_cache_load(vlc_object_t *p_this, const char *dir,
         return NULL;
     }
 
-    vlc_plugin_t *cache = NULL;
+    vlc_plugin_cache_t *cache = malloc(sizeof (*cache));
+    if (unlikely(cache == NULL))
+    {
+        block_Release(file);
+        return NULL;
+    }
+
+    cache->obj = p_this;
+    cache->plugins = NULL;
+    cache->used = NULL;
+    cache->count = 0;
+    cache->modules = NULL;
+    cache->caps = NULL;
+    cache->caps_count = 0;
+    cache->dirs = NULL;
+    cache->dirs_count = 0;
+
+    struct cache_toc toc;
+    const struct cache_plugin *plugins;
+    const struct cache_module *modules;
+    const struct cache_config *configs;
+    const int *ints;
+    const struct cache_cap *caps;
+    const uint32_t *capmods;
+    const struct cache_dir *dirs;
+    cache_pool_t p, *pool = &p;
+
+    if (vlc_cache_load_align(CACHE_ALIGN, file)
+     || vlc_cache_load_immediate(&toc, file, sizeof (toc)))
+        goto error;
+
+    LOAD_SECTION(plugins, CACHE_PLUGINS);
+    LOAD_SECTION(modules, CACHE_MODULES);
+    LOAD_SECTION(configs, CACHE_CONFIGS);
+    LOAD_SECTION(p.refs, CACHE_REFS);
+    LOAD_SECTION(ints, CACHE_INTS);
+    LOAD_SECTION(caps, CACHE_CAPS);
+    LOAD_SECTION(capmods, CACHE_CAPMODS);
+    LOAD_SECTION(dirs, CACHE_DIRS);
+    LOAD_SECTION(p.strings, CACHE_STRINGS);
+
+    const size_t plugins_count = toc.sections[CACHE_PLUGINS].count;
+    const size_t modules_count = toc.sections[CACHE_MODULES].count;
+    const size_t configs_count = toc.sections[CACHE_CONFIGS].count;
+    const size_t ints_count = toc.sections[CACHE_INTS].count;
+    const size_t caps_count = toc.sections[CACHE_CAPS].count;
+    const size_t capmods_count = toc.sections[CACHE_CAPMODS].count;
+    const size_t dirs_count = toc.sections[CACHE_DIRS].count;
+
+    p.refs_count = toc.sections[CACHE_REFS].count;
+    p.strings_size = toc.sections[CACHE_STRINGS].count;
+    if (p.strings_size == 0 || p.strings[p.strings_size - 1] != '\0')
+        goto error;
+
+    cache->plugins = vlc_alloc(plugins_count, sizeof (*cache->plugins));
+    cache->used = calloc(plugins_count, sizeof (*cache->used));
+    cache->modules = vlc_alloc(modules_count, sizeof (*cache->modules));
+    cache->caps = vlc_alloc(caps_count, sizeof (*cache->caps));
+    cache->dirs = vlc_alloc(dirs_count, sizeof (*cache->dirs));
+    if (unlikely((cache->plugins == NULL && plugins_count > 0)
+              || (cache->used == NULL && plugins_count > 0)
+              || (cache->modules == NULL && modules_count > 0)
+              || (cache->caps == NULL && caps_count > 0)
+              || (cache->dirs == NULL && dirs_count > 0)))
+        goto error;
+
+    size_t module = 0, config = 0;
 
-    while (file->i_buffer > 0)
+    for (size_t i = 0; i < plugins_count; i++)
     {
-        vlc_plugin_t *plugin = vlc_cache_load_plugin(file);
+        const struct cache_plugin *rec = plugins + i;
+
+        if (rec->modules_count > modules_count - module
+         || rec->configs_count > configs_count - config)
+            goto error;
+
+        vlc_plugin_t *plugin = vlc_cache_load_plugin(rec, modules + module,
+                                                     configs + config, pool,
+                                                     ints, ints_count,
+                                                     cache->modules + module,
+                                                     i);
         if (plugin == NULL)
             goto error;
 
+        module += rec->modules_count;
+        config += rec->configs_count;
+
+        /* Plug-ins must be sorted for vlc_cache_lookup() */
+        if (i > 0 && strcmp(cache->plugins[i - 1]->path, plugin->path) >= 0)
+        {
+            vlc_plugin_destroy(plugin);
+            goto error;
+        }
+
+        cache->plugins[cache->count++] = plugin;
+
         if (unlikely(asprintf(&plugin->abspath, "%s" DIR_SEP "%s", dir,
                               plugin->path) == -1))
         {
             plugin->abspath = NULL;
-            vlc_plugin_destroy(plugin);
             goto error;
         }
+    }
 
-        plugin->next = cache;
-        cache = plugin;
+    if (module != modules_count)
+        goto error;
+
+    for (size_t i = 0; i < capmods_count; i++)
+        if (capmods[i] >= modules_count)
+            goto error;
+
+    for (size_t i = 0; i < caps_count; i++)
+    {
+        struct vlc_cache_cap *cap = cache->caps + i;
+
+        LOAD_STRING(cap->name, caps[i].name);
+        if (cap->name == NULL || caps[i].modules > capmods_count
+         || capmods_count - caps[i].modules < caps[i].count)
+            goto error;
+
+        cap->modv = capmods + caps[i].modules;
+        cap->modc = caps[i].count;
+        cache->caps_count++;
+    }
+
+    for (size_t i = 0; i < dirs_count; i++)
+    {
+        struct vlc_cache_dir *d = cache->dirs + i;
+
+        LOAD_STRING(d->path, dirs[i].path);
+        d->mtime = dirs[i].mtime;
+        cache->dirs_count++;
     }
 
     file->p_next = *backingp;
@@ -463,198 +694,435 @@ vlc_plugin_t *vlc_cache_load(vlc_object_t *p_this, const char *dir,
 
 error:
     msg_Warn( p_this, "plugins cache not loaded (corrupted)" );
-
-    /* TODO: cleanup */
+    vlc_cache_free(cache);
     block_Release(file);
     return NULL;
 }
 
-#define SAVE_IMMEDIATE( a ) \
-    if (fwrite (&(a), sizeof(a), 1, file) != 1) \
-        goto error
-#define SAVE_FLAG(a) \
-    do { \
-        char b = (a); \
-        SAVE_IMMEDIATE(b); \
-    } while (0)
+/**
+ * Releases a plugins cache.
+ *
+ * Plug-ins that were not taken out with vlc_cache_lookup() are destroyed.
+ */
+void vlc_cache_free(vlc_plugin_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->count; i++)
+        if (!cache->used[i])
+            vlc_plugin_destroy(cache->plugins[i]);
+
+    free(cache->dirs);
+    free(cache->caps);
+    free(cache->modules);
+    free(cache->used);
+    free(cache->plugins);
+    free(cache);
+}
+
+typedef struct
+{
+    struct vlc_memstream sections[CACHE_SECTIONS];
+    size_t counts[CACHE_SECTIONS];
+    void *strings; /**< Tree of the strings in the pool */
+} cache_writer_t;
 
-static int CacheSaveString (FILE *file, const char *str)
+struct cache_string
 {
-    uint16_t size = (str != NULL) ? (strlen (str) + 1) : 0;
+    const char *str;
+    uint32_t offset;
+};
+
+struct cache_capmod
+{
+    const char *name;
+    int score;
+    uint32_t index;
+};
+
+static int CacheStringCmp(const void *a, const void *b)
+{
+    const struct cache_string *sa = a, *sb = b;
+    return strcmp(sa->str, sb->str);
+}
 
-    SAVE_IMMEDIATE (size);
-    if (size != 0 && fwrite(str, 1, size, file) != size)
+static int CachePluginCmp(const void *a, const void *b)
+{
+    const vlc_plugin_t *const *pa = a, *const *pb = b;
+    return strcmp((*pa)->path, (*pb)->path);
+}
+
+static int CacheCapmodCmp(const void *a, const void *b)
+{
+    const struct cache_capmod *ma = a, *mb = b;
+    int ret = strcmp(ma->name, mb->name);
+
+    if (ret == 0)
+        ret = mb->score - ma->score;
+    if (ret == 0)
+        ret = (ma->index > mb->index) - (ma->index < mb->index);
+    return ret;
+}
+
+static void CacheWrite(cache_writer_t *w, unsigned section,
+                       const void *data, size_t count)
+{
+    if (count == 0)
+        return;
+
+    vlc_memstream_write(&w->sections[section], data,
+                        count * cache_record_size[section]);
+    w->counts[section] += count;
+}
+
+/* Adds a string to the pool, unless it is already there */
+static int CacheSaveString(cache_writer_t *w, const char *str,
+                           uint32_t *restrict offset)
+{
+    if (str == NULL)
     {
-error:
+        *offset = 0;
+        return 0;
+    }
+
+    struct cache_string key = { .str = str }, *entry;
+    struct cache_string **node = tsearch(&key, &w->strings, CacheStringCmp);
+
+    if (unlikely(node == NULL))
         return -1;
+
+    if (*node != &key)
+    {
+        *offset = (*node)->offset;
+        return 0;
     }
+
+    entry = malloc(sizeof (*entry));
+    if (unlikely(entry == NULL)
+     || w->counts[CACHE_STRINGS] > UINT32_MAX)
+    {
+        tdelete(&key, &w->strings, CacheStringCmp);
+        free(entry);
+        return -1;
+    }
+
+    entry->str = str;
+    entry->offset = *offset = w->counts[CACHE_STRINGS];
+    *node = entry;
+    CacheWrite(w, CACHE_STRINGS, str, strlen(str) + 1);
     return 0;
 }
 
-#define SAVE_STRING( a ) \
-    if (CacheSaveString (file, (a))) \
+#define SAVE_STRING(a, s) \
+    if (CacheSaveString(w, (s), &(a))) \
         goto error
 
-static int CacheSaveAlign(FILE *file, size_t align)
+/* Appends a table of strings to the references, NULL as empty strings */
+static int CacheSaveList(cache_writer_t *w, const char *const *list,
+                         size_t count, uint32_t *restrict first)
 {
-    assert(align > 0);
+    *first = w->counts[CACHE_REFS];
 
-    size_t skip = (-ftell(file)) % align;
-    if (skip == 0)
-        return 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t offset;
 
-    assert(((ftell(file) + skip) % align) == 0);
-    return fseek(file, skip, SEEK_CUR);
+        SAVE_STRING(offset, (list[i] != NULL) ? list[i] : "");
+        CacheWrite(w, CACHE_REFS, &offset, 1);
+    }
+    return 0;
+error:
+    return -1;
 }
 
-#define SAVE_ALIGNOF(t) \
-    if (CacheSaveAlign(file, alignof (t))) \
+#define SAVE_LIST(a, l, n) \
+    if (CacheSaveList(w, (l), (n), &(a))) \
         goto error
 
-static int CacheSaveConfig (FILE *file, const module_config_t *cfg)
+static int CacheSaveConfig(cache_writer_t *w, const module_config_t *cfg)
 {
-    SAVE_IMMEDIATE (cfg->i_type);
-    SAVE_IMMEDIATE (cfg->i_short);
-    SAVE_FLAG (cfg->b_internal);
-    SAVE_FLAG (cfg->b_unsaveable);
-    SAVE_FLAG (cfg->b_safe);
-    SAVE_FLAG (cfg->b_removed);
-    SAVE_STRING (cfg->psz_type);
-    SAVE_STRING (cfg->psz_name);
-    SAVE_STRING (cfg->psz_text);
-    SAVE_STRING (cfg->psz_longtext);
-    SAVE_IMMEDIATE (cfg->list_count);
+    struct cache_config rec;
+
+    memset(&rec, 0, sizeof (rec));
+    rec.i_type = cfg->i_type;
+    rec.i_short = cfg->i_short;
+    rec.flags = (cfg->b_internal ? CACHE_CONFIG_INTERNAL : 0)
+              | (cfg->b_unsaveable ? CACHE_CONFIG_UNSAVEABLE : 0)
+              | (cfg->b_safe ? CACHE_CONFIG_SAFE : 0)
+              | (cfg->b_removed ? CACHE_CONFIG_REMOVED : 0);
+    SAVE_STRING(rec.type, cfg->psz_type);
+    SAVE_STRING(rec.name, cfg->psz_name);
+    SAVE_STRING(rec.text, cfg->psz_text);
+    SAVE_STRING(rec.longtext, cfg->psz_longtext);
+    SAVE_STRING(rec.list_cb_name, cfg->list_cb_name);
+    rec.list_count = cfg->list_count;
 
     if (IsConfigStringType (cfg->i_type))
     {
-        SAVE_STRING (cfg->orig.psz);
-        if (cfg->list_count == 0)
-            SAVE_STRING(cfg->list_cb_name);
-
-        for (unsigned i = 0; i < cfg->list_count; i++)
-            SAVE_STRING (cfg->list.psz[i]);
+        SAVE_STRING(rec.orig.psz, cfg->orig.psz);
+        SAVE_LIST(rec.list, cfg->list.psz, cfg->list_count);
     }
     else
     {
-        SAVE_IMMEDIATE (cfg->orig);
-        SAVE_IMMEDIATE (cfg->min);
-        SAVE_IMMEDIATE (cfg->max);
+        rec.orig.i = cfg->orig.i;
+        rec.min.i = cfg->min.i;
+        rec.max.i = cfg->max.i;
+        rec.list = w->counts[CACHE_INTS];
+        CacheWrite(w, CACHE_INTS, cfg->list.i, cfg->list_count);
+    }
+    SAVE_LIST(rec.list_text, cfg->list_text, cfg->list_count);
 
-        if (cfg->list_count > 0)
-        {
-            SAVE_ALIGNOF(*cfg->list.i);
-        }
-        else
-            SAVE_STRING(cfg->list_cb_name);
+    CacheWrite(w, CACHE_CONFIGS, &rec, 1);
+    return 0;
+error:
+    return -1;
+}
+
+static int CacheSaveModule(cache_writer_t *w, const module_t *module)
+{
+    struct cache_module rec;
+
+    memset(&rec, 0, sizeof (rec));
+    SAVE_STRING(rec.shortname, module->psz_shortname);
+    SAVE_STRING(rec.longname, module->psz_longname);
+    SAVE_STRING(rec.help, module->psz_help);
+    SAVE_LIST(rec.shortcuts, module->pp_shortcuts, module->i_shortcuts);
+    rec.shortcuts_count = module->i_shortcuts;
+    SAVE_STRING(rec.activate, module->activate_name);
+    SAVE_STRING(rec.deactivate, module->deactivate_name);
+    SAVE_STRING(rec.capability, module->psz_capability);
+    rec.score = module->i_score;
+
+    CacheWrite(w, CACHE_MODULES, &rec, 1);
+    return 0;
+error:
+    return -1;
+}
+
+static int CacheSavePlugin(cache_writer_t *w, const vlc_plugin_t *plugin,
+                           struct cache_capmod *capmods)
+{
+    struct cache_plugin rec;
 
-        for (unsigned i = 0; i < cfg->list_count; i++)
-             SAVE_IMMEDIATE (cfg->list.i[i]);
+    memset(&rec, 0, sizeof (rec));
+
+    for (const module_t *module = plugin->module;
+         module != NULL;
+         module = module->next)
+    {
+        struct cache_capmod *capmod = capmods + rec.modules_count++;
+
+        capmod->name = module_get_capability(module);
+        capmod->score = module->i_score;
+        capmod->index = w->counts[CACHE_MODULES];
+
+        if (CacheSaveModule(w, module))
+            goto error;
     }
-    for (unsigned i = 0; i < cfg->list_count; i++)
-        SAVE_STRING (cfg->list_text[i]);
 
+    for (size_t i = 0; i < plugin->conf.size; i++)
+        if (CacheSaveConfig(w, plugin->conf.items + i))
+            goto error;
+    rec.configs_count = plugin->conf.size;
+
+    SAVE_STRING(rec.textdomain, plugin->textdomain);
+    SAVE_STRING(rec.path, plugin->path);
+    rec.unloadable = plugin->unloadable;
+    rec.mtime = plugin->mtime;
+    rec.size = plugin->size;
+
+    CacheWrite(w, CACHE_PLUGINS, &rec, 1);
     return 0;
 error:
     return -1;
 }
 
-static int CacheSaveModuleConfig(FILE *file, const vlc_plugin_t *plugin)
+/* Sorts the modules by capability, and writes the capabilities tables */
+static int CacheSaveCaps(cache_writer_t *w, struct cache_capmod *capmods,
+                         size_t n)
 {
-    uint16_t lines = plugin->conf.size;
+    qsort(capmods, n, sizeof (*capmods), CacheCapmodCmp);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        struct cache_cap rec;
 
-    SAVE_IMMEDIATE (lines);
+        rec.modules = i;
+        rec.count = 0;
+        SAVE_STRING(rec.name, capmods[i].name);
 
-    for (size_t i = 0; i < lines; i++)
-        if (CacheSaveConfig(file, plugin->conf.items + i))
-           goto error;
+        do
+            CacheWrite(w, CACHE_CAPMODS, &capmods[i + rec.count].index, 1);
+        while (i + ++rec.count < n
+            && !strcmp(capmods[i + rec.count].name, capmods[i].name));
 
+        i += rec.count - 1;
+        CacheWrite(w, CACHE_CAPS, &rec, 1);
+    }
     return 0;
 error:
     return -1;
 }
 
-static int CacheSaveModule(FILE *file, const module_t *module)
+/* Writes the browsed directories */
+static int CacheSaveDirs(cache_writer_t *w, const struct vlc_cache_dir *dirs,
+                         size_t n)
 {
-    SAVE_STRING(module->psz_shortname);
-    SAVE_STRING(module->psz_longname);
-    SAVE_STRING(module->psz_help);
-    SAVE_IMMEDIATE(module->i_shortcuts);
-
-    for (size_t j = 0; j < module->i_shortcuts; j++)
-         SAVE_STRING(module->pp_shortcuts[j]);
+    for (size_t i = 0; i < n; i++)
+    {
+        struct cache_dir rec;
 
-    SAVE_STRING(module->activate_name);
-    SAVE_STRING(module->deactivate_name);
-    SAVE_STRING(module->psz_capability);
-    SAVE_IMMEDIATE(module->i_score);
+        rec.mtime = dirs[i].mtime;
+        rec.reserved = 0;
+        SAVE_STRING(rec.path, dirs[i].path);
+        CacheWrite(w, CACHE_DIRS, &rec, 1);
+    }
     return 0;
 error:
     return -1;
 }
 
-static int CacheSaveBank(FILE *file, vlc_plugin_t *const *cache, size_t n)
+static int CacheSaveAlign(FILE *file, size_t align)
 {
+    static const char zeroes[CACHE_ALIGN];
+
+    assert(align > 0 && align <= sizeof (zeroes));
+
+    size_t skip = (-ftell(file)) % align;
+    if (skip == 0)
+        return 0;
+
+    return (fwrite(zeroes, 1, skip, file) == skip) ? 0 : -1;
+}
+
+static int CacheSaveBank(FILE *file, vlc_plugin_t *const *cache, size_t n,
+                         const struct vlc_cache_dir *dirs, size_t dirs_count,
+                         long *restrict dirs_offset)
+{
+    cache_writer_t w = { .strings = NULL };
+    vlc_plugin_t **plugins = vlc_alloc(n, sizeof (*plugins));
+    struct cache_capmod *capmods = NULL;
+    size_t modules_count = 0;
     uint32_t i_file_size = 0;
+    int ret = -1;
+
+    if (unlikely(plugins == NULL && n > 0))
+        return -1;
+
+    if (n > 0)
+        memcpy(plugins, cache, n * sizeof (*plugins));
+    qsort(plugins, n, sizeof (*plugins), CachePluginCmp);
+
+    for (size_t i = 0; i < n; i++)
+        modules_count += plugins[i]->modules_count;
+
+    capmods = vlc_alloc(modules_count, sizeof (*capmods));
+    if (unlikely(capmods == NULL && modules_count > 0))
+    {
+        free(plugins);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < CACHE_SECTIONS; i++)
+    {
+        vlc_memstream_open(&w.sections[i]);
+        w.counts[i] = 0;
+    }
+
+    /* Offset zero stands for NULL */
+    CacheWrite(&w, CACHE_STRINGS, "", 1);
+
+    for (size_t i = 0, m = 0; i < n; i++)
+    {
+        if (CacheSavePlugin(&w, plugins[i], capmods + m))
+            goto out;
+        m += plugins[i]->modules_count;
+    }
+
+    if (CacheSaveCaps(&w, capmods, modules_count))
+        goto out;
+
+    if (CacheSaveDirs(&w, dirs, dirs_count))
+        goto out;
 
     /* Contains version number */
     if (fputs (CACHE_STRING, file) == EOF)
-        goto error;
+        goto out;
 #ifdef DISTRO_VERSION
     /* Allow binary maintaner to pass a string to detect new binary version*/
     if (fputs( DISTRO_VERSION, file ) == EOF)
-        goto error;
+        goto out;
 #endif
     /* Sub-version number (to avoid breakage in the dev version when cache
      * structure changes) */
     i_file_size = CACHE_SUBVERSION_NUM;
     if (fwrite (&i_file_size, sizeof (i_file_size), 1, file) != 1 )
-        goto error;
+        goto out;
 
     /* Header marker */
     i_file_size = ftell( file );
     if (fwrite (&i_file_size, sizeof (i_file_size), 1, file) != 1)
-        goto error;
+        goto out;
 
-    for (size_t i = 0; i < n; i++)
+    /* Table of contents */
+    struct cache_toc toc;
+    size_t offset;
+
+    if (CacheSaveAlign(file, CACHE_ALIGN))
+        goto out;
+
+    offset = ftell(file) + sizeof (toc);
+    for (unsigned i = 0; i < CACHE_SECTIONS; i++)
     {
-        const vlc_plugin_t *plugin = cache[i];
-        uint32_t count = plugin->modules_count;
+        offset += (-offset) % CACHE_ALIGN;
+        if (offset > UINT32_MAX || w.counts[i] > UINT32_MAX)
+            goto out;
 
-        SAVE_IMMEDIATE(count);
+        toc.sections[i].offset = offset;
+        toc.sections[i].count = w.counts[i];
+        offset += w.counts[i] * cache_record_size[i];
+    }
 
-        for (module_t *module = plugin->module;
-             module != NULL;
-             module = module->next)
-            if (CacheSaveModule(file, module))
-                goto error;
+    if (fwrite(&toc, sizeof (toc), 1, file) != 1)
+        goto out;
 
-        /* Config stuff */
-        if (CacheSaveModuleConfig(file, plugin))
-            goto error;
+    *dirs_offset = toc.sections[CACHE_DIRS].offset;
+    ret = 0;
+out:
+    for (unsigned i = 0; i < CACHE_SECTIONS; i++)
+    {
+        struct vlc_memstream *ms = &w.sections[i];
+
+        if (vlc_memstream_close(ms))
+        {
+            ret = -1;
+            continue;
+        }
 
-        /* Save common info */
-        SAVE_STRING(plugin->textdomain);
-        SAVE_STRING(plugin->path);
-        SAVE_FLAG(plugin->unloadable);
-        SAVE_IMMEDIATE(plugin->mtime);
-        SAVE_IMMEDIATE(plugin->size);
+        if (ret == 0
+         && (CacheSaveAlign(file, CACHE_ALIGN)
+          || fwrite(ms->ptr, 1, w.counts[i] * cache_record_size[i], file)
+                != w.counts[i] * cache_record_size[i]))
+            ret = -1;
+        free(ms->ptr);
     }
 
-    if (fflush (file)) /* flush libc buffers */
-        goto error;
-    return 0; /* success! */
+    tdestroy(w.strings, free);
+    free(capmods);
+    free(plugins);
 
-error:
-    return -1;
+    if (ret == 0 && fflush (file)) /* flush libc buffers */
+        ret = -1;
+    return ret;
 }
 
 /**
  * Saves a module cache to disk, and release cache data from memory.
  */
 void CacheSave(vlc_object_t *p_this, const char *dir,
-               vlc_plugin_t *const *entries, size_t n)
+               vlc_plugin_t *const *entries, size_t n,
+               const struct vlc_cache_dir *dirs, size_t dirs_count)
 {
     char *filename = NULL, *tmpname = NULL;
+    long dirs_offset;
 
     if (asprintf (&filename, "%s"DIR_SEP CACHE_NAME, dir ) == -1)
         goto out;
@@ -672,7 +1140,7 @@ void CacheSave(vlc_object_t *p_this, const char *dir,
         goto out;
     }
 
-    if (CacheSaveBank(file, entries, n))
+    if (CacheSaveBank(file, entries, n, dirs, dirs_count, &dirs_offset))
     {
         msg_Warn (p_this, "cannot write %s: %s", tmpname,
                   vlc_strerror_c(errno));
@@ -683,7 +1151,22 @@ void CacheSave(vlc_object_t *p_this, const char *dir,
     }
 
 #if !defined( _WIN32 ) && !defined( __OS2__ )
-    vlc_rename (tmpname, filename); /* atomically replace old cache */
+    if (vlc_rename (tmpname, filename) == 0 /* atomically replace old cache */
+     && dirs_count > 0 && dirs[0].path == NULL)
+    {
+        struct stat st;
+
+        /* The cache itself modified the base directory: record the latest
+         * modification time, lest the cache be always considered outdated. */
+        if (vlc_stat (dir, &st) == 0)
+        {
+            int64_t mtime = st.st_mtime;
+
+            if (fseek (file, dirs_offset + offsetof (struct cache_dir, mtime),
+                       SEEK_SET) == 0)
+                fwrite (&mtime, sizeof (mtime), 1, file);
+        }
+    }
     fclose (file);
 #else
     vlc_unlink (filename);
@@ -695,25 +1178,40 @@ out:
     free (tmpname);
 }
 
+
+static int vlc_cache_cmp(const void *key, const void *elem)
+{
+    const char *path = key;
+    const vlc_plugin_t *const *pp = elem;
+
+    return strcmp(path, (*pp)->path);
+}
+
 /**
- * Looks up a plugin file in a table of cached plugins.
+ * Looks up a plugin file in a cache, and takes it out if it is up to date.
  */
-vlc_plugin_t *vlc_cache_lookup(vlc_plugin_t **cache, const char *path)
+vlc_plugin_t *vlc_cache_lookup(vlc_plugin_cache_t *cache, const char *path,
+                               int64_t mtime, uint64_t size)
 {
-    vlc_plugin_t **pp = cache, *plugin;
+    vlc_plugin_t **pp = bsearch(path, cache->plugins, cache->count,
+                                sizeof (*pp), vlc_cache_cmp);
+    if (pp == NULL)
+        return NULL;
 
-    while ((plugin = *pp) != NULL)
-    {
-        if (plugin->path != NULL && !strcmp(plugin->path, path))
-        {
-            *pp = plugin->next;
-            plugin->next = NULL;
-            return plugin;
-        }
+    vlc_plugin_t *plugin = *pp;
+    size_t index = pp - cache->plugins;
+
+    if (cache->used[index])
+        return NULL;
 
-        pp = &plugin->next;
+    if (plugin->mtime != mtime || plugin->size != size)
+    {
+        msg_Err(cache->obj, "stale plugins cache: modified %s",
+                plugin->abspath);
+        return NULL;
     }
 
-    return NULL;
+    cache->used[index] = true;
+    return plugin;
 }
 #endif /* HAVE_DYNAMIC_PLUGINS */
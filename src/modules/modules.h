@@ -162,9 +162,45 @@ void *vlc_dlsym(void *handle, const char *) VLC_USED;
 char *vlc_dlerror(void) VLC_USED;
 
 /* Plugins cache */
-vlc_plugin_t *vlc_cache_load(vlc_object_t *, const char *, block_t **);
-vlc_plugin_t *vlc_cache_lookup(vlc_plugin_t **, const char *relpath);
+struct vlc_cache_dir
+{
+    const char *path; /**< Relative path, NULL for the base directory */
+    int64_t mtime; /**< Modification time */
+};
+
+typedef struct vlc_plugin_cache
+{
+    vlc_object_t *obj;
+    vlc_plugin_t **plugins; /**< Cached plug-ins, sorted by relative path */
+    bool *used; /**< Whether each plug-in was taken out of the cache */
+    size_t count; /**< Number of cached plug-ins */
 
-void CacheSave(vlc_object_t *, const char *, vlc_plugin_t *const *, size_t);
+    /** Cached modules, by index */
+    struct vlc_cache_module
+    {
+        module_t *module;
+        size_t plugin; /**< Index of the plug-in in the cache */
+    } *modules;
+
+    /** Modules of each capability */
+    struct vlc_cache_cap
+    {
+        const char *name; /**< Capability name */
+        const uint32_t *modv; /**< Module indices, by decreasing score */
+        size_t modc; /**< Number of modules */
+    } *caps;
+    size_t caps_count; /**< Number of capabilities */
+
+    struct vlc_cache_dir *dirs; /**< Directories browsed for the cache */
+    size_t dirs_count; /**< Number of browsed directories */
+} vlc_plugin_cache_t;
+
+vlc_plugin_cache_t *vlc_cache_load(vlc_object_t *, const char *, block_t **);
+vlc_plugin_t *vlc_cache_lookup(vlc_plugin_cache_t *, const char *relpath,
+                               int64_t mtime, uint64_t size);
+void vlc_cache_free(vlc_plugin_cache_t *);
+
+void CacheSave(vlc_object_t *, const char *, vlc_plugin_t *const *, size_t,
+               const struct vlc_cache_dir *, size_t);
 
 #endif /* !LIBVLC_MODULES_H */
@@ -43,6 +43,8 @@
 #include <vlc_url.h>
 #include <vlc_mime.h>
 #include <vlc_block.h>
+#include <vlc_fs.h>
+#include <vlc_metrics.h>
 #include "../libvlc.h"
 
 #include <string.h>
@@ -55,6 +57,12 @@
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+# include <sys/eventfd.h>
+#endif
 
 #if defined(_WIN32)
 #   include <winsock2.h>
@@ -69,10 +77,53 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* maximum number of stream chunks sent to a client at once */
+#define HTTPD_CL_CHUNKS 64
+
+/* A piece of stream data, shared by the stream ring and its clients */
+typedef struct httpd_stream_chunk_t
+{
+    atomic_uint refs;
+    int64_t     i_pos;      /* absolute position of the first byte */
+    bool        b_keyframe;
+    block_t     *p_block;   /* reference to the block sent to the stream */
+    const uint8_t *p_data;
+    size_t      i_data;
+} httpd_stream_chunk_t;
+
 static void httpd_ClientDestroy(httpd_client_t *cl);
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
+static void httpd_StreamChunkRelease(httpd_stream_chunk_t *chunk);
 
-/* each host run in his own thread */
+/* A thread servicing a share of the clients of a host */
+typedef struct httpd_worker_t
+{
+    httpd_host_t *host;
+    vlc_thread_t thread;
+    vlc_mutex_t  lock;
+
+    size_t client_count;
+    struct vlc_list clients;
+
+#ifdef HAVE_SYS_EPOLL_H
+    int epfd;
+    int wakefd[2]; /* wakes the worker up to run its queued clients */
+
+    /* clients waiting for stream data, or to be destroyed */
+    struct vlc_list queue;
+    atomic_uint queued;
+
+    /* binary min-heap of the clients by activity deadline */
+    httpd_client_t **timers;
+    size_t timer_count;
+    size_t timer_alloc;
+#endif
+} httpd_worker_t;
+
+#ifdef HAVE_SYS_EPOLL_H
+static void httpd_WorkerQueue(httpd_worker_t *w, httpd_client_t *cl);
+#endif
+
+/* each host run in its own thread(s) */
 struct httpd_host_t
 {
     struct vlc_common_members obj;
@@ -86,7 +137,10 @@ struct httpd_host_t
     unsigned     nfd;
     unsigned     port;
 
-    vlc_thread_t thread;
+    /* lock order: worker locks (in array order), then host lock.
+     * The host lock protects the urls and serializes their callbacks. */
+    httpd_worker_t *workers;
+    unsigned     nworkers;
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
@@ -96,11 +150,10 @@ struct httpd_host_t
      * */
     struct vlc_list urls;
 
-    size_t client_count;
-    struct vlc_list clients;
-
     /* TLS data */
     vlc_tls_creds_t *p_tls;
+
+    vlc_metric_t *clients; /* connected clients gauge */
 };
 
 
@@ -147,6 +200,14 @@ struct httpd_client_t
 
     bool    b_stream_mode;
     uint8_t i_state;
+#ifdef HAVE_SYS_EPOLL_H
+    uint32_t i_events; /* registered epoll events */
+
+    struct vlc_list queue_node;
+    bool b_queued;
+    size_t i_timer; /* position in the timers heap, or SIZE_MAX */
+    vlc_tick_t i_deadline; /* activity deadline as of the timers heap */
+#endif
 
     vlc_tick_t i_activity_date;
     vlc_tick_t i_activity_timeout;
@@ -163,6 +224,15 @@ struct httpd_client_t
      */
     int64_t i_keyframe_wait_to_pass;
 
+    /*
+     * Stream data being sent, referenced straight from the stream ring
+     * instead of p_buffer. i_chunk_start is the offset of the first byte
+     * to send within the first chunk.
+     */
+    httpd_stream_chunk_t *chunks[HTTPD_CL_CHUNKS];
+    unsigned i_chunks;
+    size_t   i_chunk_start;
+
     /* */
     httpd_message_t query;  /* client -> httpd */
     httpd_message_t answer; /* httpd -> client */
@@ -608,9 +678,13 @@ struct httpd_stream_t
     bool        b_has_keyframes;
     int64_t     i_last_keyframe_seen_pos;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* circular buffer of chunks, in stream order */
+    httpd_stream_chunk_t **pp_chunks;
+    size_t      i_chunks_alloc;
+    size_t      i_chunks_first;     /* index of the oldest chunk */
+    size_t      i_chunks;
+    size_t      i_buffer_size;      /* maximum amount of buffered data */
+    size_t      i_buffered;         /* amount of buffered data */
     int64_t     i_buffer_pos;       /* absolute position from beginning */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 
@@ -619,6 +693,41 @@ struct httpd_stream_t
     httpd_header * p_http_headers;
 };
 
+static void httpd_StreamChunkRelease(httpd_stream_chunk_t *chunk)
+{
+    if (atomic_fetch_sub_explicit(&chunk->refs, 1, memory_order_acq_rel) == 1) {
+        block_Release(chunk->p_block);
+        free(chunk);
+    }
+}
+
+static httpd_stream_chunk_t *httpd_StreamChunkAt(const httpd_stream_t *stream,
+                                                 size_t i)
+{
+    assert(i < stream->i_chunks);
+    return stream->pp_chunks[(stream->i_chunks_first + i) % stream->i_chunks_alloc];
+}
+
+/* Returns the index of the chunk holding the given position,
+ * or i_chunks if that position is not buffered (anymore) */
+static size_t httpd_StreamFindChunk(const httpd_stream_t *stream, int64_t i_pos)
+{
+    if (stream->i_chunks == 0
+     || i_pos < httpd_StreamChunkAt(stream, 0)->i_pos
+     || i_pos >= stream->i_buffer_pos)
+        return stream->i_chunks;
+
+    size_t lo = 0, hi = stream->i_chunks - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (httpd_StreamChunkAt(stream, mid)->i_pos <= i_pos)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
 static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                                  httpd_client_t *cl, httpd_message_t *answer,
                                  const httpd_message_t *query)
@@ -629,34 +738,42 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
+        vlc_mutex_lock(&stream->lock);
 
         if (answer->i_body_offset >= stream->i_buffer_pos)
-            return VLC_EGENERIC;    /* wait, no data available */
+            goto wait;  /* no data available */
 
         if (cl->i_keyframe_wait_to_pass >= 0) {
             if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
                 /* still waiting for the next keyframe */
-                return VLC_EGENERIC;
+                goto wait;
 
             /* seek to the new keyframe */
             answer->i_body_offset = stream->i_last_keyframe_seen_pos;
             cl->i_keyframe_wait_to_pass = -1;
         }
 
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
-            answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
+        size_t i_chunk = httpd_StreamFindChunk(stream, answer->i_body_offset);
+        if (i_chunk >= stream->i_chunks) {
+            /* this client isn't fast enough */
+            answer->i_body_offset = stream->i_buffer_last_pos;
+            i_chunk = stream->i_chunks - 1;
+        }
 
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
+        /* reference the data instead of copying it */
+        assert(cl->i_chunks == 0);
+        httpd_stream_chunk_t *chunk;
+        int64_t i_write;
+        do {
+            chunk = httpd_StreamChunkAt(stream, i_chunk);
+            atomic_fetch_add_explicit(&chunk->refs, 1, memory_order_relaxed);
+            cl->chunks[cl->i_chunks++] = chunk;
+            i_write = chunk->i_pos + chunk->i_data - answer->i_body_offset;
+        } while (++i_chunk < stream->i_chunks && cl->i_chunks < HTTPD_CL_CHUNKS
+                 && i_write < HTTPD_CL_BUFSIZE);
+        cl->i_chunk_start = answer->i_body_offset - cl->chunks[0]->i_pos;
 
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
+        vlc_mutex_unlock(&stream->lock);
 
         /* using HTTPD_MSG_ANSWER -> data available */
         answer->i_proto  = HTTPD_PROTO_HTTP;
@@ -664,12 +781,14 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         answer->i_type   = HTTPD_MSG_ANSWER;
 
         answer->i_body = i_write;
-        answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
+        answer->p_body = NULL;
 
         answer->i_body_offset += i_write;
 
         return VLC_SUCCESS;
+wait:
+        vlc_mutex_unlock(&stream->lock);
+        return VLC_EGENERIC;
     } else {
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
@@ -703,10 +822,16 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                 memcpy(answer->p_body, stream->p_header, stream->i_header);
             }
             answer->i_body_offset = stream->i_buffer_last_pos;
-            if (stream->b_has_keyframes)
-                cl->i_keyframe_wait_to_pass = stream->i_last_keyframe_seen_pos;
-            else
-                cl->i_keyframe_wait_to_pass = -1;
+            cl->i_keyframe_wait_to_pass = -1;
+            if (stream->b_has_keyframes) {
+                /* start from the last keyframe if it is still buffered,
+                 * otherwise wait for the next one */
+                if (httpd_StreamFindChunk(stream, stream->i_last_keyframe_seen_pos)
+                        < stream->i_chunks)
+                    answer->i_body_offset = stream->i_last_keyframe_seen_pos;
+                else
+                    cl->i_keyframe_wait_to_pass = stream->i_last_keyframe_seen_pos;
+            }
             vlc_mutex_unlock(&stream->lock);
         } else {
             httpd_MsgAdd(answer, "Content-Length", "0");
@@ -766,7 +891,11 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_header = 0;
     stream->p_header = NULL;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-    stream->p_buffer = xmalloc(stream->i_buffer_size);
+    stream->pp_chunks = NULL;
+    stream->i_chunks_alloc = 0;
+    stream->i_chunks_first = 0;
+    stream->i_chunks = 0;
+    stream->i_buffered = 0;
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
     stream->i_buffer_pos = 1;
@@ -802,42 +931,104 @@ int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
     return VLC_SUCCESS;
 }
 
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data)
+static void httpd_StreamDropChunk(httpd_stream_t *stream)
 {
-    int i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    int i_count = i_data;
-    while (i_count > 0) {
-        int i_copy = __MIN(i_count, stream->i_buffer_size - i_pos);
+    httpd_stream_chunk_t *chunk = httpd_StreamChunkAt(stream, 0);
 
-        /* Ok, we can't go past the end of our buffer */
-        memcpy(&stream->p_buffer[i_pos], p_data, i_copy);
+    stream->i_buffered -= chunk->i_data;
+    stream->i_chunks_first = (stream->i_chunks_first + 1) % stream->i_chunks_alloc;
+    stream->i_chunks--;
+    httpd_StreamChunkRelease(chunk);
+}
 
-        i_pos = (i_pos + i_copy) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+static void httpd_AppendChunk(httpd_stream_t *stream, httpd_stream_chunk_t *chunk)
+{
+    while (stream->i_chunks > 0
+        && stream->i_buffered + chunk->i_data > stream->i_buffer_size)
+        httpd_StreamDropChunk(stream);
+
+    if (stream->i_chunks == stream->i_chunks_alloc) {
+        size_t i_alloc = stream->i_chunks_alloc ? 2 * stream->i_chunks_alloc : 64;
+        httpd_stream_chunk_t **pp_chunks =
+            vlc_alloc(i_alloc, sizeof(*pp_chunks));
+        if (unlikely(pp_chunks == NULL)) {
+            if (stream->i_chunks == 0) {
+                httpd_StreamChunkRelease(chunk);
+                return;
+            }
+            httpd_StreamDropChunk(stream);
+        } else {
+            /* unwrap the ring */
+            for (size_t i = 0; i < stream->i_chunks; i++)
+                pp_chunks[i] = httpd_StreamChunkAt(stream, i);
+            free(stream->pp_chunks);
+            stream->pp_chunks = pp_chunks;
+            stream->i_chunks_alloc = i_alloc;
+            stream->i_chunks_first = 0;
+        }
     }
 
-    stream->i_buffer_pos += i_data;
+    stream->pp_chunks[(stream->i_chunks_first + stream->i_chunks)
+                      % stream->i_chunks_alloc] = chunk;
+    stream->i_chunks++;
+    stream->i_buffered += chunk->i_data;
+    stream->i_buffer_pos += chunk->i_data;
+}
+
+/* Wakes up the workers having clients queued */
+static void httpd_HostWakeUp(httpd_host_t *host)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    for (unsigned i = 0; i < host->nworkers; i++) {
+        httpd_worker_t *w = &host->workers[i];
+        uint64_t value = 1;
+
+        if (atomic_load(&w->queued) > 0)
+            write(w->wakefd[1], &value, sizeof (value));
+    }
+#else
+    VLC_UNUSED(host);
+#endif
 }
 
 int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
 {
-    if (!p_block || !p_block->p_buffer)
+    if (!p_block || !p_block->p_buffer || !p_block->i_buffer)
         return VLC_SUCCESS;
 
+    /* Hold the block outside of the lock, clients will only take references.
+     * The payload of a shared block (see block_shared_Alloc()) is not copied.
+     */
+    httpd_stream_chunk_t *chunk = malloc(sizeof(*chunk));
+    if (unlikely(chunk == NULL))
+        return VLC_ENOMEM;
+    chunk->p_block = block_Duplicate(p_block);
+    if (unlikely(chunk->p_block == NULL)) {
+        free(chunk);
+        return VLC_ENOMEM;
+    }
+    atomic_init(&chunk->refs, 1);
+    chunk->b_keyframe = (p_block->i_flags & BLOCK_FLAG_TYPE_I) != 0;
+    chunk->p_data = chunk->p_block->p_buffer;
+    chunk->i_data = chunk->p_block->i_buffer;
+
     vlc_mutex_lock(&stream->lock);
 
     /* save this pointer (to be used by new connection) */
     stream->i_buffer_last_pos = stream->i_buffer_pos;
+    chunk->i_pos = stream->i_buffer_pos;
 
-    if (p_block->i_flags & BLOCK_FLAG_TYPE_I) {
+    if (chunk->b_keyframe) {
         stream->b_has_keyframes = true;
         stream->i_last_keyframe_seen_pos = stream->i_buffer_pos;
     }
 
-    httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer);
+    httpd_AppendChunk(stream, chunk);
 
     vlc_mutex_unlock(&stream->lock);
+
+    /* Clients waiting for data are not polled for */
+    httpd_HostWakeUp(stream->url->host);
     return VLC_SUCCESS;
 }
 
@@ -852,17 +1043,91 @@ void httpd_StreamDelete(httpd_stream_t *stream)
     vlc_mutex_destroy(&stream->lock);
     free(stream->psz_mime);
     free(stream->p_header);
-    free(stream->p_buffer);
+    while (stream->i_chunks > 0)
+        httpd_StreamDropChunk(stream);
+    free(stream->pp_chunks);
     free(stream);
 }
 
 /*****************************************************************************
  * Low level
  *****************************************************************************/
-static void* httpd_HostThread(void *);
+static void* httpd_WorkerThread(void *);
 static httpd_host_t *httpd_HostCreate(vlc_object_t *, const char *,
                                        const char *, vlc_tls_creds_t *);
 
+static int httpd_WorkerInit(httpd_worker_t *w, httpd_host_t *host)
+{
+    w->host = host;
+    w->client_count = 0;
+    vlc_list_init(&w->clients);
+
+#ifdef HAVE_SYS_EPOLL_H
+    vlc_list_init(&w->queue);
+    atomic_init(&w->queued, 0);
+    w->timers = NULL;
+    w->timer_count = 0;
+    w->timer_alloc = 0;
+
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd == -1)
+        return -1;
+
+# if defined (HAVE_EVENTFD) && defined (EFD_CLOEXEC)
+    w->wakefd[0] = w->wakefd[1] = eventfd(0, EFD_CLOEXEC);
+    if (w->wakefd[0] == -1)
+# endif
+    if (vlc_pipe(w->wakefd)) {
+        vlc_close(w->epfd);
+        return -1;
+    }
+
+    struct epoll_event wev = {
+        .events = EPOLLIN,
+        .data.ptr = w,
+    };
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wakefd[0], &wev))
+        goto error;
+
+    /* Every worker watches all the listening sockets. The kernel wakes up
+     * only one of them per new connection if EPOLLEXCLUSIVE is supported. */
+    for (unsigned i = 0; i < host->nfd; i++) {
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.ptr = NULL,
+        };
+#ifdef EPOLLEXCLUSIVE
+        ev.events |= EPOLLEXCLUSIVE;
+#endif
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, host->fds[i], &ev))
+            goto error;
+    }
+#endif
+    vlc_mutex_init(&w->lock);
+    return 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+error:
+    if (w->wakefd[1] != w->wakefd[0])
+        vlc_close(w->wakefd[1]);
+    vlc_close(w->wakefd[0]);
+    vlc_close(w->epfd);
+    return -1;
+#endif
+}
+
+static void httpd_WorkerClean(httpd_worker_t *w)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (w->wakefd[1] != w->wakefd[0])
+        vlc_close(w->wakefd[1]);
+    vlc_close(w->wakefd[0]);
+    vlc_close(w->epfd);
+    free(w->timers);
+#endif
+    vlc_mutex_destroy(&w->lock);
+}
+
 /* create a new host */
 httpd_host_t *vlc_http_HostNew(vlc_object_t *p_this)
 {
@@ -939,6 +1204,10 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     vlc_mutex_init(&host->lock);
     vlc_cond_init(&host->wait);
     atomic_init(&host->ref, 1);
+    host->workers = NULL;
+    host->clients = vlc_metric_Register(host, VLC_METRIC_GAUGE,
+                                        "vlc_httpd_clients",
+                                        "Connected HTTP clients");
 
     char *hostname = var_InheritString(p_this, hostvar);
 
@@ -953,14 +1222,38 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
 
     host->port     = port;
     vlc_list_init(&host->urls);
-    host->client_count = 0;
-    vlc_list_init(&host->clients);
     host->p_tls    = p_tls;
 
-    /* create the thread */
-    if (vlc_clone(&host->thread, httpd_HostThread, host,
-                   VLC_THREAD_PRIORITY_LOW)) {
+#ifdef HAVE_SYS_EPOLL_H
+    int64_t nworkers = var_InheritInteger(p_this, "http-threads");
+    host->nworkers = (nworkers >= 1 && nworkers <= 64) ? nworkers : 1;
+#else
+    host->nworkers = 1;
+#endif
+    host->workers = vlc_alloc(host->nworkers, sizeof (*host->workers));
+    if (!host->workers) {
+        host->nworkers = 0;
+        goto error;
+    }
+
+    /* create the thread(s) */
+    for (unsigned i = 0; i < host->nworkers; i++) {
+        httpd_worker_t *w = &host->workers[i];
+
+        if (httpd_WorkerInit(w, host) == 0) {
+            if (vlc_clone(&w->thread, httpd_WorkerThread, w,
+                          VLC_THREAD_PRIORITY_LOW) == 0)
+                continue;
+            httpd_WorkerClean(w);
+        }
+
         msg_Err(p_this, "cannot spawn http host thread");
+        while (i > 0) {
+            w = &host->workers[--i];
+            vlc_cancel(w->thread);
+            vlc_join(w->thread, NULL);
+            httpd_WorkerClean(w);
+        }
         goto error;
     }
 
@@ -974,6 +1267,7 @@ error:
     vlc_mutex_unlock(&httpd.mutex);
 
     if (host) {
+        free(host->workers);
         net_ListenClose(host->fds);
         vlc_cond_destroy(&host->wait);
         vlc_mutex_destroy(&host->lock);
@@ -999,15 +1293,24 @@ void httpd_HostDelete(httpd_host_t *host)
     }
 
     vlc_list_remove(&host->node);
-    vlc_cancel(host->thread);
-    vlc_join(host->thread, NULL);
+    for (unsigned i = 0; i < host->nworkers; i++)
+        vlc_cancel(host->workers[i].thread);
+    for (unsigned i = 0; i < host->nworkers; i++)
+        vlc_join(host->workers[i].thread, NULL);
 
     msg_Dbg(host, "HTTP host removed");
 
-    vlc_list_foreach(client, &host->clients, node) {
-        msg_Warn(host, "client still connected");
-        httpd_ClientDestroy(client);
+    for (unsigned i = 0; i < host->nworkers; i++) {
+        httpd_worker_t *w = &host->workers[i];
+
+        vlc_list_foreach(client, &w->clients, node) {
+            msg_Warn(host, "client still connected");
+            httpd_ClientDestroy(client);
+        }
+        vlc_metric_Add(host->clients, -(int64_t)w->client_count);
+        httpd_WorkerClean(w);
     }
+    free(host->workers);
 
     assert(vlc_list_is_empty(&host->urls));
     vlc_tls_Delete(host->p_tls);
@@ -1052,7 +1355,7 @@ httpd_url_t *httpd_UrlNew(httpd_host_t *host, const char *psz_url,
     }
 
     vlc_list_append(&url->node, &host->urls);
-    vlc_cond_signal(&host->wait);
+    vlc_cond_broadcast(&host->wait);
     vlc_mutex_unlock(&host->lock);
 
     return url;
@@ -1076,6 +1379,8 @@ void httpd_UrlDelete(httpd_url_t *url)
     httpd_host_t *host = url->host;
     httpd_client_t *client;
 
+    for (unsigned i = 0; i < host->nworkers; i++)
+        vlc_mutex_lock(&host->workers[i].lock);
     vlc_mutex_lock(&host->lock);
     vlc_list_remove(&url->node);
 
@@ -1084,17 +1389,33 @@ void httpd_UrlDelete(httpd_url_t *url)
     free(url->psz_user);
     free(url->psz_password);
 
-    vlc_list_foreach(client, &host->clients, node) {
-        if (client->url != url)
-            continue;
+    for (unsigned i = 0; i < host->nworkers; i++) {
+        httpd_worker_t *w = &host->workers[i];
 
-        /* TODO complete it */
-        msg_Warn(host, "force closing connections");
-        host->client_count--;
-        httpd_ClientDestroy(client);
+        vlc_list_foreach(client, &w->clients, node) {
+            if (client->url != url)
+                continue;
+
+            /* TODO complete it */
+            msg_Warn(host, "force closing connections");
+#ifdef HAVE_SYS_EPOLL_H
+            /* The worker may hold pending events for this client:
+             * let it destroy the client itself. */
+            client->url = NULL;
+            client->i_state = HTTPD_CLIENT_DEAD;
+            httpd_WorkerQueue(w, client);
+#else
+            w->client_count--;
+            vlc_metric_Add(host->clients, -1);
+            httpd_ClientDestroy(client);
+#endif
+        }
     }
     free(url);
     vlc_mutex_unlock(&host->lock);
+    for (unsigned i = 0; i < host->nworkers; i++)
+        vlc_mutex_unlock(&host->workers[i].lock);
+    httpd_HostWakeUp(host);
 }
 
 static void httpd_MsgInit(httpd_message_t *msg)
@@ -1175,6 +1496,8 @@ static void httpd_ClientInit(httpd_client_t *cl, vlc_tick_t now)
     cl->i_buffer = 0;
     cl->p_buffer = xmalloc(cl->i_buffer_size);
     cl->i_keyframe_wait_to_pass = -1;
+    cl->i_chunks = 0;
+    cl->i_chunk_start = 0;
     cl->b_stream_mode = false;
 
     httpd_MsgInit(&cl->query);
@@ -1191,9 +1514,18 @@ char* httpd_ServerIP(const httpd_client_t *cl, char *ip, int *port)
     return net_GetSockAddress(vlc_tls_GetFD(cl->sock), ip, port) ? NULL : ip;
 }
 
+static void httpd_ClientReleaseChunks(httpd_client_t *cl)
+{
+    for (unsigned i = 0; i < cl->i_chunks; i++)
+        httpd_StreamChunkRelease(cl->chunks[i]);
+    cl->i_chunks = 0;
+    cl->i_chunk_start = 0;
+}
+
 static void httpd_ClientDestroy(httpd_client_t *cl)
 {
     vlc_list_remove(&cl->node);
+    httpd_ClientReleaseChunks(cl);
     vlc_tls_Close(cl->sock);
     httpd_MsgClean(&cl->answer);
     httpd_MsgClean(&cl->query);
@@ -1210,6 +1542,10 @@ static httpd_client_t *httpd_ClientNew(vlc_tls_t *sock, vlc_tick_t now)
 
     cl->sock    = sock;
     cl->url     = NULL;
+#ifdef HAVE_SYS_EPOLL_H
+    cl->b_queued = false;
+    cl->i_timer = SIZE_MAX;
+#endif
 
     httpd_ClientInit(cl, now);
     return cl;
@@ -1231,6 +1567,31 @@ ssize_t httpd_NetSend (httpd_client_t *cl, const uint8_t *p, size_t i_len)
     return sock->writev(sock, &iov, 1);
 }
 
+/* Sends the body from the referenced stream chunks, skipping the
+ * cl->i_buffer bytes already sent */
+static
+ssize_t httpd_NetSendChunks (httpd_client_t *cl)
+{
+    vlc_tls_t *sock = cl->sock;
+    struct iovec iov[HTTPD_CL_CHUNKS];
+    size_t i_skip = cl->i_chunk_start + cl->i_buffer;
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < cl->i_chunks; i++) {
+        const httpd_stream_chunk_t *chunk = cl->chunks[i];
+
+        if (i_skip >= chunk->i_data) {
+            i_skip -= chunk->i_data;
+            continue;
+        }
+        iov[n].iov_base = (void *)&chunk->p_data[i_skip];
+        iov[n].iov_len = chunk->i_data - i_skip;
+        i_skip = 0;
+        n++;
+    }
+    assert(n > 0);
+    return sock->writev(sock, iov, n);
+}
 
 static const struct
 {
@@ -1254,8 +1615,10 @@ msg_type[] =
 };
 
 
-static void httpd_ClientRecv(httpd_client_t *cl)
+/* Returns true if the client has to wait for more data to be received */
+static bool httpd_ClientRecv(httpd_client_t *cl)
 {
+    bool b_blocked = false;
     int i_len;
 
     /* ignore leading whites */
@@ -1532,13 +1895,18 @@ static void httpd_ClientRecv(httpd_client_t *cl)
         else
             cl->i_state = HTTPD_CLIENT_DEAD;
     }
+    else if (i_len < 0)
+        b_blocked = true;
 
     /* XXX: for QT I have to disable timeout. Try to find why */
     if (cl->query.i_proto == HTTPD_PROTO_RTSP)
         cl->i_activity_timeout = 0;
+
+    return b_blocked;
 }
 
-static void httpd_ClientSend(httpd_client_t *cl)
+/* Returns true if the client has to wait before sending more data */
+static bool httpd_ClientSend(httpd_host_t *host, httpd_client_t *cl)
 {
     int i_len;
 
@@ -1573,12 +1941,18 @@ static void httpd_ClientSend(httpd_client_t *cl)
         cl->i_buffer_size = (uint8_t*)p - cl->p_buffer;
     }
 
-    i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
-                           cl->i_buffer_size - cl->i_buffer);
+    if (cl->i_chunks > 0 && cl->p_buffer == NULL)
+        i_len = httpd_NetSendChunks(cl);
+    else
+        i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
+                               cl->i_buffer_size - cl->i_buffer);
     if (i_len >= 0) {
         cl->i_buffer += i_len;
 
         if (cl->i_buffer >= cl->i_buffer_size) {
+            if (cl->p_buffer == NULL)
+                httpd_ClientReleaseChunks(cl);
+
             if (cl->answer.i_body == 0  && cl->answer.i_body_offset > 0) {
                 /* catch more body data */
                 int     i_msg = cl->query.i_type;
@@ -1587,8 +1961,10 @@ static void httpd_ClientSend(httpd_client_t *cl)
                 httpd_MsgClean(&cl->answer);
                 cl->answer.i_body_offset = i_offset;
 
+                vlc_mutex_lock(&host->lock);
                 cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
                                           &cl->answer, &cl->query);
+                vlc_mutex_unlock(&host->lock);
             }
 
             if (cl->answer.i_body > 0) {
@@ -1613,7 +1989,10 @@ static void httpd_ClientSend(httpd_client_t *cl)
             /* error */
             cl->i_state = HTTPD_CLIENT_DEAD;
         }
+        else
+            return true;
     }
+    return false;
 }
 
 static void httpd_ClientTlsHandshake(httpd_host_t *host, httpd_client_t *cl)
@@ -1667,56 +2046,24 @@ auth_failed:
     return false;
 }
 
-static void httpdLoop(httpd_host_t *host)
+/**
+ * Runs the client state machine until it needs to wait for network I/O.
+ * \return the poll events to wait for, or 0 if the client is dead or is
+ * waiting for stream data.
+ */
+static short httpd_ClientPrepare(httpd_host_t *host, httpd_client_t *cl)
 {
-    struct pollfd ufd[host->nfd + host->client_count];
-    unsigned nfd;
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        ufd[nfd].fd = host->fds[nfd];
-        ufd[nfd].events = POLLIN;
-        ufd[nfd].revents = 0;
-    }
-
-    vlc_mutex_lock(&host->lock);
-    /* add all socket that should be read/write and close dead connection */
-    while (vlc_list_is_empty(&host->urls)) {
-        mutex_cleanup_push(&host->lock);
-        vlc_cond_wait(&host->wait, &host->lock);
-        vlc_cleanup_pop();
-    }
-
-    vlc_tick_t now = vlc_tick_now();
-    bool b_low_delay = false;
-    httpd_client_t *cl;
-
-    int canc = vlc_savecancel();
-    vlc_list_foreach(cl, &host->clients, node) {
+    for (;;) {
         int64_t i_offset;
 
-        if (cl->i_state == HTTPD_CLIENT_DEAD
-         || (cl->i_activity_timeout > 0
-          && cl->i_activity_date + cl->i_activity_timeout < now)) {
-            host->client_count--;
-            httpd_ClientDestroy(cl);
-            continue;
-        }
-
-        struct pollfd *pufd = ufd + nfd;
-        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
-
-        pufd->fd = vlc_tls_GetFD(cl->sock);
-        pufd->events = pufd->revents = 0;
-
         switch (cl->i_state) {
             case HTTPD_CLIENT_RECEIVING:
             case HTTPD_CLIENT_TLS_HS_IN:
-                pufd->events = POLLIN;
-                break;
+                return POLLIN;
 
             case HTTPD_CLIENT_SENDING:
             case HTTPD_CLIENT_TLS_HS_OUT:
-                pufd->events = POLLOUT;
-                break;
+                return POLLOUT;
 
             case HTTPD_CLIENT_RECEIVE_DONE: {
                 httpd_message_t *answer = &cl->answer;
@@ -1804,6 +2151,7 @@ static void httpdLoop(httpd_host_t *host)
                         bool b_auth_failed = false;
 
                         /* Search the url and trigger callbacks */
+                        vlc_mutex_lock(&host->lock);
                         vlc_list_foreach(url, &host->urls, node) {
                             if (strcmp(url->psz_url, query->psz_url))
                                 continue;
@@ -1831,6 +2179,7 @@ static void httpdLoop(httpd_host_t *host)
                             if (!cl->url)
                                 cl->url = url;
                         }
+                        vlc_mutex_unlock(&host->lock);
 
                         if (answer) {
                             answer->i_proto  = query->i_proto;
@@ -1906,32 +2255,421 @@ static void httpdLoop(httpd_host_t *host)
                 }
                 break;
 
-            case HTTPD_CLIENT_WAITING:
+            case HTTPD_CLIENT_WAITING: {
                 i_offset = cl->answer.i_body_offset;
                 int i_msg = cl->query.i_type;
 
                 httpd_MsgInit(&cl->answer);
                 cl->answer.i_body_offset = i_offset;
 
+                vlc_mutex_lock(&host->lock);
                 cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
                         &cl->answer, &cl->query);
-                if (cl->answer.i_type != HTTPD_MSG_NONE) {
-                    /* we have new data, so re-enter send mode */
-                    cl->i_buffer      = 0;
-                    cl->p_buffer      = cl->answer.p_body;
-                    cl->i_buffer_size = cl->answer.i_body;
-                    cl->answer.p_body = NULL;
-                    cl->answer.i_body = 0;
-                    cl->i_state = HTTPD_CLIENT_SENDING;
-                }
+                vlc_mutex_unlock(&host->lock);
+                if (cl->answer.i_type == HTTPD_MSG_NONE)
+                    return 0; /* no data yet, poll again later */
+
+                /* we have new data, so re-enter send mode */
+                cl->i_buffer      = 0;
+                cl->p_buffer      = cl->answer.p_body;
+                cl->i_buffer_size = cl->answer.i_body;
+                cl->answer.p_body = NULL;
+                cl->answer.i_body = 0;
+                cl->i_state = HTTPD_CLIENT_SENDING;
+                break;
+            }
+
+            default: /* HTTPD_CLIENT_DEAD */
+                return 0;
+        }
+    }
+}
+
+/* Performs pending network I/O; returns true if the socket would block */
+static bool httpd_ClientProcess(httpd_host_t *host, httpd_client_t *cl)
+{
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVING:
+            return httpd_ClientRecv(cl);
+        case HTTPD_CLIENT_SENDING:
+            return httpd_ClientSend(host, cl);
+        case HTTPD_CLIENT_TLS_HS_IN:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            httpd_ClientTlsHandshake(host, cl);
+            return cl->i_state == HTTPD_CLIENT_TLS_HS_IN
+                || cl->i_state == HTTPD_CLIENT_TLS_HS_OUT;
+    }
+    return false;
+}
+
+static bool httpd_ClientExpired(const httpd_client_t *cl, vlc_tick_t now)
+{
+    return cl->i_state == HTTPD_CLIENT_DEAD
+        || (cl->i_activity_timeout > 0
+         && cl->i_activity_date + cl->i_activity_timeout < now);
+}
+
+/* Accepts a new connection on a listening socket, NULL if there is none */
+static httpd_client_t *httpd_HostAccept(httpd_host_t *host, int fd,
+                                        vlc_tick_t now)
+{
+    fd = vlc_accept (fd, NULL, NULL, true);
+    if (fd == -1)
+        return NULL;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+            &(int){ 1 }, sizeof(int));
+
+    vlc_tls_t *sk = vlc_tls_SocketOpen(fd);
+    if (unlikely(sk == NULL))
+    {
+        vlc_close(fd);
+        return NULL;
+    }
+
+    if (host->p_tls != NULL)
+    {
+        const char *alpn[] = { "http/1.1", NULL };
+        vlc_tls_t *tls;
+
+        tls = vlc_tls_ServerSessionCreate(host->p_tls, sk, alpn);
+        if (tls == NULL)
+        {
+            vlc_tls_SessionDelete(sk);
+            return NULL;
+        }
+        sk = tls;
+    }
+
+    httpd_client_t *cl = httpd_ClientNew(sk, now);
+    if (unlikely(cl == NULL))
+    {
+        vlc_tls_Close(sk);
+        return NULL;
+    }
+
+    if (host->p_tls != NULL)
+        cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
+    return cl;
+}
+
+static void httpd_HostWaitUrls(httpd_host_t *host)
+{
+    vlc_mutex_lock(&host->lock);
+    mutex_cleanup_push(&host->lock);
+    while (vlc_list_is_empty(&host->urls))
+        vlc_cond_wait(&host->wait, &host->lock);
+    vlc_cleanup_pop();
+    vlc_mutex_unlock(&host->lock);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int httpd_WorkerWatch(httpd_worker_t *w, httpd_client_t *cl, int op,
+                             short events)
+{
+    struct epoll_event ev = {
+        .events = EPOLLET
+                | ((events & POLLIN) ? EPOLLIN : 0)
+                | ((events & POLLOUT) ? EPOLLOUT : 0),
+        .data.ptr = cl,
+    };
+
+    cl->i_events = ev.events;
+    return epoll_ctl(w->epfd, op, vlc_tls_GetFD(cl->sock), &ev);
+}
+
+/* The timers are a binary min-heap of the clients by activity deadline */
+static void httpd_TimerSwap(httpd_worker_t *w, size_t a, size_t b)
+{
+    httpd_client_t *cl = w->timers[a];
+
+    w->timers[a] = w->timers[b];
+    w->timers[b] = cl;
+    w->timers[a]->i_timer = a;
+    w->timers[b]->i_timer = b;
+}
+
+static void httpd_TimerSift(httpd_worker_t *w, size_t i)
+{
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (w->timers[parent]->i_deadline <= w->timers[i]->i_deadline)
+            break;
+        httpd_TimerSwap(w, i, parent);
+        i = parent;
+    }
+
+    for (;;) {
+        size_t min = i;
+
+        for (size_t c = 2 * i + 1; c <= 2 * i + 2 && c < w->timer_count; c++)
+            if (w->timers[c]->i_deadline < w->timers[min]->i_deadline)
+                min = c;
+        if (min == i)
+            break;
+        httpd_TimerSwap(w, i, min);
+        i = min;
+    }
+}
+
+static void httpd_TimerAdd(httpd_worker_t *w, httpd_client_t *cl)
+{
+    if (cl->i_activity_timeout <= 0)
+        return;
+
+    if (w->timer_count == w->timer_alloc) {
+        size_t alloc = w->timer_alloc ? 2 * w->timer_alloc : 64;
+        httpd_client_t **timers = realloc(w->timers, alloc * sizeof (*timers));
+
+        if (unlikely(timers == NULL))
+            return; /* the client will not time out */
+        w->timers = timers;
+        w->timer_alloc = alloc;
+    }
+
+    cl->i_deadline = cl->i_activity_date + cl->i_activity_timeout;
+    cl->i_timer = w->timer_count++;
+    w->timers[cl->i_timer] = cl;
+    httpd_TimerSift(w, cl->i_timer);
+}
+
+static void httpd_TimerRemove(httpd_worker_t *w, httpd_client_t *cl)
+{
+    size_t i = cl->i_timer;
+
+    if (i == SIZE_MAX)
+        return;
+    cl->i_timer = SIZE_MAX;
+
+    if (i != --w->timer_count) {
+        w->timers[i] = w->timers[w->timer_count];
+        w->timers[i]->i_timer = i;
+        httpd_TimerSift(w, i);
+    }
+}
+
+static void httpd_WorkerQueue(httpd_worker_t *w, httpd_client_t *cl)
+{
+    if (cl->b_queued)
+        return;
+    cl->b_queued = true;
+    vlc_list_append(&cl->queue_node, &w->queue);
+    atomic_fetch_add(&w->queued, 1);
+}
+
+static void httpd_WorkerUnqueue(httpd_worker_t *w, httpd_client_t *cl)
+{
+    if (!cl->b_queued)
+        return;
+    cl->b_queued = false;
+    vlc_list_remove(&cl->queue_node);
+    atomic_fetch_sub(&w->queued, 1);
+}
+
+static void httpd_WorkerDrop(httpd_worker_t *w, httpd_client_t *cl)
+{
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, vlc_tls_GetFD(cl->sock), NULL);
+    httpd_TimerRemove(w, cl);
+    httpd_WorkerUnqueue(w, cl);
+    w->client_count--;
+    vlc_metric_Add(w->host->clients, -1);
+    httpd_ClientDestroy(cl);
+}
+
+/**
+ * Drives a client until its socket would block or it stops waiting for I/O.
+ * Sockets are edge-triggered: the client can only be left alone once it got
+ * EAGAIN, or after its events were re-armed.
+ */
+static void httpd_WorkerRun(httpd_worker_t *w, httpd_client_t *cl,
+                            bool b_blocked)
+{
+    httpd_host_t *host = w->host;
+
+    for (;;) {
+        short events = httpd_ClientPrepare(host, cl);
+
+        if (events != 0 || cl->i_events != EPOLLET) {
+            uint32_t old = cl->i_events;
+
+            httpd_WorkerWatch(w, cl, EPOLL_CTL_MOD, events);
+            if (cl->i_events != old)
+                b_blocked = true;
+        }
+        if (events == 0 || b_blocked)
+            return;
+
+        b_blocked = httpd_ClientProcess(host, cl);
+    }
+}
+
+/**
+ * Destroys a dead client, or queues it while it waits for stream data:
+ * httpd_StreamSend() then wakes the worker up.
+ */
+static void httpd_WorkerSettle(httpd_worker_t *w, httpd_client_t *cl)
+{
+    if (cl->i_state == HTTPD_CLIENT_WAITING && !cl->b_queued) {
+        httpd_WorkerQueue(w, cl);
+        /* Data sent before the client was queued did not wake us up */
+        httpd_WorkerRun(w, cl, false);
+    }
+
+    if (cl->i_state == HTTPD_CLIENT_DEAD)
+        httpd_WorkerDrop(w, cl);
+    else if (cl->i_state != HTTPD_CLIENT_WAITING)
+        httpd_WorkerUnqueue(w, cl);
+}
+
+/* Destroys the timed out clients, and returns the next deadline */
+static vlc_tick_t httpd_WorkerExpire(httpd_worker_t *w, vlc_tick_t now)
+{
+    while (w->timer_count > 0) {
+        httpd_client_t *cl = w->timers[0];
+
+        if (cl->i_deadline >= now)
+            return cl->i_deadline;
+
+        /* The deadlines are only updated with the activity when they expire */
+        if (httpd_ClientExpired(cl, now))
+            httpd_WorkerDrop(w, cl);
+        else if (cl->i_activity_timeout > 0) {
+            cl->i_deadline = cl->i_activity_date + cl->i_activity_timeout;
+            httpd_TimerSift(w, 0);
+        } else
+            httpd_TimerRemove(w, cl);
+    }
+    return VLC_TICK_INVALID;
+}
+
+static void *httpd_WorkerThread(void *data)
+{
+    httpd_worker_t *w = data;
+    httpd_host_t *host = w->host;
+    struct epoll_event evs[64];
+    vlc_tick_t deadline = VLC_TICK_INVALID;
+
+    while (atomic_load_explicit(&host->ref, memory_order_relaxed) > 0) {
+        /* Clients left after the deletion of their URL are to be destroyed */
+        if (w->client_count == 0)
+            httpd_HostWaitUrls(host);
+
+        int timeout = -1;
+        if (deadline != VLC_TICK_INVALID) {
+            vlc_tick_t delay = deadline - vlc_tick_now();
+            timeout = delay > 0 ? MS_FROM_VLC_TICK(delay) + 1 : 0;
+        }
+
+        int n = epoll_wait(w->epfd, evs, ARRAY_SIZE(evs), timeout);
+        if (n < 0) {
+            if (errno != EINTR)
+                msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
+            continue;
+        }
+
+        int canc = vlc_savecancel();
+        vlc_mutex_lock(&w->lock);
+
+        vlc_tick_t now = vlc_tick_now();
+        httpd_client_t *cl;
+        bool b_woken = false;
+
+        for (int i = 0; i < n; i++) {
+            cl = evs[i].data.ptr;
+
+            if (evs[i].data.ptr == w) {
+                uint64_t dummy;
+
+                read(w->wakefd[0], &dummy, sizeof (dummy));
+                b_woken = true;
+                continue;
+            }
+
+            if (cl == NULL) {
+                /* Handle server sockets (accept new connections) */
+                for (unsigned j = 0; j < host->nfd; j++)
+                    while ((cl = httpd_HostAccept(host, host->fds[j],
+                                                  now)) != NULL) {
+                        if (httpd_WorkerWatch(w, cl, EPOLL_CTL_ADD, 0)) {
+                            vlc_list_init(&cl->node);
+                            httpd_ClientDestroy(cl);
+                            continue;
+                        }
+                        w->client_count++;
+                        vlc_metric_Add(host->clients, 1);
+                        vlc_list_append(&cl->node, &w->clients);
+                        httpd_TimerAdd(w, cl);
+                        httpd_WorkerRun(w, cl, false);
+                        httpd_WorkerSettle(w, cl);
+                    }
+                continue;
+            }
+
+            cl->i_activity_date = now;
+            httpd_WorkerRun(w, cl, httpd_ClientProcess(host, cl));
+            httpd_WorkerSettle(w, cl);
         }
 
+        /* Feed the clients waiting for stream data, destroy the dead ones */
+        if (b_woken)
+            vlc_list_foreach(cl, &w->queue, queue_node) {
+                if (cl->i_state == HTTPD_CLIENT_WAITING)
+                    httpd_WorkerRun(w, cl, false);
+                httpd_WorkerSettle(w, cl);
+            }
+
+        deadline = httpd_WorkerExpire(w, now);
+
+        vlc_mutex_unlock(&w->lock);
+        vlc_restorecancel(canc);
+    }
+    return NULL;
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+static void httpdLoop(httpd_worker_t *w)
+{
+    httpd_host_t *host = w->host;
+
+    httpd_HostWaitUrls(host);
+
+    int canc = vlc_savecancel();
+    vlc_mutex_lock(&w->lock);
+
+    struct pollfd ufd[host->nfd + w->client_count];
+    unsigned nfd;
+    for (nfd = 0; nfd < host->nfd; nfd++) {
+        ufd[nfd].fd = host->fds[nfd];
+        ufd[nfd].events = POLLIN;
+        ufd[nfd].revents = 0;
+    }
+
+    /* add all socket that should be read/write and close dead connection */
+    vlc_tick_t now = vlc_tick_now();
+    bool b_low_delay = false;
+    httpd_client_t *cl;
+
+    vlc_list_foreach(cl, &w->clients, node) {
+        if (httpd_ClientExpired(cl, now)) {
+            w->client_count--;
+            vlc_metric_Add(w->host->clients, -1);
+            httpd_ClientDestroy(cl);
+            continue;
+        }
+
+        struct pollfd *pufd = ufd + nfd;
+        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+
+        pufd->fd = vlc_tls_GetFD(cl->sock);
+        pufd->events = httpd_ClientPrepare(host, cl);
+        pufd->revents = 0;
+
         if (pufd->events != 0)
             nfd++;
         else
             b_low_delay = true;
     }
-    vlc_mutex_unlock(&host->lock);
+    vlc_mutex_unlock(&w->lock);
     vlc_restorecancel(canc);
 
     /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
@@ -1942,13 +2680,13 @@ static void httpdLoop(httpd_host_t *host)
     }
 
     canc = vlc_savecancel();
-    vlc_mutex_lock(&host->lock);
+    vlc_mutex_lock(&w->lock);
 
     /* Handle client sockets */
     now = vlc_tick_now();
     nfd = host->nfd;
 
-    vlc_list_foreach(cl, &host->clients, node) {
+    vlc_list_foreach(cl, &w->clients, node) {
         const struct pollfd *pufd = &ufd[nfd];
 
         assert(pufd < &ufd[sizeof(ufd) / sizeof(ufd[0])]);
@@ -1960,75 +2698,38 @@ static void httpdLoop(httpd_host_t *host)
             continue; // no event received
 
         cl->i_activity_date = now;
-
-        switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
-            case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
-            case HTTPD_CLIENT_TLS_HS_IN:
-            case HTTPD_CLIENT_TLS_HS_OUT:
-                httpd_ClientTlsHandshake(host, cl);
-                break;
-        }
+        httpd_ClientProcess(host, cl);
     }
 
     /* Handle server sockets (accept new connections) */
     for (nfd = 0; nfd < host->nfd; nfd++) {
-        int fd = ufd[nfd].fd;
-
-        assert (fd == host->fds[nfd]);
+        assert (ufd[nfd].fd == host->fds[nfd]);
 
         if (ufd[nfd].revents == 0)
             continue;
 
-        /* */
-        fd = vlc_accept (fd, NULL, NULL, true);
-        if (fd == -1)
-            continue;
-        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                &(int){ 1 }, sizeof(int));
-
-        vlc_tls_t *sk = vlc_tls_SocketOpen(fd);
-        if (unlikely(sk == NULL))
-        {
-            vlc_close(fd);
+        cl = httpd_HostAccept(host, ufd[nfd].fd, now);
+        if (cl == NULL)
             continue;
-        }
-
-        if (host->p_tls != NULL)
-        {
-            const char *alpn[] = { "http/1.1", NULL };
-            vlc_tls_t *tls;
-
-            tls = vlc_tls_ServerSessionCreate(host->p_tls, sk, alpn);
-            if (tls == NULL)
-            {
-                vlc_tls_SessionDelete(sk);
-                continue;
-            }
-            sk = tls;
-        }
-
-        cl = httpd_ClientNew(sk, now);
 
-        if (host->p_tls != NULL)
-            cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
-
-        host->client_count++;
-        vlc_list_append(&cl->node, &host->clients);
+        w->client_count++;
+        vlc_metric_Add(host->clients, 1);
+        vlc_list_append(&cl->node, &w->clients);
     }
 
-    vlc_mutex_unlock(&host->lock);
+    vlc_mutex_unlock(&w->lock);
     vlc_restorecancel(canc);
 }
 
-static void* httpd_HostThread(void *data)
+static void* httpd_WorkerThread(void *data)
 {
-    httpd_host_t *host = data;
+    httpd_worker_t *w = data;
 
-    while (atomic_load_explicit(&host->ref, memory_order_relaxed) > 0)
-        httpdLoop(host);
+    while (atomic_load_explicit(&w->host->ref, memory_order_relaxed) > 0)
+        httpdLoop(w);
     return NULL;
 }
+#endif /* !HAVE_SYS_EPOLL_H */
 
 int httpd_StreamSetHTTPHeaders(httpd_stream_t * p_stream,
                                const httpd_header *p_headers, size_t i_headers)
@@ -47,6 +47,8 @@ input_preparser_t *input_preparser_New( vlc_object_t * );
  * preparser object is deleted.
  * Listen to vlc_InputItemPreparseEnded event to get notified when item is
  * preparsed.
+ * Up to "preparse-threads" items are preparsed at the same time, and the items
+ * pushed with META_REQUEST_OPTION_PRIORITY are started before the other ones.
  *
  * @param timeout maximum time allowed to preparse the item. If -1, the default
  * "preparse-timeout" option will be used as a timeout. If 0, it will wait
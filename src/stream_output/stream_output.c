@@ -46,6 +46,7 @@
 #include <vlc_meta.h>
 #include <vlc_block.h>
 #include <vlc_codec.h>
+#include <vlc_metrics.h>
 #include <vlc_modules.h>
 
 #include "input/input_interface.h"
@@ -56,6 +57,17 @@
  *****************************************************************************/
 static char *sout_stream_url_to_chain( bool, const char * );
 
+struct sout_mux_owner
+{
+    sout_mux_t mux;
+    vlc_metric_t *p_metric; /**< muxing time histogram */
+};
+
+static inline struct sout_mux_owner *mux_get_owner( sout_mux_t *p_mux )
+{
+    return container_of( p_mux, struct sout_mux_owner, mux );
+}
+
 /*
  * Generic MRL parser
  *
@@ -355,12 +367,14 @@ int sout_AccessOutControl (sout_access_out_t *access, int query, ...)
 sout_mux_t * sout_MuxNew( sout_instance_t *p_sout, const char *psz_mux,
                           sout_access_out_t *p_access )
 {
+    struct sout_mux_owner *p_owner;
     sout_mux_t *p_mux;
     char       *psz_next;
 
-    p_mux = vlc_custom_create( p_sout, sizeof( *p_mux ), "mux" );
-    if( p_mux == NULL )
+    p_owner = vlc_custom_create( p_sout, sizeof( *p_owner ), "mux" );
+    if( p_owner == NULL )
         return NULL;
+    p_mux = &p_owner->mux;
 
     p_mux->p_sout = p_sout;
     psz_next = config_ChainCreate( &p_mux->psz_mux, &p_mux->p_cfg, psz_mux );
@@ -380,6 +394,8 @@ sout_mux_t * sout_MuxNew( sout_instance_t *p_sout, const char *psz_mux,
     p_mux->b_add_stream_any_time = false;
     p_mux->b_waiting_stream = true;
     p_mux->i_add_stream_start = VLC_TICK_INVALID;
+    p_owner->p_metric = vlc_metric_Register( p_mux, VLC_METRIC_HISTOGRAM,
+        "vlc_sout_mux_seconds", "Time spent in each muxer call" );
 
     p_mux->p_module =
         module_need( p_mux, "sout mux", p_mux->psz_mux, true );
@@ -556,7 +572,13 @@ int sout_MuxSendBuffer( sout_mux_t *p_mux, sout_input_t *p_input,
             return VLC_SUCCESS;
         p_mux->b_waiting_stream = false;
     }
-    return p_mux->pf_mux( p_mux );
+
+    vlc_tick_t start = vlc_tick_now();
+    int ret = p_mux->pf_mux( p_mux );
+
+    vlc_metric_Observe( mux_get_owner( p_mux )->p_metric,
+                        vlc_tick_now() - start );
+    return ret;
 }
 
 void sout_MuxFlush( sout_mux_t *p_mux, sout_input_t *p_input )
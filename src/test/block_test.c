@@ -86,11 +86,73 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+static void test_block_shared (void)
+{
+    block_t *block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    memcpy (block->p_buffer, text, sizeof (text));
+    block->i_pts = VLC_TICK_0 + 42;
+
+    block_t *shared = block_shared_Alloc (block);
+    assert (shared != NULL);
+    assert (block_shared_Alloc (shared) == shared);
+    assert (shared->p_buffer == block->p_buffer);
+    assert (shared->i_pts == VLC_TICK_0 + 42);
+
+    /* duplicates share the payload */
+    block_t *dup = block_Duplicate (shared);
+    assert (dup != NULL);
+    assert (dup->p_buffer == shared->p_buffer);
+    assert (dup->i_buffer == sizeof (text));
+    assert (dup->i_pts == VLC_TICK_0 + 42);
+
+    /* headers are private */
+    dup->p_buffer += 5;
+    dup->i_buffer -= 5;
+    assert (shared->i_buffer == sizeof (text));
+
+    /* growing a shared payload does not write to it */
+    block_t *grown = block_Realloc (block_Duplicate (shared), 4,
+                                    sizeof (text));
+    assert (grown != NULL);
+    assert (grown->p_buffer + 4 != shared->p_buffer);
+    memset (grown->p_buffer, 'A', 4);
+    assert (!memcmp (grown->p_buffer + 4, text, sizeof (text)));
+    block_Release (grown);
+
+    /* copy on write */
+    block_t *writable = block_MakeWritable (dup);
+    assert (writable != NULL);
+    assert (writable->p_buffer != shared->p_buffer + 5);
+    assert (!memcmp (writable->p_buffer, text + 5, sizeof (text) - 5));
+    memset (writable->p_buffer, 'A', writable->i_buffer);
+    block_Release (writable);
+    assert (!memcmp (shared->p_buffer, text, sizeof (text)));
+
+    /* last reference: no copy */
+    const uint8_t *payload = shared->p_buffer;
+    shared = block_MakeWritable (shared);
+    assert (shared != NULL);
+    assert (shared->p_buffer == payload);
+    block_Release (shared);
+
+    /* plain blocks are still copied */
+    block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    dup = block_Duplicate (block);
+    assert (dup != NULL);
+    assert (dup->p_buffer != block->p_buffer);
+    assert (block_MakeWritable (dup) == dup);
+    block_Release (dup);
+    block_Release (block);
+}
+
 int main (void)
 {
     test_block_File(false);
     test_block_File(true);
     test_block ();
+    test_block_shared ();
     return 0;
 }
 
@@ -139,6 +139,12 @@ static vout_thread_t *VoutCreate(vlc_object_t *object,
     vout_control_PushVoid(&vout->p->control, VOUT_CONTROL_INIT);
 
     vout_statistic_Init(&vout->p->statistic);
+    vout->p->metrics.displayed = vlc_metric_Register(vout, VLC_METRIC_COUNTER,
+        "vlc_vout_displayed_pictures_total", "Pictures displayed");
+    vout->p->metrics.lost = vlc_metric_Register(vout, VLC_METRIC_COUNTER,
+        "vlc_vout_late_pictures_total", "Pictures dropped for being late");
+    vout->p->metrics.display = vlc_metric_Register(vout, VLC_METRIC_HISTOGRAM,
+        "vlc_vout_display_seconds", "Time spent displaying each picture");
 
     vout_snapshot_Init(&vout->p->snapshot);
 
@@ -858,6 +864,7 @@ static int ThreadDisplayPreparePicture(vout_thread_t *vout, bool reuse, bool fra
                         msg_Warn(vout, "picture is too late to be displayed (missing %"PRId64" ms)", late/1000);
                         picture_Release(decoded);
                         vout_statistic_AddLost(&vout->p->statistic, 1);
+                        vlc_metric_Add(vout->p->metrics.lost, 1);
                         continue;
                     } else if (late > 0) {
                         msg_Dbg(vout, "picture might be displayed late (missing %"PRId64" ms)", late/1000);
@@ -1165,6 +1172,9 @@ static int ThreadDisplayRenderPicture(vout_thread_t *vout, bool is_forced)
     vout_display_Display(vd, todisplay, subpic);
 
     vout_statistic_AddDisplayed(&vout->p->statistic, 1);
+    vlc_metric_Add(vout->p->metrics.displayed, 1);
+    vlc_metric_Observe(vout->p->metrics.display,
+                       vlc_tick_now() - vout->p->displayed.date);
 
     return VLC_SUCCESS;
 }
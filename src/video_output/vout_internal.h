@@ -29,6 +29,7 @@
 #include <vlc_picture_pool.h>
 #include <vlc_vout_display.h>
 #include <vlc_vout_wrapper.h>
+#include <vlc_metrics.h>
 #include "snapshot.h"
 #include "statistic.h"
 #include "chrono.h"
@@ -71,6 +72,11 @@ struct vout_thread_sys_t
 
     /* Statistics */
     vout_statistic_t statistic;
+    struct {
+        vlc_metric_t *displayed;
+        vlc_metric_t *lost;
+        vlc_metric_t *display;
+    } metrics;
 
     /* Subpicture unit */
     vlc_mutex_t     spu_lock;
@@ -0,0 +1,225 @@
+/*****************************************************************************
+ * format.c: PCM format conversion and volume benchmark
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_tick.h>
+#include <vlc_aout.h>
+#include <vlc_fourcc.h>
+
+#include "../modules/audio_filter/converter/format_simd.h"
+#include "../modules/audio_mixer/float_simd.h"
+
+#define BENCH_SAMPLES (1024 * 1024)
+#define BENCH_LOOPS 16
+
+static const char *const simd_names[FORMAT_SIMD_COUNT] = {
+    [FORMAT_SIMD_C] = "c",
+    [FORMAT_SIMD_SSE2] = "sse2",
+    [FORMAT_SIMD_AVX2] = "avx2",
+    [FORMAT_SIMD_NEON] = "neon",
+};
+
+static bool simd_supported( int simd )
+{
+    switch( simd )
+    {
+        case FORMAT_SIMD_SSE2:
+            return vlc_CPU_SSE2();
+        case FORMAT_SIMD_AVX2:
+            return vlc_CPU_AVX2();
+        default:
+            return true;
+    }
+}
+
+static unsigned sample_size( vlc_fourcc_t fmt )
+{
+    return aout_BitsPerSample( fmt ) / 8;
+}
+
+/* Fills the buffer with samples, including out-of-range, halfway and
+ * infinite floating point values */
+static void fill( void *buf, vlc_fourcc_t fmt, size_t count )
+{
+    static const double special[] = {
+        0., -0., 1., -1., 2., -2., 1e10, -1e10, INFINITY, -INFINITY,
+        .5 / 32768., -.5 / 32768., 1.5 / 32768., -1.5 / 32768.,
+        32767.5 / 32768., -32768.5 / 32768., .5 / 2147483648.,
+        -.5 / 2147483648., 2147483646.5 / 2147483648., 2147483647. / 2147483648.,
+    };
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        uint32_t r = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        double v = (rand() / (double)RAND_MAX) * 3. - 1.5;
+
+        if( (r & 15) == 0 )
+            v = special[(r >> 4) % ARRAY_SIZE(special)];
+        else if( (r & 15) == 1 ) /* halfway between 16-bits steps */
+            v = ((int16_t)(r >> 8) + .5) / 32768.;
+
+        switch( fmt )
+        {
+            case VLC_CODEC_S16N:
+                ((int16_t *)buf)[i] = r;
+                break;
+            case VLC_CODEC_S32N:
+                ((int32_t *)buf)[i] = (r & 31) ? (int32_t)r
+                                               : ((r & 32) ? INT32_MAX
+                                                           : INT32_MIN);
+                break;
+            case VLC_CODEC_FL32:
+                ((float *)buf)[i] = v;
+                break;
+            case VLC_CODEC_FL64:
+                ((double *)buf)[i] = v;
+                break;
+        }
+    }
+}
+
+/* Checks a kernel against the C one, out of place and in place */
+static void check( format_convert_t convert, format_convert_t ref,
+                   vlc_fourcc_t src_fmt, vlc_fourcc_t dst_fmt,
+                   const uint8_t *src, size_t count,
+                   uint8_t *dst, uint8_t *dst_ref )
+{
+    const size_t dst_len = count * sample_size( dst_fmt );
+
+    ref( dst_ref, src, count );
+    convert( dst, src, count );
+    assert( memcmp( dst, dst_ref, dst_len ) == 0 );
+
+    if( sample_size( dst_fmt ) <= sample_size( src_fmt ) )
+    {
+        memcpy( dst, src, count * sample_size( src_fmt ) );
+        convert( dst, dst, count );
+        assert( memcmp( dst, dst_ref, dst_len ) == 0 );
+    }
+}
+
+static void bench( const char *psz_name, format_convert_t convert,
+                   vlc_fourcc_t src_fmt, vlc_fourcc_t dst_fmt,
+                   const void *src, void *dst, size_t count )
+{
+    vlc_tick_t i_start = vlc_tick_now();
+
+    for( int i = 0; i < BENCH_LOOPS; i++ )
+        convert( dst, src, count );
+
+    vlc_tick_t i_duration = vlc_tick_now() - i_start;
+    printf( "%4.4s -> %4.4s %-4s: %"PRId64" us, %.0f Msamples/s\n",
+            (const char *)&src_fmt, (const char *)&dst_fmt, psz_name,
+            i_duration, (double)BENCH_LOOPS * count * CLOCK_FREQ / 1e6
+                / (i_duration > 0 ? i_duration : 1) );
+}
+
+static void test_conversions( uint8_t *src, uint8_t *dst, uint8_t *dst_ref )
+{
+    for( size_t i = 0; i < ARRAY_SIZE(format_conversions); i++ )
+    {
+        const vlc_fourcc_t src_fmt = format_conversions[i].src;
+        const vlc_fourcc_t dst_fmt = format_conversions[i].dst;
+        const format_convert_t ref = format_conversions[i].convert[FORMAT_SIMD_C];
+
+        fill( src, src_fmt, BENCH_SAMPLES );
+
+        for( int simd = 0; simd < FORMAT_SIMD_COUNT; simd++ )
+        {
+            format_convert_t convert = format_conversions[i].convert[simd];
+            if( convert == NULL || !simd_supported( simd ) )
+                continue;
+            assert( format_FindConversion( src_fmt, dst_fmt, simd ) == convert );
+
+            /* Every tail length, from unaligned buffers */
+            for( size_t count = 0; count < 67; count++ )
+                check( convert, ref, src_fmt, dst_fmt,
+                       src + sample_size( src_fmt ), count, dst + 1, dst_ref );
+            check( convert, ref, src_fmt, dst_fmt, src, BENCH_SAMPLES,
+                   dst, dst_ref );
+
+            bench( simd_names[simd], convert, src_fmt, dst_fmt,
+                   src, dst, BENCH_SAMPLES );
+        }
+        assert( format_FindConversion( src_fmt, dst_fmt,
+                                       FORMAT_SIMD_AUTO ) != NULL );
+    }
+}
+
+static void test_volume( vlc_fourcc_t fmt, uint8_t *buf, uint8_t *buf_ref )
+{
+    const size_t len = BENCH_SAMPLES * sample_size( fmt );
+
+    fill( buf_ref, fmt, BENCH_SAMPLES );
+    volume_FindAmplify( fmt, VOLUME_SIMD_C )( buf_ref, BENCH_SAMPLES, .7f );
+
+    for( int simd = 0; simd < VOLUME_SIMD_COUNT; simd++ )
+    {
+        volume_amplify_t amplify = volume_FindAmplify( fmt, simd );
+        if( amplify == NULL || !simd_supported( simd ) )
+            continue;
+
+        srand( 42 );
+        fill( buf, fmt, BENCH_SAMPLES );
+        amplify( buf, BENCH_SAMPLES, .7f );
+        assert( memcmp( buf, buf_ref, len ) == 0 );
+
+        vlc_tick_t i_start = vlc_tick_now();
+        for( int i = 0; i < BENCH_LOOPS; i++ )
+            amplify( buf, BENCH_SAMPLES, 1.f - i * 1e-3f );
+
+        vlc_tick_t i_duration = vlc_tick_now() - i_start;
+        printf( "%4.4s volume %-4s: %"PRId64" us, %.0f Msamples/s\n",
+                (const char *)&fmt, simd_names[simd], i_duration,
+                (double)BENCH_LOOPS * BENCH_SAMPLES * CLOCK_FREQ / 1e6
+                    / (i_duration > 0 ? i_duration : 1) );
+    }
+    assert( volume_FindAmplify( fmt, VOLUME_SIMD_AUTO ) != NULL );
+}
+
+int main( void )
+{
+    /* Room for the largest samples, plus the unaligned offsets */
+    uint8_t *src = malloc( BENCH_SAMPLES * 8 + 8 );
+    uint8_t *dst = malloc( BENCH_SAMPLES * 8 + 8 );
+    uint8_t *dst_ref = malloc( BENCH_SAMPLES * 8 + 8 );
+    assert( src != NULL && dst != NULL && dst_ref != NULL );
+
+    srand( 42 );
+    test_conversions( src, dst, dst_ref );
+
+    srand( 42 );
+    test_volume( VLC_CODEC_FL32, dst, dst_ref );
+    srand( 42 );
+    test_volume( VLC_CODEC_FL64, dst, dst_ref );
+
+    free( dst_ref );
+    free( dst );
+    free( src );
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * csa.c: CSA batch (de)scrambler test
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define TS_NO_CSA_CK_MSG
+#include "../modules/mux/mpeg/csa.c"
+
+#undef NDEBUG
+#include <assert.h>
+
+const char vlc_module_name[] = "test_csa";
+
+#define PACKETS 600
+
+static void packets_Fill( uint8_t (*p_pkt)[188], unsigned i_count )
+{
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        for( int j = 0; j < 188; j++ )
+            p_pkt[i][j] = rand();
+        p_pkt[i][0] = 0x47;
+        p_pkt[i][3] &= 0x3f;
+        /* some packets with adaptation fields, up to the whole packet */
+        if( p_pkt[i][3]&0x20 )
+            p_pkt[i][4] = rand() % 184;
+    }
+}
+
+static void test_batch( csa_t *c, unsigned i_count, int i_pkt_size )
+{
+    static uint8_t plain[PACKETS][188], ref[PACKETS][188], pkt[PACKETS][188];
+    uint8_t *pp_pkt[PACKETS];
+
+    assert( i_count <= PACKETS );
+    packets_Fill( plain, i_count );
+    for( unsigned i = 0; i < i_count; i++ )
+        pp_pkt[i] = pkt[i];
+
+    /* scramble the first part of the batch with the odd key, the other one
+     * with the even key */
+    for( int odd = 0; odd < 2; odd++ )
+    {
+        const unsigned i_start = odd ? 0 : i_count / 3;
+        const unsigned i_end = odd ? i_count / 3 : i_count;
+
+        csa_UseKey( NULL, c, odd );
+        memcpy( ref[i_start], plain[i_start], 188 * (i_end - i_start) );
+        memcpy( pkt[i_start], plain[i_start], 188 * (i_end - i_start) );
+        for( unsigned i = i_start; i < i_end; i++ )
+            csa_Encrypt( c, ref[i], i_pkt_size );
+        csa_EncryptBatch( c, &pp_pkt[i_start], i_end - i_start, i_pkt_size );
+    }
+    assert( !memcmp( ref, pkt, 188 * i_count ) );
+
+    /* leave some packets unscrambled */
+    for( unsigned i = 0; i < i_count; i += 7 )
+    {
+        memcpy( ref[i], plain[i], 188 );
+        memcpy( pkt[i], plain[i], 188 );
+    }
+
+    for( unsigned i = 0; i < i_count; i++ )
+        csa_Decrypt( c, ref[i], i_pkt_size );
+    csa_DecryptBatch( c, pp_pkt, i_count, i_pkt_size );
+    assert( !memcmp( ref, pkt, 188 * i_count ) );
+    assert( !memcmp( plain, pkt, 188 * i_count ) );
+}
+
+int main( void )
+{
+    static const unsigned counts[] = { 1, 32, 63, 64, 65, 128, 129, 256, 257, 600 };
+    static const int sizes[] = { 188, 184, 100, 12 };
+    char ck_odd[] = "0x0123456789abcdef";
+    char ck_even[] = "f0e1d2c3b4a59687";
+
+    csa_t *c = csa_New();
+    assert( c != NULL );
+    assert( csa_SetCW( NULL, c, ck_odd, true ) == VLC_SUCCESS );
+    assert( csa_SetCW( NULL, c, ck_even, false ) == VLC_SUCCESS );
+
+    srand( 42 );
+    for( size_t i = 0; i < ARRAY_SIZE(counts); i++ )
+    {
+        for( size_t j = 0; j < ARRAY_SIZE(sizes); j++ )
+            test_batch( c, counts[i], sizes[j] );
+    }
+
+    csa_Delete( c );
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*****************************************************************************
+ * csa_bench.c: CSA batch (de)scrambler benchmark
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define TS_NO_CSA_CK_MSG
+#include "../modules/mux/mpeg/csa.c"
+
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_tick.h>
+
+const char vlc_module_name[] = "test_csa_bench";
+
+#define PACKETS 256
+
+static void bench( csa_t *c, unsigned i_count )
+{
+    static uint8_t pkt[PACKETS][188];
+    uint8_t *pp_pkt[PACKETS];
+    vlc_tick_t i_scalar, i_batch;
+
+    assert( i_count <= PACKETS );
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        for( int j = 0; j < 188; j++ )
+            pkt[i][j] = rand();
+        pkt[i][0] = 0x47;
+        pkt[i][3] = 0x10;
+        pp_pkt[i] = pkt[i];
+    }
+
+    i_scalar = vlc_tick_now();
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        pkt[i][3] |= 0x80;
+        csa_Decrypt( c, pkt[i], 188 );
+    }
+    i_scalar = vlc_tick_now() - i_scalar;
+
+    for( unsigned i = 0; i < i_count; i++ )
+        pkt[i][3] |= 0x80;
+    i_batch = vlc_tick_now();
+    csa_DecryptBatch( c, pp_pkt, i_count, 188 );
+    i_batch = vlc_tick_now() - i_batch;
+
+    printf( "%3u packets: %"PRId64" us scalar, %"PRId64" us batch\n",
+            i_count, i_scalar, i_batch );
+}
+
+int main( void )
+{
+    char ck[] = "0x0123456789abcdef";
+
+    csa_t *c = csa_New();
+    assert( c != NULL );
+    assert( csa_SetCW( NULL, c, ck, true ) == VLC_SUCCESS );
+    assert( csa_SetCW( NULL, c, ck, false ) == VLC_SUCCESS );
+
+    srand( 42 );
+    bench( c, 64 );
+    bench( c, 128 );
+    bench( c, 256 );
+
+    csa_Delete( c );
+    return 0;
+}
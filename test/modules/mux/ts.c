@@ -0,0 +1,243 @@
+/*****************************************************************************
+ * ts.c: TS muxer test
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <vlc/vlc.h>
+
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_es.h>
+#include <vlc_fs.h>
+#include <vlc_sout.h>
+
+#include <unistd.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+/*
+ * Muxes the same streams with the --sout-ts-threads packetizing threads and
+ * without, and checks that the elementary streams packets are the same.
+ * The PSI packets are not compared, as they have random version numbers.
+ */
+
+#define AUDIO_STREAMS 3
+#define FRAMES 300
+#define FRAME_LENGTH VLC_TICK_FROM_MS(40)
+
+typedef struct
+{
+    uint8_t *p_data;
+    size_t   i_size;
+} ts_output_t;
+
+static block_t *frame_New( unsigned i_stream, unsigned i_frame )
+{
+    size_t i_size = (i_stream == 0) ? 3000 + (i_frame % 7) * 1500
+                                    : 300 + (i_frame % 3) * 50;
+    block_t *p_block = block_Alloc( i_size );
+    assert( p_block != NULL );
+
+    for( size_t i = 0; i < i_size; i++ )
+        p_block->p_buffer[i] = i * 31 + i_frame * 7 + i_stream;
+
+    p_block->i_dts = p_block->i_pts = VLC_TICK_0 + i_frame * FRAME_LENGTH;
+    p_block->i_length = FRAME_LENGTH;
+    if( i_stream == 0 )
+        p_block->i_flags = (i_frame % 12 == 0) ? BLOCK_FLAG_TYPE_I
+                                               : BLOCK_FLAG_TYPE_P;
+    return p_block;
+}
+
+static int mux_Run( vlc_object_t *p_obj, unsigned i_threads,
+                    ts_output_t *p_out )
+{
+    char psz_path[] = "/tmp/libvlc_ts_XXXXXX";
+    int fd = vlc_mkstemp( psz_path );
+    assert( fd != -1 );
+    vlc_close( fd );
+
+    sout_instance_t *p_sout = vlc_object_create( p_obj, sizeof (*p_sout) );
+    assert( p_sout != NULL );
+    p_sout->psz_sout = NULL;
+    p_sout->i_out_pace_nocontrol = 0;
+    vlc_mutex_init( &p_sout->lock );
+    p_sout->p_stream = NULL;
+    var_Create( p_sout, "sout-mux-caching",
+                VLC_VAR_INTEGER | VLC_VAR_DOINHERIT );
+
+    sout_access_out_t *p_access = sout_AccessOutNew( p_sout, "file",
+                                                     psz_path );
+    assert( p_access != NULL );
+
+    char psz_mux[32];
+    snprintf( psz_mux, sizeof (psz_mux), "ts{threads=%u}", i_threads );
+
+    sout_mux_t *p_mux = sout_MuxNew( p_sout, psz_mux, p_access );
+    if( p_mux == NULL )
+    {
+        sout_AccessOutDelete( p_access );
+        vlc_mutex_destroy( &p_sout->lock );
+        vlc_object_release( p_sout );
+        vlc_unlink( psz_path );
+        return VLC_EGENERIC;
+    }
+
+    sout_input_t *pp_inputs[1 + AUDIO_STREAMS];
+    es_format_t fmt;
+
+    es_format_Init( &fmt, VIDEO_ES, VLC_CODEC_MPGV );
+    fmt.video.i_width = fmt.video.i_visible_width = 720;
+    fmt.video.i_height = fmt.video.i_visible_height = 576;
+    pp_inputs[0] = sout_MuxAddStream( p_mux, &fmt );
+    assert( pp_inputs[0] != NULL );
+    es_format_Clean( &fmt );
+
+    for( unsigned i = 1; i <= AUDIO_STREAMS; i++ )
+    {
+        es_format_Init( &fmt, AUDIO_ES, VLC_CODEC_MPGA );
+        fmt.audio.i_rate = 48000;
+        fmt.audio.i_channels = 2;
+        pp_inputs[i] = sout_MuxAddStream( p_mux, &fmt );
+        assert( pp_inputs[i] != NULL );
+        es_format_Clean( &fmt );
+    }
+
+    for( unsigned i = 0; i < FRAMES; i++ )
+        for( unsigned j = 0; j <= AUDIO_STREAMS; j++ )
+            sout_MuxSendBuffer( p_mux, pp_inputs[j], frame_New( j, i ) );
+
+    for( unsigned i = 0; i <= AUDIO_STREAMS; i++ )
+        sout_MuxDeleteStream( p_mux, pp_inputs[i] );
+    sout_MuxDelete( p_mux );
+    sout_AccessOutDelete( p_access );
+    vlc_mutex_destroy( &p_sout->lock );
+    vlc_object_release( p_sout );
+
+    block_t *p_file = block_FilePath( psz_path, false );
+    assert( p_file != NULL );
+    vlc_unlink( psz_path );
+
+    p_out->i_size = p_file->i_buffer;
+    p_out->p_data = malloc( p_file->i_buffer );
+    assert( p_out->p_data != NULL );
+    memcpy( p_out->p_data, p_file->p_buffer, p_file->i_buffer );
+    block_Release( p_file );
+    return VLC_SUCCESS;
+}
+
+static void output_Check( const ts_output_t *p_out )
+{
+    int pi_cc[8192];
+
+    assert( p_out->i_size > 0 && p_out->i_size % 188 == 0 );
+
+    for( unsigned i = 0; i < 8192; i++ )
+        pi_cc[i] = -1;
+
+    for( size_t i = 0; i < p_out->i_size; i += 188 )
+    {
+        const uint8_t *p = &p_out->p_data[i];
+        uint16_t i_pid = ((p[1] & 0x1f) << 8) | p[2];
+
+        assert( p[0] == 0x47 );
+        if( i_pid == 0x1fff || !(p[3] & 0x10) )
+            continue;
+
+        /* Continuity counters of the packets with payload */
+        int i_cc = p[3] & 0x0f;
+        assert( pi_cc[i_pid] == -1 || i_cc == ((pi_cc[i_pid] + 1) & 0xf) );
+        pi_cc[i_pid] = i_cc;
+    }
+}
+
+/* Keeps only the packets of the PIDs carrying PES, as the PSI packets are
+ * not deterministic */
+static void output_StripPSI( ts_output_t *p_out )
+{
+    bool pb_pes[8192] = { false };
+
+    for( size_t i = 0; i < p_out->i_size; i += 188 )
+    {
+        const uint8_t *p = &p_out->p_data[i];
+        const uint8_t *p_payload = (p[3] & 0x20) ? &p[5 + p[4]] : &p[4];
+
+        if( (p[1] & 0x40) && (p[3] & 0x10) && p_payload + 3 <= p + 188
+         && p_payload[0] == 0 && p_payload[1] == 0 && p_payload[2] == 1 )
+            pb_pes[((p[1] & 0x1f) << 8) | p[2]] = true;
+    }
+
+    size_t i_size = 0;
+
+    for( size_t i = 0; i < p_out->i_size; i += 188 )
+    {
+        const uint8_t *p = &p_out->p_data[i];
+
+        if( pb_pes[((p[1] & 0x1f) << 8) | p[2]] )
+        {
+            memmove( &p_out->p_data[i_size], p, 188 );
+            i_size += 188;
+        }
+    }
+    p_out->i_size = i_size;
+}
+
+int main( void )
+{
+    alarm( 10 );
+    setenv( "VLC_PLUGIN_PATH", "../modules", 1 );
+
+    libvlc_instance_t *p_libvlc = libvlc_new( 0, NULL );
+    assert( p_libvlc != NULL );
+    vlc_object_t *p_obj = VLC_OBJECT(p_libvlc->p_libvlc_int);
+
+    ts_output_t ref;
+    if( mux_Run( p_obj, 1, &ref ) )
+    {
+        fprintf( stderr, "TS muxer not available, skipping\n" );
+        libvlc_release( p_libvlc );
+        return 77;
+    }
+    output_Check( &ref );
+    output_StripPSI( &ref );
+    assert( ref.i_size > 0 );
+
+    static const unsigned threads[] = { 2, 3, 8 };
+
+    for( size_t i = 0; i < ARRAY_SIZE(threads); i++ )
+    {
+        ts_output_t out;
+
+        assert( mux_Run( p_obj, threads[i], &out ) == VLC_SUCCESS );
+        output_Check( &out );
+        output_StripPSI( &out );
+        assert( out.i_size == ref.i_size );
+        assert( !memcmp( out.p_data, ref.p_data, ref.i_size ) );
+        free( out.p_data );
+    }
+
+    free( ref.p_data );
+    libvlc_release( p_libvlc );
+    return 0;
+}
@@ -87,6 +87,34 @@ static int run_annexb_sets( const uint8_t *p_set, const uint8_t *p_end,
     }
     else printf("asm not built in, skipping test:\n");
 
+#if defined(CAN_COMPILE_SSE2) || defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+    {
+        printf("checking sse2 code:\n");
+        i_ret = check_set( p_set, p_end, p_results, i_results, i_results_offset,
+                           startcode_FindAnnexB_SSE2 );
+        if( i_ret != 0 )
+            return i_ret;
+    }
+#endif
+#ifdef STARTCODE_HAVE_AVX2
+    if( vlc_CPU_AVX2() )
+    {
+        printf("checking avx2 code:\n");
+        i_ret = check_set( p_set, p_end, p_results, i_results, i_results_offset,
+                           startcode_FindAnnexB_AVX2 );
+        if( i_ret != 0 )
+            return i_ret;
+    }
+#endif
+#ifdef STARTCODE_HAVE_NEON
+    printf("checking neon code:\n");
+    i_ret = check_set( p_set, p_end, p_results, i_results, i_results_offset,
+                       startcode_FindAnnexB_NEON );
+    if( i_ret != 0 )
+        return i_ret;
+#endif
+
     return 0;
 }
 
@@ -0,0 +1,105 @@
+/*****************************************************************************
+ * startcode.c: AnnexB startcode lookup benchmark
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_tick.h>
+
+#include "../modules/packetizer/startcode_helper.h"
+
+#define BENCH_SIZE (8 * 1024 * 1024)
+#define BENCH_LOOPS 16
+
+typedef const uint8_t *(*startcode_finder)(const uint8_t *, const uint8_t *);
+
+/* Looks up all the startcodes of the buffer, as the packetizers do */
+static size_t count_startcodes( const uint8_t *p, const uint8_t *end,
+                                startcode_finder pf_find )
+{
+    size_t i_count = 0;
+
+    while( (p = pf_find( p, end )) != NULL )
+    {
+        i_count++;
+        p += 3;
+    }
+    return i_count;
+}
+
+static size_t bench( const char *psz_name, const uint8_t *p_buf, size_t i_buf,
+                     startcode_finder pf_find )
+{
+    size_t i_count = 0;
+    vlc_tick_t i_start = vlc_tick_now();
+
+    for( int i = 0; i < BENCH_LOOPS; i++ )
+        i_count = count_startcodes( p_buf, p_buf + i_buf, pf_find );
+
+    vlc_tick_t i_duration = vlc_tick_now() - i_start;
+    printf( "%-6s: %zu startcodes, %"PRId64" us, %.0f MiB/s\n", psz_name,
+            i_count, i_duration,
+            (double)BENCH_LOOPS * i_buf * CLOCK_FREQ / (1024 * 1024)
+                / (i_duration > 0 ? i_duration : 1) );
+    return i_count;
+}
+
+int main( void )
+{
+    uint8_t *p_buf = malloc( BENCH_SIZE );
+    assert( p_buf != NULL );
+
+    /* Sparse zero bytes, with a startcode every few kilobytes, like in
+     * high bitrate video elementary streams */
+    srand( 42 );
+    for( size_t i = 0; i < BENCH_SIZE; i++ )
+        p_buf[i] = (rand() % 64) ? 1 + rand() % 255 : 0;
+    for( size_t i = 0; i + 3 < BENCH_SIZE; i += 1000 + rand() % 8000 )
+    {
+        p_buf[i] = p_buf[i + 1] = 0;
+        p_buf[i + 2] = 1;
+    }
+
+    /* unaligned start on purpose */
+    const uint8_t *p = p_buf + 1;
+    const size_t i_size = BENCH_SIZE - 1;
+    const size_t i_ref = bench( "bits", p, i_size, startcode_FindAnnexB_Bits );
+
+#if defined(CAN_COMPILE_SSE2) || defined(HAVE_SSE2_INTRINSICS)
+    if( vlc_CPU_SSE2() )
+        assert( bench( "sse2", p, i_size, startcode_FindAnnexB_SSE2 ) == i_ref );
+#endif
+#ifdef STARTCODE_HAVE_AVX2
+    if( vlc_CPU_AVX2() )
+        assert( bench( "avx2", p, i_size, startcode_FindAnnexB_AVX2 ) == i_ref );
+#endif
+#ifdef STARTCODE_HAVE_NEON
+    assert( bench( "neon", p, i_size, startcode_FindAnnexB_NEON ) == i_ref );
+#endif
+    assert( bench( "auto", p, i_size, startcode_FindAnnexB ) == i_ref );
+
+    free( p_buf );
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*****************************************************************************
+ * background_worker.c: background worker unit test
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../../src/misc/background_worker.c"
+
+#include <vlc_atomic.h>
+
+#undef NDEBUG
+#include <assert.h>
+#include <unistd.h>
+
+/* The worker threads are detached by the core, which does not export
+ * vlc_clone_detach(): they are joined at the end of the test instead. */
+#define MAX_THREADS 64
+
+static vlc_mutex_t threads_lock = VLC_STATIC_MUTEX;
+static vlc_thread_t threads[MAX_THREADS];
+static unsigned threads_count;
+
+int vlc_clone_detach(vlc_thread_t *th, void *(*entry)(void *), void *data,
+                     int priority)
+{
+    int ret = VLC_EGENERIC;
+
+    assert(th == NULL);
+    vlc_mutex_lock(&threads_lock);
+    assert(threads_count < MAX_THREADS);
+    if (vlc_clone(&threads[threads_count], entry, data, priority) == 0)
+    {
+        threads_count++;
+        ret = 0;
+    }
+    vlc_mutex_unlock(&threads_lock);
+    return ret;
+}
+
+static void threads_Join(void)
+{
+    for (unsigned i = 0; i < threads_count; i++)
+        vlc_join(threads[i], NULL);
+    threads_count = 0;
+}
+
+/* Test entities: the tasks run until they are finished or stopped */
+struct task
+{
+    atomic_int refs;
+    atomic_bool finished;
+    bool started;
+    bool stopped;
+    vlc_tick_t start;
+    vlc_tick_t stop;
+};
+
+static vlc_mutex_t lock = VLC_STATIC_MUTEX;
+static vlc_cond_t cond = VLC_STATIC_COND;
+static struct task *order[16]; /* tasks by start order */
+static unsigned started;
+
+static void task_Init(struct task *task)
+{
+    atomic_init(&task->refs, 0);
+    atomic_init(&task->finished, false);
+    task->started = task->stopped = false;
+}
+
+static void Hold(void *entity)
+{
+    struct task *task = entity;
+
+    atomic_fetch_add(&task->refs, 1);
+}
+
+static void Release(void *entity)
+{
+    struct task *task = entity;
+
+    assert(atomic_fetch_sub(&task->refs, 1) > 0);
+}
+
+static int Start(void *owner, void *entity, void **out)
+{
+    struct task *task = entity;
+
+    assert(owner == &lock);
+    vlc_mutex_lock(&lock);
+    assert(!task->started);
+    assert(started < ARRAY_SIZE(order));
+    task->started = true;
+    task->start = vlc_tick_now();
+    order[started++] = task;
+    vlc_cond_broadcast(&cond);
+    vlc_mutex_unlock(&lock);
+
+    *out = task;
+    return VLC_SUCCESS;
+}
+
+static int Probe(void *owner, void *handle)
+{
+    struct task *task = handle;
+
+    (void) owner;
+    return atomic_load(&task->finished);
+}
+
+static void Stop(void *owner, void *handle)
+{
+    struct task *task = handle;
+
+    (void) owner;
+    vlc_mutex_lock(&lock);
+    assert(task->started && !task->stopped);
+    task->stopped = true;
+    task->stop = vlc_tick_now();
+    vlc_cond_broadcast(&cond);
+    vlc_mutex_unlock(&lock);
+}
+
+static struct background_worker *worker_New(int max_threads,
+                                            vlc_tick_t default_timeout)
+{
+    struct background_worker_config conf = {
+        .default_timeout = default_timeout,
+        .max_threads = max_threads,
+        .pf_release = Release,
+        .pf_hold = Hold,
+        .pf_start = Start,
+        .pf_probe = Probe,
+        .pf_stop = Stop,
+    };
+
+    started = 0;
+    struct background_worker *worker = background_worker_New(&lock, &conf);
+    assert(worker != NULL);
+    return worker;
+}
+
+static void worker_Delete(struct background_worker *worker)
+{
+    background_worker_Delete(worker);
+    threads_Join();
+}
+
+static void task_WaitStarted(struct task *task)
+{
+    vlc_mutex_lock(&lock);
+    while (!task->started)
+        vlc_cond_wait(&cond, &lock);
+    vlc_mutex_unlock(&lock);
+}
+
+static void task_WaitStopped(struct task *task)
+{
+    vlc_mutex_lock(&lock);
+    while (!task->stopped)
+        vlc_cond_wait(&cond, &lock);
+    vlc_mutex_unlock(&lock);
+}
+
+static void task_Finish(struct background_worker *worker, struct task *task)
+{
+    atomic_store(&task->finished, true);
+    background_worker_RequestProbe(worker);
+    task_WaitStopped(task);
+}
+
+/* Entities pushed with priority start before the other ones, and each kind
+ * in the order they were pushed */
+static void test_priority(void)
+{
+    struct background_worker *worker = worker_New(1, -1);
+    struct task blocker, tasks[4];
+
+    task_Init(&blocker);
+    assert(background_worker_Push(worker, &blocker, NULL, 0, false) == 0);
+    task_WaitStarted(&blocker);
+
+    for (unsigned i = 0; i < ARRAY_SIZE(tasks); i++)
+    {
+        task_Init(&tasks[i]);
+        atomic_store(&tasks[i].finished, true);
+    }
+    assert(background_worker_Push(worker, &tasks[2], NULL, 0, false) == 0);
+    assert(background_worker_Push(worker, &tasks[0], NULL, 0, true) == 0);
+    assert(background_worker_Push(worker, &tasks[3], NULL, 0, false) == 0);
+    assert(background_worker_Push(worker, &tasks[1], NULL, 0, true) == 0);
+
+    task_Finish(worker, &blocker);
+    for (unsigned i = 0; i < ARRAY_SIZE(tasks); i++)
+        task_WaitStopped(&tasks[i]);
+
+    assert(started == 1 + ARRAY_SIZE(tasks));
+    assert(order[0] == &blocker);
+    for (unsigned i = 0; i < ARRAY_SIZE(tasks); i++)
+        assert(order[1 + i] == &tasks[i]);
+
+    worker_Delete(worker);
+
+    assert(atomic_load(&blocker.refs) == 0);
+    for (unsigned i = 0; i < ARRAY_SIZE(tasks); i++)
+        assert(atomic_load(&tasks[i].refs) == 0);
+}
+
+/* Cancelling an id stops its running task and removes its queued entities,
+ * without affecting the other ones */
+static void test_cancel(void)
+{
+    struct background_worker *worker = worker_New(2, -1);
+    struct task a, b, queued, other;
+    int id_a, id_b, id_other;
+
+    task_Init(&a);
+    task_Init(&b);
+    task_Init(&queued);
+    task_Init(&other);
+
+    assert(background_worker_Push(worker, &a, &id_a, 0, false) == 0);
+    assert(background_worker_Push(worker, &b, &id_b, 0, false) == 0);
+    task_WaitStarted(&a);
+    task_WaitStarted(&b);
+
+    /* Both threads are busy: these are queued */
+    assert(background_worker_Push(worker, &queued, &id_a, 0, true) == 0);
+    assert(background_worker_Push(worker, &other, &id_other, 0, false) == 0);
+
+    background_worker_Cancel(worker, &id_a);
+    vlc_mutex_lock(&lock);
+    assert(a.stopped);
+    assert(!queued.started);
+    assert(!b.stopped);
+    vlc_mutex_unlock(&lock);
+    assert(atomic_load(&a.refs) == 0);
+    assert(atomic_load(&queued.refs) == 0);
+
+    /* The queued entity of another id takes the free thread */
+    task_WaitStarted(&other);
+    vlc_mutex_lock(&lock);
+    assert(!b.stopped && !other.stopped);
+    vlc_mutex_unlock(&lock);
+
+    background_worker_Cancel(worker, &id_b);
+    vlc_mutex_lock(&lock);
+    assert(b.stopped && !other.stopped);
+    vlc_mutex_unlock(&lock);
+
+    task_Finish(worker, &other);
+    worker_Delete(worker);
+
+    assert(atomic_load(&b.refs) == 0);
+    assert(atomic_load(&other.refs) == 0);
+}
+
+/* Each thread stops its own task when the task times out */
+static void test_timeout(void)
+{
+    const vlc_tick_t timeout = VLC_TICK_FROM_MS(100);
+    struct background_worker *worker = worker_New(2, MS_FROM_VLC_TICK(timeout));
+    struct task limited, unlimited, deflt;
+
+    task_Init(&limited);
+    task_Init(&unlimited);
+    task_Init(&deflt);
+
+    assert(background_worker_Push(worker, &unlimited, NULL, 0, false) == 0);
+    assert(background_worker_Push(worker, &limited, NULL,
+                                  MS_FROM_VLC_TICK(timeout) / 2,
+                                  false) == 0);
+    task_WaitStopped(&limited);
+    assert(limited.stop - limited.start >= timeout / 2);
+
+    /* The other thread is still running, and the free one takes the next
+     * entity, with the default timeout */
+    assert(background_worker_Push(worker, &deflt, NULL, -1, false) == 0);
+    task_WaitStopped(&deflt);
+    assert(deflt.stop - deflt.start >= timeout);
+
+    vlc_mutex_lock(&lock);
+    assert(unlimited.started && !unlimited.stopped);
+    vlc_mutex_unlock(&lock);
+
+    worker_Delete(worker);
+    assert(unlimited.stopped);
+    assert(atomic_load(&unlimited.refs) == 0);
+    assert(atomic_load(&limited.refs) == 0);
+    assert(atomic_load(&deflt.refs) == 0);
+}
+
+int main(void)
+{
+    alarm(10);
+
+    test_priority();
+    test_cancel();
+    test_timeout();
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*****************************************************************************
+ * fifo.c: block FIFO unit test
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#define BLOCKS 10000
+
+static block_t *chain_New(size_t count, size_t size)
+{
+    block_t *chain = NULL, **pp = &chain;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        block_t *block = block_Alloc(size);
+        assert(block != NULL);
+        block_ChainLastAppend(&pp, block);
+    }
+    return chain;
+}
+
+static int chain_Count(block_t *chain)
+{
+    int count;
+
+    block_ChainProperties(chain, &count, NULL, NULL);
+    return count;
+}
+
+static void test_batch(void)
+{
+    block_fifo_t *fifo = block_FifoNew();
+    block_t *chain;
+
+    assert(fifo != NULL);
+
+    block_FifoPut(fifo, chain_New(10, 100));
+
+    vlc_fifo_Lock(fifo);
+    assert(vlc_fifo_GetCount(fifo) == 10);
+    assert(vlc_fifo_GetBytes(fifo) == 1000);
+
+    /* count limit */
+    chain = vlc_fifo_DequeueBatchUnlocked(fifo, 4, 0);
+    assert(chain_Count(chain) == 4);
+    block_ChainRelease(chain);
+
+    /* bytes limit */
+    chain = vlc_fifo_DequeueBatchUnlocked(fifo, 0, 250);
+    assert(chain_Count(chain) == 2);
+    block_ChainRelease(chain);
+
+    /* the first block is always dequeued */
+    chain = vlc_fifo_DequeueBatchUnlocked(fifo, 0, 10);
+    assert(chain_Count(chain) == 1);
+    block_ChainRelease(chain);
+
+    assert(vlc_fifo_GetCount(fifo) == 3);
+    assert(vlc_fifo_GetBytes(fifo) == 300);
+
+    chain = vlc_fifo_DequeueBatchUnlocked(fifo, 0, 0);
+    assert(chain_Count(chain) == 3);
+    block_ChainRelease(chain);
+
+    assert(vlc_fifo_IsEmpty(fifo));
+    assert(vlc_fifo_GetBytes(fifo) == 0);
+    assert(vlc_fifo_DequeueBatchUnlocked(fifo, 0, 0) == NULL);
+
+    /* the FIFO is still usable after being emptied */
+    vlc_fifo_QueueUnlocked(fifo, chain_New(2, 1));
+    assert(vlc_fifo_GetCount(fifo) == 2);
+    vlc_fifo_Unlock(fifo);
+
+    /* deadline */
+    chain = block_FifoGetBatch(fifo, 3, 0, vlc_tick_now() + VLC_TICK_FROM_MS(10));
+    assert(chain_Count(chain) == 2);
+    block_ChainRelease(chain);
+
+    chain = block_FifoGetBatch(fifo, 3, 0, vlc_tick_now() + VLC_TICK_FROM_MS(10));
+    assert(chain == NULL);
+
+    block_FifoRelease(fifo);
+}
+
+static void *producer(void *data)
+{
+    block_fifo_t *fifo = data;
+
+    for (unsigned i = 0; i < BLOCKS; )
+    {
+        unsigned count = 1 + (i % 7);
+        if (count > BLOCKS - i)
+            count = BLOCKS - i;
+
+        block_t *chain = chain_New(count, 188);
+        for (block_t *block = chain; block != NULL; block = block->p_next)
+            block->i_dts = VLC_TICK_0 + i++;
+
+        block_FifoPut(fifo, chain);
+    }
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    block_fifo_t *fifo = block_FifoNew();
+    vlc_thread_t th;
+    unsigned received = 0;
+
+    assert(fifo != NULL);
+
+    assert(vlc_clone(&th, producer, fifo, VLC_THREAD_PRIORITY_LOW) == 0);
+
+    while (received < BLOCKS)
+    {
+        vlc_tick_t deadline = (received & 1) ? VLC_TICK_INVALID
+                            : vlc_tick_now() + VLC_TICK_FROM_MS(1);
+        block_t *chain = block_FifoGetBatch(fifo, 16, 0, deadline);
+
+        assert(chain_Count(chain) <= 16);
+        while (chain != NULL)
+        {
+            block_t *next = chain->p_next;
+
+            assert(chain->i_dts == VLC_TICK_0 + received);
+            received++;
+            block_Release(chain);
+            chain = next;
+        }
+    }
+
+    vlc_join(th, NULL);
+
+    vlc_fifo_Lock(fifo);
+    assert(vlc_fifo_IsEmpty(fifo));
+    vlc_fifo_Unlock(fifo);
+    block_FifoRelease(fifo);
+}
+
+int main(void)
+{
+    test_batch();
+    test_threads();
+    return 0;
+}
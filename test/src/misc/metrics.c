@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * metrics.c: test for run-time metrics
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <string.h>
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+#include <vlc_metrics.h>
+
+static void test_metrics(libvlc_instance_t *vlc)
+{
+    libvlc_int_t *obj = vlc->p_libvlc_int;
+
+    vlc_metric_t *counter = vlc_metric_Register(obj, VLC_METRIC_COUNTER,
+                                                "test_events_total",
+                                                "Test\\events\n");
+    vlc_metric_t *gauge = vlc_metric_Register(obj, VLC_METRIC_GAUGE,
+                                              "test_depth", "Test depth");
+    vlc_metric_t *video = vlc_metric_Register(obj, VLC_METRIC_HISTOGRAM,
+                                              "test_seconds{type=\"video\"}",
+                                              "Test durations");
+    vlc_metric_t *audio = vlc_metric_Register(obj, VLC_METRIC_HISTOGRAM,
+                                              "test_seconds{type=\"audio\"}",
+                                              "Test durations");
+    assert(counter != NULL && gauge != NULL);
+    assert(video != NULL && audio != NULL && video != audio);
+
+    /* Registering again yields the same metric */
+    assert(vlc_metric_Register(obj, VLC_METRIC_GAUGE, "test_depth",
+                               "Test depth") == gauge);
+    /* Labelled metrics of a family share the same type */
+    assert(vlc_metric_Register(obj, VLC_METRIC_GAUGE,
+                               "test_seconds{type=\"spu\"}", "") == NULL);
+    assert(vlc_metric_Register(obj, VLC_METRIC_COUNTER, "test_depth",
+                               "") == NULL);
+
+    vlc_metric_Add(counter, 3);
+    vlc_metric_Add(counter, 2);
+    vlc_metric_Add(gauge, 10);
+    vlc_metric_Add(gauge, -4);
+    vlc_metric_Observe(video, VLC_TICK_FROM_US(50));
+    vlc_metric_Observe(video, VLC_TICK_FROM_MS(3));
+    vlc_metric_Observe(video, VLC_TICK_FROM_SEC(20));
+    vlc_metric_Observe(audio, VLC_TICK_FROM_MS(1));
+
+    /* NULL metrics are ignored */
+    vlc_metric_Add(NULL, 1);
+    vlc_metric_Set(NULL, 1);
+    vlc_metric_Observe(NULL, 1);
+
+    char *text = libvlc_metrics_export(vlc);
+    assert(text != NULL);
+    log("%s", text);
+
+    assert(strstr(text, "# HELP test_events_total Test\\\\events\\n\n"
+                        "# TYPE test_events_total counter\n"
+                        "test_events_total 5\n") != NULL);
+    assert(strstr(text, "# TYPE test_depth gauge\ntest_depth 6\n") != NULL);
+    /* One header per family */
+    const char *p = strstr(text, "# TYPE test_seconds histogram\n");
+    assert(p != NULL && strstr(p + 1, "# TYPE test_seconds") == NULL);
+    assert(strstr(text, "test_seconds_bucket{type=\"video\",le=\"0.0001\"} 1\n")
+           != NULL);
+    assert(strstr(text, "test_seconds_bucket{type=\"video\",le=\"0.005\"} 2\n")
+           != NULL);
+    assert(strstr(text, "test_seconds_bucket{type=\"video\",le=\"10\"} 2\n")
+           != NULL);
+    assert(strstr(text, "test_seconds_bucket{type=\"video\",le=\"+Inf\"} 3\n")
+           != NULL);
+    assert(strstr(text, "test_seconds_sum{type=\"video\"} 20.00305\n")
+           != NULL);
+    assert(strstr(text, "test_seconds_count{type=\"video\"} 3\n") != NULL);
+    assert(strstr(text, "test_seconds_bucket{type=\"audio\",le=\"0.001\"} 1\n")
+           != NULL);
+    assert(strstr(text, "test_seconds_count{type=\"audio\"} 1\n") != NULL);
+    libvlc_free(text);
+
+    vlc_metric_Set(gauge, 42);
+    text = libvlc_metrics_export(vlc);
+    assert(text != NULL);
+    assert(strstr(text, "\ntest_depth 42\n") != NULL);
+    libvlc_free(text);
+}
+
+int main(void)
+{
+    libvlc_instance_t *vlc;
+
+    test_init();
+
+    log("Testing the metrics\n");
+    vlc = libvlc_new(test_defaults_nargs, test_defaults_args);
+    assert(vlc != NULL);
+
+    test_metrics(vlc);
+
+    libvlc_release(vlc);
+    return 0;
+}